@@ -0,0 +1,1565 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+#include <math.h>
+#include <string.h>
+#include <ufo/ufo.h>
+#include "test-suite.h"
+
+typedef struct {
+    UfoBuffer *a;
+    UfoBuffer *b;
+    gfloat *data_a;
+    gfloat *data_b;
+    guint n_data;
+} Fixture;
+
+static void
+setup (Fixture *fixture, gconstpointer data)
+{
+    /* Non-square and not a multiple of four to exercise the remainder loops */
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 7,
+        .dims[1] = 5,
+    };
+
+    fixture->n_data = 7 * 5;
+    fixture->a = ufo_buffer_new (&requisition, NULL, NULL);
+    fixture->b = ufo_buffer_new (&requisition, NULL, NULL);
+    fixture->data_a = ufo_buffer_get_host_array (fixture->a, NULL);
+    fixture->data_b = ufo_buffer_get_host_array (fixture->b, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++) {
+        fixture->data_a[i] = ((gfloat) i) - 17.0f;
+        fixture->data_b[i] = 0.5f * i;
+    }
+}
+
+static void
+teardown (Fixture *fixture, gconstpointer data)
+{
+    g_object_unref (fixture->a);
+    g_object_unref (fixture->b);
+}
+
+static gboolean
+nearly_equal (gfloat x, gfloat y)
+{
+    return fabsf (x - y) <= 1e-4f * MAX (1.0f, fabsf (y));
+}
+
+static void
+test_reduce_host (Fixture *fixture,
+                  gconstpointer unused)
+{
+    gfloat l1 = 0.0f, l2 = 0.0f, dist = 0.0f, sum = 0.0f;
+    gfloat min = G_MAXFLOAT, max = -G_MAXFLOAT;
+
+    for (guint i = 0; i < fixture->n_data; i++) {
+        gfloat a = fixture->data_a[i];
+        gfloat d = a - fixture->data_b[i];
+
+        l1 += fabsf (a);
+        l2 += a * a;
+        dist += d * d;
+        sum += a;
+        min = MIN (min, a);
+        max = MAX (max, a);
+    }
+
+    g_assert (nearly_equal (ufo_op_l1_norm (fixture->a, NULL, NULL), l1));
+    g_assert (nearly_equal (ufo_op_l2_norm (fixture->a, NULL, NULL), sqrtf (l2)));
+    g_assert (nearly_equal (ufo_op_euclidean_distance (fixture->a, fixture->b, NULL, NULL), sqrtf (dist)));
+    g_assert (nearly_equal (ufo_op_sum (fixture->a, NULL, NULL), sum));
+    g_assert (nearly_equal (ufo_op_mean (fixture->a, NULL, NULL), sum / fixture->n_data));
+    g_assert (nearly_equal (ufo_op_min (fixture->a, NULL, NULL), min));
+    g_assert (nearly_equal (ufo_op_max (fixture->a, NULL, NULL), max));
+}
+
+static UfoBuffer *
+copy_to_context (UfoBuffer *buffer, gpointer context)
+{
+    UfoRequisition requisition;
+    UfoBuffer *copy;
+
+    ufo_buffer_get_requisition (buffer, &requisition);
+    copy = ufo_buffer_new (&requisition, NULL, context);
+    memcpy (ufo_buffer_get_host_array (copy, NULL),
+            ufo_buffer_get_host_array (buffer, NULL),
+            ufo_buffer_get_size (buffer));
+
+    return copy;
+}
+
+static void
+test_reduce_device (Fixture *fixture,
+                    gconstpointer unused)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *a;
+    UfoBuffer *b;
+    GList *queues;
+    gpointer queue;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    a = copy_to_context (fixture->a, ufo_resources_get_context (resources));
+    b = copy_to_context (fixture->b, ufo_resources_get_context (resources));
+
+    g_assert (nearly_equal (ufo_op_l1_norm (a, resources, queue),
+                            ufo_op_l1_norm (fixture->a, NULL, NULL)));
+    g_assert (nearly_equal (ufo_op_l2_norm (a, resources, queue),
+                            ufo_op_l2_norm (fixture->a, NULL, NULL)));
+    g_assert (nearly_equal (ufo_op_euclidean_distance (a, b, resources, queue),
+                            ufo_op_euclidean_distance (fixture->a, fixture->b, NULL, NULL)));
+    g_assert (nearly_equal (ufo_op_mean (a, resources, queue),
+                            ufo_op_mean (fixture->a, NULL, NULL)));
+    g_assert (nearly_equal (ufo_op_min (a, resources, queue),
+                            ufo_op_min (fixture->a, NULL, NULL)));
+    g_assert (nearly_equal (ufo_op_max (a, resources, queue),
+                            ufo_op_max (fixture->a, NULL, NULL)));
+
+    /* Repeated reductions reuse the partial results buffer */
+    g_assert (ufo_resources_get_scratch_buffer (resources, queue, sizeof (gfloat), NULL) ==
+              ufo_resources_get_scratch_buffer (resources, queue, sizeof (gfloat), NULL));
+
+    g_object_unref (a);
+    g_object_unref (b);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+wait_and_release (gpointer event)
+{
+    if (event == NULL)
+        return;
+
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, (cl_event *) &event));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+}
+
+static void
+run_add2 (UfoBuffer *a, UfoBuffer *b, UfoBuffer *out,
+          UfoResources *resources, gpointer queue)
+{
+    gpointer event;
+
+    event = ufo_op_add2 (a, b, 0.5f, out, resources, queue);
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, (cl_event *) &event));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+}
+
+static void
+test_elementwise_locations (Fixture *fixture,
+                            gconstpointer unused)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *a;
+    UfoBuffer *b;
+    UfoBuffer *out;
+    GList *queues;
+    gpointer queue;
+    gpointer context;
+    gpointer event;
+    gfloat *result;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+    context = ufo_resources_get_context (resources);
+
+    /* Arrays use the float4 kernels, 7x5 also exercises their tail */
+    a = copy_to_context (fixture->a, context);
+    b = copy_to_context (fixture->b, context);
+    out = ufo_buffer_dup (a);
+    ufo_buffer_get_device_array (a, queue);
+    ufo_buffer_get_device_array (b, queue);
+    run_add2 (a, b, out, resources, queue);
+    g_assert (ufo_buffer_get_location (out) == UFO_BUFFER_LOCATION_DEVICE);
+    result = ufo_buffer_get_host_array (out, queue);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (nearly_equal (result[i], fixture->data_a[i] + 0.5f * fixture->data_b[i]));
+
+    /* Images stay images */
+    ufo_buffer_get_device_image (a, queue);
+    run_add2 (a, b, out, resources, queue);
+    g_assert (ufo_buffer_get_location (out) == UFO_BUFFER_LOCATION_DEVICE_IMAGE);
+    result = ufo_buffer_get_host_array (out, queue);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (nearly_equal (result[i], fixture->data_a[i] + 0.5f * fixture->data_b[i]));
+
+    /* Setting a device array fills it in place without moving it */
+    ufo_buffer_get_device_array (out, queue);
+    wait_and_release (ufo_op_set (out, 2.0f, resources, queue));
+    g_assert (ufo_buffer_get_location (out) == UFO_BUFFER_LOCATION_DEVICE);
+    result = ufo_buffer_get_host_array (out, queue);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (result[i] == 2.0f);
+
+    /* A host array is filled on the host, but there is an event to wait on */
+    event = ufo_op_set (out, 3.0f, resources, queue);
+    g_assert (event != NULL);
+    wait_and_release (event);
+    g_assert (ufo_buffer_get_location (out) == UFO_BUFFER_LOCATION_HOST);
+    g_assert (result[0] == 3.0f && result[fixture->n_data - 1] == 3.0f);
+
+    /* Same for host-resident inputs */
+    ufo_buffer_get_host_array (a, queue);
+    ufo_buffer_get_host_array (b, queue);
+    event = ufo_op_mul (a, b, out, resources, queue);
+    g_assert (event != NULL);
+    wait_and_release (event);
+    g_assert (ufo_buffer_get_location (out) == UFO_BUFFER_LOCATION_HOST);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (nearly_equal (result[i], fixture->data_a[i] * fixture->data_b[i]));
+
+    g_object_unref (out);
+    g_object_unref (a);
+    g_object_unref (b);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+assert_buffers_equal (UfoBuffer *device, UfoBuffer *host, gpointer queue)
+{
+    gfloat *device_data = ufo_buffer_get_host_array (device, queue);
+    gfloat *host_data = ufo_buffer_get_host_array (host, NULL);
+    gsize n = ufo_buffer_get_size (host) / sizeof (gfloat);
+
+    for (gsize i = 0; i < n; i++)
+        g_assert (nearly_equal (host_data[i], device_data[i]));
+}
+
+static void
+test_host_elementwise (Fixture *fixture,
+                       gconstpointer unused)
+{
+    UfoBuffer *out;
+    gfloat *result;
+
+    out = ufo_buffer_dup (fixture->a);
+    result = ufo_buffer_get_host_array (out, NULL);
+
+    g_assert (ufo_op_add2 (fixture->a, fixture->b, 0.5f, out, NULL, NULL) == NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (nearly_equal (result[i], fixture->data_a[i] + 0.5f * fixture->data_b[i]));
+
+    ufo_op_deduction (fixture->a, fixture->b, out, NULL, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (nearly_equal (result[i], fixture->data_a[i] - fixture->data_b[i]));
+
+    ufo_op_mul (fixture->a, fixture->b, out, NULL, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (nearly_equal (result[i], fixture->data_a[i] * fixture->data_b[i]));
+
+    ufo_op_set (out, 3.0f, NULL, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (result[i] == 3.0f);
+
+    g_object_unref (out);
+}
+
+/* Run every operation once on the host and once on the device */
+static void
+test_host_vs_device (Fixture *fixture,
+                     gconstpointer unused)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *a;
+    UfoBuffer *b;
+    UfoBuffer *args[2];
+    UfoBuffer *host_args[2];
+    UfoBuffer *out;
+    UfoBuffer *host_out;
+    GList *queues;
+    gpointer queue;
+    gpointer context;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+    context = ufo_resources_get_context (resources);
+
+    a = copy_to_context (fixture->a, context);
+    b = copy_to_context (fixture->b, context);
+    ufo_buffer_get_device_image (a, queue);
+    ufo_buffer_get_device_image (b, queue);
+    out = ufo_buffer_dup (a);
+    host_out = ufo_buffer_dup (fixture->a);
+    args[0] = a;
+    args[1] = b;
+    host_args[0] = fixture->a;
+    host_args[1] = fixture->b;
+
+    wait_and_release (ufo_op_mul (a, b, out, resources, queue));
+    ufo_op_mul (fixture->a, fixture->b, host_out, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    wait_and_release (ufo_op_add (a, b, out, resources, queue));
+    ufo_op_add (fixture->a, fixture->b, host_out, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    wait_and_release (ufo_op_add2 (a, b, 0.25f, out, resources, queue));
+    ufo_op_add2 (fixture->a, fixture->b, 0.25f, host_out, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    wait_and_release (ufo_op_deduction2 (a, b, 0.25f, out, resources, queue));
+    ufo_op_deduction2 (fixture->a, fixture->b, 0.25f, host_out, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    wait_and_release (ufo_op_POSC (a, out, resources, queue));
+    ufo_op_POSC (fixture->a, host_out, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    wait_and_release (ufo_op_gradient_magnitudes (a, out, resources, queue));
+    ufo_op_gradient_magnitudes (fixture->a, host_out, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    wait_and_release (ufo_op_gradient_descent (b, out, resources, queue));
+    ufo_op_gradient_descent (fixture->b, host_out, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    wait_and_release (ufo_op_expression ("sqrt(fabs(a)) - b / 3", out, args, 2, resources, queue));
+    ufo_op_expression ("sqrt(fabs(a)) - b / 3", host_out, host_args, 2, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    ufo_buffer_get_device_image (out, queue);
+    wait_and_release (ufo_op_inv (out, resources, queue));
+    ufo_op_inv (host_out, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    g_object_unref (host_out);
+    g_object_unref (out);
+    g_object_unref (a);
+    g_object_unref (b);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+/*
+ * A few TV-like iterations are enqueued without any host synchronization and
+ * compared against the same iterations on the host.
+ */
+static void
+test_chained_iterations (Fixture *fixture,
+                         gconstpointer unused)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *x[2];
+    UfoBuffer *host_x[2];
+    UfoBuffer *magnitudes;
+    UfoBuffer *directions;
+    UfoBuffer *host_magnitudes;
+    UfoBuffer *host_directions;
+    GList *queues;
+    gpointer queue;
+    gpointer context;
+    const guint n_iterations = 5;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+    context = ufo_resources_get_context (resources);
+
+    x[0] = copy_to_context (fixture->a, context);
+    x[1] = ufo_buffer_dup (x[0]);
+    ufo_buffer_get_device_image (x[0], queue);
+    magnitudes = ufo_buffer_dup (x[0]);
+    directions = ufo_buffer_dup (x[0]);
+
+    host_x[0] = copy_to_context (fixture->a, NULL);
+    host_x[1] = ufo_buffer_dup (host_x[0]);
+    host_magnitudes = ufo_buffer_dup (host_x[0]);
+    host_directions = ufo_buffer_dup (host_x[0]);
+
+    for (guint i = 0; i < n_iterations; i++) {
+        UfoBuffer *src = x[i % 2];
+        UfoBuffer *dst = x[(i + 1) % 2];
+
+        /* Events are dropped right away, the buffers keep track of them */
+        clReleaseEvent (ufo_op_gradient_magnitudes (src, magnitudes, resources, queue));
+        clReleaseEvent (ufo_op_gradient_directions (src, magnitudes, directions, resources, queue));
+        clReleaseEvent (ufo_op_add2 (src, directions, -0.1f, dst, resources, queue));
+
+        ufo_op_gradient_magnitudes (host_x[i % 2], host_magnitudes, NULL, NULL);
+        ufo_op_gradient_directions (host_x[i % 2], host_magnitudes, host_directions, NULL, NULL);
+        ufo_op_add2 (host_x[i % 2], host_directions, -0.1f, host_x[(i + 1) % 2], NULL, NULL);
+    }
+
+    g_assert (ufo_buffer_get_event (x[n_iterations % 2]) != NULL);
+    assert_buffers_equal (x[n_iterations % 2], host_x[n_iterations % 2], queue);
+
+    for (guint i = 0; i < 2; i++) {
+        g_object_unref (x[i]);
+        g_object_unref (host_x[i]);
+    }
+
+    g_object_unref (magnitudes);
+    g_object_unref (directions);
+    g_object_unref (host_magnitudes);
+    g_object_unref (host_directions);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+test_fused_gradients (Fixture *fixture,
+                      gconstpointer unused)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *a;
+    UfoBuffer *magnitudes;
+    UfoBuffer *directions;
+    UfoBuffer *host_magnitudes;
+    UfoBuffer *host_directions;
+    GList *queues;
+    gpointer queue;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    a = copy_to_context (fixture->b, ufo_resources_get_context (resources));
+    ufo_buffer_get_device_image (a, queue);
+    magnitudes = ufo_buffer_dup (a);
+    directions = ufo_buffer_dup (a);
+    host_magnitudes = ufo_buffer_dup (fixture->b);
+    host_directions = ufo_buffer_dup (fixture->b);
+
+    wait_and_release (ufo_op_gradient_magnitudes_directions (a, magnitudes, directions, resources, queue));
+    ufo_op_gradient_magnitudes (fixture->b, host_magnitudes, NULL, NULL);
+    ufo_op_gradient_directions (fixture->b, host_magnitudes, host_directions, NULL, NULL);
+
+    assert_buffers_equal (magnitudes, host_magnitudes, queue);
+    assert_buffers_equal (directions, host_directions, queue);
+
+    g_object_unref (host_directions);
+    g_object_unref (host_magnitudes);
+    g_object_unref (directions);
+    g_object_unref (magnitudes);
+    g_object_unref (a);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+test_host_tv_step (Fixture *fixture,
+                   gconstpointer unused)
+{
+    UfoBuffer *fused;
+    UfoBuffer *grad;
+    UfoBuffer *separate;
+    gfloat *result;
+    gfloat *expected;
+    const gfloat step = 0.25f;
+
+    fused = ufo_buffer_dup (fixture->a);
+    grad = ufo_buffer_dup (fixture->a);
+    separate = ufo_buffer_dup (fixture->a);
+
+    g_assert (ufo_op_tv_step (fixture->a, fused, step, NULL, NULL) == NULL);
+    ufo_op_gradient_descent (fixture->a, grad, NULL, NULL);
+    ufo_op_add2 (fixture->a, grad, -step, separate, NULL, NULL);
+    ufo_op_POSC (separate, separate, NULL, NULL);
+
+    result = ufo_buffer_get_host_array (fused, NULL);
+    expected = ufo_buffer_get_host_array (separate, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (nearly_equal (result[i], expected[i]));
+
+    g_object_unref (separate);
+    g_object_unref (grad);
+    g_object_unref (fused);
+}
+
+static void
+test_tv_step (Fixture *fixture,
+              gconstpointer unused)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *a;
+    UfoBuffer *out;
+    UfoBuffer *host_out;
+    GList *queues;
+    gpointer queue;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    a = copy_to_context (fixture->a, ufo_resources_get_context (resources));
+    ufo_buffer_get_device_image (a, queue);
+    out = ufo_buffer_dup (a);
+    host_out = ufo_buffer_dup (fixture->a);
+
+    wait_and_release (ufo_op_tv_step (a, out, 0.25f, resources, queue));
+    ufo_op_tv_step (fixture->a, host_out, 0.25f, NULL, NULL);
+
+    assert_buffers_equal (out, host_out, queue);
+
+    g_object_unref (host_out);
+    g_object_unref (out);
+    g_object_unref (a);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+test_tv_step_benchmark (void)
+{
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 2048,
+        .dims[1] = 2048,
+    };
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *x[2];
+    UfoBuffer *grad;
+    UfoBuffer *tmp;
+    GList *queues;
+    gpointer queue;
+    gdouble fused;
+    gdouble separate;
+    const gfloat step = 0.01f;
+    const guint n_iterations = 50;
+
+    if (!g_test_perf ())
+        return;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    for (guint i = 0; i < 2; i++) {
+        x[i] = ufo_buffer_new (&requisition, NULL, ufo_resources_get_context (resources));
+        wait_and_release (ufo_op_set (x[i], 1.0f, resources, queue));
+    }
+
+    grad = ufo_buffer_dup (x[0]);
+    tmp = ufo_buffer_dup (x[0]);
+
+    /* Warm up the kernel caches */
+    wait_and_release (ufo_op_tv_step (x[0], x[1], step, resources, queue));
+    UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+
+    g_test_timer_start ();
+
+    for (guint i = 0; i < n_iterations; i++)
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (ufo_op_tv_step (x[i % 2], x[(i + 1) % 2], step, resources, queue)));
+
+    UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+    fused = g_test_timer_elapsed ();
+
+    g_test_timer_start ();
+
+    for (guint i = 0; i < n_iterations; i++) {
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (ufo_op_gradient_descent (x[i % 2], grad, resources, queue)));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (ufo_op_add2 (x[i % 2], grad, -step, tmp, resources, queue)));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (ufo_op_POSC (tmp, x[(i + 1) % 2], resources, queue)));
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+    separate = g_test_timer_elapsed ();
+
+    g_test_minimized_result (fused / n_iterations, "fused TV step: %.3f ms",
+                             fused / n_iterations * 1000.0);
+    g_test_message ("descent + add2 + POSC: %.3f ms", separate / n_iterations * 1000.0);
+
+    g_object_unref (tmp);
+    g_object_unref (grad);
+    g_object_unref (x[0]);
+    g_object_unref (x[1]);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+test_host_statistics (Fixture *fixture,
+                      gconstpointer unused)
+{
+    UfoBuffer *mean;
+    UfoBuffer *m2;
+    UfoBuffer *variance;
+    UfoBuffer *frames[3] = { fixture->a, fixture->b, fixture->a };
+    guint histogram[35];
+    const gfloat percents[3] = { 0.0f, 50.0f, 100.0f };
+    const gfloat expected[3] = { -17.0f, 0.0f, 17.0f };
+    gfloat results[3];
+    gfloat *mean_data;
+    gfloat *variance_data;
+    gfloat min;
+    gfloat max;
+
+    ufo_op_min_max (fixture->a, &min, &max, NULL, NULL);
+    g_assert (min == -17.0f && max == 17.0f);
+
+    /* Every integer from -17 to 17 falls into its own bin */
+    ufo_op_histogram (fixture->a, -17.5f, 17.5f, 35, histogram, NULL, NULL);
+
+    for (guint i = 0; i < 35; i++)
+        g_assert_cmpuint (histogram[i], ==, 1);
+
+    /* An empty range counts its single value in the first bin */
+    ufo_op_histogram (fixture->a, 3.0f, 3.0f, 35, histogram, NULL, NULL);
+    g_assert_cmpuint (histogram[0], ==, 1);
+
+    for (guint i = 1; i < 35; i++)
+        g_assert_cmpuint (histogram[i], ==, 0);
+
+    ufo_op_percentiles (fixture->a, percents, 3, results, NULL, NULL);
+
+    for (guint i = 0; i < 3; i++)
+        g_assert (fabsf (results[i] - expected[i]) <= (max - min) / 4096.0f);
+
+    mean = ufo_buffer_dup (fixture->a);
+    m2 = ufo_buffer_dup (fixture->a);
+    variance = ufo_buffer_dup (fixture->a);
+
+    for (guint i = 0; i < 3; i++)
+        g_assert (ufo_op_running_stats (frames[i], mean, m2, variance, i, NULL, NULL) == NULL);
+
+    mean_data = ufo_buffer_get_host_array (mean, NULL);
+    variance_data = ufo_buffer_get_host_array (variance, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++) {
+        gfloat a = fixture->data_a[i];
+        gfloat b = fixture->data_b[i];
+        gfloat m = (2.0f * a + b) / 3.0f;
+
+        g_assert (nearly_equal (mean_data[i], m));
+        g_assert (nearly_equal (variance_data[i], (2.0f * (a - m) * (a - m) + (b - m) * (b - m)) / 3.0f));
+    }
+
+    g_object_unref (variance);
+    g_object_unref (m2);
+    g_object_unref (mean);
+}
+
+static void
+test_statistics (Fixture *fixture,
+                 gconstpointer unused)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *a;
+    UfoBuffer *mean;
+    UfoBuffer *m2;
+    UfoBuffer *variance;
+    UfoBuffer *host_mean;
+    UfoBuffer *host_m2;
+    UfoBuffer *host_variance;
+    GList *queues;
+    gpointer queue;
+    guint histogram[16];
+    guint host_histogram[16];
+    const gfloat percents[4] = { 1.0f, 25.0f, 50.0f, 99.0f };
+    gfloat results[4];
+    gfloat host_results[4];
+    gfloat host_min, host_max;
+    gfloat min, max;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    a = copy_to_context (fixture->a, ufo_resources_get_context (resources));
+
+    ufo_op_min_max (fixture->a, &host_min, &host_max, NULL, NULL);
+    ufo_op_histogram (fixture->a, -10.0f, 10.0f, 16, host_histogram, NULL, NULL);
+    ufo_op_percentiles (fixture->a, percents, 4, host_results, NULL, NULL);
+
+    /* Both the image and the array kernels must agree with the host */
+    for (guint location = 0; location < 2; location++) {
+        if (location == 0)
+            ufo_buffer_get_device_image (a, queue);
+        else
+            ufo_buffer_get_device_array (a, queue);
+
+        ufo_op_min_max (a, &min, &max, resources, queue);
+        g_assert (min == host_min && max == host_max);
+
+        g_assert (nearly_equal (ufo_op_sum (a, resources, queue),
+                                ufo_op_sum (fixture->a, NULL, NULL)));
+
+        ufo_op_histogram (a, -10.0f, 10.0f, 16, histogram, resources, queue);
+
+        for (guint i = 0; i < 16; i++)
+            g_assert_cmpuint (histogram[i], ==, host_histogram[i]);
+
+        /* An empty range is counted, not rejected, on both sides */
+        ufo_op_histogram (a, 0.0f, 0.0f, 16, histogram, resources, queue);
+        ufo_op_histogram (fixture->a, 0.0f, 0.0f, 16, host_histogram, NULL, NULL);
+
+        for (guint i = 0; i < 16; i++)
+            g_assert_cmpuint (histogram[i], ==, host_histogram[i]);
+
+        for (guint i = 1; i < 16; i++)
+            g_assert_cmpuint (histogram[i], ==, 0);
+
+        ufo_op_histogram (fixture->a, -10.0f, 10.0f, 16, host_histogram, NULL, NULL);
+
+        ufo_op_percentiles (a, percents, 4, results, resources, queue);
+
+        for (guint i = 0; i < 4; i++)
+            g_assert (nearly_equal (results[i], host_results[i]));
+    }
+
+    mean = ufo_buffer_dup (a);
+    m2 = ufo_buffer_dup (a);
+    variance = ufo_buffer_dup (a);
+    host_mean = ufo_buffer_dup (fixture->a);
+    host_m2 = ufo_buffer_dup (fixture->a);
+    host_variance = ufo_buffer_dup (fixture->a);
+
+    for (guint i = 0; i < 3; i++) {
+        UfoBuffer *frame = i % 2 ? fixture->b : fixture->a;
+        UfoBuffer *device_frame = copy_to_context (frame, ufo_resources_get_context (resources));
+
+        ufo_buffer_get_device_image (device_frame, queue);
+        wait_and_release (ufo_op_running_stats (device_frame, mean, m2, i == 2 ? variance : NULL,
+                                                i, resources, queue));
+        ufo_op_running_stats (frame, host_mean, host_m2, i == 2 ? host_variance : NULL, i, NULL, NULL);
+        g_object_unref (device_frame);
+    }
+
+    g_assert (ufo_buffer_get_location (mean) == UFO_BUFFER_LOCATION_DEVICE);
+    assert_buffers_equal (mean, host_mean, queue);
+    assert_buffers_equal (variance, host_variance, queue);
+
+    g_object_unref (host_variance);
+    g_object_unref (host_m2);
+    g_object_unref (host_mean);
+    g_object_unref (variance);
+    g_object_unref (m2);
+    g_object_unref (mean);
+    g_object_unref (a);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+test_host_layout (Fixture *fixture,
+                  gconstpointer unused)
+{
+    UfoRequisition requisition;
+    UfoBuffer *out;
+    gfloat *data;
+
+    out = ufo_buffer_dup (fixture->a);
+
+    /* 7x5 becomes 5x7 */
+    g_assert (ufo_op_transpose (fixture->a, out, NULL, NULL) == NULL);
+    ufo_buffer_get_requisition (out, &requisition);
+    g_assert (requisition.dims[0] == 5 && requisition.dims[1] == 7);
+    data = ufo_buffer_get_host_array (out, NULL);
+
+    for (guint y = 0; y < 7; y++) {
+        for (guint x = 0; x < 5; x++)
+            g_assert (data[y * 5 + x] == fixture->data_a[x * 7 + y]);
+    }
+
+    /* 7x5 binned by two is 3x2, the last column and row are dropped */
+    ufo_op_bin (fixture->a, out, 2, NULL, NULL);
+    ufo_buffer_get_requisition (out, &requisition);
+    g_assert (requisition.dims[0] == 3 && requisition.dims[1] == 2);
+    data = ufo_buffer_get_host_array (out, NULL);
+
+    for (guint y = 0; y < 2; y++) {
+        for (guint x = 0; x < 3; x++) {
+            const gfloat *in = fixture->data_a + 2 * y * 7 + 2 * x;
+            g_assert (nearly_equal (data[y * 3 + x], (in[0] + in[1] + in[7] + in[8]) / 4.0f));
+        }
+    }
+
+    /* Region sticking out to the top left is padded */
+    ufo_op_crop (fixture->a, out, -1, -2, 4, 4, -1.0f, NULL, NULL);
+    data = ufo_buffer_get_host_array (out, NULL);
+
+    for (gint y = 0; y < 4; y++) {
+        for (gint x = 0; x < 4; x++) {
+            gboolean inside = x >= 1 && y >= 2;
+            g_assert (data[y * 4 + x] == (inside ? fixture->data_a[(y - 2) * 7 + x - 1] : -1.0f));
+        }
+    }
+
+    g_object_unref (out);
+}
+
+static void
+test_layout (Fixture *fixture,
+             gconstpointer unused)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *a;
+    UfoBuffer *out;
+    UfoBuffer *host_out;
+    GList *queues;
+    gpointer queue;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    a = copy_to_context (fixture->a, ufo_resources_get_context (resources));
+    ufo_buffer_get_device_array (a, queue);
+    out = ufo_buffer_dup (a);
+    host_out = ufo_buffer_dup (fixture->a);
+
+    wait_and_release (ufo_op_transpose (a, out, resources, queue));
+    ufo_op_transpose (fixture->a, host_out, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    wait_and_release (ufo_op_bin (a, out, 2, resources, queue));
+    ufo_op_bin (fixture->a, host_out, 2, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    /* Inside, overlapping the bottom right and completely outside */
+    wait_and_release (ufo_op_crop (a, out, 1, 1, 3, 2, 0.0f, resources, queue));
+    ufo_op_crop (fixture->a, host_out, 1, 1, 3, 2, 0.0f, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    wait_and_release (ufo_op_crop (a, out, 5, 3, 4, 4, 2.0f, resources, queue));
+    ufo_op_crop (fixture->a, host_out, 5, 3, 4, 4, 2.0f, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    wait_and_release (ufo_op_crop (a, out, 10, 10, 2, 2, 3.0f, resources, queue));
+    ufo_op_crop (fixture->a, host_out, 10, 10, 2, 2, 3.0f, NULL, NULL);
+    assert_buffers_equal (out, host_out, queue);
+
+    g_object_unref (host_out);
+    g_object_unref (out);
+    g_object_unref (a);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+test_layout_benchmark (void)
+{
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 2048,
+        .dims[1] = 2048,
+    };
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *in;
+    UfoBuffer *out;
+    GList *queues;
+    gpointer queue;
+    gdouble elapsed;
+    gdouble n_bytes;
+    const guint n_runs = 20;
+
+    if (!g_test_perf ())
+        return;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    in = ufo_buffer_new (&requisition, NULL, ufo_resources_get_context (resources));
+    out = ufo_buffer_dup (in);
+    ufo_buffer_get_device_array (in, queue);
+    wait_and_release (ufo_op_set (in, 1.0f, resources, queue));
+
+    /* Warm up the kernel caches */
+    wait_and_release (ufo_op_transpose (in, out, resources, queue));
+    wait_and_release (ufo_op_bin (in, out, 2, resources, queue));
+    wait_and_release (ufo_op_bin (in, out, 4, resources, queue));
+
+    g_test_timer_start ();
+
+    for (guint i = 0; i < n_runs; i++)
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (ufo_op_transpose (in, out, resources, queue)));
+
+    UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+    elapsed = g_test_timer_elapsed ();
+    n_bytes = 2.0 * ufo_buffer_get_size (in) * n_runs;
+    g_test_maximized_result (n_bytes / elapsed / 1e9, "transpose: %.2f GB/s", n_bytes / elapsed / 1e9);
+
+    for (guint factor = 2; factor <= 4; factor *= 2) {
+        g_test_timer_start ();
+
+        for (guint i = 0; i < n_runs; i++)
+            UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (ufo_op_bin (in, out, factor, resources, queue)));
+
+        UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+        elapsed = g_test_timer_elapsed ();
+        n_bytes = (1.0 + 1.0 / (factor * factor)) * ufo_buffer_get_size (in) * n_runs;
+        g_test_maximized_result (n_bytes / elapsed / 1e9, "%ux%u binning: %.2f GB/s",
+                                 factor, factor, n_bytes / elapsed / 1e9);
+    }
+
+    g_test_timer_start ();
+
+    for (guint i = 0; i < n_runs; i++)
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (ufo_op_crop (in, out, 512, 512, 1024, 1024, 0.0f,
+                                                                resources, queue)));
+
+    UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+    elapsed = g_test_timer_elapsed ();
+    n_bytes = 2.0 * 1024 * 1024 * sizeof (gfloat) * n_runs;
+    g_test_maximized_result (n_bytes / elapsed / 1e9, "1024x1024 crop: %.2f GB/s", n_bytes / elapsed / 1e9);
+
+    g_object_unref (out);
+    g_object_unref (in);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static gint
+border_index (gint i, gint n, UfoOpBorder border)
+{
+    if (i >= 0 && i < n)
+        return i;
+
+    if (border == UFO_OP_BORDER_ZERO)
+        return -1;
+
+    if (border == UFO_OP_BORDER_MIRROR)
+        i = i < 0 ? -i - 1 : 2 * n - i - 1;
+
+    return CLAMP (i, 0, n - 1);
+}
+
+static void
+test_host_convolve (Fixture *fixture,
+                    gconstpointer unused)
+{
+    const gfloat weights[5] = { 0.1f, 0.2f, 0.4f, 0.2f, 0.1f };
+    const UfoOpBorder borders[3] = { UFO_OP_BORDER_CLAMP, UFO_OP_BORDER_ZERO, UFO_OP_BORDER_MIRROR };
+    UfoBuffer *out;
+    gfloat *result;
+
+    out = ufo_buffer_dup (fixture->a);
+
+    /* Compare against a direct 2D convolution with the outer product */
+    for (guint b = 0; b < 3; b++) {
+        g_assert (ufo_op_convolve_separable (fixture->a, out, weights, 5, borders[b], NULL, NULL) == NULL);
+        result = ufo_buffer_get_host_array (out, NULL);
+
+        for (gint y = 0; y < 5; y++) {
+            for (gint x = 0; x < 7; x++) {
+                gfloat expected = 0.0f;
+
+                for (gint j = 0; j < 5; j++) {
+                    for (gint i = 0; i < 5; i++) {
+                        gint sx = border_index (x + 2 - i, 7, borders[b]);
+                        gint sy = border_index (y + 2 - j, 5, borders[b]);
+
+                        if (sx >= 0 && sy >= 0)
+                            expected += weights[i] * weights[j] * fixture->data_a[sy * 7 + sx];
+                    }
+                }
+
+                g_assert (nearly_equal (result[y * 7 + x], expected));
+            }
+        }
+    }
+
+    g_object_unref (out);
+}
+
+static void
+test_convolve (Fixture *fixture,
+               gconstpointer unused)
+{
+    const gfloat weights[9] = { 0.05f, 0.1f, 0.1f, 0.15f, 0.2f, 0.15f, 0.1f, 0.1f, 0.05f };
+    const UfoOpBorder borders[3] = { UFO_OP_BORDER_CLAMP, UFO_OP_BORDER_ZERO, UFO_OP_BORDER_MIRROR };
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *a;
+    UfoBuffer *out;
+    UfoBuffer *host_out;
+    GList *queues;
+    gpointer queue;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    a = copy_to_context (fixture->a, ufo_resources_get_context (resources));
+    ufo_buffer_get_device_array (a, queue);
+    out = ufo_buffer_dup (a);
+    host_out = ufo_buffer_dup (fixture->a);
+
+    /* A radius of four is larger than the 7x5 input in one direction */
+    for (guint b = 0; b < 3; b++) {
+        for (guint size = 3; size <= 9; size += 6) {
+            const gfloat *w = weights + (9 - size) / 2;
+
+            wait_and_release (ufo_op_convolve_separable (a, out, w, size, borders[b], resources, queue));
+            ufo_op_convolve_separable (fixture->a, host_out, w, size, borders[b], NULL, NULL);
+            assert_buffers_equal (out, host_out, queue);
+        }
+    }
+
+    g_object_unref (host_out);
+    g_object_unref (out);
+    g_object_unref (a);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static const gchar *naive_convolve_source =
+    "__kernel void convolve_2d (__global const float *in, __global float *out,"
+    "                           __constant float *weights, const int radius)"
+    "{"
+    "  const int x = get_global_id(0);"
+    "  const int y = get_global_id(1);"
+    "  const int width = get_global_size(0);"
+    "  const int height = get_global_size(1);"
+    "  float sum = 0.0f;"
+    "  for (int j = 0; j <= 2 * radius; j++)"
+    "    for (int i = 0; i <= 2 * radius; i++)"
+    "      sum += weights[i] * weights[j] *"
+    "             in[clamp(y + radius - j, 0, height - 1) * width + clamp(x + radius - i, 0, width - 1)];"
+    "  out[y * width + x] = sum;"
+    "}";
+
+static void
+test_convolve_benchmark (void)
+{
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 2048,
+        .dims[1] = 2048,
+    };
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *in;
+    UfoBuffer *out;
+    GList *queues;
+    gpointer queue;
+    cl_kernel naive;
+    const gint radii[] = { 1, 2, 4, 8, 16 };
+    const guint n_runs = 10;
+
+    if (!g_test_perf ())
+        return;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+    naive = ufo_resources_get_kernel_from_source (resources, naive_convolve_source, "convolve_2d", NULL);
+    g_assert (naive != NULL);
+
+    in = ufo_buffer_new (&requisition, NULL, ufo_resources_get_context (resources));
+    out = ufo_buffer_dup (in);
+    ufo_buffer_get_device_array (in, queue);
+    wait_and_release (ufo_op_set (in, 1.0f, resources, queue));
+
+    for (guint r = 0; r < G_N_ELEMENTS (radii); r++) {
+        guint size = 2 * radii[r] + 1;
+        gfloat *weights = g_new (gfloat, size);
+        cl_mem d_in;
+        cl_mem d_out;
+        cl_mem d_weights;
+        gdouble separable;
+        gdouble direct;
+
+        for (guint i = 0; i < size; i++)
+            weights[i] = 1.0f / size;
+
+        wait_and_release (ufo_op_convolve_separable (in, out, weights, size, UFO_OP_BORDER_CLAMP,
+                                                     resources, queue));
+
+        g_test_timer_start ();
+
+        for (guint i = 0; i < n_runs; i++)
+            UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (ufo_op_convolve_separable (in, out, weights, size,
+                                                                                  UFO_OP_BORDER_CLAMP,
+                                                                                  resources, queue)));
+
+        UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+        separable = g_test_timer_elapsed () / n_runs * 1000.0;
+
+        d_in = ufo_buffer_get_device_array (in, queue);
+        d_out = ufo_buffer_get_device_array (out, queue);
+        d_weights = clCreateBuffer (ufo_resources_get_context (resources),
+                                    CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                    size * sizeof (gfloat), weights, NULL);
+
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (naive, 0, sizeof (cl_mem), &d_in));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (naive, 1, sizeof (cl_mem), &d_out));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (naive, 2, sizeof (cl_mem), &d_weights));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (naive, 3, sizeof (cl_int), &radii[r]));
+
+        g_test_timer_start ();
+
+        for (guint i = 0; i < n_runs; i++)
+            UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (queue, naive, 2, NULL, requisition.dims,
+                                                               NULL, 0, NULL, NULL));
+
+        UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+        direct = g_test_timer_elapsed () / n_runs * 1000.0;
+
+        g_test_message ("radius %2i: %.3f ms separable, %.3f ms naive 2D", radii[r], separable, direct);
+
+        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (d_weights));
+        g_free (weights);
+    }
+
+    g_object_unref (out);
+    g_object_unref (in);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static gdouble
+time_stencil (UfoResources *resources,
+              gpointer queue,
+              const gchar *kernel_name,
+              gsize *local_work_size,
+              UfoBuffer **args,
+              guint n_args,
+              UfoRequisition *requisition)
+{
+    cl_kernel kernel;
+    gsize global_work_size[2];
+    const guint n_runs = 20;
+
+    kernel = ufo_resources_get_cached_kernel (resources, "ufo-basic-ops.cl", kernel_name, NULL);
+    g_assert (kernel != NULL);
+
+    for (guint i = 0; i < n_args; i++) {
+        cl_mem mem = ufo_buffer_get_device_image (args[i], queue);
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, i, sizeof (cl_mem), &mem));
+    }
+
+    for (guint i = 0; i < 2; i++) {
+        gsize tile = local_work_size != NULL ? local_work_size[i] : 1;
+        global_work_size[i] = (requisition->dims[i] + tile - 1) / tile * tile;
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+    g_test_timer_start ();
+
+    for (guint i = 0; i < n_runs; i++)
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (queue, kernel, 2, NULL, global_work_size,
+                                                           local_work_size, 0, NULL, NULL));
+
+    UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+    return g_test_timer_elapsed () / n_runs * 1000.0;
+}
+
+static void
+test_stencil_benchmark (void)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    GList *queues;
+    gpointer queue;
+    gsize tile[2] = { 16, 16 };
+    const gsize sizes[] = { 256, 1024, 2048, 4096 };
+
+    if (!g_test_perf ())
+        return;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    for (guint i = 0; i < G_N_ELEMENTS (sizes); i++) {
+        UfoRequisition requisition = { .n_dims = 2, .dims[0] = sizes[i], .dims[1] = sizes[i] };
+        UfoBuffer *buffers[3];
+        UfoBuffer *args[3];
+        gdouble plain;
+        gdouble tiled;
+
+        for (guint j = 0; j < 3; j++) {
+            buffers[j] = ufo_buffer_new (&requisition, NULL, ufo_resources_get_context (resources));
+            wait_and_release (ufo_op_set (buffers[j], (gfloat) j, resources, queue));
+        }
+
+        args[0] = buffers[0];
+        args[1] = buffers[1];
+        plain = time_stencil (resources, queue, "operation_gradient_magnitude", NULL, args, 2, &requisition);
+        tiled = time_stencil (resources, queue, "operation_gradient_magnitude_tiled", tile, args, 2, &requisition);
+        g_test_message ("%4zux%-4zu magnitude:  %.3f ms plain, %.3f ms tiled", sizes[i], sizes[i], plain, tiled);
+
+        args[1] = buffers[1];
+        args[2] = buffers[2];
+        plain = time_stencil (resources, queue, "operation_gradient_direction", NULL, args, 3, &requisition);
+        tiled = time_stencil (resources, queue, "operation_gradient_direction_tiled", tile, args, 3, &requisition);
+        g_test_message ("%4zux%-4zu direction:  %.3f ms plain, %.3f ms tiled", sizes[i], sizes[i], plain, tiled);
+
+        args[1] = buffers[2];
+        plain = time_stencil (resources, queue, "descent_grad", NULL, args, 2, &requisition);
+        tiled = time_stencil (resources, queue, "descent_grad_tiled", tile, args, 2, &requisition);
+        g_test_message ("%4zux%-4zu descent:    %.3f ms plain, %.3f ms tiled", sizes[i], sizes[i], plain, tiled);
+
+        args[1] = buffers[1];
+        args[2] = buffers[2];
+        tiled = time_stencil (resources, queue, "operation_gradient_magnitude_direction_tiled", tile, args, 3, &requisition);
+        g_test_message ("%4zux%-4zu fused magnitude and direction: %.3f ms", sizes[i], sizes[i], tiled);
+
+        for (guint j = 0; j < 3; j++)
+            g_object_unref (buffers[j]);
+    }
+
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+test_host_benchmark (void)
+{
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 2048,
+        .dims[1] = 2048,
+    };
+    UfoBuffer *a;
+    UfoBuffer *b;
+    UfoBuffer *out;
+    gdouble elapsed;
+    gdouble n_bytes;
+    const guint n_runs = 20;
+
+    if (!g_test_perf ())
+        return;
+
+    a = ufo_buffer_new (&requisition, NULL, NULL);
+    b = ufo_buffer_new (&requisition, NULL, NULL);
+    out = ufo_buffer_new (&requisition, NULL, NULL);
+    ufo_op_set (a, 1.0f, NULL, NULL);
+    ufo_op_set (b, 2.0f, NULL, NULL);
+    ufo_op_set (out, 0.0f, NULL, NULL);
+
+    g_test_timer_start ();
+
+    for (guint i = 0; i < n_runs; i++)
+        ufo_op_add2 (a, b, 0.5f, out, NULL, NULL);
+
+    elapsed = g_test_timer_elapsed ();
+
+    /* Two loads and one store per element */
+    n_bytes = 3.0 * ufo_buffer_get_size (out) * n_runs;
+    g_test_maximized_result (n_bytes / elapsed / 1e9, "host add2: %.2f GB/s",
+                             n_bytes / elapsed / 1e9);
+
+    g_object_unref (a);
+    g_object_unref (b);
+    g_object_unref (out);
+}
+
+static void
+test_expression (Fixture *fixture,
+                 gconstpointer unused)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *args[2];
+    UfoBuffer *out;
+    GList *queues;
+    gpointer queue;
+    gpointer event;
+    gfloat *result;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    args[0] = copy_to_context (fixture->a, ufo_resources_get_context (resources));
+    args[1] = copy_to_context (fixture->b, ufo_resources_get_context (resources));
+    out = ufo_buffer_dup (args[0]);
+
+    /* Host-resident inputs would be evaluated on the host */
+    ufo_buffer_get_device_image (args[0], queue);
+    ufo_buffer_get_device_image (args[1], queue);
+
+    event = ufo_op_expression ("out = a * b + 0.5 * max(a, -b) / (1 + fabs(b))",
+                               out, args, 2, resources, queue);
+    g_assert (event != NULL);
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, (cl_event *) &event));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+
+    result = ufo_buffer_get_host_array (out, queue);
+
+    for (guint i = 0; i < fixture->n_data; i++) {
+        gfloat a = fixture->data_a[i];
+        gfloat b = fixture->data_b[i];
+
+        g_assert (nearly_equal (result[i], a * b + 0.5f * MAX (a, -b) / (1.0f + fabsf (b))));
+    }
+
+    /* Same shape with other constants reuses the kernel with new arguments */
+    event = ufo_op_expression ("out = a * b + 2 * max(a, -b) / (3.5 + fabs(b))",
+                               out, args, 2, resources, queue);
+    g_assert (event != NULL);
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, (cl_event *) &event));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+
+    result = ufo_buffer_get_host_array (out, queue);
+
+    for (guint i = 0; i < fixture->n_data; i++) {
+        gfloat a = fixture->data_a[i];
+        gfloat b = fixture->data_b[i];
+
+        g_assert (nearly_equal (result[i], a * b + 2.0f * MAX (a, -b) / (3.5f + fabsf (b))));
+    }
+
+    /* Array-resident inputs use the vectorized buffer kernel and its tail */
+    ufo_buffer_get_device_array (args[0], queue);
+    ufo_buffer_get_device_array (args[1], queue);
+    g_assert (fixture->n_data % 4 != 0);
+
+    event = ufo_op_expression ("out = pow(fabs(a), 2) - min(b, 0.5) + 1",
+                               out, args, 2, resources, queue);
+    g_assert (event != NULL);
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, (cl_event *) &event));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+
+    result = ufo_buffer_get_host_array (out, queue);
+
+    for (guint i = 0; i < fixture->n_data; i++) {
+        gfloat a = fixture->data_a[i];
+        gfloat b = fixture->data_b[i];
+
+        g_assert (nearly_equal (result[i], powf (fabsf (a), 2.0f) - MIN (b, 0.5f) + 1.0f));
+    }
+
+    g_object_unref (out);
+    g_object_unref (args[0]);
+    g_object_unref (args[1]);
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+test_expression_benchmark (void)
+{
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 2048,
+        .dims[1] = 2048,
+    };
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoBuffer *args[3];
+    UfoBuffer *tmp;
+    UfoBuffer *out;
+    GList *queues;
+    gpointer queue;
+    gpointer event;
+    gdouble fused;
+    gdouble separate;
+    const guint n_runs = 50;
+
+    if (!g_test_perf ())
+        return;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    queues = ufo_resources_get_cmd_queues (resources);
+    queue = g_list_nth_data (queues, 0);
+
+    for (guint i = 0; i < 3; i++) {
+        args[i] = ufo_buffer_new (&requisition, NULL, ufo_resources_get_context (resources));
+        event = ufo_op_set (args[i], (gfloat) i + 1.0f, resources, queue);
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    }
+
+    tmp = ufo_buffer_dup (args[0]);
+    out = ufo_buffer_dup (args[0]);
+
+    /* Warm up the kernel caches */
+    event = ufo_op_expression ("a * b + 0.5 * c", out, args, 3, resources, queue);
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+
+    g_test_timer_start ();
+
+    for (guint i = 0; i < n_runs; i++) {
+        event = ufo_op_expression ("a * b + 0.5 * c", out, args, 3, resources, queue);
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+    fused = g_test_timer_elapsed ();
+
+    g_test_timer_start ();
+
+    for (guint i = 0; i < n_runs; i++) {
+        event = ufo_op_mul (args[0], args[1], tmp, resources, queue);
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+        event = ufo_op_add2 (tmp, args[2], 0.5f, out, resources, queue);
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clFinish (queue));
+    separate = g_test_timer_elapsed ();
+
+    g_test_minimized_result (fused / n_runs, "fused a * b + 0.5 * c: %.3f ms",
+                             fused / n_runs * 1000.0);
+    g_test_message ("mul + add2: %.3f ms", separate / n_runs * 1000.0);
+
+    g_object_unref (out);
+    g_object_unref (tmp);
+
+    for (guint i = 0; i < 3; i++)
+        g_object_unref (args[i]);
+
+    g_list_free (queues);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+void
+test_add_basic_ops (void)
+{
+    g_test_add ("/no-opencl/basic-ops/reduce/host",
+                Fixture, NULL,
+                setup, test_reduce_host, teardown);
+
+    g_test_add ("/basic-ops/reduce/device",
+                Fixture, NULL,
+                setup, test_reduce_device, teardown);
+
+    g_test_add ("/basic-ops/elementwise/locations",
+                Fixture, NULL,
+                setup, test_elementwise_locations, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/host/elementwise",
+                Fixture, NULL,
+                setup, test_host_elementwise, teardown);
+
+    g_test_add ("/basic-ops/host-vs-device",
+                Fixture, NULL,
+                setup, test_host_vs_device, teardown);
+
+    g_test_add ("/basic-ops/chained-iterations",
+                Fixture, NULL,
+                setup, test_chained_iterations, teardown);
+
+    g_test_add ("/basic-ops/fused-gradients",
+                Fixture, NULL,
+                setup, test_fused_gradients, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/host/tv-step",
+                Fixture, NULL,
+                setup, test_host_tv_step, teardown);
+
+    g_test_add ("/basic-ops/tv-step",
+                Fixture, NULL,
+                setup, test_tv_step, teardown);
+
+    g_test_add_func ("/basic-ops/tv-step/benchmark",
+                     test_tv_step_benchmark);
+
+    g_test_add ("/no-opencl/basic-ops/host/statistics",
+                Fixture, NULL,
+                setup, test_host_statistics, teardown);
+
+    g_test_add ("/basic-ops/statistics",
+                Fixture, NULL,
+                setup, test_statistics, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/host/layout",
+                Fixture, NULL,
+                setup, test_host_layout, teardown);
+
+    g_test_add ("/basic-ops/layout",
+                Fixture, NULL,
+                setup, test_layout, teardown);
+
+    g_test_add_func ("/basic-ops/layout/benchmark",
+                     test_layout_benchmark);
+
+    g_test_add ("/no-opencl/basic-ops/host/convolve",
+                Fixture, NULL,
+                setup, test_host_convolve, teardown);
+
+    g_test_add ("/basic-ops/convolve",
+                Fixture, NULL,
+                setup, test_convolve, teardown);
+
+    g_test_add_func ("/basic-ops/convolve/benchmark",
+                     test_convolve_benchmark);
+
+    g_test_add_func ("/basic-ops/stencil/benchmark",
+                     test_stencil_benchmark);
+
+    g_test_add_func ("/no-opencl/basic-ops/host/benchmark",
+                     test_host_benchmark);
+
+    g_test_add ("/basic-ops/expression",
+                Fixture, NULL,
+                setup, test_expression, teardown);
+
+    g_test_add_func ("/basic-ops/expression/benchmark",
+                     test_expression_benchmark);
+}
@@ -18,6 +18,7 @@
  */
 
 #include <string.h>
+#include <unistd.h>
 #include <ufo/ufo.h>
 #include "test-suite.h"
 
@@ -100,6 +101,105 @@ test_copy_lots_of_buffers (Fixture *fixture,
     }
 
 }
+/*
+ * Measure the host-device round trip bandwidth for each pair of GPU and NUMA
+ * node holding the host array. Run with -m perf to get the full matrix.
+ */
+static gdouble
+measure_bandwidth (UfoGpuNode *gpu_node,
+                   gpointer context,
+                   gint numa_node)
+{
+    const guint n_transfers = 50;
+    gpointer cmd_queue;
+    UfoBuffer *buffer;
+    GTimer *timer;
+    gdouble elapsed;
+    gsize size;
+
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 2048,
+        .dims[1] = 2048
+    };
+
+    cmd_queue = ufo_gpu_node_get_cmd_queue (gpu_node);
+    buffer = ufo_buffer_new (&requisition, NULL, context);
+    ufo_buffer_set_numa_node (buffer, numa_node);
+
+    /* Allocate both sides before timing */
+    ufo_buffer_get_host_array (buffer, NULL);
+    ufo_buffer_get_device_array (buffer, cmd_queue);
+
+    timer = g_timer_new ();
+
+    for (guint i = 0; i < n_transfers; i++) {
+        ufo_buffer_get_host_array (buffer, cmd_queue);
+        ufo_buffer_get_device_array (buffer, cmd_queue);
+    }
+
+    elapsed = g_timer_elapsed (timer, NULL);
+    size = ufo_buffer_get_size (buffer);
+    g_timer_destroy (timer);
+    g_object_unref (buffer);
+
+    return 2 * n_transfers * size / elapsed / 1024.0 / 1024.0;
+}
+
+static void
+test_numa_bandwidth (void)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoArchGraph *arch_graph;
+    GList *gpu_nodes;
+    GList *cpu_nodes;
+    GList *numa_nodes = NULL;
+    gdouble best = 0.0;
+
+    if (!g_test_perf ())
+        return;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    arch_graph = UFO_ARCH_GRAPH (ufo_arch_graph_new (resources, NULL));
+    gpu_nodes = ufo_arch_graph_get_gpu_nodes (arch_graph);
+    cpu_nodes = ufo_arch_graph_get_cpu_nodes (arch_graph);
+
+    for (GList *it = g_list_first (cpu_nodes); it != NULL; it = g_list_next (it)) {
+        gint node = ufo_cpu_node_get_numa_node (UFO_CPU_NODE (it->data));
+
+        if (g_list_find (numa_nodes, GINT_TO_POINTER (node)) == NULL)
+            numa_nodes = g_list_append (numa_nodes, GINT_TO_POINTER (node));
+    }
+
+    for (GList *it = g_list_first (gpu_nodes); it != NULL; it = g_list_next (it)) {
+        UfoGpuNode *gpu_node = UFO_GPU_NODE (it->data);
+
+        for (GList *jt = g_list_first (numa_nodes); jt != NULL; jt = g_list_next (jt)) {
+            gint numa_node = GPOINTER_TO_INT (jt->data);
+            gdouble bandwidth;
+
+            bandwidth = measure_bandwidth (gpu_node, ufo_resources_get_context (resources), numa_node);
+            best = MAX (best, bandwidth);
+
+            g_test_message ("GPU %s (node %i) <-> host node %i: %.1f MB/s",
+                            ufo_gpu_node_get_pci_address (gpu_node) != NULL ?
+                                ufo_gpu_node_get_pci_address (gpu_node) : "unknown",
+                            ufo_gpu_node_get_numa_node (gpu_node), numa_node, bandwidth);
+        }
+    }
+
+    g_test_maximized_result (best, "best host-device bandwidth: %.1f MB/s", best);
+
+    g_list_free (numa_nodes);
+    g_list_free (cpu_nodes);
+    g_list_free (gpu_nodes);
+    g_object_unref (arch_graph);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
 static void
 test_convert_8 (Fixture *fixture,
                 gconstpointer unused)
@@ -158,12 +258,38 @@ test_convert_16_from_data (Fixture *fixture,
         g_assert (host_data[i] == ((gfloat) fixture->data16[i]));
 }
 
+static void
+test_numa_host_array (Fixture *fixture,
+                      gconstpointer unused)
+{
+    gfloat *host_data;
+    gfloat *data;
+
+    /* Host arrays own whole pages so that they can be bound to a node */
+    ufo_buffer_set_numa_node (fixture->buffer, 0);
+    host_data = ufo_buffer_get_host_array (fixture->buffer, NULL);
+    g_assert_cmpuint (((guintptr) host_data) % sysconf (_SC_PAGESIZE), ==, 0);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (host_data[i] == 0.0f);
+
+    /* Arrays passed in are neither bound nor freed with the wrong allocator */
+    data = g_new0 (gfloat, fixture->n_data);
+    ufo_buffer_set_host_array (fixture->buffer, data);
+    ufo_buffer_set_numa_node (fixture->buffer, -1);
+    ufo_buffer_set_numa_node (fixture->buffer, 0);
+    g_assert (ufo_buffer_get_host_array (fixture->buffer, NULL) == data);
+}
+
 void
 test_add_buffer (void)
 {
     g_test_add ("/buffer/create",
                 Fixture, NULL,
                 setup, test_create_lots_of_buffers, teardown);
+    g_test_add_func ("/buffer/numa-bandwidth",
+                     test_numa_bandwidth);
+
     g_test_add ("/buffer/convert/8/host",
                 Fixture, NULL,
                 setup, test_convert_8, teardown);
@@ -179,4 +305,8 @@ test_add_buffer (void)
     g_test_add ("/no-opencl/buffer/convert/16/data",
                 Fixture, NULL,
                 setup, test_convert_16_from_data, teardown);
+
+    g_test_add ("/no-opencl/buffer/numa/host-array",
+                Fixture, NULL,
+                setup, test_numa_host_array, teardown);
 }
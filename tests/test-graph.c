@@ -17,6 +17,9 @@
  * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
 #include <ufo/ufo.h>
 #include "test-suite.h"
 
@@ -39,6 +42,176 @@ static gpointer FOO_LABEL = GINT_TO_POINTER (0xDEADF00D);
 static gpointer BAR_LABEL = GINT_TO_POINTER (0xF00BA);
 static gpointer BAZ_LABEL = GINT_TO_POINTER (0xBA22BA22);
 
+/* GPU tasks that are only mapped and fused, never run */
+typedef struct {
+    UfoTaskNode parent_instance;
+    gboolean in_place;
+} TestGpuTask;
+
+typedef struct {
+    UfoTaskNodeClass parent_class;
+} TestGpuTaskClass;
+
+typedef TestGpuTask TestAsyncGpuTask;
+typedef TestGpuTaskClass TestAsyncGpuTaskClass;
+
+/* A CPU processor with one or two inputs that is only expanded, never run */
+typedef struct {
+    UfoTaskNode parent_instance;
+    guint n_inputs;
+} TestCpuTask;
+
+typedef struct {
+    UfoTaskNodeClass parent_class;
+} TestCpuTaskClass;
+
+static void test_gpu_task_task_init (UfoTaskIface *iface);
+static void test_gpu_task_gpu_task_init (UfoGpuTaskIface *iface);
+static void test_async_gpu_task_gpu_task_init (UfoGpuTaskIface *iface);
+static void test_cpu_task_task_init (UfoTaskIface *iface);
+static void test_cpu_task_cpu_task_init (UfoCpuTaskIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestGpuTask, test_gpu_task, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_gpu_task_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_GPU_TASK, test_gpu_task_gpu_task_init))
+
+G_DEFINE_TYPE_WITH_CODE (TestAsyncGpuTask, test_async_gpu_task, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_gpu_task_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_GPU_TASK, test_async_gpu_task_gpu_task_init))
+
+G_DEFINE_TYPE_WITH_CODE (TestCpuTask, test_cpu_task, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_cpu_task_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_CPU_TASK, test_cpu_task_cpu_task_init))
+
+static void
+gpu_task_setup (UfoTask *task, UfoResources *resources, GError **error)
+{
+}
+
+static void
+gpu_task_get_structure (UfoTask *task, guint *n_inputs, UfoInputParam **in_params, UfoTaskMode *mode)
+{
+    *n_inputs = 1;
+    *in_params = g_new0 (UfoInputParam, 1);
+    (*in_params)[0].n_dims = 2;
+    *mode = UFO_TASK_MODE_PROCESSOR;
+}
+
+static void
+gpu_task_get_requisition (UfoTask *task, UfoBuffer **inputs, UfoRequisition *requisition)
+{
+    ufo_buffer_get_requisition (inputs[0], requisition);
+}
+
+static gboolean
+gpu_task_process (UfoGpuTask *task, UfoBuffer **inputs, UfoBuffer *output, UfoRequisition *requisition)
+{
+    return TRUE;
+}
+
+static gboolean
+gpu_task_process_async (UfoGpuTask *task, UfoBuffer **inputs, UfoBuffer *output,
+                        UfoRequisition *requisition, gpointer *event)
+{
+    return TRUE;
+}
+
+static gboolean
+gpu_task_can_process_in_place (UfoTask *task, guint input)
+{
+    return ((TestGpuTask *) task)->in_place;
+}
+
+static void
+test_gpu_task_task_init (UfoTaskIface *iface)
+{
+    iface->setup = gpu_task_setup;
+    iface->get_structure = gpu_task_get_structure;
+    iface->get_requisition = gpu_task_get_requisition;
+    iface->can_process_in_place = gpu_task_can_process_in_place;
+}
+
+static void
+test_gpu_task_gpu_task_init (UfoGpuTaskIface *iface)
+{
+    iface->process = gpu_task_process;
+}
+
+static void
+test_async_gpu_task_gpu_task_init (UfoGpuTaskIface *iface)
+{
+    iface->process = gpu_task_process;
+    iface->process_async = gpu_task_process_async;
+}
+
+static void
+test_gpu_task_class_init (TestGpuTaskClass *klass)
+{
+}
+
+static void
+test_gpu_task_init (TestGpuTask *self)
+{
+    self->in_place = FALSE;
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-gpu-task");
+}
+
+static void
+test_async_gpu_task_class_init (TestAsyncGpuTaskClass *klass)
+{
+}
+
+static void
+test_async_gpu_task_init (TestAsyncGpuTask *self)
+{
+    self->in_place = FALSE;
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-async-gpu-task");
+}
+
+static void
+cpu_task_get_structure (UfoTask *task, guint *n_inputs, UfoInputParam **in_params, UfoTaskMode *mode)
+{
+    *n_inputs = ((TestCpuTask *) task)->n_inputs;
+    *in_params = g_new0 (UfoInputParam, *n_inputs);
+
+    for (guint i = 0; i < *n_inputs; i++)
+        (*in_params)[i].n_dims = 2;
+
+    *mode = UFO_TASK_MODE_PROCESSOR;
+}
+
+static gboolean
+cpu_task_process (UfoCpuTask *task, UfoBuffer **inputs, UfoBuffer *output, UfoRequisition *requisition)
+{
+    return TRUE;
+}
+
+static void
+test_cpu_task_task_init (UfoTaskIface *iface)
+{
+    iface->setup = gpu_task_setup;
+    iface->get_structure = cpu_task_get_structure;
+    iface->get_requisition = gpu_task_get_requisition;
+}
+
+static void
+test_cpu_task_cpu_task_init (UfoCpuTaskIface *iface)
+{
+    iface->process = cpu_task_process;
+}
+
+static void
+test_cpu_task_class_init (TestCpuTaskClass *klass)
+{
+}
+
+static void
+test_cpu_task_init (TestCpuTask *self)
+{
+    self->n_inputs = 1;
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-cpu-task");
+}
+
 static void
 fixture_setup (Fixture *fixture, gconstpointer data)
 {
@@ -365,6 +538,442 @@ test_flatten (Fixture *fixture, gconstpointer data)
     g_list_free (levels);
 }
 
+static void
+test_map_locality (void)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoArchGraph *arch_graph;
+    UfoTaskGraph *task_graph;
+    UfoTaskNode *root, *a, *b, *c, *d;
+    guint n_gpus;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    arch_graph = UFO_ARCH_GRAPH (ufo_arch_graph_new (resources, NULL));
+    task_graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    n_gpus = ufo_arch_graph_get_num_gpus (arch_graph);
+
+    root = UFO_TASK_NODE (g_object_new (test_gpu_task_get_type (), NULL));
+    a = UFO_TASK_NODE (g_object_new (test_gpu_task_get_type (), NULL));
+    b = UFO_TASK_NODE (g_object_new (test_gpu_task_get_type (), NULL));
+    c = UFO_TASK_NODE (g_object_new (test_gpu_task_get_type (), NULL));
+    d = UFO_TASK_NODE (g_object_new (test_gpu_task_get_type (), NULL));
+
+    /* Two chains branching off a common root */
+    ufo_task_graph_connect_nodes (task_graph, root, a);
+    ufo_task_graph_connect_nodes (task_graph, a, b);
+    ufo_task_graph_connect_nodes (task_graph, root, c);
+    ufo_task_graph_connect_nodes (task_graph, c, d);
+
+    ufo_task_graph_map (task_graph, arch_graph);
+
+    g_assert (ufo_task_node_get_proc_node (root) == ufo_task_node_get_proc_node (a));
+    g_assert (ufo_task_node_get_proc_node (a) == ufo_task_node_get_proc_node (b));
+    g_assert (ufo_task_node_get_proc_node (c) == ufo_task_node_get_proc_node (d));
+    g_assert_cmpuint (ufo_task_graph_get_num_cross_device_edges (task_graph), ==, n_gpus > 1 ? 1 : 0);
+
+    /* The second branch starts on another GPU if there is one */
+    if (n_gpus > 1)
+        g_assert (ufo_task_node_get_proc_node (root) != ufo_task_node_get_proc_node (c));
+
+    g_object_unref (root);
+    g_object_unref (a);
+    g_object_unref (b);
+    g_object_unref (c);
+    g_object_unref (d);
+    g_object_unref (task_graph);
+    g_object_unref (arch_graph);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+test_costs (void)
+{
+    UfoTaskGraph *graph;
+    UfoTaskGraph *copy;
+    UfoTaskNode *node;
+    gchar *filename;
+    gchar *contents;
+    gchar *copy_contents;
+    gint fd;
+
+    fd = g_file_open_tmp ("ufo-costs-XXXXXX", &filename, NULL);
+    g_assert (fd >= 0);
+    close (fd);
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    copy = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    node = UFO_TASK_NODE (ufo_input_task_new ());
+
+    ufo_task_graph_add_cost_sample (graph, node, 0.5, 10, 4096);
+    ufo_task_graph_add_cost_sample (graph, node, 0.5, 10, 4096);
+    g_assert (ufo_task_graph_save_costs (graph, filename, NULL));
+    g_assert (g_file_get_contents (filename, &contents, NULL, NULL));
+
+    /* Loaded timings must survive another round trip unchanged */
+    g_assert (ufo_task_graph_load_costs (copy, filename, NULL));
+    g_assert (ufo_task_graph_save_costs (copy, filename, NULL));
+    g_assert (g_file_get_contents (filename, &copy_contents, NULL, NULL));
+    g_assert_cmpstr (contents, ==, copy_contents);
+    g_assert (ufo_task_graph_get_plan (graph) == NULL);
+
+    g_unlink (filename);
+    g_free (copy_contents);
+    g_free (contents);
+    g_free (filename);
+    g_object_unref (node);
+    g_object_unref (copy);
+    g_object_unref (graph);
+}
+
+static void
+test_costs_per_node (void)
+{
+    UfoTaskGraph *graph;
+    UfoTaskNode *first, *second;
+    UfoNode *replica;
+    GKeyFile *key_file;
+    gchar **groups;
+    gchar *filename;
+    gdouble times[2];
+    gsize n_groups;
+    gint fd;
+
+    fd = g_file_open_tmp ("ufo-costs-XXXXXX", &filename, NULL);
+    g_assert (fd >= 0);
+    close (fd);
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    first = UFO_TASK_NODE (ufo_input_task_new ());
+    second = UFO_TASK_NODE (ufo_input_task_new ());
+    ufo_task_graph_connect_nodes (graph, first, second);
+    replica = ufo_node_copy (UFO_NODE (first), NULL);
+
+    /* Instances of one plugin are kept apart, a copy adds to its original */
+    ufo_task_graph_add_cost_sample (graph, first, 0.5, 1, 4096);
+    ufo_task_graph_add_cost_sample (graph, UFO_TASK_NODE (replica), 1.5, 1, 4096);
+    ufo_task_graph_add_cost_sample (graph, second, 3.0, 1, 4096);
+    g_assert (ufo_task_graph_save_costs (graph, filename, NULL));
+
+    key_file = g_key_file_new ();
+    g_assert (g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, NULL));
+    groups = g_key_file_get_groups (key_file, &n_groups);
+    g_assert_cmpuint (n_groups, ==, 2);
+
+    for (guint i = 0; i < 2; i++)
+        times[i] = g_key_file_get_double (key_file, groups[i], "time", NULL);
+
+    g_assert_cmpfloat (MIN (times[0], times[1]), ==, 1.0);
+    g_assert_cmpfloat (MAX (times[0], times[1]), ==, 3.0);
+
+    g_unlink (filename);
+    g_strfreev (groups);
+    g_key_file_free (key_file);
+    g_free (filename);
+    g_object_unref (replica);
+    g_object_unref (first);
+    g_object_unref (second);
+    g_object_unref (graph);
+}
+
+static void
+test_fuse (void)
+{
+    UfoTaskGraph *graph;
+    UfoTaskNode *a, *b, *c;
+    gboolean fusable;
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    a = UFO_TASK_NODE (ufo_input_task_new ());
+    b = UFO_TASK_NODE (ufo_input_task_new ());
+    c = UFO_TASK_NODE (ufo_input_task_new ());
+
+    g_assert (ufo_task_node_get_fusable (a));
+    g_object_set (a, "fusable", FALSE, NULL);
+    g_object_get (a, "fusable", &fusable, NULL);
+    g_assert (!fusable);
+    g_assert (!ufo_task_node_get_fusable (a));
+
+    /* Only GPU tasks are fused, CPU tasks must stay where they are */
+    ufo_task_graph_connect_nodes (graph, a, b);
+    ufo_task_graph_connect_nodes (graph, b, c);
+    ufo_task_graph_fuse (graph);
+    g_assert_cmpuint (ufo_graph_get_num_nodes (UFO_GRAPH (graph)), ==, 3);
+
+    g_object_unref (a);
+    g_object_unref (b);
+    g_object_unref (c);
+    g_object_unref (graph);
+}
+
+static UfoTaskNode *
+new_gpu_task (gboolean in_place)
+{
+    TestGpuTask *task = g_object_new (test_gpu_task_get_type (), NULL);
+
+    task->in_place = in_place;
+    return UFO_TASK_NODE (task);
+}
+
+/*
+ * Connect @n tasks to a chain fed by an input task, map and fuse it and check
+ * that @n_fused of them remain. Without a GPU nothing is mapped and nothing can
+ * be fused.
+ */
+static void
+check_fused_chain (UfoTaskNode **tasks, guint n, guint n_fused)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoArchGraph *arch_graph;
+    UfoTaskGraph *task_graph;
+    UfoTaskNode *source;
+    guint n_gpus;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    arch_graph = UFO_ARCH_GRAPH (ufo_arch_graph_new (resources, NULL));
+    task_graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    n_gpus = ufo_arch_graph_get_num_gpus (arch_graph);
+
+    /* Fusion only looks at the graph, every member needs its single input connected */
+    source = UFO_TASK_NODE (ufo_input_task_new ());
+    ufo_task_graph_connect_nodes (task_graph, source, tasks[0]);
+
+    for (guint i = 1; i < n; i++)
+        ufo_task_graph_connect_nodes (task_graph, tasks[i - 1], tasks[i]);
+
+    ufo_task_graph_map (task_graph, arch_graph);
+    ufo_task_graph_fuse (task_graph);
+    g_assert_cmpuint (ufo_graph_get_num_nodes (UFO_GRAPH (task_graph)), ==, 1 + (n_gpus > 0 ? n_fused : n));
+
+    for (guint i = 0; i < n; i++)
+        g_object_unref (tasks[i]);
+
+    g_object_unref (source);
+
+    g_object_unref (task_graph);
+    g_object_unref (arch_graph);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+test_fuse_gpu (void)
+{
+    UfoTaskNode *plain[3];
+    UfoTaskNode *mixed[5];
+
+    for (guint i = 0; i < 3; i++)
+        plain[i] = new_gpu_task (FALSE);
+
+    check_fused_chain (plain, 3, 1);
+
+    /* In-place and asynchronous tasks keep their own thread */
+    mixed[0] = new_gpu_task (FALSE);
+    mixed[1] = new_gpu_task (TRUE);
+    mixed[2] = new_gpu_task (FALSE);
+    mixed[3] = new_gpu_task (FALSE);
+    mixed[4] = UFO_TASK_NODE (g_object_new (test_async_gpu_task_get_type (), NULL));
+
+    check_fused_chain (mixed, 5, 4);
+}
+
+static UfoTaskNode *
+new_cpu_task (void)
+{
+    return UFO_TASK_NODE (g_object_new (test_cpu_task_get_type (), NULL));
+}
+
+static UfoTaskNode *
+new_scatter_task (void)
+{
+    UfoTaskNode *task = UFO_TASK_NODE (ufo_input_task_new ());
+
+    ufo_task_node_set_send_pattern (task, UFO_SEND_SCATTER);
+    return task;
+}
+
+/* Expand @task_graph on the local machine with up to @n_replicas CPU copies */
+static void
+expand_cpu (UfoTaskGraph *task_graph, guint n_replicas)
+{
+    UfoConfig *config;
+    UfoResources *resources;
+    UfoArchGraph *arch_graph;
+
+    config = ufo_config_new ();
+    resources = ufo_resources_new (config, NULL);
+    arch_graph = UFO_ARCH_GRAPH (ufo_arch_graph_new (resources, NULL));
+
+    ufo_task_graph_set_cpu_replicas (task_graph, n_replicas);
+    ufo_task_graph_expand (task_graph, arch_graph, FALSE, FALSE, FALSE);
+
+    g_object_unref (arch_graph);
+    g_object_unref (resources);
+    g_object_unref (config);
+}
+
+static void
+check_replica_set (UfoTaskGraph *task_graph, guint index, UfoTaskNode *head, UfoTaskNode *tail, guint n_replicas)
+{
+    UfoTaskNode *set_head;
+    UfoTaskNode *set_tail;
+    GList *entries;
+    GList *exits;
+
+    ufo_task_graph_get_replica_set (task_graph, index, &set_head, &set_tail, &entries, &exits);
+    g_assert (set_head == head);
+    g_assert (set_tail == tail);
+    g_assert_cmpuint (g_list_length (entries), ==, n_replicas);
+    g_assert_cmpuint (g_list_length (exits), ==, n_replicas);
+    g_assert_cmpuint (ufo_graph_get_num_successors (UFO_GRAPH (task_graph), UFO_NODE (head)), ==, n_replicas);
+    g_assert_cmpuint (ufo_graph_get_num_predecessors (UFO_GRAPH (task_graph), UFO_NODE (tail)), ==, n_replicas);
+}
+
+static void
+test_expand_cpu (void)
+{
+    UfoTaskGraph *graph;
+    UfoTaskNode *head, *a, *b, *tail;
+    gchar *plan;
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    head = new_scatter_task ();
+    a = new_cpu_task ();
+    b = new_cpu_task ();
+    tail = UFO_TASK_NODE (ufo_input_task_new ());
+
+    ufo_task_graph_connect_nodes (graph, head, a);
+    ufo_task_graph_connect_nodes (graph, a, b);
+    ufo_task_graph_connect_nodes (graph, b, tail);
+
+    expand_cpu (graph, 3);
+    g_assert_cmpuint (ufo_task_graph_get_num_replica_sets (graph), ==, 1);
+    g_assert_cmpuint (ufo_graph_get_num_nodes (UFO_GRAPH (graph)), ==, 4 + 2 * 2);
+    check_replica_set (graph, 0, head, tail, 3);
+
+    plan = ufo_task_graph_get_plan (graph);
+    g_assert (strstr (plan, "3 replicas") != NULL);
+    g_free (plan);
+
+    /* Expanding again replaces the report of the first expansion */
+    expand_cpu (graph, 1);
+    g_assert_cmpuint (ufo_task_graph_get_num_replica_sets (graph), ==, 0);
+    plan = ufo_task_graph_get_plan (graph);
+    g_assert (strstr (plan, "3 replicas") == NULL);
+    g_free (plan);
+
+    g_object_unref (head);
+    g_object_unref (a);
+    g_object_unref (b);
+    g_object_unref (tail);
+    g_object_unref (graph);
+}
+
+static void
+test_expand_multiple_paths (void)
+{
+    UfoTaskGraph *graph;
+    UfoTaskNode *heads[2], *tails[2], *inner[3];
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+
+    for (guint i = 0; i < 2; i++) {
+        heads[i] = new_scatter_task ();
+        tails[i] = UFO_TASK_NODE (ufo_input_task_new ());
+    }
+
+    for (guint i = 0; i < 3; i++)
+        inner[i] = new_cpu_task ();
+
+    /* Two independent pipelines with a path of two and of one task */
+    ufo_task_graph_connect_nodes (graph, heads[0], inner[0]);
+    ufo_task_graph_connect_nodes (graph, inner[0], inner[1]);
+    ufo_task_graph_connect_nodes (graph, inner[1], tails[0]);
+    ufo_task_graph_connect_nodes (graph, heads[1], inner[2]);
+    ufo_task_graph_connect_nodes (graph, inner[2], tails[1]);
+
+    expand_cpu (graph, 2);
+    g_assert_cmpuint (ufo_task_graph_get_num_replica_sets (graph), ==, 2);
+    g_assert_cmpuint (ufo_graph_get_num_nodes (UFO_GRAPH (graph)), ==, 7 + 2 + 1);
+
+    /* Longer paths are replicated first */
+    check_replica_set (graph, 0, heads[0], tails[0], 2);
+    check_replica_set (graph, 1, heads[1], tails[1], 2);
+
+    for (guint i = 0; i < 2; i++) {
+        g_object_unref (heads[i]);
+        g_object_unref (tails[i]);
+    }
+
+    for (guint i = 0; i < 3; i++)
+        g_object_unref (inner[i]);
+
+    g_object_unref (graph);
+}
+
+static void
+test_expand_multiple_inputs (void)
+{
+    UfoTaskGraph *graph;
+    UfoTaskNode *head, *split, *left, *right, *merge, *tail;
+    GList *exits;
+    GList *entries;
+    UfoTaskNode *set_head, *set_tail;
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    head = new_scatter_task ();
+    split = new_cpu_task ();
+    left = new_cpu_task ();
+    right = new_cpu_task ();
+    merge = new_cpu_task ();
+    ((TestCpuTask *) merge)->n_inputs = 2;
+    tail = UFO_TASK_NODE (ufo_input_task_new ());
+
+    /* A diamond whose merging task has both inputs inside the sub-graph */
+    ufo_task_graph_connect_nodes (graph, head, split);
+    ufo_task_graph_connect_nodes (graph, split, left);
+    ufo_task_graph_connect_nodes (graph, split, right);
+    ufo_task_graph_connect_nodes_full (graph, left, merge, 0);
+    ufo_task_graph_connect_nodes_full (graph, right, merge, 1);
+    ufo_task_graph_connect_nodes (graph, merge, tail);
+
+    expand_cpu (graph, 2);
+    g_assert_cmpuint (ufo_task_graph_get_num_replica_sets (graph), ==, 1);
+    g_assert_cmpuint (ufo_graph_get_num_nodes (UFO_GRAPH (graph)), ==, 6 + 4);
+    check_replica_set (graph, 0, head, tail, 2);
+
+    /* Each copy of the merging task is fed by the copies of its own branch */
+    ufo_task_graph_get_replica_set (graph, 0, &set_head, &set_tail, &entries, &exits);
+
+    for (GList *it = g_list_first (exits); it != NULL; it = g_list_next (it)) {
+        GList *predecessors = ufo_graph_get_predecessors (UFO_GRAPH (graph), UFO_NODE (it->data));
+
+        g_assert_cmpuint (g_list_length (predecessors), ==, 2);
+
+        for (GList *jt = g_list_first (predecessors); jt != NULL; jt = g_list_next (jt)) {
+            GList *sources = ufo_graph_get_predecessors (UFO_GRAPH (graph), UFO_NODE (jt->data));
+
+            g_assert_cmpuint (g_list_length (sources), ==, 1);
+            g_assert (g_list_find (entries, sources->data) != NULL);
+            g_list_free (sources);
+        }
+
+        g_list_free (predecessors);
+    }
+
+    g_object_unref (head);
+    g_object_unref (split);
+    g_object_unref (left);
+    g_object_unref (right);
+    g_object_unref (merge);
+    g_object_unref (tail);
+    g_object_unref (graph);
+}
+
 void
 test_add_graph (void)
 {
@@ -387,8 +996,18 @@ test_add_graph (void)
         { NULL, NULL }
     };
 
+    g_test_add_func ("/no-opencl/graph/task-graph/costs", test_costs);
+    g_test_add_func ("/no-opencl/graph/task-graph/costs/per-node", test_costs_per_node);
+    g_test_add_func ("/no-opencl/graph/task-graph/fuse", test_fuse);
+
     for (guint i = 0; test_cases[i].path != NULL; i++) {
         g_test_add (test_cases[i].path, Fixture, NULL,
                     fixture_setup, test_cases[i].test_func, fixture_teardown);
     }
+
+    g_test_add_func ("/graph/task-graph/map", test_map_locality);
+    g_test_add_func ("/graph/task-graph/fuse", test_fuse_gpu);
+    g_test_add_func ("/graph/task-graph/expand/cpu", test_expand_cpu);
+    g_test_add_func ("/graph/task-graph/expand/paths", test_expand_multiple_paths);
+    g_test_add_func ("/graph/task-graph/expand/multiple-inputs", test_expand_multiple_inputs);
 }
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+#include <string.h>
+#include <ufo/ufo.h>
+#include "test-suite.h"
+
+typedef struct {
+    UfoConfig *config;
+    UfoResources *resources;
+} Fixture;
+
+static void
+setup (Fixture *fixture, gconstpointer data)
+{
+    fixture->config = ufo_config_new ();
+    fixture->resources = ufo_resources_new (fixture->config, NULL);
+}
+
+static void
+teardown (Fixture *fixture, gconstpointer data)
+{
+    g_object_unref (fixture->resources);
+    g_object_unref (fixture->config);
+}
+
+static void
+test_constant_buffers (Fixture *fixture,
+                       gconstpointer unused)
+{
+    GList *devices;
+    GList *queues;
+    gfloat table[64];
+    gfloat other[64];
+    gfloat result[64];
+    guint n_buffers;
+    guint n_hits;
+    guint n_misses;
+    gsize size;
+    guint n_devices;
+
+    devices = ufo_resources_get_devices (fixture->resources);
+    queues = ufo_resources_get_cmd_queues (fixture->resources);
+    n_devices = g_list_length (devices);
+
+    for (guint i = 0; i < 64; i++) {
+        table[i] = (gfloat) i;
+        other[i] = (gfloat) i;
+    }
+
+    other[63] = -1.0f;
+
+    for (guint i = 0; i < n_devices; i++) {
+        gpointer device = g_list_nth_data (devices, i);
+        gpointer queue = g_list_nth_data (queues, i);
+        gpointer first;
+        gpointer second;
+        gpointer third;
+
+        first = ufo_resources_get_constant_buffer (fixture->resources, device, table, sizeof (table), NULL);
+        g_assert (first != NULL);
+
+        /* Equal contents from a different host array hit the cache */
+        memcpy (result, table, sizeof (table));
+        second = ufo_resources_get_constant_buffer (fixture->resources, device, result, sizeof (result), NULL);
+        g_assert (first == second);
+
+        third = ufo_resources_get_constant_buffer (fixture->resources, device, other, sizeof (other), NULL);
+        g_assert (third != first);
+
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBuffer (queue, first, CL_TRUE, 0, sizeof (result), result,
+                                                        0, NULL, NULL));
+        g_assert (memcmp (result, table, sizeof (table)) == 0);
+    }
+
+    ufo_resources_get_constant_cache_stats (fixture->resources, &n_buffers, &size, &n_hits, &n_misses);
+    g_assert_cmpuint (n_buffers, ==, 2 * n_devices);
+    g_assert_cmpuint (size, ==, 2 * n_devices * sizeof (table));
+    g_assert_cmpuint (n_hits, ==, n_devices);
+    g_assert_cmpuint (n_misses, ==, 2 * n_devices);
+
+    g_list_free (queues);
+    g_list_free (devices);
+}
+
+static void
+test_copy_queues (Fixture *fixture,
+                  gconstpointer unused)
+{
+    GList *queues;
+    UfoRequisition requisition = { .n_dims = 2, .dims[0] = 256, .dims[1] = 256 };
+    gpointer context;
+
+    queues = ufo_resources_get_cmd_queues (fixture->resources);
+    context = ufo_resources_get_context (fixture->resources);
+
+    for (GList *it = g_list_first (queues); it != NULL; it = g_list_next (it)) {
+        UfoBuffer *buffer;
+        UfoBuffer *copy;
+        gpointer copy_queue;
+        gfloat *data;
+
+        copy_queue = ufo_resources_get_copy_queue (fixture->resources, it->data);
+        g_assert (copy_queue != NULL);
+        g_assert (copy_queue != it->data);
+
+        /* Round trip through device memory with transfers on the copy queue */
+        buffer = ufo_buffer_new (&requisition, NULL, context);
+        data = ufo_buffer_get_host_array (buffer, NULL);
+
+        for (guint i = 0; i < 256 * 256; i++)
+            data[i] = (gfloat) i;
+
+        ufo_buffer_get_device_array (buffer, it->data);
+        memset (data, 0, 256 * 256 * sizeof (gfloat));
+        data = ufo_buffer_get_host_array (buffer, it->data);
+
+        for (guint i = 0; i < 256 * 256; i++)
+            g_assert_cmpfloat (data[i], ==, (gfloat) i);
+
+        /* An upload must not overwrite memory that a pending command still reads */
+        copy = ufo_buffer_new (&requisition, NULL, context);
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueCopyBuffer (it->data,
+                                                        ufo_buffer_get_device_array (buffer, it->data),
+                                                        ufo_buffer_get_device_array (copy, it->data),
+                                                        0, 0, 256 * 256 * sizeof (gfloat), 0, NULL, NULL));
+
+        data = ufo_buffer_get_host_array (buffer, it->data);
+        memset (data, 0, 256 * 256 * sizeof (gfloat));
+        ufo_buffer_get_device_array (buffer, it->data);
+        data = ufo_buffer_get_host_array (copy, it->data);
+
+        for (guint i = 0; i < 256 * 256; i++)
+            g_assert_cmpfloat (data[i], ==, (gfloat) i);
+
+        g_object_unref (copy);
+        g_object_unref (buffer);
+    }
+
+    g_assert (ufo_resources_get_copy_queue (fixture->resources, NULL) == NULL);
+    g_list_free (queues);
+}
+
+static void
+launch_and_check (UfoResources *resources,
+                  gpointer queue,
+                  gpointer kernel,
+                  cl_mem mem,
+                  gfloat scale)
+{
+    const gsize global_work_size = 4096;
+    gfloat result[4096];
+    cl_event event;
+
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &mem));
+    ufo_resources_launch_kernel (resources, queue, kernel, 1, &global_work_size, 0, NULL, &event);
+    g_assert (event != NULL);
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBuffer (queue, mem, CL_TRUE, 0, sizeof (result), result,
+                                                    0, NULL, NULL));
+
+    for (guint i = 0; i < global_work_size; i++)
+        g_assert_cmpfloat (result[i], ==, scale * i);
+}
+
+static void
+test_launch_kernel (Fixture *fixture,
+                    gconstpointer unused)
+{
+    static const gchar *first_source = "kernel void fill (global float *a) { a[get_global_id (0)] = get_global_id (0); }";
+    static const gchar *second_source = "kernel void fill (global float *a) { a[get_global_id (0)] = 2 * get_global_id (0); }";
+    const gsize global_work_size = 4096;
+    gpointer context;
+    GList *queues;
+
+    context = ufo_resources_get_context (fixture->resources);
+    queues = ufo_resources_get_cmd_queues (fixture->resources);
+
+    for (GList *it = g_list_first (queues); it != NULL; it = g_list_next (it)) {
+        gpointer first;
+        gpointer second;
+        gsize local_work_size[1];
+        cl_mem mem;
+        cl_int errcode;
+
+        first = ufo_resources_get_kernel_from_source (fixture->resources, first_source, "fill", NULL);
+        second = ufo_resources_get_kernel_from_source (fixture->resources, second_source, "fill", NULL);
+        g_assert (first != NULL && second != NULL);
+
+        mem = clCreateBuffer (context, CL_MEM_READ_WRITE, global_work_size * sizeof (gfloat), NULL, &errcode);
+        UFO_RESOURCES_CHECK_CLERR (errcode);
+
+        /* Results must stay correct while candidates are tried */
+        for (guint i = 0; i < 64; i++)
+            launch_and_check (fixture->resources, it->data, first, mem, 1.0f);
+
+        g_assert (ufo_resources_get_local_work_size (fixture->resources, it->data, first, 1,
+                                                     &global_work_size, local_work_size));
+        g_assert (local_work_size[0] == 0 || global_work_size % local_work_size[0] == 0);
+
+        /* A kernel with the same name from another program is tuned separately */
+        for (guint i = 0; i < 64; i++)
+            launch_and_check (fixture->resources, it->data, second, mem, 2.0f);
+
+        g_assert (ufo_resources_get_local_work_size (fixture->resources, it->data, second, 1,
+                                                     &global_work_size, local_work_size));
+
+        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (mem));
+    }
+
+    g_list_free (queues);
+}
+
+void
+test_add_resources (void)
+{
+    g_test_add ("/resources/constant-buffers",
+                Fixture, NULL,
+                setup, test_constant_buffers, teardown);
+
+    g_test_add ("/resources/copy-queues",
+                Fixture, NULL,
+                setup, test_copy_queues, teardown);
+
+    g_test_add ("/resources/launch-kernel",
+                Fixture, NULL,
+                setup, test_launch_kernel, teardown);
+}
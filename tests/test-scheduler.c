@@ -0,0 +1,1136 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+#include <math.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <ufo/ufo.h>
+#include "test-suite.h"
+
+#define N_FRAMES        400
+#define FRAME_SIZE      4096
+#define CHEAP_USEC      100
+#define EXPENSIVE_USEC  2000
+#define CHEAP_PASSES    20
+#define EXPENSIVE_PASSES 200
+#define N_RUNS          5
+#define SIZE_RUN        12
+#define BATCH_SIZE      8
+#define SMALL_FRAME     64
+#define N_SMALL_FRAMES  20000
+
+/*
+ * Synthetic tasks: a source numbering its frames, a sleeping worker and a
+ * computing worker whose cost jumps halfway through the stream, a batched task adding one to every element, an
+ * in-place task doing the same on its input, an asynchronous GPU task copying
+ * its input, a sink recording when each frame arrives and a collector
+ * remembering which buffer carried each frame.
+ */
+
+typedef struct {
+    UfoTaskNode parent_instance;
+    guint current;
+} TestSource;
+
+typedef struct {
+    UfoTaskNodeClass parent_class;
+} TestSourceClass;
+
+typedef UfoTaskNode TestWorker;
+typedef UfoTaskNodeClass TestWorkerClass;
+
+typedef UfoTaskNode TestComputer;
+typedef UfoTaskNodeClass TestComputerClass;
+
+typedef struct {
+    UfoTaskNode parent_instance;
+    guint batch_size;
+} TestBatcher;
+
+typedef struct {
+    UfoTaskNodeClass parent_class;
+} TestBatcherClass;
+
+typedef UfoTaskNode TestInPlace;
+typedef UfoTaskNodeClass TestInPlaceClass;
+
+typedef UfoTaskNode TestAsync;
+typedef UfoTaskNodeClass TestAsyncClass;
+
+typedef UfoTaskNode TestSink;
+typedef UfoTaskNodeClass TestSinkClass;
+
+typedef struct {
+    UfoTaskNode parent_instance;
+    guint n_received;
+    gboolean in_order;
+    gpointer buffers[N_FRAMES];
+} TestCollector;
+
+typedef struct {
+    UfoTaskNodeClass parent_class;
+} TestCollectorClass;
+
+static void test_source_task_init (UfoTaskIface *iface);
+static void test_source_cpu_task_init (UfoCpuTaskIface *iface);
+static void test_worker_task_init (UfoTaskIface *iface);
+static void test_worker_cpu_task_init (UfoCpuTaskIface *iface);
+static void test_computer_task_init (UfoTaskIface *iface);
+static void test_computer_cpu_task_init (UfoCpuTaskIface *iface);
+static void test_batcher_task_init (UfoTaskIface *iface);
+static void test_batcher_cpu_task_init (UfoCpuTaskIface *iface);
+static void test_in_place_task_init (UfoTaskIface *iface);
+static void test_in_place_cpu_task_init (UfoCpuTaskIface *iface);
+static void test_async_task_init (UfoTaskIface *iface);
+static void test_async_gpu_task_init (UfoGpuTaskIface *iface);
+static void test_sink_task_init (UfoTaskIface *iface);
+static void test_sink_cpu_task_init (UfoCpuTaskIface *iface);
+static void test_collector_task_init (UfoTaskIface *iface);
+static void test_collector_cpu_task_init (UfoCpuTaskIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestSource, test_source, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_source_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_CPU_TASK, test_source_cpu_task_init))
+
+G_DEFINE_TYPE_WITH_CODE (TestWorker, test_worker, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_worker_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_CPU_TASK, test_worker_cpu_task_init))
+
+G_DEFINE_TYPE_WITH_CODE (TestComputer, test_computer, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_computer_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_CPU_TASK, test_computer_cpu_task_init))
+
+G_DEFINE_TYPE_WITH_CODE (TestBatcher, test_batcher, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_batcher_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_CPU_TASK, test_batcher_cpu_task_init))
+
+G_DEFINE_TYPE_WITH_CODE (TestInPlace, test_in_place, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_in_place_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_CPU_TASK, test_in_place_cpu_task_init))
+
+G_DEFINE_TYPE_WITH_CODE (TestAsync, test_async, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_async_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_GPU_TASK, test_async_gpu_task_init))
+
+G_DEFINE_TYPE_WITH_CODE (TestSink, test_sink, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_sink_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_CPU_TASK, test_sink_cpu_task_init))
+
+G_DEFINE_TYPE_WITH_CODE (TestCollector, test_collector, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_collector_task_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_CPU_TASK, test_collector_cpu_task_init))
+
+typedef struct {
+    gdouble generated[N_FRAMES];
+    gdouble arrival[N_FRAMES];
+    guint n_frames;         /* Frames to generate, N_FRAMES if 0 */
+    guint frame_size;       /* Elements per frame, FRAME_SIZE if 0 */
+    gboolean mixed_sizes;   /* Halve the size of every other run of SIZE_RUN frames */
+    gboolean fill;          /* Fill frames with their number, checked by the sink */
+    gfloat offset;          /* Expected difference of the sink's input to the frame number */
+    guint n_received;
+    guint n_batches;
+    guint max_batch;
+    guint n_in_place;       /* Frames the in-place task wrote into its input */
+    guint n_async;          /* Frames the asynchronous task enqueued */
+    gboolean in_order;
+    gboolean static_shapes;
+    gint n_requisitions;        /* Calls of get_requisition() */
+    UfoTask *consumer;          /* Target of the source whose buffers are counted */
+    guint n_allocated;          /* Buffers allocated for it when the first frame was generated */
+    guint capacity;             /* Buffers that can circulate between the source and it */
+    GHashTable *thread_names;   /* Names of the computer threads if not NULL */
+    gint max_cpus;              /* Most CPUs a computer thread was allowed to run on */
+    guint max_active_replicas;  /* Reported by the scheduler after the run */
+    GTimer *timer;
+} Arrivals;
+
+static Arrivals arrivals;
+
+G_LOCK_DEFINE_STATIC (arrivals);
+
+static void
+setup_nothing (UfoTask *task, UfoResources *resources, GError **error)
+{
+}
+
+static guint
+get_frame_size (guint frame)
+{
+    guint size = arrivals.frame_size > 0 ? arrivals.frame_size : FRAME_SIZE;
+
+    if (arrivals.mixed_sizes && (frame / SIZE_RUN) % 2)
+        size /= 2;
+
+    return size;
+}
+
+static void
+get_frame_requisition (UfoTask *task, UfoBuffer **inputs, UfoRequisition *requisition)
+{
+    g_atomic_int_inc (&arrivals.n_requisitions);
+    requisition->n_dims = 1;
+    requisition->dims[0] = FRAME_SIZE;
+}
+
+static void
+get_source_requisition (UfoTask *task, UfoBuffer **inputs, UfoRequisition *requisition)
+{
+    g_atomic_int_inc (&arrivals.n_requisitions);
+    requisition->n_dims = 1;
+    requisition->dims[0] = get_frame_size (((TestSource *) task)->current);
+}
+
+static void
+get_input_requisition (UfoTask *task, UfoBuffer **inputs, UfoRequisition *requisition)
+{
+    g_atomic_int_inc (&arrivals.n_requisitions);
+    ufo_buffer_get_requisition (inputs[0], requisition);
+}
+
+static void
+get_no_requisition (UfoTask *task, UfoBuffer **inputs, UfoRequisition *requisition)
+{
+    g_atomic_int_inc (&arrivals.n_requisitions);
+    requisition->n_dims = 0;
+}
+
+static gboolean
+get_static_frame_requisition (UfoTask *task, UfoRequisition *inputs, UfoRequisition *requisition)
+{
+    requisition->n_dims = 1;
+    requisition->dims[0] = FRAME_SIZE;
+    return arrivals.static_shapes;
+}
+
+static gboolean
+get_static_input_requisition (UfoTask *task, UfoRequisition *inputs, UfoRequisition *requisition)
+{
+    *requisition = inputs[0];
+    return arrivals.static_shapes;
+}
+
+static gboolean
+get_static_no_requisition (UfoTask *task, UfoRequisition *inputs, UfoRequisition *requisition)
+{
+    requisition->n_dims = 0;
+    return arrivals.static_shapes;
+}
+
+static void
+get_generator_structure (UfoTask *task, guint *n_inputs, UfoInputParam **in_params, UfoTaskMode *mode)
+{
+    *n_inputs = 0;
+    *mode = UFO_TASK_MODE_GENERATOR;
+}
+
+static void
+get_processor_structure (UfoTask *task, guint *n_inputs, UfoInputParam **in_params, UfoTaskMode *mode)
+{
+    *n_inputs = 1;
+    *in_params = g_new0 (UfoInputParam, 1);
+    (*in_params)[0].n_dims = 1;
+    *mode = UFO_TASK_MODE_PROCESSOR;
+}
+
+static gboolean
+source_generate (UfoCpuTask *task, UfoBuffer *output, UfoRequisition *requisition)
+{
+    TestSource *source = (TestSource *) task;
+    gfloat *data = ufo_buffer_get_host_array (output, NULL);
+
+    if (source->current == (arrivals.n_frames > 0 ? arrivals.n_frames : N_FRAMES))
+        return FALSE;
+
+    if (source->current == 0 && arrivals.consumer != NULL) {
+        UfoGroup *group = ufo_task_node_get_out_group (UFO_TASK_NODE (task));
+
+        arrivals.n_allocated = ufo_group_get_num_buffers (group, arrivals.consumer);
+        arrivals.capacity = ufo_group_get_capacity (group, arrivals.consumer);
+    }
+
+    arrivals.generated[source->current % N_FRAMES] = g_timer_elapsed (arrivals.timer, NULL);
+
+    if (arrivals.fill) {
+        for (guint i = 1; i < requisition->dims[0]; i++)
+            data[i] = (gfloat) source->current;
+    }
+
+    data[0] = (gfloat) source->current++;
+    return TRUE;
+}
+
+static gboolean
+worker_process (UfoCpuTask *task, UfoBuffer **inputs, UfoBuffer *output, UfoRequisition *requisition)
+{
+    gfloat *in = ufo_buffer_get_host_array (inputs[0], NULL);
+
+    g_assert_cmpuint (requisition->n_dims, ==, 1);
+    g_assert_cmpuint (requisition->dims[0], ==, FRAME_SIZE);
+    g_usleep (((guint) in[0]) < N_FRAMES / 2 ? CHEAP_USEC : EXPENSIVE_USEC);
+    memcpy (ufo_buffer_get_host_array (output, NULL), in, FRAME_SIZE * sizeof (gfloat));
+    return TRUE;
+}
+
+/* Remember the name and the CPUs of the calling thread */
+static void
+record_thread (void)
+{
+    gchar name[17] = { 0 };
+    cpu_set_t mask;
+
+    prctl (PR_GET_NAME, name, 0, 0, 0);
+    g_assert (sched_getaffinity (0, sizeof (cpu_set_t), &mask) == 0);
+
+    G_LOCK (arrivals);
+    g_hash_table_insert (arrivals.thread_names, g_strdup (name), NULL);
+    arrivals.max_cpus = MAX (arrivals.max_cpus, CPU_COUNT (&mask));
+    G_UNLOCK (arrivals);
+}
+
+static gboolean
+computer_process (UfoCpuTask *task, UfoBuffer **inputs, UfoBuffer *output, UfoRequisition *requisition)
+{
+    gfloat *in = ufo_buffer_get_host_array (inputs[0], NULL);
+    gfloat *out = ufo_buffer_get_host_array (output, NULL);
+    guint n_passes = ((guint) in[0]) < N_FRAMES / 2 ? CHEAP_PASSES : EXPENSIVE_PASSES;
+
+    if (arrivals.thread_names != NULL)
+        record_thread ();
+
+    memcpy (out, in, FRAME_SIZE * sizeof (gfloat));
+
+    /* Keep the frame number in the first element intact */
+    for (guint pass = 0; pass < n_passes; pass++) {
+        for (guint i = 1; i < FRAME_SIZE; i++)
+            out[i] = sqrtf (out[i] * out[i] + 1.0f);
+    }
+
+    return TRUE;
+}
+
+/* Add one to every element but the frame number */
+static void
+add_one (UfoBuffer *input, UfoBuffer *output)
+{
+    gfloat *in = ufo_buffer_get_host_array (input, NULL);
+    gfloat *out = ufo_buffer_get_host_array (output, NULL);
+    gsize n = ufo_buffer_get_size (input) / sizeof (gfloat);
+
+    g_assert_cmpuint (ufo_buffer_get_size (output), ==, ufo_buffer_get_size (input));
+    out[0] = in[0];
+
+    for (gsize i = 1; i < n; i++)
+        out[i] = in[i] + 1.0f;
+}
+
+static gboolean
+batcher_process (UfoCpuTask *task, UfoBuffer **inputs, UfoBuffer *output, UfoRequisition *requisition)
+{
+    add_one (inputs[0], output);
+    return TRUE;
+}
+
+static gboolean
+batcher_process_batch (UfoCpuTask *task, UfoBuffer **inputs, UfoBuffer **outputs,
+                       guint n_items, UfoRequisition *requisition)
+{
+    g_assert (n_items > 0 && n_items <= ((TestBatcher *) task)->batch_size);
+
+    for (guint i = 0; i < n_items; i++) {
+        UfoRequisition item;
+
+        /* All items of a batch share the requisition */
+        ufo_buffer_get_requisition (inputs[i], &item);
+        g_assert_cmpuint (item.dims[0], ==, requisition->dims[0]);
+        add_one (inputs[i], outputs[i]);
+    }
+
+    arrivals.n_batches++;
+    arrivals.max_batch = MAX (arrivals.max_batch, n_items);
+    return TRUE;
+}
+
+static gboolean
+in_place_process (UfoCpuTask *task, UfoBuffer **inputs, UfoBuffer *output, UfoRequisition *requisition)
+{
+    if (output == inputs[0])
+        arrivals.n_in_place++;
+
+    add_one (inputs[0], output);
+    return TRUE;
+}
+
+static gboolean
+in_place_can_process_in_place (UfoTask *task, guint input)
+{
+    return input == 0;
+}
+
+/* Enqueue a copy of the input on the node's queue and return its event */
+static cl_event
+enqueue_copy (UfoTask *task, UfoBuffer *input, UfoBuffer *output)
+{
+    UfoGpuNode *node;
+    cl_command_queue cmd_queue;
+    cl_mem in_mem;
+    cl_mem out_mem;
+    cl_event event;
+
+    node = UFO_GPU_NODE (ufo_task_node_get_proc_node (UFO_TASK_NODE (task)));
+    cmd_queue = ufo_gpu_node_get_cmd_queue (node);
+    in_mem = ufo_buffer_get_device_array (input, cmd_queue);
+    out_mem = ufo_buffer_get_device_array (output, cmd_queue);
+
+    g_assert_cmpint (clEnqueueCopyBuffer (cmd_queue, in_mem, out_mem, 0, 0,
+                                          ufo_buffer_get_size (input),
+                                          0, NULL, &event), ==, CL_SUCCESS);
+    return event;
+}
+
+static gboolean
+async_process (UfoGpuTask *task, UfoBuffer **inputs, UfoBuffer *output, UfoRequisition *requisition)
+{
+    cl_event event;
+
+    event = enqueue_copy (UFO_TASK (task), inputs[0], output);
+    g_assert_cmpint (clWaitForEvents (1, &event), ==, CL_SUCCESS);
+    g_assert_cmpint (clReleaseEvent (event), ==, CL_SUCCESS);
+    return TRUE;
+}
+
+static gboolean
+async_process_async (UfoGpuTask *task, UfoBuffer **inputs, UfoBuffer *output,
+                     UfoRequisition *requisition, gpointer *event)
+{
+    /* The scheduler takes over the event and keeps inputs until it completed */
+    *event = enqueue_copy (UFO_TASK (task), inputs[0], output);
+    arrivals.n_async++;
+    return TRUE;
+}
+
+static gboolean
+sink_process (UfoCpuTask *task, UfoBuffer **inputs, UfoBuffer *output, UfoRequisition *requisition)
+{
+    gfloat *data = ufo_buffer_get_host_array (inputs[0], NULL);
+    guint frame = (guint) data[0];
+
+    if (arrivals.fill) {
+        gsize n = ufo_buffer_get_size (inputs[0]) / sizeof (gfloat);
+
+        g_assert_cmpuint (n, ==, get_frame_size (frame));
+
+        for (gsize i = 1; i < n; i++)
+            g_assert_cmpfloat (data[i], ==, frame + arrivals.offset);
+    }
+
+    arrivals.in_order = arrivals.in_order && frame == arrivals.n_received;
+    arrivals.arrival[arrivals.n_received++ % N_FRAMES] = g_timer_elapsed (arrivals.timer, NULL);
+    return TRUE;
+}
+
+static gboolean
+collector_process (UfoCpuTask *task, UfoBuffer **inputs, UfoBuffer *output, UfoRequisition *requisition)
+{
+    TestCollector *collector = (TestCollector *) task;
+    gfloat *data = ufo_buffer_get_host_array (inputs[0], NULL);
+    gsize n = ufo_buffer_get_size (inputs[0]) / sizeof (gfloat);
+    guint frame = (guint) data[0];
+
+    for (gsize i = 1; i < n; i++)
+        g_assert_cmpfloat (data[i], ==, frame + arrivals.offset);
+
+    collector->in_order = collector->in_order && frame == collector->n_received;
+    collector->buffers[collector->n_received++ % N_FRAMES] = inputs[0];
+
+    /* Scribble over the frame so that anyone sharing the buffer notices */
+    for (gsize i = 1; i < n; i++)
+        data[i] = -1.0f;
+
+    return TRUE;
+}
+
+static void
+test_source_task_init (UfoTaskIface *iface)
+{
+    iface->setup = setup_nothing;
+    iface->get_structure = get_generator_structure;
+    iface->get_requisition = get_source_requisition;
+    iface->get_static_requisition = get_static_frame_requisition;
+}
+
+static void
+test_source_cpu_task_init (UfoCpuTaskIface *iface)
+{
+    iface->generate = source_generate;
+}
+
+static void
+test_worker_task_init (UfoTaskIface *iface)
+{
+    iface->setup = setup_nothing;
+    iface->get_structure = get_processor_structure;
+    iface->get_requisition = get_frame_requisition;
+    iface->get_static_requisition = get_static_input_requisition;
+}
+
+static void
+test_worker_cpu_task_init (UfoCpuTaskIface *iface)
+{
+    iface->process = worker_process;
+}
+
+static void
+test_computer_task_init (UfoTaskIface *iface)
+{
+    test_worker_task_init (iface);
+}
+
+static void
+test_computer_cpu_task_init (UfoCpuTaskIface *iface)
+{
+    iface->process = computer_process;
+}
+
+static guint
+batcher_get_batch_size (UfoTask *task)
+{
+    return ((TestBatcher *) task)->batch_size;
+}
+
+static void
+test_batcher_task_init (UfoTaskIface *iface)
+{
+    iface->setup = setup_nothing;
+    iface->get_structure = get_processor_structure;
+    iface->get_requisition = get_input_requisition;
+    iface->get_batch_size = batcher_get_batch_size;
+}
+
+static void
+test_batcher_cpu_task_init (UfoCpuTaskIface *iface)
+{
+    iface->process = batcher_process;
+    iface->process_batch = batcher_process_batch;
+}
+
+static void
+test_in_place_task_init (UfoTaskIface *iface)
+{
+    iface->setup = setup_nothing;
+    iface->get_structure = get_processor_structure;
+    iface->get_requisition = get_input_requisition;
+    iface->can_process_in_place = in_place_can_process_in_place;
+}
+
+static void
+test_in_place_cpu_task_init (UfoCpuTaskIface *iface)
+{
+    iface->process = in_place_process;
+}
+
+static void
+test_async_task_init (UfoTaskIface *iface)
+{
+    iface->setup = setup_nothing;
+    iface->get_structure = get_processor_structure;
+    iface->get_requisition = get_input_requisition;
+}
+
+static void
+test_async_gpu_task_init (UfoGpuTaskIface *iface)
+{
+    iface->process = async_process;
+    iface->process_async = async_process_async;
+}
+
+static void
+test_sink_task_init (UfoTaskIface *iface)
+{
+    iface->setup = setup_nothing;
+    iface->get_structure = get_processor_structure;
+    iface->get_requisition = get_no_requisition;
+    iface->get_static_requisition = get_static_no_requisition;
+}
+
+static void
+test_sink_cpu_task_init (UfoCpuTaskIface *iface)
+{
+    iface->process = sink_process;
+}
+
+static void
+test_collector_task_init (UfoTaskIface *iface)
+{
+    iface->setup = setup_nothing;
+    iface->get_structure = get_processor_structure;
+    iface->get_requisition = get_no_requisition;
+}
+
+static void
+test_collector_cpu_task_init (UfoCpuTaskIface *iface)
+{
+    iface->process = collector_process;
+}
+
+static void
+test_source_class_init (TestSourceClass *klass)
+{
+}
+
+static void
+test_source_init (TestSource *self)
+{
+    self->current = 0;
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-source");
+}
+
+static void
+test_worker_class_init (TestWorkerClass *klass)
+{
+}
+
+static void
+test_worker_init (TestWorker *self)
+{
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-worker");
+}
+
+static void
+test_computer_class_init (TestComputerClass *klass)
+{
+}
+
+static void
+test_computer_init (TestComputer *self)
+{
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-computer");
+}
+
+static void
+test_batcher_class_init (TestBatcherClass *klass)
+{
+}
+
+static void
+test_batcher_init (TestBatcher *self)
+{
+    self->batch_size = BATCH_SIZE;
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-batcher");
+}
+
+static void
+test_in_place_class_init (TestInPlaceClass *klass)
+{
+}
+
+static void
+test_in_place_init (TestInPlace *self)
+{
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-in-place");
+}
+
+static void
+test_async_class_init (TestAsyncClass *klass)
+{
+}
+
+static void
+test_async_init (TestAsync *self)
+{
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-async");
+}
+
+static void
+test_sink_class_init (TestSinkClass *klass)
+{
+}
+
+static void
+test_sink_init (TestSink *self)
+{
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-sink");
+}
+
+static void
+test_collector_class_init (TestCollectorClass *klass)
+{
+}
+
+static void
+test_collector_init (TestCollector *self)
+{
+    self->n_received = 0;
+    self->in_order = TRUE;
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (self), "test-collector");
+}
+
+/*
+ * Run source -> worker -> sink with up to @n_replicas workers of @worker_type
+ * and return the throughput in frames/s over the expensive second half of the
+ * stream.
+ */
+static gdouble
+run_changing_cost (GType worker_type,
+                   guint n_replicas,
+                   gboolean adaptive,
+                   UfoThreadPlacement placement)
+{
+    UfoConfig *config;
+    UfoScheduler *scheduler;
+    UfoTaskGraph *graph;
+    UfoTaskNode *source;
+    UfoTaskNode *worker;
+    UfoTaskNode *sink;
+    GError *error = NULL;
+    gdouble elapsed;
+
+    config = ufo_config_new ();
+    g_object_set (config,
+                  "cpu-replicas", n_replicas,
+                  "thread-placement", placement,
+                  NULL);
+    scheduler = ufo_scheduler_new (config, NULL);
+    g_object_set (scheduler, "adaptive", adaptive, NULL);
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    source = UFO_TASK_NODE (g_object_new (test_source_get_type (), NULL));
+    worker = UFO_TASK_NODE (g_object_new (worker_type, NULL));
+    sink = UFO_TASK_NODE (g_object_new (test_sink_get_type (), NULL));
+    ufo_task_graph_connect_nodes (graph, source, worker);
+    ufo_task_graph_connect_nodes (graph, worker, sink);
+
+    arrivals.n_received = 0;
+    arrivals.n_requisitions = 0;
+    arrivals.in_order = TRUE;
+    arrivals.consumer = UFO_TASK (worker);
+    arrivals.timer = g_timer_new ();
+
+    ufo_scheduler_run (scheduler, graph, &error);
+    g_assert_no_error (error);
+    arrivals.consumer = NULL;
+    g_object_get (scheduler, "max-active-replicas", &arrivals.max_active_replicas, NULL);
+
+    /* Replicas must neither lose nor reorder frames */
+    g_assert_cmpuint (arrivals.n_received, ==, N_FRAMES);
+    g_assert (arrivals.in_order);
+
+    elapsed = arrivals.arrival[N_FRAMES - 1] - arrivals.arrival[N_FRAMES / 2];
+
+    g_timer_destroy (arrivals.timer);
+    g_object_unref (source);
+    g_object_unref (worker);
+    g_object_unref (sink);
+    g_object_unref (graph);
+    g_object_unref (scheduler);
+    g_object_unref (config);
+
+    return (N_FRAMES / 2 - 1) / elapsed;
+}
+
+static void
+test_adaptive_replicas (void)
+{
+    /* run_changing_cost() checks that every frame arrives once and in order */
+    run_changing_cost (test_worker_get_type (), 4, TRUE, UFO_THREAD_PLACEMENT_NONE);
+
+    /* The expensive second half must have resumed parked replicas */
+    g_assert_cmpuint (arrivals.max_active_replicas, >, 1);
+    g_assert_cmpuint (arrivals.max_active_replicas, <=, 4);
+}
+
+static void
+test_adaptive_replicas_benchmark (void)
+{
+    gdouble single;
+    gdouble fixed;
+    gdouble adaptive;
+
+    if (!g_test_perf ())
+        return;
+
+    single = run_changing_cost (test_worker_get_type (), 1, FALSE, UFO_THREAD_PLACEMENT_NONE);
+    fixed = run_changing_cost (test_worker_get_type (), 4, FALSE, UFO_THREAD_PLACEMENT_NONE);
+    adaptive = run_changing_cost (test_worker_get_type (), 4, TRUE, UFO_THREAD_PLACEMENT_NONE);
+
+    g_test_maximized_result (adaptive, "adaptive replicas: %.1f frames/s after cost change", adaptive);
+    g_test_message ("single worker: %.1f frames/s, four fixed workers: %.1f frames/s",
+                    single, fixed);
+}
+
+static gint
+compare_doubles (gconstpointer a, gconstpointer b)
+{
+    gdouble x = *((const gdouble *) a);
+    gdouble y = *((const gdouble *) b);
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void
+measure_throughput (UfoThreadPlacement placement,
+                    gdouble *mean,
+                    gdouble *deviation)
+{
+    gdouble rates[N_RUNS];
+
+    *mean = 0.0;
+    *deviation = 0.0;
+
+    for (guint i = 0; i < N_RUNS; i++) {
+        rates[i] = run_changing_cost (test_computer_get_type (), 4, FALSE, placement);
+        *mean += rates[i] / N_RUNS;
+    }
+
+    for (guint i = 0; i < N_RUNS; i++)
+        *deviation += (rates[i] - *mean) * (rates[i] - *mean) / N_RUNS;
+
+    *deviation = sqrt (*deviation);
+}
+
+static void
+test_thread_placement (void)
+{
+    arrivals.thread_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    arrivals.max_cpus = 0;
+
+    run_changing_cost (test_computer_get_type (), 2, FALSE, UFO_THREAD_PLACEMENT_COMPACT);
+
+    /* Threads are named after their plugin, copies truncated with their index */
+    g_assert (g_hash_table_lookup_extended (arrivals.thread_names, "test-computer", NULL, NULL));
+    g_assert (g_hash_table_lookup_extended (arrivals.thread_names, "test-compu:1", NULL, NULL));
+    g_assert_cmpint (arrivals.max_cpus, ==, 1);
+
+    g_hash_table_destroy (arrivals.thread_names);
+    arrivals.thread_names = NULL;
+}
+
+static void
+test_thread_placement_benchmark (void)
+{
+    gdouble pinned_mean;
+    gdouble pinned_deviation;
+    gdouble free_mean;
+    gdouble free_deviation;
+
+    if (!g_test_perf ())
+        return;
+
+    measure_throughput (UFO_THREAD_PLACEMENT_NONE, &free_mean, &free_deviation);
+    measure_throughput (UFO_THREAD_PLACEMENT_COMPACT, &pinned_mean, &pinned_deviation);
+
+    g_test_minimized_result (pinned_deviation / pinned_mean,
+                             "pinned: %.1f frames/s, relative deviation %.3f",
+                             pinned_mean, pinned_deviation / pinned_mean);
+    g_test_message ("unpinned: %.1f frames/s, relative deviation %.3f",
+                    free_mean, free_deviation / free_mean);
+}
+
+/*
+ * Run source -> @task -> sink with the default configuration and return the
+ * elapsed time in seconds. @task is consumed.
+ */
+static gdouble
+run_through (UfoTaskNode *task)
+{
+    UfoConfig *config;
+    UfoScheduler *scheduler;
+    UfoTaskGraph *graph;
+    UfoTaskNode *source;
+    UfoTaskNode *sink;
+    GError *error = NULL;
+    gdouble elapsed;
+
+    config = ufo_config_new ();
+    scheduler = ufo_scheduler_new (config, NULL);
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    source = UFO_TASK_NODE (g_object_new (test_source_get_type (), NULL));
+    sink = UFO_TASK_NODE (g_object_new (test_sink_get_type (), NULL));
+    ufo_task_graph_connect_nodes (graph, source, task);
+    ufo_task_graph_connect_nodes (graph, task, sink);
+
+    arrivals.n_received = 0;
+    arrivals.n_batches = 0;
+    arrivals.max_batch = 0;
+    arrivals.n_in_place = 0;
+    arrivals.n_async = 0;
+    arrivals.in_order = TRUE;
+    arrivals.timer = g_timer_new ();
+
+    ufo_scheduler_run (scheduler, graph, &error);
+    g_assert_no_error (error);
+    elapsed = g_timer_elapsed (arrivals.timer, NULL);
+
+    g_assert_cmpuint (arrivals.n_received, ==, arrivals.n_frames > 0 ? arrivals.n_frames : N_FRAMES);
+    g_assert (arrivals.in_order);
+
+    g_timer_destroy (arrivals.timer);
+    g_object_unref (source);
+    g_object_unref (task);
+    g_object_unref (sink);
+    g_object_unref (graph);
+    g_object_unref (scheduler);
+    g_object_unref (config);
+
+    return elapsed;
+}
+
+static void
+test_batched (void)
+{
+    guint n_runs = N_FRAMES / SIZE_RUN;
+    guint rest = N_FRAMES % SIZE_RUN;
+
+    arrivals.fill = TRUE;
+    arrivals.mixed_sizes = TRUE;
+    arrivals.offset = 1.0f;
+
+    run_through (UFO_TASK_NODE (g_object_new (test_batcher_get_type (), NULL)));
+
+    /* A size change ends a batch, so every run splits into a full and a partial batch */
+    g_assert_cmpuint (arrivals.max_batch, ==, BATCH_SIZE);
+    g_assert_cmpuint (arrivals.n_batches, ==,
+                      n_runs * ((SIZE_RUN + BATCH_SIZE - 1) / BATCH_SIZE) +
+                      (rest + BATCH_SIZE - 1) / BATCH_SIZE);
+
+    arrivals.fill = FALSE;
+    arrivals.mixed_sizes = FALSE;
+    arrivals.offset = 0.0f;
+}
+
+static gdouble
+run_small_frames (guint batch_size)
+{
+    TestBatcher *batcher;
+    gdouble elapsed;
+
+    batcher = g_object_new (test_batcher_get_type (), NULL);
+    batcher->batch_size = batch_size;
+
+    arrivals.n_frames = N_SMALL_FRAMES;
+    arrivals.frame_size = SMALL_FRAME;
+    elapsed = run_through (UFO_TASK_NODE (batcher));
+    arrivals.n_frames = 0;
+    arrivals.frame_size = 0;
+
+    return N_SMALL_FRAMES / elapsed;
+}
+
+static void
+test_batched_benchmark (void)
+{
+    gdouble single;
+    gdouble batched;
+
+    if (!g_test_perf ())
+        return;
+
+    single = run_small_frames (1);
+    batched = run_small_frames (16);
+
+    g_test_maximized_result (batched / single,
+                             "batches of 16: %.0f frames/s, %.2fx unbatched", batched, batched / single);
+    g_test_message ("unbatched: %.0f frames/s of %u elements", single, SMALL_FRAME);
+}
+
+static void
+test_in_place (void)
+{
+    arrivals.fill = TRUE;
+    arrivals.offset = 1.0f;
+
+    run_through (UFO_TASK_NODE (g_object_new (test_in_place_get_type (), NULL)));
+
+    /* With a single consumer every frame is written into the input buffer */
+    g_assert_cmpuint (arrivals.n_in_place, ==, N_FRAMES);
+
+    arrivals.fill = FALSE;
+    arrivals.offset = 0.0f;
+}
+
+static void
+test_in_place_fan_out (void)
+{
+    UfoConfig *config;
+    UfoScheduler *scheduler;
+    UfoTaskGraph *graph;
+    UfoTaskNode *source;
+    UfoTaskNode *in_place;
+    TestCollector *first;
+    TestCollector *second;
+    GError *error = NULL;
+
+    config = ufo_config_new ();
+    scheduler = ufo_scheduler_new (config, NULL);
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    source = UFO_TASK_NODE (g_object_new (test_source_get_type (), NULL));
+    in_place = UFO_TASK_NODE (g_object_new (test_in_place_get_type (), NULL));
+    first = g_object_new (test_collector_get_type (), NULL);
+    second = g_object_new (test_collector_get_type (), NULL);
+    ufo_task_graph_connect_nodes (graph, source, in_place);
+    ufo_task_graph_connect_nodes (graph, in_place, UFO_TASK_NODE (first));
+    ufo_task_graph_connect_nodes (graph, in_place, UFO_TASK_NODE (second));
+
+    arrivals.fill = TRUE;
+    arrivals.offset = 1.0f;
+    arrivals.n_in_place = 0;
+    arrivals.timer = g_timer_new ();
+
+    ufo_scheduler_run (scheduler, graph, &error);
+    g_assert_no_error (error);
+
+    /* Two consumers cannot share the input, each must get its own buffer */
+    g_assert_cmpuint (arrivals.n_in_place, ==, 0);
+    g_assert_cmpuint (first->n_received, ==, N_FRAMES);
+    g_assert_cmpuint (second->n_received, ==, N_FRAMES);
+    g_assert (first->in_order && second->in_order);
+
+    for (guint i = 0; i < N_FRAMES; i++)
+        g_assert (first->buffers[i] != second->buffers[i]);
+
+    arrivals.fill = FALSE;
+    arrivals.offset = 0.0f;
+
+    g_timer_destroy (arrivals.timer);
+    g_object_unref (source);
+    g_object_unref (in_place);
+    g_object_unref (first);
+    g_object_unref (second);
+    g_object_unref (graph);
+    g_object_unref (scheduler);
+    g_object_unref (config);
+}
+
+static void
+test_async (void)
+{
+    /* The sink checks the copied values, run_through() their count and order */
+    arrivals.fill = TRUE;
+    arrivals.mixed_sizes = TRUE;
+
+    run_through (UFO_TASK_NODE (g_object_new (test_async_get_type (), NULL)));
+    g_assert_cmpuint (arrivals.n_async, ==, N_FRAMES);
+
+    arrivals.fill = FALSE;
+    arrivals.mixed_sizes = FALSE;
+}
+
+/* Return the latency of the first frame relative to the median of the rest */
+static gdouble
+run_first_frame (gboolean static_shapes)
+{
+    gdouble latencies[N_FRAMES / 2];
+    gdouble first;
+    guint n = N_FRAMES / 2;
+
+    arrivals.static_shapes = static_shapes;
+    run_changing_cost (test_worker_get_type (), 1, FALSE, UFO_THREAD_PLACEMENT_NONE);
+    arrivals.static_shapes = FALSE;
+
+    /* Only look at the cheap first half to keep the cost constant */
+    for (guint i = 0; i < n; i++)
+        latencies[i] = arrivals.arrival[i] - arrivals.generated[i];
+
+    first = latencies[0];
+    qsort (latencies + 1, n - 1, sizeof (gdouble), compare_doubles);
+    return first / latencies[n / 2];
+}
+
+static void
+test_static_shapes (void)
+{
+    /* Without static shapes buffers are allocated as the stream needs them */
+    run_changing_cost (test_worker_get_type (), 1, FALSE, UFO_THREAD_PLACEMENT_NONE);
+    g_assert_cmpint (arrivals.n_requisitions, >, 0);
+    g_assert_cmpuint (arrivals.n_allocated, <, arrivals.capacity);
+
+    /*
+     * The source's shape is constant, the worker's is inferred from it and the
+     * sink produces nothing, so get_requisition() is never called and the
+     * source's buffers exist before its first frame.
+     */
+    arrivals.static_shapes = TRUE;
+    run_changing_cost (test_worker_get_type (), 1, FALSE, UFO_THREAD_PLACEMENT_NONE);
+    arrivals.static_shapes = FALSE;
+
+    g_assert_cmpint (arrivals.n_requisitions, ==, 0);
+    g_assert_cmpuint (arrivals.n_allocated, ==, arrivals.capacity);
+}
+
+static void
+test_static_shapes_benchmark (void)
+{
+    gdouble dynamic_ratio;
+    gdouble static_ratio;
+
+    if (!g_test_perf ())
+        return;
+
+    dynamic_ratio = run_first_frame (FALSE);
+    static_ratio = run_first_frame (TRUE);
+
+    g_test_minimized_result (static_ratio,
+                             "static shapes: first frame latency %.2fx the median", static_ratio);
+    g_test_message ("dynamic shapes: first frame latency %.2fx the median", dynamic_ratio);
+}
+
+void
+test_add_scheduler (void)
+{
+    g_test_add_func ("/scheduler/adaptive-replicas",
+                     test_adaptive_replicas);
+
+    g_test_add_func ("/scheduler/adaptive-replicas/benchmark",
+                     test_adaptive_replicas_benchmark);
+
+    g_test_add_func ("/scheduler/thread-placement",
+                     test_thread_placement);
+
+    g_test_add_func ("/scheduler/thread-placement/benchmark",
+                     test_thread_placement_benchmark);
+
+    g_test_add_func ("/scheduler/static-shapes",
+                     test_static_shapes);
+
+    g_test_add_func ("/scheduler/static-shapes/benchmark",
+                     test_static_shapes_benchmark);
+
+    g_test_add_func ("/scheduler/batched",
+                     test_batched);
+
+    g_test_add_func ("/scheduler/batched/benchmark",
+                     test_batched_benchmark);
+
+    g_test_add_func ("/scheduler/async",
+                     test_async);
+
+    g_test_add_func ("/scheduler/in-place",
+                     test_in_place);
+
+    g_test_add_func ("/scheduler/in-place/fan-out",
+                     test_in_place_fan_out);
+}
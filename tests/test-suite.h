@@ -1,11 +1,14 @@
 #ifndef TEST_SUITE_H
 #define TEST_SUITE_H
 
+void test_add_basic_ops (void);
 void test_add_buffer (void);
 void test_add_config (void);
 void test_add_graph (void);
 void test_add_profiler (void);
 void test_add_remote_node (void);
+void test_add_resources (void);
+void test_add_scheduler (void);
 void test_add_mpi_remote_node (void);
 void test_add_zmq_messenger (void);
 
@@ -20,6 +20,7 @@
 #define _GNU_SOURCE
 #include <sys/sysinfo.h>
 #include <sched.h>
+#include <stdlib.h>
 #include <zmq.h>
 #include <ufo/ufo-arch-graph.h>
 #include <ufo/ufo-cpu-node.h>
@@ -47,6 +48,37 @@ struct _UfoArchGraphPrivate {
     guint n_remotes;
 };
 
+/* ACPI SLIT distance of a node to itself */
+#define LOCAL_DISTANCE  10
+
+static guint
+read_numa_distance (gint from,
+                    gint to)
+{
+    gchar *filename;
+    gchar *contents;
+    guint distance = LOCAL_DISTANCE;
+
+    /* Without topology information every path is considered local */
+    if (from < 0 || to < 0)
+        return LOCAL_DISTANCE;
+
+    filename = g_strdup_printf ("/sys/devices/system/node/node%i/distance", from);
+
+    if (g_file_get_contents (filename, &contents, NULL, NULL)) {
+        gchar **distances = g_strsplit_set (g_strstrip (contents), " \t", -1);
+
+        if ((guint) to < g_strv_length (distances))
+            distance = (guint) atoi (distances[to]);
+
+        g_strfreev (distances);
+        g_free (contents);
+    }
+
+    g_free (filename);
+    return distance;
+}
+
 /**
  * ufo_arch_graph_new:
  * @resources: An initialized #UfoResources object
@@ -101,15 +133,20 @@ ufo_arch_graph_new (UfoResources *resources,
     }
 
     /*
-     * Connect all CPUs to all GPUs. In the future this is the place for a
-     * NUMA-specific mapping.
+     * Connect all CPUs to all GPUs. Each edge is labeled with the NUMA
+     * distance between the memory node of the CPU and the node that the GPU
+     * is attached to.
      */
     for (guint i = 0; i < priv->n_cpus; i++) {
+        gint cpu_numa_node = ufo_cpu_node_get_numa_node (UFO_CPU_NODE (priv->cpu_nodes[i]));
+
         for (guint j = 0; j < priv->n_gpus; j++) {
+            gint gpu_numa_node = ufo_gpu_node_get_numa_node (UFO_GPU_NODE (priv->gpu_nodes[j]));
+
             ufo_graph_connect_nodes (UFO_GRAPH (graph),
                                      priv->cpu_nodes[i],
                                      priv->gpu_nodes[j],
-                                     NULL);
+                                     GUINT_TO_POINTER (read_numa_distance (cpu_numa_node, gpu_numa_node)));
         }
 
         for (guint j = 0; j < priv->n_remotes; j++) {
@@ -184,6 +221,105 @@ ufo_arch_graph_get_gpu_nodes (UfoArchGraph *graph)
                                          NULL);
 }
 
+/**
+ * ufo_arch_graph_get_cpu_nodes:
+ * @graph: A #UfoArchGraph
+ *
+ * Returns: (element-type UfoCpuNode) (transfer container): A list of
+ * #UfoCpuNode elements in @graph, ordered by CPU number.
+ */
+GList *
+ufo_arch_graph_get_cpu_nodes (UfoArchGraph *graph)
+{
+    GList *nodes = NULL;
+
+    g_return_val_if_fail (UFO_IS_ARCH_GRAPH (graph), NULL);
+
+    for (guint i = 0; i < graph->priv->n_cpus; i++)
+        nodes = g_list_append (nodes, graph->priv->cpu_nodes[i]);
+
+    return nodes;
+}
+
+/**
+ * ufo_arch_graph_get_distance:
+ * @graph: A #UfoArchGraph
+ * @cpu_node: A #UfoCpuNode of @graph
+ * @gpu_node: A #UfoGpuNode of @graph
+ *
+ * Get the NUMA distance between the memory local to @cpu_node and the PCI root
+ * complex of @gpu_node as reported by the firmware. Local access has distance
+ * 10, if the topology is unknown all pairs are local.
+ *
+ * Returns: Relative distance between @cpu_node and @gpu_node.
+ */
+guint
+ufo_arch_graph_get_distance (UfoArchGraph *graph,
+                             UfoCpuNode *cpu_node,
+                             UfoGpuNode *gpu_node)
+{
+    g_return_val_if_fail (UFO_IS_ARCH_GRAPH (graph), LOCAL_DISTANCE);
+    return GPOINTER_TO_UINT (ufo_graph_get_edge_label (UFO_GRAPH (graph),
+                                                       UFO_NODE (cpu_node),
+                                                       UFO_NODE (gpu_node)));
+}
+
+/**
+ * ufo_arch_graph_get_local_cpu_nodes:
+ * @graph: A #UfoArchGraph
+ * @gpu_node: A #UfoGpuNode of @graph
+ *
+ * Get the CPUs that should feed @gpu_node. These are the CPUs with the
+ * smallest NUMA distance to @gpu_node. If all CPUs are equally far away, they
+ * are split evenly among the GPUs in device order.
+ *
+ * Returns: (element-type UfoCpuNode) (transfer container): A list of
+ * #UfoCpuNode elements close to @gpu_node.
+ */
+GList *
+ufo_arch_graph_get_local_cpu_nodes (UfoArchGraph *graph,
+                                    UfoGpuNode *gpu_node)
+{
+    UfoArchGraphPrivate *priv;
+    GList *nodes = NULL;
+    guint first = 0;
+    guint last;
+    guint min_distance = G_MAXUINT;
+    guint max_distance = 0;
+
+    g_return_val_if_fail (UFO_IS_ARCH_GRAPH (graph), NULL);
+    priv = graph->priv;
+    last = priv->n_cpus;
+
+    for (guint i = 0; i < priv->n_cpus; i++) {
+        guint distance = ufo_arch_graph_get_distance (graph, UFO_CPU_NODE (priv->cpu_nodes[i]), gpu_node);
+
+        min_distance = MIN (min_distance, distance);
+        max_distance = MAX (max_distance, distance);
+    }
+
+    if (min_distance < max_distance) {
+        for (guint i = 0; i < priv->n_cpus; i++) {
+            if (ufo_arch_graph_get_distance (graph, UFO_CPU_NODE (priv->cpu_nodes[i]), gpu_node) == min_distance)
+                nodes = g_list_append (nodes, priv->cpu_nodes[i]);
+        }
+
+        return nodes;
+    }
+
+    for (guint i = 0; i < priv->n_gpus; i++) {
+        if (priv->gpu_nodes[i] == UFO_NODE (gpu_node) && priv->n_cpus >= priv->n_gpus) {
+            first = i * priv->n_cpus / priv->n_gpus;
+            last = (i + 1) * priv->n_cpus / priv->n_gpus;
+        }
+    }
+
+    for (guint i = first; i < last; i++)
+        nodes = g_list_append (nodes, priv->cpu_nodes[i]);
+
+    return nodes;
+}
+
 static gboolean
 is_remote_node (UfoNode *node, gpointer user_data)
 {
@@ -26,6 +26,8 @@
 
 #include <ufo/ufo-graph.h>
 #include <ufo/ufo-resources.h>
+#include <ufo/ufo-cpu-node.h>
+#include <ufo/ufo-gpu-node.h>
 
 G_BEGIN_DECLS
 
@@ -69,7 +71,14 @@ UfoGraph    *ufo_arch_graph_new              (UfoResources   *resources,
 guint        ufo_arch_graph_get_num_cpus     (UfoArchGraph   *graph);
 guint        ufo_arch_graph_get_num_gpus     (UfoArchGraph   *graph);
 guint        ufo_arch_graph_get_num_remotes  (UfoArchGraph   *graph);
+GList       *ufo_arch_graph_get_cpu_nodes    (UfoArchGraph   *graph);
 GList       *ufo_arch_graph_get_gpu_nodes    (UfoArchGraph   *graph);
+GList       *ufo_arch_graph_get_local_cpu_nodes
+                                             (UfoArchGraph   *graph,
+                                              UfoGpuNode     *gpu_node);
+guint        ufo_arch_graph_get_distance     (UfoArchGraph   *graph,
+                                              UfoCpuNode     *cpu_node,
+                                              UfoGpuNode     *gpu_node);
 GList       *ufo_arch_graph_get_remote_nodes (UfoArchGraph   *graph);
 GType        ufo_arch_graph_get_type         (void);
 
@@ -5,7 +5,16 @@
 #endif
 
 #include <math.h>
+#include <string.h>
+#include <sys/sysinfo.h>
 #include <ufo/ufo-basic-ops.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 #define OPS_FILENAME "ufo-basic-ops.cl"
 
 static cl_event
@@ -16,666 +25,3396 @@ operation (const gchar *kernel_name,
            UfoResources *resources,
            gpointer command_queue);
 
-static cl_event
-operation2 (const gchar *kernel_name,
-            UfoBuffer *arg1,
-            UfoBuffer *arg2,
-            gfloat modifier,
-            UfoBuffer *out,
-            UfoResources *resources,
-            gpointer command_queue);
+static cl_event
+operation2 (const gchar *kernel_name,
+            UfoBuffer *arg1,
+            UfoBuffer *arg2,
+            gfloat modifier,
+            UfoBuffer *out,
+            UfoResources *resources,
+            gpointer command_queue);
+
+/*
+ * Host backend. Operations run on the host arrays if no command queue is
+ * given or if all inputs already live in host memory. In the latter case a
+ * completed event is returned like for device operations. Inner loops use
+ * SSE/AVX depending on the compiler flags and large buffers are split by rows
+ * across the threads of a shared pool.
+ */
+#if defined(__AVX__)
+#define HOST_VECTOR_SIZE            8
+typedef __m256 HostVector;
+#define host_vector_load(p)         _mm256_loadu_ps (p)
+#define host_vector_store(p, v)     _mm256_storeu_ps ((p), (v))
+#define host_vector_set(x)          _mm256_set1_ps (x)
+#define host_vector_add(a, b)       _mm256_add_ps ((a), (b))
+#define host_vector_mul(a, b)       _mm256_mul_ps ((a), (b))
+#define host_vector_max(a, b)       _mm256_max_ps ((a), (b))
+#elif defined(__SSE__)
+#define HOST_VECTOR_SIZE            4
+typedef __m128 HostVector;
+#define host_vector_load(p)         _mm_loadu_ps (p)
+#define host_vector_store(p, v)     _mm_storeu_ps ((p), (v))
+#define host_vector_set(x)          _mm_set1_ps (x)
+#define host_vector_add(a, b)       _mm_add_ps ((a), (b))
+#define host_vector_mul(a, b)       _mm_mul_ps ((a), (b))
+#define host_vector_max(a, b)       _mm_max_ps ((a), (b))
+#endif
+
+#define HOST_PARALLEL_THRESHOLD     (1 << 18)
+#define HOST_MAX_THREADS            16
+
+typedef struct {
+    const gfloat *a;
+    const gfloat *b;
+    gfloat       *out;
+    gfloat        value;
+    gsize         width;
+    gsize         height;
+    gpointer      user_data;
+} HostJob;
+
+typedef void (*HostRowFunc) (HostJob *job, gsize first_row, gsize last_row);
+
+typedef struct {
+    GMutex      *lock;
+    GCond       *cond;
+    guint        n_pending;
+} HostBarrier;
+
+typedef struct {
+    HostRowFunc  func;
+    HostJob     *job;
+    gsize        first_row;
+    gsize        last_row;
+    HostBarrier *barrier;
+} HostChunk;
+
+static gboolean
+use_host (UfoResources *resources,
+          gpointer command_queue,
+          UfoBuffer *arg1,
+          UfoBuffer *arg2)
+{
+    if (resources == NULL || command_queue == NULL)
+        return TRUE;
+
+    if (ufo_buffer_get_location (arg1) != UFO_BUFFER_LOCATION_HOST)
+        return FALSE;
+
+    return arg2 == NULL || ufo_buffer_get_location (arg2) == UFO_BUFFER_LOCATION_HOST;
+}
+
+static void
+host_job_init (HostJob *job,
+               UfoBuffer *arg1,
+               UfoBuffer *arg2,
+               UfoBuffer *out)
+{
+    UfoRequisition requisition;
+
+    ufo_buffer_get_requisition (out, &requisition);
+    job->width = requisition.n_dims > 0 ? requisition.dims[0] : 1;
+    job->height = 1;
+
+    for (guint i = 1; i < requisition.n_dims; i++)
+        job->height *= requisition.dims[i];
+
+    job->a = arg1 != NULL ? ufo_buffer_get_host_array (arg1, NULL) : NULL;
+    job->b = arg2 != NULL ? ufo_buffer_get_host_array (arg2, NULL) : NULL;
+    job->out = ufo_buffer_get_host_array (out, NULL);
+    job->value = 0.0f;
+    job->user_data = NULL;
+}
+
+static void
+host_run_chunk (HostChunk *chunk)
+{
+    chunk->func (chunk->job, chunk->first_row, chunk->last_row);
+}
+
+static void
+host_pool_run (HostChunk *chunk, gpointer unused)
+{
+    HostBarrier *barrier = chunk->barrier;
+
+    host_run_chunk (chunk);
+
+    g_mutex_lock (barrier->lock);
+
+    if (--barrier->n_pending == 0)
+        g_cond_signal (barrier->cond);
+
+    g_mutex_unlock (barrier->lock);
+}
+
+/*
+ * The pool is shared by all operations and lives as long as the process, so
+ * large host operations do not pay for creating threads on every call. The
+ * calling thread always processes the first chunk itself.
+ */
+static GThreadPool *
+get_host_pool (guint n_threads)
+{
+    static GThreadPool *pool = NULL;
+    static gboolean initialized = FALSE;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    g_static_mutex_lock (&mutex);
+
+    if (!initialized) {
+        if (n_threads > 1)
+            pool = g_thread_pool_new ((GFunc) host_pool_run, NULL, (gint) n_threads - 1, FALSE, NULL);
+
+        initialized = TRUE;
+    }
+
+    g_static_mutex_unlock (&mutex);
+    return pool;
+}
+
+static void
+host_run (HostRowFunc func, HostJob *job)
+{
+    HostChunk chunks[HOST_MAX_THREADS];
+    HostBarrier barrier;
+    GThreadPool *pool;
+    guint n_threads;
+
+    n_threads = MIN ((guint) get_nprocs (), HOST_MAX_THREADS);
+    pool = get_host_pool (n_threads);
+
+    if (pool == NULL || job->width * job->height < HOST_PARALLEL_THRESHOLD || job->height < n_threads)
+        n_threads = 1;
+
+    for (guint i = 0; i < n_threads; i++) {
+        chunks[i].func = func;
+        chunks[i].job = job;
+        chunks[i].first_row = job->height * i / n_threads;
+        chunks[i].last_row = job->height * (i + 1) / n_threads;
+        chunks[i].barrier = &barrier;
+    }
+
+    if (n_threads == 1) {
+        host_run_chunk (&chunks[0]);
+        return;
+    }
+
+    barrier.lock = g_mutex_new ();
+    barrier.cond = g_cond_new ();
+    barrier.n_pending = n_threads - 1;
+
+    for (guint i = 1; i < n_threads; i++)
+        g_thread_pool_push (pool, &chunks[i], NULL);
+
+    host_run_chunk (&chunks[0]);
+
+    g_mutex_lock (barrier.lock);
+
+    while (barrier.n_pending > 0)
+        g_cond_wait (barrier.cond, barrier.lock);
+
+    g_mutex_unlock (barrier.lock);
+    g_mutex_free (barrier.lock);
+    g_cond_free (barrier.cond);
+}
+
+static void
+host_set_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    gfloat *out = job->out + first_row * job->width;
+    gsize n = (last_row - first_row) * job->width;
+    gsize i = 0;
+
+#ifdef HOST_VECTOR_SIZE
+    HostVector value = host_vector_set (job->value);
+
+    for (; i + HOST_VECTOR_SIZE <= n; i += HOST_VECTOR_SIZE)
+        host_vector_store (out + i, value);
+#endif
+
+    for (; i < n; i++)
+        out[i] = job->value;
+}
+
+static void
+host_inv_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    gsize last = last_row * job->width;
+
+    for (gsize i = first_row * job->width; i < last; i++)
+        job->out[i] = job->a[i] != 0.0f ? 1.0f / job->a[i] : 0.0f;
+}
+
+static void
+host_mul_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    gsize offset = first_row * job->width;
+    const gfloat *a = job->a + offset;
+    const gfloat *b = job->b + offset;
+    gfloat *out = job->out + offset;
+    gsize n = (last_row - first_row) * job->width;
+    gsize i = 0;
+
+#ifdef HOST_VECTOR_SIZE
+    for (; i + HOST_VECTOR_SIZE <= n; i += HOST_VECTOR_SIZE)
+        host_vector_store (out + i, host_vector_mul (host_vector_load (a + i), host_vector_load (b + i)));
+#endif
+
+    for (; i < n; i++)
+        out[i] = a[i] * b[i];
+}
+
+/* out = a + value * b, which also covers add and deduction */
+static void
+host_axpy_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    gsize offset = first_row * job->width;
+    const gfloat *a = job->a + offset;
+    const gfloat *b = job->b + offset;
+    gfloat *out = job->out + offset;
+    gsize n = (last_row - first_row) * job->width;
+    gsize i = 0;
+
+#ifdef HOST_VECTOR_SIZE
+    HostVector modifier = host_vector_set (job->value);
+
+    for (; i + HOST_VECTOR_SIZE <= n; i += HOST_VECTOR_SIZE) {
+        HostVector scaled = host_vector_mul (modifier, host_vector_load (b + i));
+        host_vector_store (out + i, host_vector_add (host_vector_load (a + i), scaled));
+    }
+#endif
+
+    for (; i < n; i++)
+        out[i] = a[i] + job->value * b[i];
+}
+
+static void
+host_posc_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    gsize offset = first_row * job->width;
+    const gfloat *a = job->a + offset;
+    gfloat *out = job->out + offset;
+    gsize n = (last_row - first_row) * job->width;
+    gsize i = 0;
+
+#ifdef HOST_VECTOR_SIZE
+    HostVector zero = host_vector_set (0.0f);
+
+    for (; i + HOST_VECTOR_SIZE <= n; i += HOST_VECTOR_SIZE)
+        host_vector_store (out + i, host_vector_max (host_vector_load (a + i), zero));
+#endif
+
+    for (; i < n; i++)
+        out[i] = a[i] > 0.0f ? a[i] : 0.0f;
+}
+
+/* Clamp-to-edge access like imageSampler2 */
+static inline gfloat
+host_pixel (const gfloat *data, HostJob *job, gssize x, gssize y)
+{
+    x = CLAMP (x, 0, (gssize) job->width - 1);
+    y = CLAMP (y, 0, (gssize) job->height - 1);
+    return data[y * job->width + x];
+}
+
+static inline gfloat
+host_gradient_magnitude (const gfloat *data, HostJob *job, gssize x, gssize y)
+{
+    gfloat cell = host_pixel (data, job, x, y);
+    gfloat d1 = host_pixel (data, job, x + 1, y) - cell;
+    gfloat d2 = host_pixel (data, job, x - 1, y) - cell;
+    gfloat d3 = host_pixel (data, job, x, y + 1) - cell;
+    gfloat d4 = host_pixel (data, job, x, y - 1) - cell;
+
+    return sqrtf ((d1 * d1 + d2 * d2 + d3 * d3 + d4 * d4) / 2.0f);
+}
+
+static void
+host_gradient_magnitude_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    for (gsize y = first_row; y < last_row; y++) {
+        for (gsize x = 0; x < job->width; x++)
+            job->out[y * job->width + x] = host_gradient_magnitude (job->a, job, x, y);
+    }
+}
+
+/* job->b holds the magnitudes computed by ufo_op_gradient_magnitudes() */
+static void
+host_gradient_direction_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    static const gint dx[5] = { 0, 1, -1, 0, 0 };
+    static const gint dy[5] = { 0, 0, 0, 1, -1 };
+
+    for (gsize y = first_row; y < last_row; y++) {
+        for (gsize x = 0; x < job->width; x++) {
+            gfloat values[5];
+            gfloat magnitudes[5];
+            gfloat direction = 0.0f;
+
+            for (guint i = 0; i < 5; i++) {
+                values[i] = host_pixel (job->a, job, (gssize) x + dx[i], (gssize) y + dy[i]);
+                magnitudes[i] = host_pixel (job->b, job, (gssize) x + dx[i], (gssize) y + dy[i]);
+            }
+
+            if (magnitudes[0] != 0.0f)
+                direction += (4 * values[0] - values[1] - values[2] - values[3] - values[4]) / magnitudes[0];
+
+            for (guint i = 1; i < 5; i++) {
+                if (magnitudes[i] != 0.0f)
+                    direction += (values[0] - values[i]) / magnitudes[i];
+            }
+
+            job->out[y * job->width + x] = direction;
+        }
+    }
+}
+
+static inline gfloat
+host_descent (HostJob *job, gssize x, gssize y)
+{
+    const gfloat eps = 1e-8f;
+    gfloat v0 = host_pixel (job->a, job, x, y);
+    gfloat v1 = host_pixel (job->a, job, x - 1, y);
+    gfloat v2 = host_pixel (job->a, job, x, y - 1);
+    gfloat v3 = host_pixel (job->a, job, x + 1, y);
+    gfloat v4 = host_pixel (job->a, job, x, y + 1);
+    gfloat v5 = host_pixel (job->a, job, x + 1, y - 1);
+    gfloat v6 = host_pixel (job->a, job, x - 1, y + 1);
+    gfloat t1, t2, value;
+
+    t1 = v0 - v1;
+    t2 = v0 - v2;
+    value = (t1 + t2) / sqrtf (eps + t1 * t1 + t2 * t2);
+    t1 = v3 - v0;
+    t2 = v3 - v5;
+    value -= t1 / sqrtf (eps + t1 * t1 + t2 * t2);
+    t1 = v4 - v0;
+    t2 = v4 - v6;
+    value -= t1 / sqrtf (eps + t1 * t1 + t2 * t2);
+
+    return value;
+}
+
+static void
+host_descent_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    for (gsize y = first_row; y < last_row; y++) {
+        for (gsize x = 0; x < job->width; x++)
+            job->out[y * job->width + x] = host_descent (job, (gssize) x, (gssize) y);
+    }
+}
+
+/* job->value is the step size */
+static void
+host_tv_step_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    for (gsize y = first_row; y < last_row; y++) {
+        for (gsize x = 0; x < job->width; x++) {
+            gsize i = y * job->width + x;
+            gfloat value = job->a[i] - job->value * host_descent (job, (gssize) x, (gssize) y);
+
+            job->out[i] = value > 0.0f ? value : 0.0f;
+        }
+    }
+}
+
+/* An event for work that already finished on the host, so callers can wait uniformly */
+static cl_event
+completed_event (UfoResources *resources)
+{
+    cl_event event;
+    cl_int errcode;
+
+    event = clCreateUserEvent (ufo_resources_get_context (resources), &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+    UFO_RESOURCES_CHECK_CLERR (clSetUserEventStatus (event, CL_COMPLETE));
+    return event;
+}
+
+/*
+ * Host paths return a completed event if a queue was given, so that callers
+ * get an event whenever they pass one, no matter where the operation ran.
+ */
+static gpointer
+host_done (UfoResources *resources,
+           gpointer command_queue)
+{
+    if (resources == NULL || command_queue == NULL)
+        return NULL;
+
+    return completed_event (resources);
+}
+
+static gpointer
+host_operation (HostRowFunc func,
+                UfoBuffer *arg1,
+                UfoBuffer *arg2,
+                gfloat value,
+                UfoBuffer *out,
+                UfoResources *resources,
+                gpointer command_queue)
+{
+    HostJob job;
+
+    host_job_init (&job, arg1, arg2, out);
+    job.value = value;
+    host_run (func, &job);
+    return host_done (resources, command_queue);
+}
+
+/*
+ * Element-wise operations exist as image and as float4-vectorized buffer
+ * kernels. The image variant is only used if an input already lives in an
+ * image, otherwise we avoid converting array data to images and back.
+ */
+static gboolean
+use_device_arrays (UfoBuffer *arg1, UfoBuffer *arg2)
+{
+    if (ufo_buffer_get_location (arg1) == UFO_BUFFER_LOCATION_DEVICE_IMAGE)
+        return FALSE;
+
+    return arg2 == NULL || ufo_buffer_get_location (arg2) != UFO_BUFFER_LOCATION_DEVICE_IMAGE;
+}
+
+static cl_mem
+get_device_mem (UfoBuffer *buffer, gboolean arrays, gpointer command_queue)
+{
+    if (arrays)
+        return ufo_buffer_get_device_array (buffer, command_queue);
+
+    return ufo_buffer_get_device_image (buffer, command_queue);
+}
+
+static cl_kernel
+get_elementwise_kernel (UfoResources *resources, const gchar *kernel_name, gboolean arrays)
+{
+    cl_kernel kernel;
+    gchar *name;
+    GError *error = NULL;
+
+    name = arrays ? g_strdup_printf ("%s_buffer", kernel_name) : g_strdup (kernel_name);
+    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, name, &error);
+    g_free (name);
+
+    if (error) {
+        g_error ("%s\n", error->message);
+        return NULL;
+    }
+
+    return kernel;
+}
+
+/* Expressions read up to 26 inputs and write one output */
+#define OPS_MAX_WAIT_EVENTS 27
+
+static guint
+collect_wait_list (UfoBuffer *out,
+                   UfoBuffer **inputs,
+                   guint n_inputs,
+                   cl_event *wait_list)
+{
+    guint n_events = 0;
+
+    for (guint i = 0; i <= n_inputs; i++) {
+        UfoBuffer *buffer = i < n_inputs ? inputs[i] : out;
+        cl_event pending;
+        gboolean duplicate = FALSE;
+
+        if (buffer == NULL || (pending = ufo_buffer_get_event (buffer)) == NULL)
+            continue;
+
+        for (guint j = 0; j < n_events; j++)
+            duplicate = duplicate || wait_list[j] == pending;
+
+        if (!duplicate) {
+            /* Another thread may replace and release the buffer's event meanwhile */
+            UFO_RESOURCES_CHECK_CLERR (clRetainEvent (pending));
+            wait_list[n_events++] = pending;
+        }
+    }
+
+    return n_events;
+}
+
+/* Release the events retained by collect_wait_list() once they are enqueued */
+static void
+release_wait_list (cl_event *wait_list,
+                   guint n_events)
+{
+    for (guint i = 0; i < n_events; i++)
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (wait_list[i]));
+}
+
+/*
+ * Enqueue @kernel after all pending writes to @inputs and @out and record it
+ * as the pending write of @out. Dependent operations can thus be enqueued
+ * back to back without waiting on the host.
+ */
+static cl_event
+launch_after (UfoResources *resources,
+              gpointer command_queue,
+              cl_kernel kernel,
+              guint work_dim,
+              const gsize *work_size,
+              UfoBuffer *out,
+              UfoBuffer **inputs,
+              guint n_inputs)
+{
+    cl_event wait_list[OPS_MAX_WAIT_EVENTS];
+    cl_event event;
+    guint n_events;
+
+    n_events = collect_wait_list (out, inputs, n_inputs, wait_list);
+    ufo_resources_launch_kernel (resources, command_queue, kernel, work_dim, work_size,
+                                 n_events, wait_list, &event);
+    release_wait_list (wait_list, n_events);
+    ufo_buffer_set_event (out, event);
+
+    return event;
+}
+
+/*
+ * Launch an element-wise kernel whose arguments up to @size_index have been
+ * set. Buffer variants take the number of elements as their last argument and
+ * process four elements per work item.
+ */
+static cl_event
+launch_elementwise (UfoResources *resources,
+                    gpointer command_queue,
+                    cl_kernel kernel,
+                    gboolean arrays,
+                    guint size_index,
+                    UfoRequisition *requisition,
+                    UfoBuffer *out,
+                    UfoBuffer **inputs,
+                    guint n_inputs)
+{
+    if (arrays) {
+        cl_uint n = 1;
+        gsize work_size;
+
+        for (guint i = 0; i < requisition->n_dims; i++)
+            n *= (cl_uint) requisition->dims[i];
+
+        work_size = (n + 3) / 4;
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, size_index, sizeof(cl_uint), &n));
+        return launch_after (resources, command_queue, kernel, 1, &work_size, out, inputs, n_inputs);
+    }
+
+    return launch_after (resources, command_queue, kernel, requisition->n_dims, requisition->dims,
+                         out, inputs, n_inputs);
+}
+
+/* Keep in sync with TILE_SIZE in ufo-basic-ops.cl */
+#define OPS_TILE_SIZE 16
+
+/*
+ * Get the local-memory tiled variant of a stencil kernel or %NULL if the
+ * device cannot run a full tile per work group.
+ */
+static cl_kernel
+get_tiled_kernel (UfoResources *resources,
+                  gpointer command_queue,
+                  const gchar *kernel_name,
+                  UfoRequisition *requisition)
+{
+    cl_kernel kernel;
+    cl_device_id device;
+    gsize max_size = 0;
+    gchar *name;
+    GError *error = NULL;
+
+    if (requisition->n_dims != 2)
+        return NULL;
+
+    name = g_strdup_printf ("%s_tiled", kernel_name);
+    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, name, &error);
+    g_free (name);
+
+    if (error) {
+        g_error ("%s\n", error->message);
+        return NULL;
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (command_queue, CL_QUEUE_DEVICE,
+                                                      sizeof (cl_device_id), &device, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelWorkGroupInfo (kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                                         sizeof (gsize), &max_size, NULL));
+
+    return max_size >= OPS_TILE_SIZE * OPS_TILE_SIZE ? kernel : NULL;
+}
+
+static cl_kernel
+get_stencil_kernel (UfoResources *resources,
+                    gpointer command_queue,
+                    const gchar *kernel_name,
+                    UfoRequisition *requisition,
+                    gboolean *tiled)
+{
+    cl_kernel kernel;
+    GError *error = NULL;
+
+    kernel = get_tiled_kernel (resources, command_queue, kernel_name, requisition);
+    *tiled = kernel != NULL;
+
+    if (kernel != NULL)
+        return kernel;
+
+    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, kernel_name, &error);
+
+    if (error) {
+        g_error ("%s\n", error->message);
+        return NULL;
+    }
+
+    return kernel;
+}
+
+/*
+ * Tiled kernels need exactly one tile per work group, so the local size is
+ * fixed instead of tuned and the global size is rounded up to full tiles.
+ */
+static cl_event
+enqueue_tiled (gpointer command_queue,
+               cl_kernel kernel,
+               UfoRequisition *requisition,
+               guint n_events,
+               const cl_event *wait_list)
+{
+    cl_event event;
+    gsize local_work_size[2] = { OPS_TILE_SIZE, OPS_TILE_SIZE };
+    gsize global_work_size[2];
+
+    for (guint i = 0; i < 2; i++)
+        global_work_size[i] = (requisition->dims[i] + OPS_TILE_SIZE - 1) / OPS_TILE_SIZE * OPS_TILE_SIZE;
+
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
+                                                       2, NULL, global_work_size, local_work_size,
+                                                       n_events, n_events > 0 ? wait_list : NULL,
+                                                       &event));
+    return event;
+}
+
+static cl_event
+launch_tiled (gpointer command_queue,
+              cl_kernel kernel,
+              UfoRequisition *requisition,
+              UfoBuffer *out,
+              UfoBuffer **inputs,
+              guint n_inputs)
+{
+    cl_event wait_list[OPS_MAX_WAIT_EVENTS];
+    cl_event event;
+    guint n_events;
+
+    n_events = collect_wait_list (out, inputs, n_inputs, wait_list);
+    event = enqueue_tiled (command_queue, kernel, requisition, n_events, wait_list);
+    release_wait_list (wait_list, n_events);
+    ufo_buffer_set_event (out, event);
+
+    return event;
+}
+
+/**
+ * ufo_op_set:
+ * @arg: A #UfoBuffer
+ * @value: Value to fill @arg with
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Fill a buffer with a value where its data currently lives, so neither the
+ * old contents are transferred nor the buffer moved.
+ *
+ * Returns: (transfer full): Event of the set operation or %NULL if no
+ * @resources and @command_queue were given
+ */
+gpointer
+ufo_op_set (UfoBuffer *arg,
+            gfloat value,
+            UfoResources *resources,
+            gpointer command_queue)
+{
+    UfoRequisition requisition;
+    UfoBufferLocation location;
+    cl_kernel kernel;
+    cl_mem d_arg;
+    gboolean arrays;
+
+    /*
+     * The old contents are overwritten, so fill the buffer where it currently
+     * lives instead of moving data that is thrown away anyway.
+     */
+    location = ufo_buffer_get_location (arg);
+
+    if (resources == NULL || command_queue == NULL) {
+        if (location == UFO_BUFFER_LOCATION_DEVICE || location == UFO_BUFFER_LOCATION_DEVICE_IMAGE)
+            ufo_buffer_discard_location (arg);
+
+        return host_operation (host_set_rows, NULL, NULL, value, arg, resources, command_queue);
+    }
+
+    if (location == UFO_BUFFER_LOCATION_HOST)
+        return host_operation (host_set_rows, NULL, NULL, value, arg, resources, command_queue);
+
+    ufo_buffer_get_requisition (arg, &requisition);
+
+    /* Never convert between arrays and images, an invalid buffer becomes an array */
+    arrays = location != UFO_BUFFER_LOCATION_DEVICE_IMAGE;
+    d_arg = get_device_mem (arg, arrays, command_queue);
+    kernel = get_elementwise_kernel (resources, "operation_set", arrays);
+
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(gfloat), (void *) &value));
+
+    return launch_elementwise (resources, command_queue, kernel, arrays, 2, &requisition, arg, NULL, 0);
+}
+
+/**
+ * ufo_op_inv:
+ * @arg: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Invert @arg.
+ *
+ * Returns: (transfer full): Event of the invert operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_inv (UfoBuffer *arg,
+            UfoResources *resources,
+            gpointer command_queue)
+{
+    UfoRequisition requisition;
+    cl_event event;
+    cl_kernel kernel;
+    cl_mem d_arg;
+    gboolean arrays;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    if (use_host (resources, command_queue, arg, NULL))
+        return host_operation (host_inv_rows, arg, NULL, 0.0f, arg, resources, command_queue);
+
+    ufo_buffer_get_requisition (arg, &requisition);
+
+    arrays = use_device_arrays (arg, NULL);
+    d_arg = get_device_mem (arg, arrays, command_queue);
+    kernel = get_elementwise_kernel (resources, "operation_inv", arrays);
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 1, sizeof(void *), (void *) &d_arg));
+    event = launch_elementwise (resources, command_queue, kernel, arrays, 2, &requisition, arg, &arg, 1);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+/**
+ * ufo_op_mul:
+ * @arg1: A #UfoBuffer
+ * @arg2: A #UfoBuffer
+ * @out: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * out = arg1 * arg2
+ *
+ * Returns: (transfer full): Event of the mul operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_mul (UfoBuffer *arg1,
+            UfoBuffer *arg2,
+            UfoBuffer *out,
+            UfoResources *resources,
+            gpointer command_queue)
+{
+    if (use_host (resources, command_queue, arg1, arg2))
+        return host_operation (host_mul_rows, arg1, arg2, 0.0f, out, resources, command_queue);
+
+    return operation ("operation_mul", arg1, arg2, out, resources, command_queue);
+}
+
+/**
+ * ufo_op_add:
+ * @arg1: A #UfoBuffer
+ * @arg2: A #UfoBuffer
+ * @out: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * out = arg1 + arg2
+ *
+ * Returns: (transfer full): Event of the add operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_add (UfoBuffer *arg1,
+            UfoBuffer *arg2,
+            UfoBuffer *out,
+            UfoResources *resources,
+            gpointer command_queue)
+{
+    if (use_host (resources, command_queue, arg1, arg2))
+        return host_operation (host_axpy_rows, arg1, arg2, 1.0f, out, resources, command_queue);
+
+    return operation ("operation_add", arg1, arg2, out, resources, command_queue);
+}
+
+/**
+ * ufo_op_add2:
+ * @arg1: A #UfoBuffer
+ * @arg2: A #UfoBuffer
+ * @modifier: Scalar value
+ * @out: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * @out = @arg1 + @modifier * @arg2
+ *
+ * Returns: (transfer full): Event of the add operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_add2 (UfoBuffer *arg1,
+             UfoBuffer *arg2,
+             gfloat modifier,
+             UfoBuffer *out,
+             UfoResources *resources,
+             gpointer command_queue)
+{
+    if (use_host (resources, command_queue, arg1, arg2))
+        return host_operation (host_axpy_rows, arg1, arg2, modifier, out, resources, command_queue);
+
+    return operation2 ("operation_add2", arg1, arg2, modifier, out, resources, command_queue);
+}
+
+/**
+ * ufo_op_deduction:
+ * @arg1: A #UfoBuffer
+ * @arg2: A #UfoBuffer
+ * @out: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * @out = @arg1 - @arg2
+ *
+ * Returns: (transfer full): Event of the add operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_deduction (UfoBuffer *arg1,
+                  UfoBuffer *arg2,
+                  UfoBuffer *out,
+                  UfoResources *resources,
+                  gpointer command_queue)
+{
+    if (use_host (resources, command_queue, arg1, arg2))
+        return host_operation (host_axpy_rows, arg1, arg2, -1.0f, out, resources, command_queue);
+
+    return operation ("operation_deduction", arg1, arg2, out, resources, command_queue);
+}
+
+/**
+ * ufo_op_deduction2:
+ * @arg1: A #UfoBuffer
+ * @arg2: A #UfoBuffer
+ * @modifier: Scalar value
+ * @out: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * @out = @arg1 - @modifier * @arg2
+ *
+ * Returns: (transfer full): Event of the add operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_deduction2 (UfoBuffer *arg1,
+                   UfoBuffer *arg2,
+                   gfloat modifier,
+                   UfoBuffer *out,
+                   UfoResources *resources,
+                   gpointer command_queue)
+{
+    if (use_host (resources, command_queue, arg1, arg2))
+        return host_operation (host_axpy_rows, arg1, arg2, -modifier, out, resources, command_queue);
+
+    return operation2 ("operation_deduction2", arg1, arg2, modifier, out, resources, command_queue);
+}
+
+/**
+ * ufo_op_mul_rows:
+ * @arg1: A #UfoBuffer
+ * @arg2: A #UfoBuffer
+ * @offset: Offset
+ * @n: n ?
+ * @out: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * @out = @arg1 - @modifier * @arg2
+ *
+ * Returns: (transfer full): Event of the add operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_mul_rows (UfoBuffer *arg1,
+                 UfoBuffer *arg2,
+                 UfoBuffer *out,
+                 guint offset,
+                 guint n,
+                 UfoResources *resources,
+                 gpointer command_queue)
+{
+    cl_event event;
+    UfoRequisition arg1_requisition, arg2_requisition, out_requisition;
+    GError *error = NULL;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    ufo_buffer_get_requisition (arg1, &arg1_requisition);
+    ufo_buffer_get_requisition (arg2, &arg2_requisition);
+    ufo_buffer_get_requisition (out, &out_requisition);
+
+    if (arg1_requisition.dims[0] != arg2_requisition.dims[0] ||
+        arg1_requisition.dims[0] != out_requisition.dims[0]) {
+        g_error ("Number of columns is different.");
+        return NULL;
+    }
+
+    if (arg1_requisition.dims[1] < offset + n ||
+        arg2_requisition.dims[1] < offset + n ||
+        out_requisition.dims[1] < offset + n) {
+        g_error ("Rows are not enough.");
+        return NULL;
+    }
+
+    if (use_host (resources, command_queue, arg1, arg2)) {
+        HostJob job;
+        gsize offset_elements;
+
+        host_job_init (&job, arg1, arg2, out);
+        offset_elements = offset * job.width;
+        job.a += offset_elements;
+        job.b += offset_elements;
+        job.out += offset_elements;
+        job.height = n;
+        host_run (host_mul_rows, &job);
+        return host_done (resources, command_queue);
+    }
+
+    cl_mem d_arg1 = ufo_buffer_get_device_image (arg1, command_queue);
+    cl_mem d_arg2 = ufo_buffer_get_device_image (arg2, command_queue);
+    cl_mem d_out  = ufo_buffer_get_device_image (out, command_queue);
+    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "op_mulRows", &error);
+
+    if (error != NULL) {
+        g_error ("Error: %s\n", error->message);
+        return NULL;
+    }
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg1));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_arg2));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_out));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, sizeof(unsigned int), (void *) &offset));
+
+    UfoRequisition operation_requisition = out_requisition;
+    operation_requisition.dims[1] = n;
+
+    UfoBuffer *inputs[] = { arg1, arg2 };
+    event = launch_after (resources, command_queue, kernel,
+                          operation_requisition.n_dims, operation_requisition.dims,
+                          out, inputs, 2);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+static cl_event
+operation (const gchar *kernel_name,
+           UfoBuffer *arg1,
+           UfoBuffer *arg2,
+           UfoBuffer *out,
+           UfoResources *resources,
+           gpointer command_queue)
+{
+    UfoRequisition arg1_requisition, arg2_requisition, out_requisition;
+    cl_event event;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    ufo_buffer_get_requisition (arg1, &arg1_requisition);
+    ufo_buffer_get_requisition (arg2, &arg2_requisition);
+    ufo_buffer_get_requisition (out, &out_requisition);
+
+    if ((arg1_requisition.dims[0] != arg2_requisition.dims[0] &&
+         arg1_requisition.dims[0] != out_requisition.dims[0]) ||
+        (arg1_requisition.dims[1] != arg2_requisition.dims[1] &&
+         arg1_requisition.dims[1] != out_requisition.dims[1])) {
+        g_error ("Incorrect volume size.");
+        return NULL;
+    }
+
+    UfoBuffer *inputs[] = { arg1, arg2 };
+    gboolean arrays = use_device_arrays (arg1, arg2);
+    cl_mem d_arg1 = get_device_mem (arg1, arrays, command_queue);
+    cl_mem d_arg2 = get_device_mem (arg2, arrays, command_queue);
+    cl_mem d_out = get_device_mem (out, arrays, command_queue);
+    cl_kernel kernel = get_elementwise_kernel (resources, kernel_name, arrays);
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg1));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_arg2));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_out));
+    event = launch_elementwise (resources, command_queue, kernel, arrays, 3, &arg1_requisition,
+                                out, inputs, 2);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+static cl_event
+operation2 (const gchar *kernel_name,
+            UfoBuffer *arg1,
+            UfoBuffer *arg2,
+            gfloat modifier,
+            UfoBuffer *out,
+            UfoResources *resources,
+            gpointer command_queue)
+{
+    UfoRequisition arg1_requisition, arg2_requisition, out_requisition;
+    cl_event event;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    ufo_buffer_get_requisition (arg1, &arg1_requisition);
+    ufo_buffer_get_requisition (arg2, &arg2_requisition);
+    ufo_buffer_get_requisition (out, &out_requisition);
+
+    if ((arg1_requisition.dims[0] != arg2_requisition.dims[0] &&
+         arg1_requisition.dims[0] != out_requisition.dims[0]) ||
+        (arg1_requisition.dims[1] != arg2_requisition.dims[1] &&
+         arg1_requisition.dims[1] != out_requisition.dims[1])) {
+        g_error ("Incorrect volume size.");
+        return NULL;
+    }
+
+    UfoBuffer *inputs[] = { arg1, arg2 };
+    gboolean arrays = use_device_arrays (arg1, arg2);
+    cl_mem d_arg1 = get_device_mem (arg1, arrays, command_queue);
+    cl_mem d_arg2 = get_device_mem (arg2, arrays, command_queue);
+    cl_mem d_out = get_device_mem (out, arrays, command_queue);
+    cl_kernel kernel = get_elementwise_kernel (resources, kernel_name, arrays);
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 0, sizeof(void *), (void *) &d_arg1));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 1, sizeof(void *), (void *) &d_arg2));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 2, sizeof(gfloat), (void *) &modifier));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 3, sizeof(void *), (void *) &d_out));
+    event = launch_elementwise (resources, command_queue, kernel, arrays, 4, &arg1_requisition,
+                                out, inputs, 2);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+/**
+ * ufo_op_gradient_magnitudes:
+ * @arg: A #UfoBuffer
+ * @out: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Compute magnitude of gradients
+ *
+ * Returns: (transfer full): Event of the add operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_gradient_magnitudes (UfoBuffer *arg,
+                            UfoBuffer *out,
+                            UfoResources *resources,
+                            gpointer command_queue)
+{
+    UfoRequisition arg_requisition;
+    cl_event event;
+    gboolean tiled;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    ufo_buffer_get_requisition (arg, &arg_requisition);
+    ufo_buffer_resize (out, &arg_requisition);
+
+    if (use_host (resources, command_queue, arg, NULL))
+        return host_operation (host_gradient_magnitude_rows, arg, NULL, 0.0f, out, resources, command_queue);
+
+    cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
+    cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
+
+    cl_kernel kernel = get_stencil_kernel (resources, command_queue, "operation_gradient_magnitude",
+                                           &arg_requisition, &tiled);
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_out));
+
+    if (tiled)
+        event = launch_tiled (command_queue, kernel, &arg_requisition, out, &arg, 1);
+    else
+        event = launch_after (resources, command_queue, kernel,
+                              arg_requisition.n_dims, arg_requisition.dims, out, &arg, 1);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+/**
+ * ufo_op_gradient_directions:
+ * @arg: A #UfoBuffer
+ * @magnitudes: A #UfoBuffer
+ * @out: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Compute magnitude of gradients
+ *
+ * Returns: (transfer full): Event of the add operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_gradient_directions (UfoBuffer *arg,
+                            UfoBuffer *magnitudes,
+                            UfoBuffer *out,
+                            UfoResources *resources,
+                            gpointer command_queue)
+{
+    UfoRequisition arg_requisition;
+    cl_event event;
+    gboolean tiled;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    ufo_buffer_get_requisition (arg, &arg_requisition);
+    ufo_buffer_resize (out, &arg_requisition);
+
+    if (use_host (resources, command_queue, arg, magnitudes))
+        return host_operation (host_gradient_direction_rows, arg, magnitudes, 0.0f, out, resources, command_queue);
+
+    cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
+    cl_mem d_magnitudes = ufo_buffer_get_device_image (magnitudes, command_queue);
+    cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
+
+    cl_kernel kernel = get_stencil_kernel (resources, command_queue, "operation_gradient_direction",
+                                           &arg_requisition, &tiled);
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_magnitudes));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_out));
+
+    UfoBuffer *inputs[] = { arg, magnitudes };
+
+    if (tiled)
+        event = launch_tiled (command_queue, kernel, &arg_requisition, out, inputs, 2);
+    else
+        event = launch_after (resources, command_queue, kernel,
+                              arg_requisition.n_dims, arg_requisition.dims, out, inputs, 2);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+/**
+ * ufo_op_gradient_magnitudes_directions:
+ * @arg: A #UfoBuffer
+ * @magnitudes: A #UfoBuffer receiving the gradient magnitudes
+ * @directions: A #UfoBuffer receiving the gradient directions
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Compute the results of ufo_op_gradient_magnitudes() and
+ * ufo_op_gradient_directions() in a single pass over @arg.
+ *
+ * Returns: (transfer full): Event of the operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_gradient_magnitudes_directions (UfoBuffer *arg,
+                                       UfoBuffer *magnitudes,
+                                       UfoBuffer *directions,
+                                       UfoResources *resources,
+                                       gpointer command_queue)
+{
+    UfoRequisition requisition;
+    UfoBuffer *inputs[2];
+    cl_kernel kernel;
+    cl_mem d_arg;
+    cl_mem d_magnitudes;
+    cl_mem d_directions;
+    cl_event event;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    ufo_buffer_get_requisition (arg, &requisition);
+    ufo_buffer_resize (magnitudes, &requisition);
+    ufo_buffer_resize (directions, &requisition);
+
+    if (use_host (resources, command_queue, arg, NULL)) {
+        host_operation (host_gradient_magnitude_rows, arg, NULL, 0.0f, magnitudes, NULL, NULL);
+        return host_operation (host_gradient_direction_rows, arg, magnitudes, 0.0f, directions, resources, command_queue);
+    }
+
+    kernel = get_tiled_kernel (resources, command_queue, "operation_gradient_magnitude_direction",
+                               &requisition);
+
+    /* The fused kernel exists only in the tiled form */
+    if (kernel == NULL) {
+        event = ufo_op_gradient_magnitudes (arg, magnitudes, resources, command_queue);
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+        return ufo_op_gradient_directions (arg, magnitudes, directions, resources, command_queue);
+    }
+
+    d_arg = ufo_buffer_get_device_image (arg, command_queue);
+    d_magnitudes = ufo_buffer_get_device_image (magnitudes, command_queue);
+    d_directions = ufo_buffer_get_device_image (directions, command_queue);
+    inputs[0] = arg;
+    inputs[1] = directions;
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_magnitudes));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_directions));
+    event = launch_tiled (command_queue, kernel, &requisition, magnitudes, inputs, 2);
+    g_static_mutex_unlock (&mutex);
+
+    ufo_buffer_set_event (directions, event);
+    return event;
+}
+
+/* Keep in sync with the REDUCE_* constants in ufo-basic-ops.cl */
+typedef enum {
+    REDUCE_SUM = 0,
+    REDUCE_ABS_SUM,
+    REDUCE_SQUARE_SUM,
+    REDUCE_DIFF_SQUARE_SUM,
+    REDUCE_MIN,
+    REDUCE_MAX
+} ReduceMode;
+
+#define REDUCE_N_GROUPS     64
+#define REDUCE_LOCAL_SIZE   256
+
+static inline gfloat
+reduce_identity (ReduceMode mode)
+{
+    /* Same identities as reduce_identity in ufo-basic-ops.cl */
+    if (mode == REDUCE_MIN)
+        return INFINITY;
+
+    if (mode == REDUCE_MAX)
+        return -INFINITY;
+
+    return 0.0f;
+}
+
+static inline gfloat
+reduce_map (ReduceMode mode, gfloat a, gfloat b)
+{
+    switch (mode) {
+        case REDUCE_ABS_SUM:
+            return fabsf (a);
+        case REDUCE_SQUARE_SUM:
+            return a * a;
+        case REDUCE_DIFF_SQUARE_SUM:
+            return (a - b) * (a - b);
+        default:
+            return a;
+    }
+}
+
+static inline gfloat
+reduce_combine (ReduceMode mode, gfloat x, gfloat y)
+{
+    if (mode == REDUCE_MIN)
+        return x < y ? x : y;
+
+    if (mode == REDUCE_MAX)
+        return x > y ? x : y;
+
+    return x + y;
+}
+
+static gfloat
+reduce_host (ReduceMode mode,
+             const gfloat *a,
+             gsize n_a,
+             const gfloat *b,
+             gsize n_b)
+{
+    gfloat acc[4];
+    gsize n_common = MIN (n_a, n_b);
+    gsize n = MAX (n_a, n_b);
+    gsize i = 0;
+
+    for (guint j = 0; j < 4; j++)
+        acc[j] = reduce_identity (mode);
+
+    /* Four independent accumulators let the compiler keep them in one SIMD register */
+    for (; i + 4 <= n_common; i += 4) {
+        for (guint j = 0; j < 4; j++)
+            acc[j] = reduce_combine (mode, acc[j], reduce_map (mode, a[i + j], b[i + j]));
+    }
+
+    for (; i < n; i++) {
+        gfloat va = i < n_a ? a[i] : 0.0f;
+        gfloat vb = i < n_b ? b[i] : 0.0f;
+        acc[0] = reduce_combine (mode, acc[0], reduce_map (mode, va, vb));
+    }
+
+    return reduce_combine (mode,
+                           reduce_combine (mode, acc[0], acc[1]),
+                           reduce_combine (mode, acc[2], acc[3]));
+}
+
+static cl_device_id
+get_queue_device (gpointer command_queue)
+{
+    cl_device_id device;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (command_queue, CL_QUEUE_DEVICE,
+                                                      sizeof (cl_device_id), &device, NULL));
+    return device;
+}
+
+static gsize
+get_local_reduce_size (cl_kernel kernel,
+                       cl_command_queue queue)
+{
+    gsize max_size;
+    gsize size = REDUCE_LOCAL_SIZE;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelWorkGroupInfo (kernel, get_queue_device (queue), CL_KERNEL_WORK_GROUP_SIZE,
+                                                         sizeof (gsize), &max_size, NULL));
+
+    /* The tree reduction in the kernel needs a power of two */
+    while (size > max_size)
+        size >>= 1;
+
+    return size;
+}
+
+static gfloat
+reduce (ReduceMode mode,
+        UfoBuffer *arg1,
+        UfoBuffer *arg2,
+        UfoResources *resources,
+        gpointer command_queue)
+{
+    cl_kernel image_kernel;
+    cl_kernel partials_kernel;
+    cl_mem d_arg1;
+    cl_mem d_arg2;
+    cl_mem d_partials;
+    cl_uint n_groups = REDUCE_N_GROUPS;
+    gsize image_local_size;
+    gsize partials_local_size;
+    gsize global_size;
+    gfloat result;
+    UfoBuffer *inputs[] = { arg1, arg2 };
+    cl_event wait_list[2];
+    guint n_events;
+    gboolean arrays;
+    GError *error = NULL;
+
+    if (use_host (resources, command_queue, arg1, arg2)) {
+        gfloat *values1 = ufo_buffer_get_host_array (arg1, NULL);
+        gfloat *values2 = ufo_buffer_get_host_array (arg2, NULL);
+
+        return reduce_host (mode,
+                            values1, ufo_buffer_get_size (arg1) / sizeof (gfloat),
+                            values2, ufo_buffer_get_size (arg2) / sizeof (gfloat));
+    }
+
+    arrays = use_device_arrays (arg1, arg2);
+    image_kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME,
+                                                    arrays ? "reduce_array" : "reduce_image", &error);
+
+    if (error == NULL)
+        partials_kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "reduce_partials", &error);
+
+    /* The kernels and the partials are private to this thread and queue */
+    if (error == NULL)
+        d_partials = ufo_resources_get_scratch_buffer (resources, command_queue,
+                                                       n_groups * sizeof (gfloat), &error);
+
+    if (error) {
+        g_error ("%s\n", error->message);
+        return 0.0f;
+    }
+
+    d_arg1 = get_device_mem (arg1, arrays, command_queue);
+    d_arg2 = arg2 == arg1 ? d_arg1 : get_device_mem (arg2, arrays, command_queue);
+
+    image_local_size = get_local_reduce_size (image_kernel, command_queue);
+    partials_local_size = get_local_reduce_size (partials_kernel, command_queue);
+    global_size = n_groups * image_local_size;
+
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (image_kernel, 0, sizeof(void *), (void *) &d_arg1));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (image_kernel, 1, sizeof(void *), (void *) &d_arg2));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (image_kernel, 2, sizeof(gint), (void *) &mode));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (image_kernel, 3, sizeof(void *), (void *) &d_partials));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (image_kernel, 4, image_local_size * sizeof(gfloat), NULL));
+
+    if (arrays) {
+        cl_uint n1 = (cl_uint) (ufo_buffer_get_size (arg1) / sizeof (gfloat));
+        cl_uint n2 = (cl_uint) (ufo_buffer_get_size (arg2) / sizeof (gfloat));
+
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (image_kernel, 5, sizeof(cl_uint), (void *) &n1));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (image_kernel, 6, sizeof(cl_uint), (void *) &n2));
+    }
+
+    n_events = collect_wait_list (NULL, inputs, 2, wait_list);
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, image_kernel,
+                                                       1, NULL, &global_size, &image_local_size,
+                                                       n_events, n_events > 0 ? wait_list : NULL,
+                                                       NULL));
+    release_wait_list (wait_list, n_events);
+
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (partials_kernel, 0, sizeof(void *), (void *) &d_partials));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (partials_kernel, 1, sizeof(cl_uint), (void *) &n_groups));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (partials_kernel, 2, sizeof(gint), (void *) &mode));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (partials_kernel, 3, partials_local_size * sizeof(gfloat), NULL));
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, partials_kernel,
+                                                       1, NULL, &partials_local_size, &partials_local_size,
+                                                       0, NULL, NULL));
+
+    /* Only the scalar result leaves the device */
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBuffer (command_queue, d_partials, CL_TRUE,
+                                                    0, sizeof (gfloat), &result,
+                                                    0, NULL, NULL));
+
+    return result;
+}
+
+/**
+ * ufo_op_l1_norm:
+ * @arg: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Compute the L1 norm of @arg on the device. If @resources or @command_queue
+ * is %NULL, the norm is computed on the host.
+ *
+ * Returns: L1 norm.
+ */
+gfloat
+ufo_op_l1_norm (UfoBuffer *arg,
+                UfoResources *resources,
+                gpointer command_queue)
+{
+    return reduce (REDUCE_ABS_SUM, arg, arg, resources, command_queue);
+}
+
+/**
+ * ufo_op_euclidean_distance:
+ * @arg1: A #UfoBuffer
+ * @arg2: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Compute the euclidean distance on the device. If the sizes of @arg1 and
+ * @arg2 differ, the smaller one is zero-padded. If @resources or
+ * @command_queue is %NULL, the distance is computed on the host.
+ *
+ * Returns: Euclidean distance between @arg1 and @arg2.
+ */
+gfloat
+ufo_op_euclidean_distance (UfoBuffer *arg1,
+                           UfoBuffer *arg2,
+                           UfoResources *resources,
+                           gpointer command_queue)
+{
+    if (ufo_buffer_get_size (arg1) != ufo_buffer_get_size (arg2))
+        g_warning ("Sizes of buffers are not the same. Zero-padding applied.");
+
+    return sqrtf (reduce (REDUCE_DIFF_SQUARE_SUM, arg1, arg2, resources, command_queue));
+}
+
+/**
+ * ufo_op_l2_norm:
+ * @arg: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Compute the L2 norm of @arg on the device. If @resources or @command_queue
+ * is %NULL, the norm is computed on the host.
+ *
+ * Returns: L2 norm.
+ */
+gfloat
+ufo_op_l2_norm (UfoBuffer *arg,
+                UfoResources *resources,
+                gpointer command_queue)
+{
+    return sqrtf (reduce (REDUCE_SQUARE_SUM, arg, arg, resources, command_queue));
+}
+
+/**
+ * ufo_op_sum:
+ * @arg: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Returns: Sum of all elements of @arg.
+ */
+gfloat
+ufo_op_sum (UfoBuffer *arg,
+            UfoResources *resources,
+            gpointer command_queue)
+{
+    return reduce (REDUCE_SUM, arg, arg, resources, command_queue);
+}
+
+/**
+ * ufo_op_mean:
+ * @arg: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Returns: Arithmetic mean of all elements of @arg.
+ */
+gfloat
+ufo_op_mean (UfoBuffer *arg,
+             UfoResources *resources,
+             gpointer command_queue)
+{
+    gsize n_elements = ufo_buffer_get_size (arg) / sizeof (gfloat);
+
+    if (n_elements == 0)
+        return 0.0f;
+
+    return reduce (REDUCE_SUM, arg, arg, resources, command_queue) / n_elements;
+}
+
+/**
+ * ufo_op_min:
+ * @arg: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Returns: Smallest element of @arg.
+ */
+gfloat
+ufo_op_min (UfoBuffer *arg,
+            UfoResources *resources,
+            gpointer command_queue)
+{
+    return reduce (REDUCE_MIN, arg, arg, resources, command_queue);
+}
+
+/**
+ * ufo_op_max:
+ * @arg: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Returns: Largest element of @arg.
+ */
+gfloat
+ufo_op_max (UfoBuffer *arg,
+            UfoResources *resources,
+            gpointer command_queue)
+{
+    return reduce (REDUCE_MAX, arg, arg, resources, command_queue);
+}
+
+static void
+host_min_max (const gfloat *values, gsize n, gfloat *min, gfloat *max)
+{
+    gfloat lo = INFINITY;
+    gfloat hi = -INFINITY;
+
+    for (gsize i = 0; i < n; i++) {
+        lo = values[i] < lo ? values[i] : lo;
+        hi = values[i] > hi ? values[i] : hi;
+    }
+
+    *min = lo;
+    *max = hi;
+}
+
+/**
+ * ufo_op_min_max:
+ * @arg: A #UfoBuffer
+ * @min: (out): Location for the smallest element
+ * @max: (out): Location for the largest element
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Compute the smallest and largest element of @arg in a single pass. Only the
+ * two results are transferred if @arg lives on the device.
+ */
+void
+ufo_op_min_max (UfoBuffer *arg,
+                gfloat *min,
+                gfloat *max,
+                UfoResources *resources,
+                gpointer command_queue)
+{
+    cl_kernel kernel;
+    cl_kernel partials_kernel;
+    cl_mem d_arg;
+    cl_mem d_partials;
+    cl_event wait_list[1];
+    guint n_events;
+    cl_uint n_groups = REDUCE_N_GROUPS;
+    gsize local_size;
+    gsize partials_local_size;
+    gsize global_size;
+    gfloat result[2];
+    gboolean arrays;
+    GError *error = NULL;
+
+    if (use_host (resources, command_queue, arg, NULL)) {
+        host_min_max (ufo_buffer_get_host_array (arg, NULL),
+                      ufo_buffer_get_size (arg) / sizeof (gfloat), min, max);
+        return;
+    }
+
+    arrays = use_device_arrays (arg, NULL);
+    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME,
+                                              arrays ? "min_max_array" : "min_max_image", &error);
+
+    if (error == NULL)
+        partials_kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "min_max_partials", &error);
+
+    if (error == NULL)
+        d_partials = ufo_resources_get_scratch_buffer (resources, command_queue,
+                                                       n_groups * 2 * sizeof (gfloat), &error);
+
+    if (error) {
+        g_error ("%s\n", error->message);
+        return;
+    }
+
+    d_arg = get_device_mem (arg, arrays, command_queue);
+    local_size = get_local_reduce_size (kernel, command_queue);
+    partials_local_size = get_local_reduce_size (partials_kernel, command_queue);
+    global_size = n_groups * local_size;
+
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_partials));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, local_size * 2 * sizeof(gfloat), NULL));
+
+    if (arrays) {
+        cl_uint n = (cl_uint) (ufo_buffer_get_size (arg) / sizeof (gfloat));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, sizeof(cl_uint), (void *) &n));
+    }
+
+    n_events = collect_wait_list (NULL, &arg, 1, wait_list);
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
+                                                       1, NULL, &global_size, &local_size,
+                                                       n_events, n_events > 0 ? wait_list : NULL,
+                                                       NULL));
+    release_wait_list (wait_list, n_events);
+
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (partials_kernel, 0, sizeof(void *), (void *) &d_partials));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (partials_kernel, 1, sizeof(cl_uint), (void *) &n_groups));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (partials_kernel, 2, partials_local_size * 2 * sizeof(gfloat), NULL));
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, partials_kernel,
+                                                       1, NULL, &partials_local_size, &partials_local_size,
+                                                       0, NULL, NULL));
+
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBuffer (command_queue, d_partials, CL_TRUE,
+                                                    0, sizeof (result), result,
+                                                    0, NULL, NULL));
+
+    *min = result[0];
+    *max = result[1];
+}
+
+/* Same binning as histogram_add in ufo-basic-ops.cl */
+static void
+host_histogram (const gfloat *values,
+                gsize n,
+                gfloat min,
+                gfloat max,
+                guint n_bins,
+                guint *histogram)
+{
+    memset (histogram, 0, n_bins * sizeof (guint));
+
+    for (gsize i = 0; i < n; i++) {
+        if (values[i] >= min && values[i] <= max) {
+            gfloat position = max > min ? (values[i] - min) / (max - min) * n_bins : 0.0f;
+            guint bin = position < n_bins ? (guint) position : n_bins - 1;
+
+            histogram[bin]++;
+        }
+    }
+}
+
+/**
+ * ufo_op_histogram:
+ * @arg: A #UfoBuffer
+ * @min: Lower bound of the first bin
+ * @max: Upper bound of the last bin, if it equals @min all elements with
+ * that value are counted in the first bin
+ * @n_bins: Number of bins
+ * @histogram: (array length=n_bins): Location for @n_bins counts
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Count the elements of @arg in @n_bins equally wide bins between @min and
+ * @max. Elements outside that range are not counted. On the device, every
+ * work group builds a histogram in local memory before merging it into the
+ * result, so only the counts are transferred. Histograms that do not fit into
+ * local memory are computed on the host.
+ */
+void
+ufo_op_histogram (UfoBuffer *arg,
+                  gfloat min,
+                  gfloat max,
+                  guint n_bins,
+                  guint *histogram,
+                  UfoResources *resources,
+                  gpointer command_queue)
+{
+    cl_kernel kernel;
+    cl_mem d_arg;
+    cl_mem d_histogram;
+    cl_int errcode;
+    cl_ulong local_mem_size;
+    cl_event wait_list[1];
+    guint n_events;
+    gsize local_size;
+    gsize global_size;
+    gboolean arrays;
+    gboolean host;
+    GError *error = NULL;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    g_return_if_fail (n_bins > 0 && max >= min);
+
+    host = use_host (resources, command_queue, arg, NULL);
+
+    if (!host) {
+        UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (get_queue_device (command_queue), CL_DEVICE_LOCAL_MEM_SIZE,
+                                                    sizeof (cl_ulong), &local_mem_size, NULL));
+        host = n_bins * sizeof (cl_uint) > local_mem_size;
+    }
+
+    if (host) {
+        host_histogram (ufo_buffer_get_host_array (arg, command_queue),
+                        ufo_buffer_get_size (arg) / sizeof (gfloat),
+                        min, max, n_bins, histogram);
+        return;
+    }
+
+    arrays = use_device_arrays (arg, NULL);
+    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME,
+                                              arrays ? "histogram_array" : "histogram_image", &error);
+
+    if (error) {
+        g_error ("%s\n", error->message);
+        return;
+    }
+
+    /* The zeroed result doubles as the initial global histogram */
+    memset (histogram, 0, n_bins * sizeof (guint));
+    d_arg = get_device_mem (arg, arrays, command_queue);
+    d_histogram = clCreateBuffer (ufo_resources_get_context (resources),
+                                  CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                                  n_bins * sizeof (cl_uint), histogram, &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+
+    g_static_mutex_lock (&mutex);
+    local_size = get_local_reduce_size (kernel, command_queue);
+    global_size = REDUCE_N_GROUPS * local_size;
+
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(gfloat), (void *) &min));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(gfloat), (void *) &max));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, sizeof(cl_uint), (void *) &n_bins));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 4, sizeof(void *), (void *) &d_histogram));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 5, n_bins * sizeof(cl_uint), NULL));
+
+    if (arrays) {
+        cl_uint n = (cl_uint) (ufo_buffer_get_size (arg) / sizeof (gfloat));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 6, sizeof(cl_uint), (void *) &n));
+    }
+
+    n_events = collect_wait_list (NULL, &arg, 1, wait_list);
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
+                                                       1, NULL, &global_size, &local_size,
+                                                       n_events, n_events > 0 ? wait_list : NULL,
+                                                       NULL));
+    release_wait_list (wait_list, n_events);
+    g_static_mutex_unlock (&mutex);
+
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBuffer (command_queue, d_histogram, CL_TRUE,
+                                                    0, n_bins * sizeof (cl_uint), histogram,
+                                                    0, NULL, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (d_histogram));
+}
+
+#define PERCENTILE_N_BINS   4096
+
+/**
+ * ufo_op_percentiles:
+ * @arg: A #UfoBuffer
+ * @percents: (array length=n_percents): Percentiles to compute between 0 and 100
+ * @n_percents: Number of percentiles
+ * @results: (array length=n_percents): Location for @n_percents values
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Approximate percentiles of @arg, e.g. for auto-contrast. The values are
+ * interpolated within the bins of a histogram over the value range of @arg,
+ * so the error is at most 1/4096 of that range.
+ */
+void
+ufo_op_percentiles (UfoBuffer *arg,
+                    const gfloat *percents,
+                    guint n_percents,
+                    gfloat *results,
+                    UfoResources *resources,
+                    gpointer command_queue)
+{
+    guint *histogram;
+    guint64 total = 0;
+    gfloat min;
+    gfloat max;
+    gfloat bin_width;
+
+    ufo_op_min_max (arg, &min, &max, resources, command_queue);
+
+    if (!(max > min)) {
+        for (guint i = 0; i < n_percents; i++)
+            results[i] = min;
+
+        return;
+    }
+
+    histogram = g_new (guint, PERCENTILE_N_BINS);
+    ufo_op_histogram (arg, min, max, PERCENTILE_N_BINS, histogram, resources, command_queue);
+    bin_width = (max - min) / PERCENTILE_N_BINS;
+
+    for (guint i = 0; i < PERCENTILE_N_BINS; i++)
+        total += histogram[i];
+
+    for (guint i = 0; i < n_percents; i++) {
+        gdouble rank = CLAMP (percents[i], 0.0f, 100.0f) / 100.0 * total;
+        guint64 count = 0;
+        guint bin = 0;
+
+        while (bin < PERCENTILE_N_BINS - 1 && count + histogram[bin] < rank)
+            count += histogram[bin++];
+
+        results[i] = min + bin_width * bin;
+
+        if (histogram[bin] > 0)
+            results[i] += bin_width * (gfloat) ((rank - count) / histogram[bin]);
+    }
+
+    g_free (histogram);
+}
+
+typedef struct {
+    gfloat *m2;
+    gfloat *variance;
+    guint   n_frames;
+} RunningStats;
+
+/* job->a is the new frame and job->out the mean */
+static void
+host_running_stats_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    RunningStats *stats = job->user_data;
+    guint n_frames = stats->n_frames;
+
+    for (gsize i = first_row * job->width; i < last_row * job->width; i++) {
+        gfloat x = job->a[i];
+        gfloat old_mean = n_frames > 0 ? job->out[i] : x;
+        gfloat new_mean = old_mean + (x - old_mean) / (n_frames + 1);
+
+        stats->m2[i] = (n_frames > 0 ? stats->m2[i] : 0.0f) + (x - old_mean) * (x - new_mean);
+        job->out[i] = new_mean;
+
+        if (stats->variance != NULL)
+            stats->variance[i] = stats->m2[i] / (n_frames + 1);
+    }
+}
+
+static void
+resize_if_needed (UfoBuffer *buffer, UfoRequisition *requisition)
+{
+    if (ufo_buffer_cmp_dimensions (buffer, requisition) != 0)
+        ufo_buffer_resize (buffer, requisition);
+}
+
+/**
+ * ufo_op_running_stats:
+ * @arg: A #UfoBuffer with the next frame
+ * @mean: A #UfoBuffer with the running mean
+ * @m2: A #UfoBuffer with the running sum of squared deviations
+ * @variance: (allow-none): A #UfoBuffer for the variance or %NULL
+ * @n_frames: Number of frames already accumulated in @mean and @m2
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Add @arg to the per-element running mean and variance of a frame stack using
+ * Welford's update. @mean and @m2 are overwritten if @n_frames is 0 and must be
+ * passed unchanged with increasing @n_frames afterwards. They stay in device
+ * memory between frames. If @variance is given, it receives the population
+ * variance of all @n_frames + 1 frames.
+ *
+ * Returns: (transfer full): Event of the update or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_running_stats (UfoBuffer *arg,
+                      UfoBuffer *mean,
+                      UfoBuffer *m2,
+                      UfoBuffer *variance,
+                      guint n_frames,
+                      UfoResources *resources,
+                      gpointer command_queue)
+{
+    UfoRequisition requisition;
+    UfoBuffer *inputs[3] = { arg, m2, variance };
+    cl_kernel kernel;
+    cl_mem d_arg;
+    cl_mem d_mean;
+    cl_mem d_m2;
+    cl_mem d_variance;
+    cl_uint write_variance = variance != NULL;
+    cl_uint n;
+    cl_event event;
+    gsize work_size;
+    GError *error = NULL;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    ufo_buffer_get_requisition (arg, &requisition);
+    resize_if_needed (mean, &requisition);
+    resize_if_needed (m2, &requisition);
+
+    if (variance != NULL)
+        resize_if_needed (variance, &requisition);
+
+    if (use_host (resources, command_queue, arg, mean)) {
+        RunningStats stats;
+        HostJob job;
+
+        host_job_init (&job, arg, NULL, mean);
+        stats.m2 = ufo_buffer_get_host_array (m2, NULL);
+        stats.variance = variance != NULL ? ufo_buffer_get_host_array (variance, NULL) : NULL;
+        stats.n_frames = n_frames;
+        job.user_data = &stats;
+        host_run (host_running_stats_rows, &job);
+        return host_done (resources, command_queue);
+    }
+
+    /* mean and m2 are read and written, which images cannot do in one kernel */
+    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "running_stats", &error);
+
+    if (error) {
+        g_error ("%s\n", error->message);
+        return NULL;
+    }
+
+    d_arg = ufo_buffer_get_device_array (arg, command_queue);
+    d_mean = ufo_buffer_get_device_array (mean, command_queue);
+    d_m2 = ufo_buffer_get_device_array (m2, command_queue);
+    d_variance = variance != NULL ? ufo_buffer_get_device_array (variance, command_queue) : d_m2;
+    n = (cl_uint) (ufo_buffer_get_size (arg) / sizeof (gfloat));
+    work_size = n;
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_mean));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_m2));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, sizeof(void *), (void *) &d_variance));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 4, sizeof(cl_uint), (void *) &write_variance));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 5, sizeof(cl_uint), (void *) &n_frames));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 6, sizeof(cl_uint), (void *) &n));
+    event = launch_after (resources, command_queue, kernel, 1, &work_size,
+                          mean, inputs, variance != NULL ? 3 : 2);
+    g_static_mutex_unlock (&mutex);
+
+    ufo_buffer_set_event (m2, event);
+
+    if (variance != NULL)
+        ufo_buffer_set_event (variance, event);
+
+    return event;
+}
+
+/**
+ * ufo_op_POSC:
+ * @arg: A #UfoBuffer
+ * @out: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Returns: (transfer full): Event of the POSC operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_POSC (UfoBuffer *arg,
+             UfoBuffer *out,
+             UfoResources *resources,
+             gpointer command_queue)
+{
+    UfoRequisition arg_requisition;
+    cl_event event;
+    GError *error = NULL;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    ufo_buffer_get_requisition (arg, &arg_requisition);
+    ufo_buffer_resize (out, &arg_requisition);
+
+    if (use_host (resources, command_queue, arg, NULL))
+        return host_operation (host_posc_rows, arg, NULL, 0.0f, out, resources, command_queue);
+
+    cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
+    cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
+
+    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "POSC", &error);
+
+    if (error) {
+        g_error ("%s\n", error->message);
+    }
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_out));
+
+    event = launch_after (resources, command_queue, kernel,
+                          arg_requisition.n_dims, arg_requisition.dims, out, &arg, 1);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+/**
+ * ufo_op_gradient_descent:
+ * @arg: A #UfoBuffer
+ * @out: A #UfoBuffer
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Returns: (transfer full): Event of the POSC operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_gradient_descent (UfoBuffer *arg,
+                         UfoBuffer *out,
+                         UfoResources *resources,
+                         gpointer command_queue)
+{
+    UfoRequisition arg_requisition;
+    cl_event event;
+    gboolean tiled;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    ufo_buffer_get_requisition (arg, &arg_requisition);
+    ufo_buffer_resize (out, &arg_requisition);
+
+    if (use_host (resources, command_queue, arg, NULL))
+        return host_operation (host_descent_rows, arg, NULL, 0.0f, out, resources, command_queue);
+
+    cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
+    cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
+
+    cl_kernel kernel = get_stencil_kernel (resources, command_queue, "descent_grad",
+                                           &arg_requisition, &tiled);
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 1, sizeof(void *), (void *) &d_out));
+
+    if (tiled)
+        event = launch_tiled (command_queue, kernel, &arg_requisition, out, &arg, 1);
+    else
+        event = launch_after (resources, command_queue, kernel,
+                              arg_requisition.n_dims, arg_requisition.dims, out, &arg, 1);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+/**
+ * ufo_op_tv_step:
+ * @arg: A #UfoBuffer
+ * @out: A #UfoBuffer, must be different from @arg
+ * @step: Step size
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Perform one total variation regularization step, i.e. @out = max (0, @arg -
+ * @step * TV gradient of @arg) with the gradient of ufo_op_gradient_descent().
+ * This replaces the sequence ufo_op_gradient_descent(), ufo_op_add2() and
+ * ufo_op_POSC() with a single pass over @arg.
+ *
+ * Returns: (transfer full): Event of the operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_tv_step (UfoBuffer *arg,
+                UfoBuffer *out,
+                gfloat step,
+                UfoResources *resources,
+                gpointer command_queue)
+{
+    UfoRequisition requisition;
+    cl_kernel kernel;
+    cl_mem d_arg;
+    cl_mem d_out;
+    cl_event event;
+    gboolean tiled;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    g_return_val_if_fail (arg != out, NULL);
+
+    ufo_buffer_get_requisition (arg, &requisition);
+    ufo_buffer_resize (out, &requisition);
+
+    if (use_host (resources, command_queue, arg, NULL))
+        return host_operation (host_tv_step_rows, arg, NULL, step, out, resources, command_queue);
+
+    d_arg = ufo_buffer_get_device_image (arg, command_queue);
+    d_out = ufo_buffer_get_device_image (out, command_queue);
+    kernel = get_stencil_kernel (resources, command_queue, "tv_step", &requisition, &tiled);
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(gfloat), (void *) &step));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_out));
+
+    if (tiled)
+        event = launch_tiled (command_queue, kernel, &requisition, out, &arg, 1);
+    else
+        event = launch_after (resources, command_queue, kernel,
+                              requisition.n_dims, requisition.dims, out, &arg, 1);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+#define HOST_TRANSPOSE_BLOCK    32
+
+/* job->width and job->height are the dimensions of the transposed output */
+static void
+host_transpose_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    for (gsize y0 = first_row; y0 < last_row; y0 += HOST_TRANSPOSE_BLOCK) {
+        gsize y1 = MIN (y0 + HOST_TRANSPOSE_BLOCK, last_row);
+
+        for (gsize x0 = 0; x0 < job->width; x0 += HOST_TRANSPOSE_BLOCK) {
+            gsize x1 = MIN (x0 + HOST_TRANSPOSE_BLOCK, job->width);
+
+            for (gsize y = y0; y < y1; y++) {
+                for (gsize x = x0; x < x1; x++)
+                    job->out[y * job->width + x] = job->a[x * job->height + y];
+            }
+        }
+    }
+}
+
+/* job->value is the binning factor */
+static void
+host_bin_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    gsize factor = (gsize) job->value;
+    gsize in_width = GPOINTER_TO_SIZE (job->user_data);
+
+    for (gsize y = first_row; y < last_row; y++) {
+        for (gsize x = 0; x < job->width; x++) {
+            gfloat sum = 0.0f;
+
+            for (gsize j = 0; j < factor; j++) {
+                const gfloat *row = job->a + (y * factor + j) * in_width + x * factor;
+
+                for (gsize i = 0; i < factor; i++)
+                    sum += row[i];
+            }
+
+            job->out[y * job->width + x] = sum / (factor * factor);
+        }
+    }
+}
+
+/**
+ * ufo_op_transpose:
+ * @arg: A two-dimensional #UfoBuffer
+ * @out: A #UfoBuffer, must be different from @arg
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Transpose @arg into @out, e.g. to reorder projections into sinograms. On the
+ * device, tiles are staged in local memory so that reads and writes are both
+ * coalesced.
+ *
+ * Returns: (transfer full): Event of the operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_transpose (UfoBuffer *arg,
+                  UfoBuffer *out,
+                  UfoResources *resources,
+                  gpointer command_queue)
+{
+    UfoRequisition requisition;
+    UfoRequisition out_requisition;
+    cl_kernel kernel;
+    cl_mem d_arg;
+    cl_mem d_out;
+    cl_uint width;
+    cl_uint height;
+    cl_event event;
+    gboolean tiled;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    g_return_val_if_fail (arg != out, NULL);
+
+    ufo_buffer_get_requisition (arg, &requisition);
+    g_return_val_if_fail (requisition.n_dims == 2, NULL);
+
+    out_requisition.n_dims = 2;
+    out_requisition.dims[0] = requisition.dims[1];
+    out_requisition.dims[1] = requisition.dims[0];
+    resize_if_needed (out, &out_requisition);
+
+    if (use_host (resources, command_queue, arg, NULL))
+        return host_operation (host_transpose_rows, arg, NULL, 0.0f, out, resources, command_queue);
+
+    d_arg = ufo_buffer_get_device_array (arg, command_queue);
+    d_out = ufo_buffer_get_device_array (out, command_queue);
+    kernel = get_stencil_kernel (resources, command_queue, "transpose", &requisition, &tiled);
+    width = (cl_uint) requisition.dims[0];
+    height = (cl_uint) requisition.dims[1];
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_out));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(cl_uint), (void *) &width));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, sizeof(cl_uint), (void *) &height));
+
+    /* The work items cover the input, not the output */
+    if (tiled)
+        event = launch_tiled (command_queue, kernel, &requisition, out, &arg, 1);
+    else
+        event = launch_after (resources, command_queue, kernel, 2, requisition.dims, out, &arg, 1);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+/**
+ * ufo_op_bin:
+ * @arg: A two-dimensional #UfoBuffer
+ * @out: A #UfoBuffer, must be different from @arg
+ * @factor: Binning factor
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Downsample @arg by averaging @factor x @factor blocks. @out is resized to
+ * the number of complete blocks, remaining border pixels are dropped.
+ *
+ * Returns: (transfer full): Event of the operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_bin (UfoBuffer *arg,
+            UfoBuffer *out,
+            guint factor,
+            UfoResources *resources,
+            gpointer command_queue)
+{
+    UfoRequisition requisition;
+    UfoRequisition out_requisition;
+    cl_kernel kernel;
+    cl_mem d_arg;
+    cl_mem d_out;
+    cl_uint in_width;
+    cl_uint out_width;
+    cl_uint out_height;
+    cl_event event;
+    GError *error = NULL;
+    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    g_return_val_if_fail (arg != out && factor > 0, NULL);
+
+    ufo_buffer_get_requisition (arg, &requisition);
+    g_return_val_if_fail (requisition.n_dims == 2, NULL);
+
+    out_requisition.n_dims = 2;
+    out_requisition.dims[0] = requisition.dims[0] / factor;
+    out_requisition.dims[1] = requisition.dims[1] / factor;
+    resize_if_needed (out, &out_requisition);
+
+    if (use_host (resources, command_queue, arg, NULL)) {
+        HostJob job;
+
+        host_job_init (&job, arg, NULL, out);
+        job.value = (gfloat) factor;
+        job.user_data = GSIZE_TO_POINTER (requisition.dims[0]);
+        host_run (host_bin_rows, &job);
+        return host_done (resources, command_queue);
+    }
+
+    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "bin", &error);
+
+    if (error) {
+        g_error ("%s\n", error->message);
+        return NULL;
+    }
+
+    d_arg = ufo_buffer_get_device_array (arg, command_queue);
+    d_out = ufo_buffer_get_device_array (out, command_queue);
+    in_width = (cl_uint) requisition.dims[0];
+    out_width = (cl_uint) out_requisition.dims[0];
+    out_height = (cl_uint) out_requisition.dims[1];
+
+    g_static_mutex_lock (&mutex);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_out));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(cl_uint), (void *) &in_width));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, sizeof(cl_uint), (void *) &out_width));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 4, sizeof(cl_uint), (void *) &out_height));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 5, sizeof(cl_uint), (void *) &factor));
+    event = launch_after (resources, command_queue, kernel, 2, out_requisition.dims, out, &arg, 1);
+    g_static_mutex_unlock (&mutex);
+
+    return event;
+}
+
+/**
+ * ufo_op_crop:
+ * @arg: A two-dimensional #UfoBuffer
+ * @out: A #UfoBuffer, must be different from @arg
+ * @x: Horizontal offset of the region in @arg, may be negative
+ * @y: Vertical offset of the region in @arg, may be negative
+ * @width: Width of the region
+ * @height: Height of the region
+ * @fill: Value for parts of the region outside of @arg
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
+ *
+ * Copy a @width x @height region of interest starting at (@x, @y) into @out.
+ * Regions that extend beyond @arg are padded with @fill, so the same call
+ * crops and pads. On the device, the region is copied with a rectangular
+ * buffer copy without any kernel.
+ *
+ * Returns: (transfer full): Event of the operation or %NULL if
+ * no @command_queue was given
+ */
+gpointer
+ufo_op_crop (UfoBuffer *arg,
+             UfoBuffer *out,
+             gint x,
+             gint y,
+             guint width,
+             guint height,
+             gfloat fill,
+             UfoResources *resources,
+             gpointer command_queue)
+{
+    UfoRequisition requisition;
+    UfoRequisition out_requisition;
+    gint in_width;
+    gint in_height;
+    gint x0, y0, x1, y1;
+    cl_event event = NULL;
+
+    g_return_val_if_fail (arg != out && width > 0 && height > 0, NULL);
+
+    ufo_buffer_get_requisition (arg, &requisition);
+    g_return_val_if_fail (requisition.n_dims == 2, NULL);
+
+    out_requisition.n_dims = 2;
+    out_requisition.dims[0] = width;
+    out_requisition.dims[1] = height;
+    resize_if_needed (out, &out_requisition);
+
+    /* Intersection of the region with @arg in input coordinates */
+    in_width = (gint) requisition.dims[0];
+    in_height = (gint) requisition.dims[1];
+    x0 = MAX (x, 0);
+    y0 = MAX (y, 0);
+    x1 = MIN (x + (gint) width, in_width);
+    y1 = MIN (y + (gint) height, in_height);
+
+    if (use_host (resources, command_queue, arg, NULL)) {
+        const gfloat *in_data = ufo_buffer_get_host_array (arg, NULL);
+        gfloat *out_data = ufo_buffer_get_host_array (out, NULL);
+
+        if (x0 > x || y0 > y || x1 < x + (gint) width || y1 < y + (gint) height)
+            ufo_op_set (out, fill, NULL, NULL);
+
+        for (gint row = y0; row < y1 && x0 < x1; row++)
+            memcpy (out_data + (row - y) * width + (x0 - x),
+                    in_data + row * in_width + x0,
+                    (x1 - x0) * sizeof (gfloat));
+
+        return host_done (resources, command_queue);
+    }
+
+    if (x0 > x || y0 > y || x1 < x + (gint) width || y1 < y + (gint) height) {
+        /* Fill the array so the copy below can wait on it */
+        ufo_buffer_get_device_array (out, command_queue);
+        event = ufo_op_set (out, fill, resources, command_queue);
+    }
+
+    if (x0 < x1 && y0 < y1) {
+        cl_mem d_arg;
+        cl_mem d_out;
+        cl_event wait_list[2];
+        guint n_events;
+        gsize src_origin[3] = { x0 * sizeof (gfloat), y0, 0 };
+        gsize dst_origin[3] = { (x0 - x) * sizeof (gfloat), y0 - y, 0 };
+        gsize region[3] = { (x1 - x0) * sizeof (gfloat), y1 - y0, 1 };
+
+        d_arg = ufo_buffer_get_device_array (arg, command_queue);
+        d_out = ufo_buffer_get_device_array (out, command_queue);
+        n_events = collect_wait_list (out, &arg, 1, wait_list);
+
+        if (event != NULL)
+            UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueCopyBufferRect (command_queue, d_arg, d_out,
+                                                            src_origin, dst_origin, region,
+                                                            in_width * sizeof (gfloat), 0,
+                                                            width * sizeof (gfloat), 0,
+                                                            n_events, n_events > 0 ? wait_list : NULL,
+                                                            &event));
+        release_wait_list (wait_list, n_events);
+        ufo_buffer_set_event (out, event);
+    }
+
+    return event;
+}
+
+/* Same mapping as border_index in ufo-basic-ops.cl */
+static gssize
+host_border_index (gssize i, gssize n, UfoOpBorder border)
+{
+    if (i >= 0 && i < n)
+        return i;
+
+    if (border == UFO_OP_BORDER_ZERO)
+        return -1;
+
+    if (border == UFO_OP_BORDER_MIRROR)
+        i = i < 0 ? -i - 1 : 2 * n - i - 1;
+
+    return CLAMP (i, 0, n - 1);
+}
+
+typedef struct {
+    const gfloat *weights;
+    gssize        radius;
+    UfoOpBorder   border;
+} HostConvolution;
+
+static void
+host_convolve_rows (HostJob *job, gsize first_row, gsize last_row)
+{
+    HostConvolution *conv = job->user_data;
+    gssize radius = conv->radius;
+    gssize width = (gssize) job->width;
+    gfloat *padded;
+
+    padded = g_malloc ((width + 2 * radius) * sizeof (gfloat));
+
+    for (gsize y = first_row; y < last_row; y++) {
+        const gfloat *in = job->a + y * width;
+        gfloat *out = job->out + y * width;
+        gssize x = 0;
+
+        for (gssize i = 0; i < width + 2 * radius; i++) {
+            gssize index = host_border_index (i - radius, width, conv->border);
+            padded[i] = index < 0 ? 0.0f : in[index];
+        }
+
+#ifdef HOST_VECTOR_SIZE
+        for (; x + HOST_VECTOR_SIZE <= width; x += HOST_VECTOR_SIZE) {
+            HostVector sum = host_vector_set (0.0f);
+
+            for (gssize k = 0; k <= 2 * radius; k++) {
+                HostVector v = host_vector_load (padded + x + 2 * radius - k);
+                sum = host_vector_add (sum, host_vector_mul (host_vector_set (conv->weights[k]), v));
+            }
+
+            host_vector_store (out + x, sum);
+        }
+#endif
+
+        for (; x < width; x++) {
+            gfloat sum = 0.0f;
+
+            for (gssize k = 0; k <= 2 * radius; k++)
+                sum += conv->weights[k] * padded[x + 2 * radius - k];
+
+            out[x] = sum;
+        }
+    }
+
+    g_free (padded);
+}
+
+static void
+host_convolve_columns (HostJob *job, gsize first_row, gsize last_row)
+{
+    HostConvolution *conv = job->user_data;
+    gssize radius = conv->radius;
+    gsize width = job->width;
+
+    for (gsize y = first_row; y < last_row; y++) {
+        gfloat *out = job->out + y * width;
+
+        memset (out, 0, width * sizeof (gfloat));
+
+        /* Accumulate whole rows so the inner loop runs over contiguous memory */
+        for (gssize k = 0; k <= 2 * radius; k++) {
+            gssize row = host_border_index ((gssize) y + radius - k, (gssize) job->height, conv->border);
+            const gfloat *in;
+            gfloat weight = conv->weights[k];
+            gsize x = 0;
 
-/**
- * ufo_op_set:
- * @arg: A #UfoBuffer
- * @value: Value to fill @arg with
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * Fill a buffer with a value using OpenCL.
- *
- * Returns: (transfer full): Event of the set operation
- */
-gpointer
-ufo_op_set (UfoBuffer *arg,
-            gfloat value,
-            UfoResources *resources,
-            gpointer command_queue)
+            if (row < 0)
+                continue;
+
+            in = job->a + row * width;
+
+#ifdef HOST_VECTOR_SIZE
+            for (; x + HOST_VECTOR_SIZE <= width; x += HOST_VECTOR_SIZE) {
+                HostVector scaled = host_vector_mul (host_vector_set (weight), host_vector_load (in + x));
+                host_vector_store (out + x, host_vector_add (host_vector_load (out + x), scaled));
+            }
+#endif
+
+            for (; x < width; x++)
+                out[x] += weight * in[x];
+        }
+    }
+}
+
+static cl_kernel
+get_convolve_kernel (UfoResources *resources,
+                     gpointer command_queue,
+                     const gchar *kernel_name,
+                     UfoRequisition *requisition,
+                     guint radius,
+                     gboolean *tiled)
 {
-    UfoRequisition requisition;
     cl_kernel kernel;
-    cl_mem d_arg;
-    cl_event event;
+    cl_ulong local_mem_size;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
 
-    ufo_buffer_get_requisition (arg, &requisition);
-    d_arg = ufo_buffer_get_device_image (arg, command_queue);
-    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "operation_set", &error);
+    kernel = get_stencil_kernel (resources, command_queue, kernel_name, requisition, tiled);
+
+    if (!*tiled)
+        return kernel;
+
+    /* Large radii need an apron that does not fit into local memory */
+    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (get_queue_device (command_queue), CL_DEVICE_LOCAL_MEM_SIZE,
+                                                sizeof (cl_ulong), &local_mem_size, NULL));
+
+    if ((OPS_TILE_SIZE + 2 * radius) * OPS_TILE_SIZE * sizeof (gfloat) <= local_mem_size)
+        return kernel;
+
+    *tiled = FALSE;
+    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, kernel_name, &error);
 
     if (error) {
         g_error ("%s\n", error->message);
         return NULL;
     }
 
-    g_static_mutex_lock (&mutex);
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(gfloat), (void *) &value));
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       requisition.n_dims, NULL, requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    return kernel;
+}
+
+static void
+set_convolve_args (cl_kernel kernel,
+                   gboolean tiled,
+                   cl_mem in,
+                   cl_mem out,
+                   cl_mem weights,
+                   cl_int radius,
+                   UfoRequisition *requisition,
+                   cl_int border)
+{
+    cl_int width = (cl_int) requisition->dims[0];
+    cl_int height = (cl_int) requisition->dims[1];
+
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &in));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &out));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &weights));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, sizeof(cl_int), (void *) &radius));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 4, sizeof(cl_int), (void *) &width));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 5, sizeof(cl_int), (void *) &height));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 6, sizeof(cl_int), (void *) &border));
+
+    if (tiled) {
+        gsize tile_size = (OPS_TILE_SIZE + 2 * radius) * OPS_TILE_SIZE * sizeof (gfloat);
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 7, tile_size, NULL));
+    }
+}
 
+static cl_event
+launch_convolve_pass (UfoResources *resources,
+                      gpointer command_queue,
+                      cl_kernel kernel,
+                      gboolean tiled,
+                      UfoRequisition *requisition,
+                      guint n_events,
+                      cl_event *wait_list)
+{
+    cl_event event;
+
+    if (tiled)
+        return enqueue_tiled (command_queue, kernel, requisition, n_events, wait_list);
+
+    ufo_resources_launch_kernel (resources, command_queue, kernel, 2, requisition->dims,
+                                 n_events, wait_list, &event);
     return event;
 }
 
 /**
- * ufo_op_inv:
- * @arg: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * ufo_op_convolve_separable:
+ * @arg: A two-dimensional #UfoBuffer
+ * @out: A #UfoBuffer, must be different from @arg
+ * @weights: (array length=size): Filter weights, the centre at @size / 2
+ * @size: Number of weights, must be odd
+ * @border: Handling of pixels outside of @arg
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
  *
- * Invert @arg.
+ * Convolve @arg with the separable 2D filter given by the outer product of
+ * @weights with itself, e.g. a Gaussian. Rows and columns are filtered in two
+ * passes that stage tiles and their apron in local memory. @weights are
+ * uploaded once per device with ufo_resources_get_constant_buffer().
  *
- * Returns: (transfer full): Event of the invert operation
+ * Returns: (transfer full): Event of the operation or %NULL if
+ * no @command_queue was given
  */
 gpointer
-ufo_op_inv (UfoBuffer *arg,
-            UfoResources *resources,
-            gpointer command_queue)
+ufo_op_convolve_separable (UfoBuffer *arg,
+                           UfoBuffer *out,
+                           const gfloat *weights,
+                           guint size,
+                           UfoOpBorder border,
+                           UfoResources *resources,
+                           gpointer command_queue)
 {
     UfoRequisition requisition;
-    cl_event event;
-    cl_kernel kernel;
+    cl_kernel rows_kernel;
+    cl_kernel columns_kernel;
     cl_mem d_arg;
+    cl_mem d_out;
+    cl_mem d_tmp;
+    cl_mem d_weights;
+    cl_int errcode;
+    cl_event wait_list[2];
+    cl_event rows_event;
+    cl_event event;
+    guint n_events;
+    gboolean rows_tiled;
+    gboolean columns_tiled;
+    guint radius = size / 2;
     GError *error = NULL;
     static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
 
+    g_return_val_if_fail (arg != out && size % 2 == 1, NULL);
+
     ufo_buffer_get_requisition (arg, &requisition);
+    g_return_val_if_fail (requisition.n_dims == 2, NULL);
+    resize_if_needed (out, &requisition);
+
+    if (use_host (resources, command_queue, arg, NULL)) {
+        HostConvolution conv = { weights, radius, border };
+        HostJob job;
+        gfloat *tmp;
+
+        host_job_init (&job, arg, NULL, out);
+        tmp = g_malloc (job.width * job.height * sizeof (gfloat));
+        job.user_data = &conv;
+        job.out = tmp;
+        host_run (host_convolve_rows, &job);
+
+        job.a = tmp;
+        job.out = ufo_buffer_get_host_array (out, NULL);
+        host_run (host_convolve_columns, &job);
+        g_free (tmp);
+        return host_done (resources, command_queue);
+    }
 
-    d_arg = ufo_buffer_get_device_image (arg, command_queue);
-    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "operation_inv", &error);
+    rows_kernel = get_convolve_kernel (resources, command_queue, "convolve_rows",
+                                       &requisition, radius, &rows_tiled);
+    columns_kernel = get_convolve_kernel (resources, command_queue, "convolve_columns",
+                                          &requisition, radius, &columns_tiled);
+
+    d_arg = ufo_buffer_get_device_array (arg, command_queue);
+    d_out = ufo_buffer_get_device_array (out, command_queue);
+    d_weights = ufo_resources_get_constant_buffer (resources, get_queue_device (command_queue),
+                                                   weights, size * sizeof (gfloat), &error);
 
     if (error) {
         g_error ("%s\n", error->message);
         return NULL;
     }
 
+    d_tmp = clCreateBuffer (ufo_resources_get_context (resources), CL_MEM_READ_WRITE,
+                            ufo_buffer_get_size (arg), NULL, &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+
     g_static_mutex_lock (&mutex);
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 0, sizeof(void *), (void *) &d_arg));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 1, sizeof(void *), (void *) &d_arg));
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel(command_queue, kernel,
-                                                      requisition.n_dims, NULL, requisition.dims,
-                                                      NULL, 0, NULL, &event));
+    set_convolve_args (rows_kernel, rows_tiled, d_arg, d_tmp, d_weights, radius, &requisition, border);
+    n_events = collect_wait_list (NULL, &arg, 1, wait_list);
+    rows_event = launch_convolve_pass (resources, command_queue, rows_kernel, rows_tiled,
+                                       &requisition, n_events, wait_list);
+    release_wait_list (wait_list, n_events);
+
+    set_convolve_args (columns_kernel, columns_tiled, d_tmp, d_out, d_weights, radius, &requisition, border);
+    wait_list[0] = rows_event;
+    n_events = 1 + collect_wait_list (out, NULL, 0, wait_list + 1);
+    event = launch_convolve_pass (resources, command_queue, columns_kernel, columns_tiled,
+                                  &requisition, n_events, wait_list);
+    release_wait_list (wait_list + 1, n_events - 1);
     g_static_mutex_unlock (&mutex);
 
+    /* The intermediate buffer is freed once the column pass is done with it */
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (rows_event));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (d_tmp));
+    ufo_buffer_set_event (out, event);
+
     return event;
 }
 
-/**
- * ufo_op_mul:
- * @arg1: A #UfoBuffer
- * @arg2: A #UfoBuffer
- * @out: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * out = arg1 * arg2
- *
- * Returns: (transfer full): Event of the mul operation
- */
-gpointer
-ufo_op_mul (UfoBuffer *arg1,
-            UfoBuffer *arg2,
-            UfoBuffer *out,
-            UfoResources *resources,
-            gpointer command_queue)
+typedef enum {
+    EXPR_CONSTANT,
+    EXPR_VARIABLE,
+    EXPR_NEGATE,
+    EXPR_BINARY,
+    EXPR_CALL
+} ExprType;
+
+typedef struct {
+    const gchar *name;
+    const gchar *cl_name;
+    guint        n_args;
+} ExprFunction;
+
+typedef struct _ExprNode ExprNode;
+
+struct _ExprNode {
+    ExprType            type;
+    gchar               op;
+    gdouble             value;
+    guint               index;
+    const ExprFunction *func;
+    ExprNode           *left;
+    ExprNode           *right;
+};
+
+typedef struct {
+    const gchar *pos;
+    guint        n_args;
+    gboolean     failed;
+} ExprParser;
+
+static const ExprFunction expr_functions[] = {
+    { "sqrt", "sqrt", 1 },
+    { "fabs", "fabs", 1 },
+    { "exp",  "exp",  1 },
+    { "log",  "log",  1 },
+    { "min",  "fmin", 2 },
+    { "max",  "fmax", 2 },
+    { "pow",  "pow",  2 },
+};
+
+static ExprNode *parse_sum (ExprParser *parser);
+
+static void
+expr_node_free (ExprNode *node)
 {
-    return operation ("operation_mul", arg1, arg2, out, resources, command_queue);
-}
+    if (node == NULL)
+        return;
 
-/**
- * ufo_op_add:
- * @arg1: A #UfoBuffer
- * @arg2: A #UfoBuffer
- * @out: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * out = arg1 + arg2
- *
- * Returns: (transfer full): Event of the add operation
- */
-gpointer
-ufo_op_add (UfoBuffer *arg1,
-            UfoBuffer *arg2,
-            UfoBuffer *out,
-            UfoResources *resources,
-            gpointer command_queue)
-{
-    return operation ("operation_add", arg1, arg2, out, resources, command_queue);
+    expr_node_free (node->left);
+    expr_node_free (node->right);
+    g_free (node);
 }
 
-/**
- * ufo_op_add2:
- * @arg1: A #UfoBuffer
- * @arg2: A #UfoBuffer
- * @modifier: Scalar value
- * @out: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * @out = @arg1 + @modifier * @arg2
- *
- * Returns: (transfer full): Event of the add operation
- */
-gpointer
-ufo_op_add2 (UfoBuffer *arg1,
-             UfoBuffer *arg2,
-             gfloat modifier,
-             UfoBuffer *out,
-             UfoResources *resources,
-             gpointer command_queue)
+static ExprNode *
+expr_node_new (ExprType type, ExprNode *left, ExprNode *right)
 {
-    return operation2 ("operation_add2", arg1, arg2, modifier, out, resources, command_queue);
-}
+    ExprNode *node = g_new0 (ExprNode, 1);
 
-/**
- * ufo_op_deduction:
- * @arg1: A #UfoBuffer
- * @arg2: A #UfoBuffer
- * @out: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * @out = @arg1 - @arg2
- *
- * Returns: (transfer full): Event of the add operation
- */
-gpointer
-ufo_op_deduction (UfoBuffer *arg1,
-                  UfoBuffer *arg2,
-                  UfoBuffer *out,
-                  UfoResources *resources,
-                  gpointer command_queue)
-{
-    return operation ("operation_deduction", arg1, arg2, out, resources, command_queue);
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    return node;
 }
 
-/**
- * ufo_op_deduction2:
- * @arg1: A #UfoBuffer
- * @arg2: A #UfoBuffer
- * @modifier: Scalar value
- * @out: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * @out = @arg1 - @modifier * @arg2
- *
- * Returns: (transfer full): Event of the add operation
- */
-gpointer
-ufo_op_deduction2 (UfoBuffer *arg1,
-                   UfoBuffer *arg2,
-                   gfloat modifier,
-                   UfoBuffer *out,
-                   UfoResources *resources,
-                   gpointer command_queue)
+static gchar
+parser_peek (ExprParser *parser)
 {
-    return operation2 ("operation_deduction2", arg1, arg2, modifier, out, resources, command_queue);
+    while (g_ascii_isspace (*parser->pos))
+        parser->pos++;
+
+    return *parser->pos;
 }
 
-/**
- * ufo_op_mul_rows:
- * @arg1: A #UfoBuffer
- * @arg2: A #UfoBuffer
- * @offset: Offset
- * @n: n ?
- * @out: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * @out = @arg1 - @modifier * @arg2
- *
- * Returns: (transfer full): Event of the add operation
- */
-gpointer
-ufo_op_mul_rows (UfoBuffer *arg1,
-                 UfoBuffer *arg2,
-                 UfoBuffer *out,
-                 guint offset,
-                 guint n,
-                 UfoResources *resources,
-                 gpointer command_queue)
+static ExprNode *
+parser_fail (ExprParser *parser, const gchar *message, ExprNode *partial)
 {
-    cl_event event;
-    UfoRequisition arg1_requisition, arg2_requisition, out_requisition;
-    GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+    if (!parser->failed)
+        g_warning ("Invalid expression at `%s': %s", parser->pos, message);
 
-    ufo_buffer_get_requisition (arg1, &arg1_requisition);
-    ufo_buffer_get_requisition (arg2, &arg2_requisition);
-    ufo_buffer_get_requisition (out, &out_requisition);
+    parser->failed = TRUE;
+    expr_node_free (partial);
+    return NULL;
+}
 
-    if (arg1_requisition.dims[0] != arg2_requisition.dims[0] ||
-        arg1_requisition.dims[0] != out_requisition.dims[0]) {
-        g_error ("Number of columns is different.");
-        return NULL;
-    }
+static ExprNode *
+parse_call (ExprParser *parser, const gchar *name, gsize length)
+{
+    const ExprFunction *func = NULL;
+    ExprNode *node;
 
-    if (arg1_requisition.dims[1] < offset + n ||
-        arg2_requisition.dims[1] < offset + n ||
-        out_requisition.dims[1] < offset + n) {
-        g_error ("Rows are not enough.");
-        return NULL;
+    for (guint i = 0; i < G_N_ELEMENTS (expr_functions); i++) {
+        if (strlen (expr_functions[i].name) == length &&
+            strncmp (expr_functions[i].name, name, length) == 0)
+            func = &expr_functions[i];
     }
 
-    cl_mem d_arg1 = ufo_buffer_get_device_image (arg1, command_queue);
-    cl_mem d_arg2 = ufo_buffer_get_device_image (arg2, command_queue);
-    cl_mem d_out  = ufo_buffer_get_device_image (out, command_queue);
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "op_mulRows", &error);
+    if (func == NULL || parser_peek (parser) != '(')
+        return parser_fail (parser, "unknown function or variable", NULL);
 
-    if (error != NULL) {
-        g_error ("Error: %s\n", error->message);
-        return NULL;
-    }
+    parser->pos++;
+    node = expr_node_new (EXPR_CALL, parse_sum (parser), NULL);
+    node->func = func;
 
-    g_static_mutex_lock (&mutex);
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg1));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_arg2));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_out));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, sizeof(unsigned int), (void *) &offset));
+    if (func->n_args == 2) {
+        if (parser_peek (parser) != ',')
+            return parser_fail (parser, "expected `,'", node);
 
-    UfoRequisition operation_requisition = out_requisition;
-    operation_requisition.dims[1] = n;
+        parser->pos++;
+        node->right = parse_sum (parser);
+    }
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       operation_requisition.n_dims, NULL, operation_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    if (parser->failed || parser_peek (parser) != ')')
+        return parser_fail (parser, "expected `)'", node);
 
-    return event;
+    parser->pos++;
+    return node;
 }
 
-static cl_event
-operation (const gchar *kernel_name,
-           UfoBuffer *arg1,
-           UfoBuffer *arg2,
-           UfoBuffer *out,
-           UfoResources *resources,
-           gpointer command_queue)
+static ExprNode *
+parse_factor (ExprParser *parser)
 {
-    UfoRequisition arg1_requisition, arg2_requisition, out_requisition;
-    cl_event event;
-    GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+    ExprNode *node;
+    gchar c = parser_peek (parser);
 
-    ufo_buffer_get_requisition (arg1, &arg1_requisition);
-    ufo_buffer_get_requisition (arg2, &arg2_requisition);
-    ufo_buffer_get_requisition (out, &out_requisition);
+    if (c == '-') {
+        parser->pos++;
+        return expr_node_new (EXPR_NEGATE, parse_factor (parser), NULL);
+    }
 
-    if ((arg1_requisition.dims[0] != arg2_requisition.dims[0] &&
-         arg1_requisition.dims[0] != out_requisition.dims[0]) ||
-        (arg1_requisition.dims[1] != arg2_requisition.dims[1] &&
-         arg1_requisition.dims[1] != out_requisition.dims[1])) {
-        g_error ("Incorrect volume size.");
-        return NULL;
+    if (c == '(') {
+        parser->pos++;
+        node = parse_sum (parser);
+
+        if (parser->failed || parser_peek (parser) != ')')
+            return parser_fail (parser, "expected `)'", node);
+
+        parser->pos++;
+        return node;
     }
 
-    cl_mem d_arg1 = ufo_buffer_get_device_image (arg1, command_queue);
-    cl_mem d_arg2 = ufo_buffer_get_device_image (arg2, command_queue);
-    cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, kernel_name, &error);
+    if (g_ascii_isdigit (c) || c == '.') {
+        gchar *end;
 
-    if (error) {
-        g_error ("%s\n", error->message);
-        return NULL;
+        node = expr_node_new (EXPR_CONSTANT, NULL, NULL);
+        node->value = g_ascii_strtod (parser->pos, &end);
+
+        if (end == parser->pos)
+            return parser_fail (parser, "expected a number", node);
+
+        parser->pos = end;
+        return node;
     }
 
-    g_static_mutex_lock (&mutex);
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg1));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_arg2));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_out));
+    if (g_ascii_islower (c)) {
+        const gchar *name = parser->pos;
+        gsize length = 0;
+
+        while (g_ascii_isalnum (name[length]) || name[length] == '_')
+            length++;
+
+        parser->pos += length;
+
+        if (length > 1 || parser_peek (parser) == '(')
+            return parse_call (parser, name, length);
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg1_requisition.n_dims, NULL, arg1_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+        if ((guint) (c - 'a') >= parser->n_args)
+            return parser_fail (parser, "variable without argument", NULL);
 
-    return event;
+        node = expr_node_new (EXPR_VARIABLE, NULL, NULL);
+        node->index = (guint) (c - 'a');
+        return node;
+    }
+
+    return parser_fail (parser, "unexpected character", NULL);
 }
 
-static cl_event
-operation2 (const gchar *kernel_name,
-            UfoBuffer *arg1,
-            UfoBuffer *arg2,
-            gfloat modifier,
-            UfoBuffer *out,
-            UfoResources *resources,
-            gpointer command_queue)
+static ExprNode *
+parse_product (ExprParser *parser)
 {
-    UfoRequisition arg1_requisition, arg2_requisition, out_requisition;
-    cl_event event;
-    GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+    ExprNode *node = parse_factor (parser);
 
-    ufo_buffer_get_requisition (arg1, &arg1_requisition);
-    ufo_buffer_get_requisition (arg2, &arg2_requisition);
-    ufo_buffer_get_requisition (out, &out_requisition);
+    while (!parser->failed && (parser_peek (parser) == '*' || parser_peek (parser) == '/')) {
+        gchar op = *parser->pos++;
 
-    if ((arg1_requisition.dims[0] != arg2_requisition.dims[0] &&
-         arg1_requisition.dims[0] != out_requisition.dims[0]) ||
-        (arg1_requisition.dims[1] != arg2_requisition.dims[1] &&
-         arg1_requisition.dims[1] != out_requisition.dims[1])) {
-        g_error ("Incorrect volume size.");
-        return NULL;
+        node = expr_node_new (EXPR_BINARY, node, parse_factor (parser));
+        node->op = op;
     }
 
-    cl_mem d_arg1 = ufo_buffer_get_device_image (arg1, command_queue);
-    cl_mem d_arg2 = ufo_buffer_get_device_image (arg2, command_queue);
-    cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, kernel_name, &error);
+    return node;
+}
 
-    if (error) {
-        g_error ("%s\n", error->message);
-        return NULL;
-    }
+static ExprNode *
+parse_sum (ExprParser *parser)
+{
+    ExprNode *node = parse_product (parser);
 
-    g_static_mutex_lock (&mutex);
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 0, sizeof(void *), (void *) &d_arg1));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 1, sizeof(void *), (void *) &d_arg2));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 2, sizeof(gfloat), (void *) &modifier));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 3, sizeof(void *), (void *) &d_out));
+    while (!parser->failed && (parser_peek (parser) == '+' || parser_peek (parser) == '-')) {
+        gchar op = *parser->pos++;
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg1_requisition.n_dims, NULL, arg1_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+        node = expr_node_new (EXPR_BINARY, node, parse_product (parser));
+        node->op = op;
+    }
 
-    return event;
+    return node;
 }
 
-/**
- * ufo_op_gradient_magnitudes:
- * @arg: A #UfoBuffer
- * @out: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * Compute magnitude of gradients
- *
- * Returns: (transfer full): Event of the add operation
+/*
+ * Constants become kernel arguments c0, c1, ... numbered in the order of
+ * traversal, so that expressions that differ only in their constants share
+ * the same source and thus the same cached kernel. In @vector code the
+ * variables are float4 and constants are widened because functions such as
+ * pow() have no mixed vector/scalar overloads.
  */
-gpointer
-ufo_op_gradient_magnitudes (UfoBuffer *arg,
-                            UfoBuffer *out,
-                            UfoResources *resources,
-                            gpointer command_queue)
+static void
+generate_code (ExprNode *node, GString *code, gboolean vector, guint *n_constants)
 {
-    UfoRequisition arg_requisition;
-    cl_event event;
-    GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+    switch (node->type) {
+        case EXPR_CONSTANT:
+            node->index = (*n_constants)++;
+            g_string_append_printf (code, vector ? "((float4) c%u)" : "c%u", node->index);
+            break;
+
+        case EXPR_VARIABLE:
+            g_string_append_printf (code, "v%u", node->index);
+            break;
+
+        case EXPR_NEGATE:
+            g_string_append (code, "(-");
+            generate_code (node->left, code, vector, n_constants);
+            g_string_append_c (code, ')');
+            break;
+
+        case EXPR_BINARY:
+            g_string_append_c (code, '(');
+            generate_code (node->left, code, vector, n_constants);
+            g_string_append_printf (code, " %c ", node->op);
+            generate_code (node->right, code, vector, n_constants);
+            g_string_append_c (code, ')');
+            break;
+
+        case EXPR_CALL:
+            g_string_append_printf (code, "%s(", node->func->cl_name);
+            generate_code (node->left, code, vector, n_constants);
+
+            if (node->right != NULL) {
+                g_string_append (code, ", ");
+                generate_code (node->right, code, vector, n_constants);
+            }
+
+            g_string_append_c (code, ')');
+            break;
+    }
+}
 
-    ufo_buffer_get_requisition (arg, &arg_requisition);
-    ufo_buffer_resize (out, &arg_requisition);
+static ExprNode *
+parse_expression (const gchar *expression, guint n_args)
+{
+    ExprParser parser;
+    ExprNode *tree;
 
-    cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
-    cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
+    parser.pos = expression;
+    parser.n_args = n_args;
+    parser.failed = FALSE;
 
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "operation_gradient_magnitude", &error);
+    /* Allow "out = ..." for readability */
+    if (g_str_has_prefix (expression, "out")) {
+        const gchar *rest = expression + 3;
 
-    if (error) {
-        g_error ("%s\n", error->message);
+        while (g_ascii_isspace (*rest))
+            rest++;
+
+        if (*rest == '=')
+            parser.pos = rest + 1;
     }
 
-    g_static_mutex_lock (&mutex);
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_out));
+    tree = parse_sum (&parser);
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg_requisition.n_dims, NULL, arg_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    if (!parser.failed && parser_peek (&parser) != '\0')
+        tree = parser_fail (&parser, "trailing characters", tree);
 
-    return event;
+    /* A failure deep down leaves the nodes built so far */
+    if (parser.failed) {
+        expr_node_free (tree);
+        return NULL;
+    }
+
+    return tree;
 }
 
-/**
- * ufo_op_gradient_directions:
- * @arg: A #UfoBuffer
- * @magnitudes: A #UfoBuffer
- * @out: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * Compute magnitude of gradients
- *
- * Returns: (transfer full): Event of the add operation
- */
-gpointer
-ufo_op_gradient_directions (UfoBuffer *arg,
-                            UfoBuffer *magnitudes,
-                            UfoBuffer *out,
-                            UfoResources *resources,
-                            gpointer command_queue)
+static gchar *
+generate_image_kernel (ExprNode *tree, guint n_args, guint *n_constants)
 {
-    UfoRequisition arg_requisition;
-    cl_event event;
-    GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+    GString *source;
+    GString *code;
 
-    ufo_buffer_get_requisition (arg, &arg_requisition);
-    ufo_buffer_resize (out, &arg_requisition);
+    code = g_string_new (NULL);
+    generate_code (tree, code, FALSE, n_constants);
 
-    cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
-    cl_mem d_magnitudes = ufo_buffer_get_device_image (magnitudes, command_queue);
-    cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
+    source = g_string_new ("const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | "
+                           "CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;\n\n"
+                           "__kernel void\nexpression (");
 
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "operation_gradient_direction", &error);
+    for (guint i = 0; i < n_args; i++)
+        g_string_append_printf (source, "__read_only image2d_t arg%u, ", i);
 
-    if (error) {
-        g_error ("%s\n", error->message);
-    }
+    g_string_append (source, "__write_only image2d_t out");
 
-    g_static_mutex_lock (&mutex);
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_magnitudes));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_out));
+    for (guint i = 0; i < *n_constants; i++)
+        g_string_append_printf (source, ", const float c%u", i);
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg_requisition.n_dims, NULL, arg_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    g_string_append (source, ")\n{\n"
+                             "  const int2 pos = (int2) (get_global_id (0), get_global_id (1));\n");
 
-    return event;
+    for (guint i = 0; i < n_args; i++)
+        g_string_append_printf (source, "  const float v%u = read_imagef (arg%u, sampler, pos).s0;\n", i, i);
+
+    g_string_append_printf (source, "  write_imagef (out, pos, %s);\n}\n", code->str);
+    g_string_free (code, TRUE);
+
+    return g_string_free (source, FALSE);
 }
 
-/**
- * ufo_op_l1_norm:
- * @arg: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * Returns: L1 norm.
+/*
+ * The buffer variant follows the *_buffer kernels in ufo-basic-ops.cl: each
+ * work item handles four elements with vload4/vstore4 and the last one
+ * handles the remaining elements one by one. The element count comes last.
  */
-gfloat
-ufo_op_l1_norm (UfoBuffer *arg,
-                UfoResources *resources,
-                gpointer command_queue)
+static gchar *
+generate_buffer_kernel (ExprNode *tree, guint n_args, guint *n_constants)
 {
-    UfoRequisition arg_requisition;
-    gfloat *values;
-    gfloat norm = 0;
+    GString *source;
+    GString *vector_code;
+    GString *scalar_code;
 
-    ufo_buffer_get_requisition (arg, &arg_requisition);
-    values = ufo_buffer_get_host_array (arg, command_queue);
+    vector_code = g_string_new (NULL);
+    generate_code (tree, vector_code, TRUE, n_constants);
 
-    for (guint i = 0; i < arg_requisition.dims[0]; ++i) {
-        for (guint j = 0; j < arg_requisition.dims[1]; ++j) {
-            norm += (gfloat) fabs (values[i * arg_requisition.dims[0] + j]);
-        }
-    }
+    /* Same traversal order, so the constants get the same numbers */
+    *n_constants = 0;
+    scalar_code = g_string_new (NULL);
+    generate_code (tree, scalar_code, FALSE, n_constants);
 
-    return norm;
+    source = g_string_new ("__kernel void\nexpression_buffer (");
+
+    for (guint i = 0; i < n_args; i++)
+        g_string_append_printf (source, "__global const float *arg%u, ", i);
+
+    g_string_append (source, "__global float *out");
+
+    for (guint i = 0; i < *n_constants; i++)
+        g_string_append_printf (source, ", const float c%u", i);
+
+    g_string_append (source, ", const uint n)\n{\n"
+                             "  const uint idx = get_global_id (0);\n\n"
+                             "  if (4 * idx + 3 < n) {\n");
+
+    for (guint i = 0; i < n_args; i++)
+        g_string_append_printf (source, "    const float4 v%u = vload4 (idx, arg%u);\n", i, i);
+
+    g_string_append_printf (source, "    vstore4 (%s, idx, out);\n"
+                                    "  }\n"
+                                    "  else {\n"
+                                    "    for (uint i = 4 * idx; i < n; i++) {\n",
+                            vector_code->str);
+
+    for (guint i = 0; i < n_args; i++)
+        g_string_append_printf (source, "      const float v%u = arg%u[i];\n", i, i);
+
+    g_string_append_printf (source, "      out[i] = %s;\n"
+                                    "    }\n"
+                                    "  }\n"
+                                    "}\n",
+                            scalar_code->str);
+
+    g_string_free (vector_code, TRUE);
+    g_string_free (scalar_code, TRUE);
+
+    return g_string_free (source, FALSE);
 }
 
-/**
- * ufo_op_euclidean_distance:
- * @arg1: A #UfoBuffer
- * @arg2: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * Returns: Euclidean distance between @arg1 and @arg2.
- */
-gfloat
-ufo_op_euclidean_distance (UfoBuffer *arg1,
-                           UfoBuffer *arg2,
-                           UfoResources *resources,
-                           gpointer command_queue)
+/* Set the constants numbered by generate_code() starting at argument @first */
+static void
+set_constant_args (ExprNode *node, cl_kernel kernel, guint first)
 {
-    UfoRequisition arg1_requisition, arg2_requisition;
-    guint length;
-    gfloat diff;
-    gfloat norm = 0;
-    guint length1 = 0;
-    guint length2 = 0;
-    gfloat *values1;
-    gfloat *values2;
+    if (node == NULL)
+        return;
 
-    ufo_buffer_get_requisition (arg1, &arg1_requisition);
-    ufo_buffer_get_requisition (arg2, &arg2_requisition);
+    if (node->type == EXPR_CONSTANT) {
+        gfloat value = (gfloat) node->value;
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, first + node->index, sizeof (gfloat), &value));
+        return;
+    }
 
-    for (guint i = 0; i < arg1_requisition.n_dims; ++i)
-        length1 += (guint)arg1_requisition.dims[i];
+    set_constant_args (node->left, kernel, first);
+    set_constant_args (node->right, kernel, first);
+}
 
-    for (guint i = 0; i < arg2_requisition.n_dims; ++i)
-        length2 += (guint)arg2_requisition.dims[i];
+#define HOST_EXPR_BLOCK 256
 
-    if (length2 != length1)
-        g_warning ("Sizes of buffers are not the same. Zero-padding applied.");
+/* Evaluate @node for @n <= HOST_EXPR_BLOCK elements starting at @offset */
+static void
+host_evaluate (ExprNode *node, gfloat **args, gsize offset, gsize n, gfloat *result)
+{
+    gfloat right[HOST_EXPR_BLOCK];
 
-    length = length2 < length1 ? length2 : length1;
-    values1 = ufo_buffer_get_host_array (arg1, command_queue);
-    values2 = ufo_buffer_get_host_array (arg2, command_queue);
+    switch (node->type) {
+        case EXPR_CONSTANT:
+            for (gsize i = 0; i < n; i++)
+                result[i] = (gfloat) node->value;
+            return;
 
-    for (guint i = 0; i < length; ++i) {
-        diff = values1[i] - values2[i];
-        norm += powf (diff, 2);
+        case EXPR_VARIABLE:
+            memcpy (result, args[node->index] + offset, n * sizeof (gfloat));
+            return;
+
+        case EXPR_NEGATE:
+            host_evaluate (node->left, args, offset, n, result);
+
+            for (gsize i = 0; i < n; i++)
+                result[i] = -result[i];
+            return;
+
+        default:
+            break;
     }
 
-    for (guint i = length; i < length2; ++i)
-        norm += powf (values2[i], 2);
+    host_evaluate (node->left, args, offset, n, result);
+
+    if (node->right != NULL)
+        host_evaluate (node->right, args, offset, n, right);
 
-    for (guint i = length; i < length1; ++i)
-        norm += powf (values1[i], 2);
+    if (node->type == EXPR_BINARY) {
+        for (gsize i = 0; i < n; i++) {
+            switch (node->op) {
+                case '+': result[i] += right[i]; break;
+                case '-': result[i] -= right[i]; break;
+                case '*': result[i] *= right[i]; break;
+                default:  result[i] /= right[i]; break;
+            }
+        }
+        return;
+    }
 
-    norm = sqrtf(norm);
-    return norm;
+    for (gsize i = 0; i < n; i++) {
+        const gchar *name = node->func->name;
+
+        if (!strcmp (name, "sqrt"))
+            result[i] = sqrtf (result[i]);
+        else if (!strcmp (name, "fabs"))
+            result[i] = fabsf (result[i]);
+        else if (!strcmp (name, "exp"))
+            result[i] = expf (result[i]);
+        else if (!strcmp (name, "log"))
+            result[i] = logf (result[i]);
+        else if (!strcmp (name, "min"))
+            result[i] = fminf (result[i], right[i]);
+        else if (!strcmp (name, "max"))
+            result[i] = fmaxf (result[i], right[i]);
+        else
+            result[i] = powf (result[i], right[i]);
+    }
 }
 
-/**
- * ufo_op_l2_norm:
- * @arg: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * Returns: L2 norm.
- */
-gfloat
-ufo_op_l2_norm (UfoBuffer *arg,
-                UfoResources *resources,
-                gpointer command_queue)
+typedef struct {
+    ExprNode  *tree;
+    gfloat   **args;
+} HostExpression;
+
+static void
+host_expression_rows (HostJob *job, gsize first_row, gsize last_row)
 {
-    return ufo_op_euclidean_distance (arg, arg, resources, command_queue);
+    HostExpression *expression = job->user_data;
+    gsize last = last_row * job->width;
+
+    for (gsize i = first_row * job->width; i < last; i += HOST_EXPR_BLOCK)
+        host_evaluate (expression->tree, expression->args, i, MIN (HOST_EXPR_BLOCK, last - i), job->out + i);
 }
 
-/**
- * ufo_op_POSC:
- * @arg: A #UfoBuffer
- * @out: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
- *
- * Returns: (transfer full): Event of the POSC operation
- */
-gpointer
-ufo_op_POSC (UfoBuffer *arg,
-             UfoBuffer *out,
-             UfoResources *resources,
-             gpointer command_queue)
+static gboolean
+use_host_for_all (UfoResources *resources,
+                  gpointer command_queue,
+                  UfoBuffer **args,
+                  guint n_args)
 {
-    UfoRequisition arg_requisition;
-    cl_event event;
-    GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
-
-    ufo_buffer_get_requisition (arg, &arg_requisition);
-    ufo_buffer_resize (out, &arg_requisition);
+    for (guint i = 0; i < n_args; i++) {
+        if (!use_host (resources, command_queue, args[i], NULL))
+            return FALSE;
+    }
 
-    cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
-    cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
+    return n_args > 0 || resources == NULL || command_queue == NULL;
+}
 
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "POSC", &error);
+static gboolean
+has_same_dimensions (UfoBuffer *buffer, UfoRequisition *requisition)
+{
+    UfoRequisition other;
 
-    if (error) {
-        g_error ("%s\n", error->message);
-    }
+    ufo_buffer_get_requisition (buffer, &other);
 
-    g_static_mutex_lock (&mutex);
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_out));
+    if (other.n_dims != requisition->n_dims)
+        return FALSE;
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg_requisition.n_dims, NULL, arg_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    for (guint i = 0; i < other.n_dims; i++) {
+        if (other.dims[i] != requisition->dims[i])
+            return FALSE;
+    }
 
-    return event;
+    return TRUE;
 }
 
 /**
- * ufo_op_gradient_descent:
- * @arg: A #UfoBuffer
- * @out: A #UfoBuffer
- * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * ufo_op_expression:
+ * @expression: Element-wise arithmetic expression
+ * @out: A #UfoBuffer receiving the result
+ * @args: (array length=n_args): Input buffers
+ * @n_args: Number of input buffers, at most 26
+ * @resources: (allow-none): #UfoResources object or %NULL
+ * @command_queue: (allow-none): A valid cl_command_queue or %NULL
  *
- * Returns: (transfer full): Event of the POSC operation
+ * Evaluate @expression for every pixel with a single kernel instead of a
+ * sequence of ufo_op_mul(), ufo_op_add2() etc. calls that store every
+ * intermediate result in device memory. @args are referred to as a, b, c and
+ * so on. An expression consists of float constants, the operators +, -, *, /,
+ * parentheses and the functions sqrt, fabs, exp, log, min, max and pow. It
+ * may start with "out =", e.g. "out = a * b + 0.5 * c".
+ *
+ * Constants are passed as kernel arguments and the generated kernel is cached
+ * by its source in @resources, so expressions of the same shape, e.g. "a * 2"
+ * and "a * 0.5", are compiled only once. Like the other element-wise
+ * operations, the kernel reads images only if an input already lives in an
+ * image and works on float4-vectorized arrays otherwise.
+ *
+ * Returns: (transfer full): Event of the operation or %NULL if @expression
+ * is invalid or no @command_queue was given.
  */
 gpointer
-ufo_op_gradient_descent (UfoBuffer *arg,
-                         UfoBuffer *out,
-                         UfoResources *resources,
-                         gpointer command_queue)
+ufo_op_expression (const gchar *expression,
+                   UfoBuffer *out,
+                   UfoBuffer **args,
+                   guint n_args,
+                   UfoResources *resources,
+                   gpointer command_queue)
 {
-    UfoRequisition arg_requisition;
-    cl_event event;
+    UfoRequisition requisition;
+    cl_kernel kernel;
+    cl_mem d_out;
+    ExprNode *tree;
+    gchar *source;
+    guint n_constants = 0;
+    gboolean arrays;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
 
-    ufo_buffer_get_requisition (arg, &arg_requisition);
-    ufo_buffer_resize (out, &arg_requisition);
+    g_return_val_if_fail (expression != NULL && n_args <= 26, NULL);
 
-    cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
-    cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
+    ufo_buffer_get_requisition (out, &requisition);
+
+    for (guint i = 0; i < n_args; i++) {
+        if (!has_same_dimensions (args[i], &requisition)) {
+            g_error ("Incorrect volume size.");
+            return NULL;
+        }
+    }
+
+    tree = parse_expression (expression, n_args);
+
+    if (tree == NULL)
+        return NULL;
+
+    if (use_host_for_all (resources, command_queue, args, n_args)) {
+        HostExpression host_expression;
+        HostJob job;
+
+        host_expression.tree = tree;
+        host_expression.args = g_new0 (gfloat *, MAX (n_args, 1));
+
+        for (guint i = 0; i < n_args; i++)
+            host_expression.args[i] = ufo_buffer_get_host_array (args[i], NULL);
+
+        host_job_init (&job, NULL, NULL, out);
+        job.user_data = &host_expression;
+        host_run (host_expression_rows, &job);
 
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "descent_grad", &error);
+        g_free (host_expression.args);
+        expr_node_free (tree);
+        return host_done (resources, command_queue);
+    }
+
+    arrays = TRUE;
+
+    for (guint i = 0; i < n_args && arrays; i++)
+        arrays = use_device_arrays (args[i], NULL);
+
+    /* The image kernel is two-dimensional */
+    arrays = arrays || requisition.n_dims != 2;
+
+    if (arrays) {
+        source = generate_buffer_kernel (tree, n_args, &n_constants);
+        kernel = ufo_resources_get_cached_kernel_from_source (resources, source, "expression_buffer", &error);
+    }
+    else {
+        source = generate_image_kernel (tree, n_args, &n_constants);
+        kernel = ufo_resources_get_cached_kernel_from_source (resources, source, "expression", &error);
+    }
+
+    g_free (source);
 
     if (error) {
+        expr_node_free (tree);
         g_error ("%s\n", error->message);
+        return NULL;
     }
 
-    g_static_mutex_lock (&mutex);
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 0, sizeof(void *), (void *) &d_arg));
-    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 1, sizeof(void *), (void *) &d_out));
+    for (guint i = 0; i < n_args; i++) {
+        cl_mem d_arg = get_device_mem (args[i], arrays, command_queue);
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, i, sizeof(void *), (void *) &d_arg));
+    }
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg_requisition.n_dims, NULL, arg_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    d_out = get_device_mem (out, arrays, command_queue);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, n_args, sizeof(void *), (void *) &d_out));
+    set_constant_args (tree, kernel, n_args + 1);
+    expr_node_free (tree);
 
-    return event;
+    return launch_elementwise (resources, command_queue, kernel, arrays, n_args + 1 + n_constants,
+                               &requisition, out, args, n_args);
 }
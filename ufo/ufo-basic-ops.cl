@@ -147,6 +147,117 @@ void operation_add2 (__read_only image2d_t arg1_r,
   write_imagef(out, coord_w, value);
 }
 
+/*
+ * Buffer variants of the element-wise operations. Each work item processes
+ * four consecutive floats, the last one handles the remaining n % 4 elements.
+ * vload4/vstore4 only require float alignment, so any cl_mem can be used.
+ */
+
+#define ELEMENTWISE_TAIL(expr)          \
+  for (uint i = 4 * idx; i < n; i++) {  \
+    expr;                               \
+  }
+
+__kernel
+void operation_set_buffer (__global float *out,
+                           const float value,
+                           const uint n)
+{
+  const uint idx = get_global_id(0);
+
+  if (4 * idx + 3 < n)
+    vstore4((float4) (value), idx, out);
+  else
+    ELEMENTWISE_TAIL(out[i] = value)
+}
+
+__kernel
+void operation_inv_buffer (__global const float *in,
+                           __global float *out,
+                           const uint n)
+{
+  const uint idx = get_global_id(0);
+
+  if (4 * idx + 3 < n) {
+    float4 value = vload4(idx, in);
+    vstore4(select((float4) (0.0f), 1.0f / value, value != (float4) (0.0f)), idx, out);
+  }
+  else
+    ELEMENTWISE_TAIL(out[i] = in[i] != 0.0f ? 1.0f / in[i] : 0.0f)
+}
+
+__kernel
+void operation_mul_buffer (__global const float *arg1,
+                           __global const float *arg2,
+                           __global float *out,
+                           const uint n)
+{
+  const uint idx = get_global_id(0);
+
+  if (4 * idx + 3 < n)
+    vstore4(vload4(idx, arg1) * vload4(idx, arg2), idx, out);
+  else
+    ELEMENTWISE_TAIL(out[i] = arg1[i] * arg2[i])
+}
+
+__kernel
+void operation_add_buffer (__global const float *arg1,
+                           __global const float *arg2,
+                           __global float *out,
+                           const uint n)
+{
+  const uint idx = get_global_id(0);
+
+  if (4 * idx + 3 < n)
+    vstore4(vload4(idx, arg1) + vload4(idx, arg2), idx, out);
+  else
+    ELEMENTWISE_TAIL(out[i] = arg1[i] + arg2[i])
+}
+
+__kernel
+void operation_deduction_buffer (__global const float *arg1,
+                                 __global const float *arg2,
+                                 __global float *out,
+                                 const uint n)
+{
+  const uint idx = get_global_id(0);
+
+  if (4 * idx + 3 < n)
+    vstore4(vload4(idx, arg1) - vload4(idx, arg2), idx, out);
+  else
+    ELEMENTWISE_TAIL(out[i] = arg1[i] - arg2[i])
+}
+
+__kernel
+void operation_deduction2_buffer (__global const float *arg1,
+                                  __global const float *arg2,
+                                  const float modifier,
+                                  __global float *out,
+                                  const uint n)
+{
+  const uint idx = get_global_id(0);
+
+  if (4 * idx + 3 < n)
+    vstore4(vload4(idx, arg1) - modifier * vload4(idx, arg2), idx, out);
+  else
+    ELEMENTWISE_TAIL(out[i] = arg1[i] - modifier * arg2[i])
+}
+
+__kernel
+void operation_add2_buffer (__global const float *arg1,
+                            __global const float *arg2,
+                            const float modifier,
+                            __global float *out,
+                            const uint n)
+{
+  const uint idx = get_global_id(0);
+
+  if (4 * idx + 3 < n)
+    vstore4(vload4(idx, arg1) + modifier * vload4(idx, arg2), idx, out);
+  else
+    ELEMENTWISE_TAIL(out[i] = arg1[i] + modifier * arg2[i])
+}
+
 __kernel
 void op_mulRows (__read_only  image2d_t arg1_r,
                  __read_only  image2d_t arg2_r,
@@ -323,4 +434,773 @@ void descent_grad (__read_only image2d_t arg_r,
 
   float value = part[0] - part[1] - part[2];
   write_imagef(out, coord_w, value);
-}
\ No newline at end of file
+}
+
+/*
+ * Tiled stencils. A work group of TILE_SIZE x TILE_SIZE pixels loads its tile
+ * plus a halo into local memory once, clamped like imageSampler2, and computes
+ * all pixels from there. The global size is rounded up to the tile size, so
+ * out-of-range work items only help loading. Keep TILE_SIZE in sync with
+ * OPS_TILE_SIZE in ufo-basic-ops.c.
+ */
+#define TILE_SIZE 16
+
+void
+load_tile (read_only image2d_t image,
+           __local float *tile,
+           const int halo)
+{
+  const int width = TILE_SIZE + 2 * halo;
+  const int2 origin = (int2) ((int) get_group_id(0) * TILE_SIZE - halo,
+                              (int) get_group_id(1) * TILE_SIZE - halo);
+  const int lid = get_local_id(1) * TILE_SIZE + get_local_id(0);
+
+  for (int i = lid; i < width * width; i += TILE_SIZE * TILE_SIZE) {
+    const int2 pos = origin + (int2) (i % width, i / width);
+    tile[i] = read_imagef(image, imageSampler2, pos).s0;
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+float
+tile_magnitude (__local const float *tile,
+                const int width,
+                const int x,
+                const int y)
+{
+  const float cell = tile[y * width + x];
+  const float d1 = tile[y * width + x + 1] - cell;
+  const float d2 = tile[y * width + x - 1] - cell;
+  const float d3 = tile[(y + 1) * width + x] - cell;
+  const float d4 = tile[(y - 1) * width + x] - cell;
+
+  return sqrt((d1 * d1 + d2 * d2 + d3 * d3 + d4 * d4) / 2.0f);
+}
+
+float
+tile_direction (__local const float *values,
+                __local const float *magnitudes,
+                const int width,
+                const int x,
+                const int y)
+{
+  const int idx[5] = {
+    y * width + x,
+    y * width + x + 1,
+    y * width + x - 1,
+    (y + 1) * width + x,
+    (y - 1) * width + x
+  };
+  float direction = 0.0f;
+
+  if (magnitudes[idx[0]] != 0.0f)
+    direction += (4 * values[idx[0]] - values[idx[1]] - values[idx[2]] - values[idx[3]] - values[idx[4]]) / magnitudes[idx[0]];
+
+  for (int i = 1; i < 5; i++) {
+    if (magnitudes[idx[i]] != 0.0f)
+      direction += (values[idx[0]] - values[idx[i]]) / magnitudes[idx[i]];
+  }
+
+  return direction;
+}
+
+__kernel
+void operation_gradient_magnitude_tiled (__read_only image2d_t arg_r,
+                                         __write_only image2d_t out)
+{
+  __local float tile[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+  const int2 pos = (int2) (get_global_id(0), get_global_id(1));
+
+  load_tile(arg_r, tile, 1);
+
+  if (pos.x < get_image_width(out) && pos.y < get_image_height(out))
+    write_imagef(out, pos, tile_magnitude(tile, TILE_SIZE + 2, get_local_id(0) + 1, get_local_id(1) + 1));
+}
+
+__kernel
+void operation_gradient_direction_tiled (__read_only image2d_t arg_r,
+                                         __read_only image2d_t magnitude,
+                                         __write_only image2d_t out)
+{
+  __local float values[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+  __local float magnitudes[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+  const int2 pos = (int2) (get_global_id(0), get_global_id(1));
+
+  load_tile(arg_r, values, 1);
+  load_tile(magnitude, magnitudes, 1);
+
+  if (pos.x < get_image_width(out) && pos.y < get_image_height(out))
+    write_imagef(out, pos, tile_direction(values, magnitudes, TILE_SIZE + 2,
+                                          get_local_id(0) + 1, get_local_id(1) + 1));
+}
+
+/*
+ * Magnitudes and directions in one pass. The direction needs magnitudes of
+ * the direct neighbours, which are computed for the tile plus a halo of one
+ * from an input tile with a halo of two. As in the separate kernels, the
+ * magnitude of a pixel outside the image is the one of the nearest edge pixel.
+ */
+__kernel
+void operation_gradient_magnitude_direction_tiled (__read_only image2d_t arg_r,
+                                                   __write_only image2d_t magnitudes_w,
+                                                   __write_only image2d_t directions_w)
+{
+  __local float input[(TILE_SIZE + 4) * (TILE_SIZE + 4)];
+  __local float values[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+  __local float magnitudes[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+  const int width = TILE_SIZE + 2;
+  const int2 size = (int2) (get_image_width(arg_r), get_image_height(arg_r));
+  const int2 origin = (int2) ((int) get_group_id(0) * TILE_SIZE - 1,
+                              (int) get_group_id(1) * TILE_SIZE - 1);
+  const int2 pos = (int2) (get_global_id(0), get_global_id(1));
+  const int lid = get_local_id(1) * TILE_SIZE + get_local_id(0);
+
+  load_tile(arg_r, input, 2);
+
+  for (int i = lid; i < width * width; i += TILE_SIZE * TILE_SIZE) {
+    const int2 p = origin + (int2) (i % width, i / width);
+    const int2 q = clamp(p, (int2) (0, 0), size - 1) - origin + 1;
+
+    values[i] = input[(i / width + 1) * (TILE_SIZE + 4) + i % width + 1];
+    magnitudes[i] = tile_magnitude(input, TILE_SIZE + 4, q.x, q.y);
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (pos.x < size.x && pos.y < size.y) {
+    const int x = get_local_id(0) + 1;
+    const int y = get_local_id(1) + 1;
+
+    write_imagef(magnitudes_w, pos, magnitudes[y * width + x]);
+    write_imagef(directions_w, pos, tile_direction(values, magnitudes, width, x, y));
+  }
+}
+
+/* v0 is the centre, v1-v4 are left, top, right, bottom, v5 top right, v6 bottom left */
+float
+descent_value (const float v0, const float v1, const float v2, const float v3,
+               const float v4, const float v5, const float v6)
+{
+  const float eps = 1E-8;
+  float t1, t2, value;
+
+  t1 = v0 - v1;
+  t2 = v0 - v2;
+  value = (t1 + t2) / sqrt(eps + t1 * t1 + t2 * t2);
+  t1 = v3 - v0;
+  t2 = v3 - v5;
+  value -= t1 / sqrt(eps + t1 * t1 + t2 * t2);
+  t1 = v4 - v0;
+  t2 = v4 - v6;
+  value -= t1 / sqrt(eps + t1 * t1 + t2 * t2);
+
+  return value;
+}
+
+float
+tile_descent (__local const float *tile,
+              const int width,
+              const int x,
+              const int y)
+{
+  return descent_value(tile[y * width + x],
+                       tile[y * width + x - 1],
+                       tile[(y - 1) * width + x],
+                       tile[y * width + x + 1],
+                       tile[(y + 1) * width + x],
+                       tile[(y - 1) * width + x + 1],
+                       tile[(y + 1) * width + x - 1]);
+}
+
+__kernel
+void descent_grad_tiled (__read_only image2d_t arg_r,
+                         __write_only image2d_t out)
+{
+  __local float tile[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+  const int2 pos = (int2) (get_global_id(0), get_global_id(1));
+
+  load_tile(arg_r, tile, 1);
+
+  if (pos.x < get_image_width(out) && pos.y < get_image_height(out))
+    write_imagef(out, pos, tile_descent(tile, TILE_SIZE + 2, get_local_id(0) + 1, get_local_id(1) + 1));
+}
+
+/*
+ * One total variation step: descend along the TV gradient like descent_grad
+ * and apply the positivity constraint of POSC, without storing the gradient.
+ */
+__kernel
+void tv_step_tiled (__read_only image2d_t arg_r,
+                    const float step,
+                    __write_only image2d_t out)
+{
+  __local float tile[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+  const int2 pos = (int2) (get_global_id(0), get_global_id(1));
+  const int x = get_local_id(0) + 1;
+  const int y = get_local_id(1) + 1;
+
+  load_tile(arg_r, tile, 1);
+
+  if (pos.x < get_image_width(out) && pos.y < get_image_height(out)) {
+    const float value = tile[y * (TILE_SIZE + 2) + x] - step * tile_descent(tile, TILE_SIZE + 2, x, y);
+    write_imagef(out, pos, fmax(value, 0.0f));
+  }
+}
+
+__kernel
+void tv_step (__read_only image2d_t arg_r,
+              const float step,
+              __write_only image2d_t out)
+{
+  const int2 pos = (int2) (get_global_id(0), get_global_id(1));
+  const float v0 = read_imagef(arg_r, imageSampler2, pos).s0;
+  const float gradient = descent_value(v0,
+                                       read_imagef(arg_r, imageSampler2, pos + (int2) (-1, 0)).s0,
+                                       read_imagef(arg_r, imageSampler2, pos + (int2) (0, -1)).s0,
+                                       read_imagef(arg_r, imageSampler2, pos + (int2) (1, 0)).s0,
+                                       read_imagef(arg_r, imageSampler2, pos + (int2) (0, 1)).s0,
+                                       read_imagef(arg_r, imageSampler2, pos + (int2) (1, -1)).s0,
+                                       read_imagef(arg_r, imageSampler2, pos + (int2) (-1, 1)).s0);
+
+  write_imagef(out, pos, fmax(v0 - step * gradient, 0.0f));
+}
+
+/* Keep in sync with ReduceMode in ufo-basic-ops.c */
+#define REDUCE_SUM              0
+#define REDUCE_ABS_SUM          1
+#define REDUCE_SQUARE_SUM       2
+#define REDUCE_DIFF_SQUARE_SUM  3
+#define REDUCE_MIN              4
+#define REDUCE_MAX              5
+
+float
+reduce_identity (const int mode)
+{
+  if (mode == REDUCE_MIN)
+    return INFINITY;
+
+  if (mode == REDUCE_MAX)
+    return -INFINITY;
+
+  return 0.0f;
+}
+
+float
+reduce_map (const int mode, const float a, const float b)
+{
+  switch (mode) {
+    case REDUCE_ABS_SUM:
+      return fabs (a);
+    case REDUCE_SQUARE_SUM:
+      return a * a;
+    case REDUCE_DIFF_SQUARE_SUM:
+      return (a - b) * (a - b);
+    default:
+      return a;
+  }
+}
+
+float
+reduce_combine (const int mode, const float x, const float y)
+{
+  if (mode == REDUCE_MIN)
+    return fmin (x, y);
+
+  if (mode == REDUCE_MAX)
+    return fmax (x, y);
+
+  return x + y;
+}
+
+void
+reduce_local (const int mode, float value, __local float *scratch)
+{
+  const uint lid = get_local_id(0);
+
+  scratch[lid] = value;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint stride = get_local_size(0) / 2; stride > 0; stride >>= 1) {
+    if (lid < stride)
+      scratch[lid] = reduce_combine (mode, scratch[lid], scratch[lid + stride]);
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
+/*
+ * First stage: every work group reduces a strided part of both images into
+ * one partial result. Pixels beyond the smaller image are zero-padded.
+ */
+__kernel
+void reduce_image (__read_only image2d_t arg1_r,
+                   __read_only image2d_t arg2_r,
+                   const int mode,
+                   __global float *partials,
+                   __local float *scratch)
+{
+  const int width1 = get_image_width(arg1_r);
+  const int width2 = get_image_width(arg2_r);
+  const int n1 = width1 * get_image_height(arg1_r);
+  const int n2 = width2 * get_image_height(arg2_r);
+  const int n = max (n1, n2);
+  float value = reduce_identity (mode);
+
+  for (int i = get_global_id(0); i < n; i += get_global_size(0)) {
+    float a = i < n1 ? read_imagef(arg1_r, imageSampler, (int2) (i % width1, i / width1)).s0 : 0.0f;
+    float b = i < n2 ? read_imagef(arg2_r, imageSampler, (int2) (i % width2, i / width2)).s0 : 0.0f;
+    value = reduce_combine (mode, value, reduce_map (mode, a, b));
+  }
+
+  reduce_local (mode, value, scratch);
+
+  if (get_local_id(0) == 0)
+    partials[get_group_id(0)] = scratch[0];
+}
+
+/*
+ * Second stage: a single work group combines the partial results and stores
+ * the final value in the first element.
+ */
+__kernel
+void reduce_partials (__global float *partials,
+                      const uint n,
+                      const int mode,
+                      __local float *scratch)
+{
+  float value = reduce_identity (mode);
+
+  for (uint i = get_local_id(0); i < n; i += get_local_size(0))
+    value = reduce_combine (mode, value, partials[i]);
+
+  reduce_local (mode, value, scratch);
+
+  if (get_local_id(0) == 0)
+    partials[0] = scratch[0];
+}
+
+/*
+ * Array variant of reduce_image for buffers that live in device memory. The
+ * first arguments match reduce_image so both can be set up the same way.
+ */
+__kernel
+void reduce_array (__global const float *arg1,
+                   __global const float *arg2,
+                   const int mode,
+                   __global float *partials,
+                   __local float *scratch,
+                   const uint n1,
+                   const uint n2)
+{
+  const uint n = max (n1, n2);
+  float value = reduce_identity (mode);
+
+  for (uint i = get_global_id(0); i < n; i += get_global_size(0)) {
+    float a = i < n1 ? arg1[i] : 0.0f;
+    float b = i < n2 ? arg2[i] : 0.0f;
+    value = reduce_combine (mode, value, reduce_map (mode, a, b));
+  }
+
+  reduce_local (mode, value, scratch);
+
+  if (get_local_id(0) == 0)
+    partials[get_group_id(0)] = scratch[0];
+}
+
+/* Minimum and maximum are reduced together as (min, max) pairs */
+void
+min_max_local (float2 value, __local float2 *scratch)
+{
+  const uint lid = get_local_id(0);
+
+  scratch[lid] = value;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint stride = get_local_size(0) / 2; stride > 0; stride >>= 1) {
+    if (lid < stride) {
+      scratch[lid].x = fmin (scratch[lid].x, scratch[lid + stride].x);
+      scratch[lid].y = fmax (scratch[lid].y, scratch[lid + stride].y);
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
+__kernel
+void min_max_image (__read_only image2d_t arg_r,
+                    __global float2 *partials,
+                    __local float2 *scratch)
+{
+  const int width = get_image_width(arg_r);
+  const int n = width * get_image_height(arg_r);
+  float2 value = (float2) (INFINITY, -INFINITY);
+
+  for (int i = get_global_id(0); i < n; i += get_global_size(0)) {
+    float a = read_imagef(arg_r, imageSampler, (int2) (i % width, i / width)).s0;
+    value = (float2) (fmin (value.x, a), fmax (value.y, a));
+  }
+
+  min_max_local (value, scratch);
+
+  if (get_local_id(0) == 0)
+    partials[get_group_id(0)] = scratch[0];
+}
+
+__kernel
+void min_max_array (__global const float *arg,
+                    __global float2 *partials,
+                    __local float2 *scratch,
+                    const uint n)
+{
+  float2 value = (float2) (INFINITY, -INFINITY);
+
+  for (uint i = get_global_id(0); i < n; i += get_global_size(0))
+    value = (float2) (fmin (value.x, arg[i]), fmax (value.y, arg[i]));
+
+  min_max_local (value, scratch);
+
+  if (get_local_id(0) == 0)
+    partials[get_group_id(0)] = scratch[0];
+}
+
+__kernel
+void min_max_partials (__global float2 *partials,
+                       const uint n,
+                       __local float2 *scratch)
+{
+  float2 value = (float2) (INFINITY, -INFINITY);
+
+  for (uint i = get_local_id(0); i < n; i += get_local_size(0))
+    value = (float2) (fmin (value.x, partials[i].x), fmax (value.y, partials[i].y));
+
+  min_max_local (value, scratch);
+
+  if (get_local_id(0) == 0)
+    partials[0] = scratch[0];
+}
+
+/*
+ * Histograms are accumulated per work group in local memory and merged into
+ * the global histogram with one atomic add per non-empty bin. Values outside
+ * [min, max] and NaNs are not counted, max itself falls into the last bin.
+ */
+void
+histogram_clear (__local uint *local_hist, const uint n_bins)
+{
+  for (uint i = get_local_id(0); i < n_bins; i += get_local_size(0))
+    local_hist[i] = 0;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+void
+histogram_add (__local uint *local_hist,
+               const float value,
+               const float min,
+               const float max,
+               const uint n_bins)
+{
+  if (value >= min && value <= max) {
+    /* An empty range puts all values into the first bin instead of dividing by zero */
+    const float position = max > min ? (value - min) / (max - min) * n_bins : 0.0f;
+    const uint bin = position < n_bins ? (uint) position : n_bins - 1;
+
+    atomic_inc (&local_hist[bin]);
+  }
+}
+
+void
+histogram_merge (__local uint *local_hist,
+                 __global uint *histogram,
+                 const uint n_bins)
+{
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint i = get_local_id(0); i < n_bins; i += get_local_size(0)) {
+    if (local_hist[i] > 0)
+      atomic_add (&histogram[i], local_hist[i]);
+  }
+}
+
+__kernel
+void histogram_image (__read_only image2d_t arg_r,
+                      const float min,
+                      const float max,
+                      const uint n_bins,
+                      __global uint *histogram,
+                      __local uint *local_hist)
+{
+  const int width = get_image_width(arg_r);
+  const int n = width * get_image_height(arg_r);
+
+  histogram_clear (local_hist, n_bins);
+
+  for (int i = get_global_id(0); i < n; i += get_global_size(0))
+    histogram_add (local_hist, read_imagef(arg_r, imageSampler, (int2) (i % width, i / width)).s0,
+                   min, max, n_bins);
+
+  histogram_merge (local_hist, histogram, n_bins);
+}
+
+__kernel
+void histogram_array (__global const float *arg,
+                      const float min,
+                      const float max,
+                      const uint n_bins,
+                      __global uint *histogram,
+                      __local uint *local_hist,
+                      const uint n)
+{
+  histogram_clear (local_hist, n_bins);
+
+  for (uint i = get_global_id(0); i < n; i += get_global_size(0))
+    histogram_add (local_hist, arg[i], min, max, n_bins);
+
+  histogram_merge (local_hist, histogram, n_bins);
+}
+
+/*
+ * Welford update of per-element running statistics with the n_frames + 1-th
+ * frame. The first frame initializes mean and m2, so they need not be cleared.
+ */
+__kernel
+void running_stats (__global const float *arg,
+                    __global float *mean,
+                    __global float *m2,
+                    __global float *variance,
+                    const uint write_variance,
+                    const uint n_frames,
+                    const uint n)
+{
+  const uint idx = get_global_id(0);
+
+  if (idx >= n)
+    return;
+
+  const float x = arg[idx];
+  const float old_mean = n_frames > 0 ? mean[idx] : x;
+  const float new_mean = old_mean + (x - old_mean) / (n_frames + 1);
+  const float new_m2 = (n_frames > 0 ? m2[idx] : 0.0f) + (x - old_mean) * (x - new_mean);
+
+  mean[idx] = new_mean;
+  m2[idx] = new_m2;
+
+  if (write_variance)
+    variance[idx] = new_m2 / (n_frames + 1);
+}
+
+/*
+ * Transpose through a local tile so that both the reads and the writes of a
+ * work group are coalesced. The padding column avoids bank conflicts when the
+ * tile is read column-wise.
+ */
+__kernel
+void transpose_tiled (__global const float *in,
+                      __global float *out,
+                      const uint width,
+                      const uint height)
+{
+  __local float tile[TILE_SIZE][TILE_SIZE + 1];
+  const uint lx = get_local_id(0);
+  const uint ly = get_local_id(1);
+  uint x = get_group_id(0) * TILE_SIZE + lx;
+  uint y = get_group_id(1) * TILE_SIZE + ly;
+
+  if (x < width && y < height)
+    tile[ly][lx] = in[y * width + x];
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  x = get_group_id(1) * TILE_SIZE + lx;
+  y = get_group_id(0) * TILE_SIZE + ly;
+
+  if (x < height && y < width)
+    out[y * height + x] = tile[lx][ly];
+}
+
+__kernel
+void transpose (__global const float *in,
+                __global float *out,
+                const uint width,
+                const uint height)
+{
+  const uint x = get_global_id(0);
+  const uint y = get_global_id(1);
+
+  if (x < width && y < height)
+    out[x * height + y] = in[y * width + x];
+}
+
+/* Average factor x factor blocks, incomplete blocks at the border are dropped */
+__kernel
+void bin (__global const float *in,
+          __global float *out,
+          const uint in_width,
+          const uint out_width,
+          const uint out_height,
+          const uint factor)
+{
+  const uint x = get_global_id(0);
+  const uint y = get_global_id(1);
+  float sum = 0.0f;
+
+  if (x >= out_width || y >= out_height)
+    return;
+
+  for (uint j = 0; j < factor; j++) {
+    __global const float *row = in + (y * factor + j) * in_width + x * factor;
+
+    for (uint i = 0; i < factor; i++)
+      sum += row[i];
+  }
+
+  out[y * out_width + x] = sum / (factor * factor);
+}
+
+/* Keep in sync with UfoOpBorder in ufo-basic-ops.h */
+#define BORDER_CLAMP    0
+#define BORDER_ZERO     1
+#define BORDER_MIRROR   2
+
+/* Map an index outside of [0, n) according to the border mode, -1 means zero */
+int
+border_index (int i, const int n, const int mode)
+{
+  if (i >= 0 && i < n)
+    return i;
+
+  if (mode == BORDER_ZERO)
+    return -1;
+
+  if (mode == BORDER_MIRROR)
+    i = i < 0 ? -i - 1 : 2 * n - i - 1;
+
+  return clamp (i, 0, n - 1);
+}
+
+float
+load_border (__global const float *in,
+             const int x, const int y,
+             const int width, const int height,
+             const int mode)
+{
+  const int bx = border_index (x, width, mode);
+  const int by = border_index (y, height, mode);
+
+  return bx < 0 || by < 0 ? 0.0f : in[by * width + bx];
+}
+
+/*
+ * Separable convolution passes. Every work group stages a TILE_SIZE x
+ * TILE_SIZE block plus the radius-wide apron along the filtered direction in
+ * local memory. weights[radius] is the centre of the filter.
+ */
+__kernel
+void convolve_rows_tiled (__global const float *in,
+                          __global float *out,
+                          __constant float *weights,
+                          const int radius,
+                          const int width,
+                          const int height,
+                          const int mode,
+                          __local float *tile)
+{
+  const int lx = get_local_id(0);
+  const int ly = get_local_id(1);
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  const int tile_width = TILE_SIZE + 2 * radius;
+  const int x0 = (int) get_group_id(0) * TILE_SIZE - radius;
+  __local float *row = tile + ly * tile_width;
+  float sum = 0.0f;
+
+  for (int i = lx; i < tile_width; i += TILE_SIZE)
+    row[i] = y < height ? load_border (in, x0 + i, y, width, height, mode) : 0.0f;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (x >= width || y >= height)
+    return;
+
+  for (int k = 0; k <= 2 * radius; k++)
+    sum += weights[k] * row[lx + 2 * radius - k];
+
+  out[y * width + x] = sum;
+}
+
+__kernel
+void convolve_columns_tiled (__global const float *in,
+                             __global float *out,
+                             __constant float *weights,
+                             const int radius,
+                             const int width,
+                             const int height,
+                             const int mode,
+                             __local float *tile)
+{
+  const int lx = get_local_id(0);
+  const int ly = get_local_id(1);
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  const int tile_height = TILE_SIZE + 2 * radius;
+  const int y0 = (int) get_group_id(1) * TILE_SIZE - radius;
+  float sum = 0.0f;
+
+  for (int i = ly; i < tile_height; i += TILE_SIZE)
+    tile[i * TILE_SIZE + lx] = x < width ? load_border (in, x, y0 + i, width, height, mode) : 0.0f;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (x >= width || y >= height)
+    return;
+
+  for (int k = 0; k <= 2 * radius; k++)
+    sum += weights[k] * tile[(ly + 2 * radius - k) * TILE_SIZE + lx];
+
+  out[y * width + x] = sum;
+}
+
+__kernel
+void convolve_rows (__global const float *in,
+                    __global float *out,
+                    __constant float *weights,
+                    const int radius,
+                    const int width,
+                    const int height,
+                    const int mode)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  float sum = 0.0f;
+
+  if (x >= width || y >= height)
+    return;
+
+  for (int k = 0; k <= 2 * radius; k++)
+    sum += weights[k] * load_border (in, x + radius - k, y, width, height, mode);
+
+  out[y * width + x] = sum;
+}
+
+__kernel
+void convolve_columns (__global const float *in,
+                       __global float *out,
+                       __constant float *weights,
+                       const int radius,
+                       const int width,
+                       const int height,
+                       const int mode)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  float sum = 0.0f;
+
+  if (x >= width || y >= height)
+    return;
+
+  for (int k = 0; k <= 2 * radius; k++)
+    sum += weights[k] * load_border (in, x, y + radius - k, width, height, mode);
+
+  out[y * width + x] = sum;
+}
@@ -11,6 +11,20 @@
 
 G_BEGIN_DECLS
 
+/**
+ * UfoOpBorder:
+ * @UFO_OP_BORDER_CLAMP: Repeat the nearest edge pixel
+ * @UFO_OP_BORDER_ZERO: Treat pixels outside as zero
+ * @UFO_OP_BORDER_MIRROR: Mirror at the edge, repeating the edge pixel
+ *
+ * Border handling of filters as used in ufo_op_convolve_separable().
+ */
+typedef enum {
+    UFO_OP_BORDER_CLAMP = 0,
+    UFO_OP_BORDER_ZERO,
+    UFO_OP_BORDER_MIRROR
+} UfoOpBorder;
+
 gpointer ufo_op_set         (UfoBuffer      *arg,
                              gfloat           value,
                              UfoResources   *resources,
@@ -63,6 +77,12 @@ gpointer ufo_op_gradient_directions
                              UfoBuffer      *out,
                              UfoResources   *resources,
                              gpointer        command_queue);
+gpointer ufo_op_gradient_magnitudes_directions
+                            (UfoBuffer      *arg,
+                             UfoBuffer      *magnitudes,
+                             UfoBuffer      *directions,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
 gfloat ufo_op_l1_norm       (UfoBuffer      *arg,
                              UfoResources   *resources,
                              gpointer        command_queue);
@@ -74,6 +94,44 @@ gfloat ufo_op_euclidean_distance
                              UfoBuffer      *arg2,
                              UfoResources   *resources,
                              gpointer        command_queue);
+gfloat ufo_op_sum           (UfoBuffer      *arg,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+gfloat ufo_op_mean          (UfoBuffer      *arg,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+gfloat ufo_op_min           (UfoBuffer      *arg,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+gfloat ufo_op_max           (UfoBuffer      *arg,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+void     ufo_op_min_max     (UfoBuffer      *arg,
+                             gfloat         *min,
+                             gfloat         *max,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+void     ufo_op_histogram   (UfoBuffer      *arg,
+                             gfloat          min,
+                             gfloat          max,
+                             guint           n_bins,
+                             guint          *histogram,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+void     ufo_op_percentiles (UfoBuffer      *arg,
+                             const gfloat   *percents,
+                             guint           n_percents,
+                             gfloat         *results,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+gpointer ufo_op_running_stats
+                            (UfoBuffer      *arg,
+                             UfoBuffer      *mean,
+                             UfoBuffer      *m2,
+                             UfoBuffer      *variance,
+                             guint           n_frames,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
 gpointer ufo_op_POSC        (UfoBuffer      *arg,
                              UfoBuffer      *out,
                              UfoResources   *resources,
@@ -83,6 +141,43 @@ gpointer ufo_op_gradient_descent
                              UfoBuffer      *out,
                              UfoResources   *resources,
                              gpointer        command_queue);
+gpointer ufo_op_tv_step     (UfoBuffer      *arg,
+                             UfoBuffer      *out,
+                             gfloat          step,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+gpointer ufo_op_transpose   (UfoBuffer      *arg,
+                             UfoBuffer      *out,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+gpointer ufo_op_bin         (UfoBuffer      *arg,
+                             UfoBuffer      *out,
+                             guint           factor,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+gpointer ufo_op_crop        (UfoBuffer      *arg,
+                             UfoBuffer      *out,
+                             gint            x,
+                             gint            y,
+                             guint           width,
+                             guint           height,
+                             gfloat          fill,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+gpointer ufo_op_convolve_separable
+                            (UfoBuffer      *arg,
+                             UfoBuffer      *out,
+                             const gfloat   *weights,
+                             guint           size,
+                             UfoOpBorder     border,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
+gpointer ufo_op_expression  (const gchar    *expression,
+                             UfoBuffer      *out,
+                             UfoBuffer     **args,
+                             guint           n_args,
+                             UfoResources   *resources,
+                             gpointer        command_queue);
 
 G_END_DECLS
 
@@ -17,6 +17,7 @@
  * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include <string.h>
 #ifdef __APPLE__
 #include <OpenCL/cl.h>
@@ -25,6 +26,9 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #include <ufo/ufo-buffer.h>
 #include <ufo/ufo-buffer-pool.h>
 #include <ufo/ufo-resources.h>
@@ -39,13 +43,6 @@ G_DEFINE_TYPE(UfoBuffer, ufo_buffer, G_TYPE_OBJECT)
 
 #define UFO_BUFFER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_BUFFER, UfoBufferPrivate))
 
-typedef enum {
-    UFO_LOCATION_HOST = 0,
-    UFO_LOCATION_DEVICE,
-    UFO_LOCATION_DEVICE_IMAGE,
-    UFO_LOCATION_INVALID
-} UfoMemLocation;
-
 enum {
     PROP_0,
     PROP_ID,
@@ -61,13 +58,21 @@ struct _UfoBufferPrivate {
     cl_context          context;
     cl_command_queue    last_queue;
     gsize               size;   /**< size of buffer in bytes */
-    UfoMemLocation      location;
-    UfoMemLocation      last_location;
+    UfoBufferLocation      location;
+    UfoBufferLocation      last_location;
+    cl_event            event;  /**< last pending write to device memory */
     UfoBufferPool       *origin;
     guint                id;
     GMutex              *mutex;
+    gint                 numa_node;
+    gboolean             host_aligned;  /**< host array is page-aligned and owned */
 };
 
+/* Memory policy constants from <linux/mempolicy.h>. We call mbind() directly
+ * instead of pulling in libnuma for this single call. */
+#define MPOL_PREFERRED_POLICY   1
+#define MPOL_MF_MOVE_PAGES      (1 << 1)
+
 static void
 copy_requisition (UfoRequisition *src,
                   UfoRequisition *dst)
@@ -91,13 +96,72 @@ compute_required_size (UfoRequisition *requisition)
     return size;
 }
 
+static gsize
+get_page_size (void)
+{
+    return (gsize) sysconf (_SC_PAGESIZE);
+}
+
+/* Host arrays are rounded up to whole pages so that they can be bound */
+static gsize
+get_host_mem_size (UfoBufferPrivate *priv)
+{
+    gsize page_size = get_page_size ();
+
+    return (priv->size + page_size - 1) & ~(page_size - 1);
+}
+
+/*
+ * Bind the host array to the preferred NUMA node. Only arrays allocated by
+ * alloc_host_mem() are bound, since only they own all the pages they span.
+ */
 static void
-alloc_host_mem (UfoBufferPrivate *priv)
+bind_host_mem (UfoBufferPrivate *priv)
 {
-    if (priv->host_array != NULL)
+#ifdef SYS_mbind
+    gulong nodemask;
+
+    if (priv->numa_node < 0 || priv->numa_node >= (gint) (8 * sizeof (gulong)) ||
+        priv->host_array == NULL || !priv->host_aligned)
+        return;
+
+    nodemask = 1UL << priv->numa_node;
+
+    /* The kernel expects one more than the number of bits in the mask */
+    if (syscall (SYS_mbind, priv->host_array, get_host_mem_size (priv), MPOL_PREFERRED_POLICY,
+                 &nodemask, 8 * sizeof (gulong) + 1, MPOL_MF_MOVE_PAGES) != 0)
+        g_debug ("Could not bind host memory to NUMA node %i", priv->numa_node);
+#endif
+}
+
+static void
+free_host_mem (UfoBufferPrivate *priv)
+{
+    if (priv->host_aligned)
+        free (priv->host_array);
+    else
         g_free (priv->host_array);
 
-    priv->host_array = g_malloc0 (priv->size);
+    priv->host_array = NULL;
+    priv->host_aligned = FALSE;
+}
+
+static void
+alloc_host_mem (UfoBufferPrivate *priv)
+{
+    gpointer mem;
+
+    free_host_mem (priv);
+
+    if (posix_memalign (&mem, get_page_size (), get_host_mem_size (priv)) != 0)
+        g_error ("Could not allocate %" G_GSIZE_FORMAT " bytes of host memory", priv->size);
+
+    priv->host_array = mem;
+    priv->host_aligned = TRUE;
+
+    /* Bind before touching the pages so that they are faulted in on the node */
+    bind_host_mem (priv);
+    memset (priv->host_array, 0, priv->size);
 }
 
 static void
@@ -320,6 +384,110 @@ set_region_from_requisition (size_t region[3],
         region[2] = 1;
 }
 
+static guint
+get_wait_list (UfoBufferPrivate *src_priv,
+               UfoBufferPrivate *dst_priv,
+               cl_event wait_list[2])
+{
+    guint n_events = 0;
+
+    if (src_priv->event != NULL)
+        wait_list[n_events++] = src_priv->event;
+
+    if (dst_priv != src_priv && dst_priv->event != NULL)
+        wait_list[n_events++] = dst_priv->event;
+
+    return n_events;
+}
+
+static void
+replace_event (UfoBufferPrivate *priv,
+               cl_event event)
+{
+    if (priv->event != NULL)
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (priv->event));
+
+    priv->event = event;
+}
+
+/* Maps compute queues to the copy queues of the same device */
+static GHashTable *copy_queues = NULL;
+static GStaticMutex copy_queues_mutex = G_STATIC_MUTEX_INIT;
+
+/*
+ * Return the queue on which host transfers for @queue should be issued. If a
+ * copy queue is registered, a marker is enqueued on @queue and appended to
+ * @wait_list, so that the transfer waits for all commands issued on @queue so
+ * far, including kernels still reading the device memory. @queue is flushed so
+ * that the marker can complete while the copy queue waits for it. Release
+ * @marker with release_marker() once the transfer is enqueued.
+ */
+static cl_command_queue
+get_transfer_queue (cl_command_queue queue,
+                    cl_event *wait_list,
+                    guint *n_events,
+                    cl_event *marker)
+{
+    cl_command_queue copy_queue = NULL;
+
+    *marker = NULL;
+
+    if (queue == NULL)
+        return queue;
+
+    g_static_mutex_lock (&copy_queues_mutex);
+
+    if (copy_queues != NULL)
+        copy_queue = g_hash_table_lookup (copy_queues, queue);
+
+    g_static_mutex_unlock (&copy_queues_mutex);
+
+    if (copy_queue == NULL)
+        return queue;
+
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueMarker (queue, marker));
+    UFO_RESOURCES_CHECK_CLERR (clFlush (queue));
+    wait_list[(*n_events)++] = *marker;
+    return copy_queue;
+}
+
+static void
+release_marker (cl_event marker)
+{
+    if (marker != NULL)
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (marker));
+}
+
+/**
+ * ufo_buffer_set_copy_queue: (skip)
+ * @cmd_queue: A cl_command_queue used for computation
+ * @copy_queue: (allow-none): A cl_command_queue of the same device or %NULL
+ *
+ * Issue transfers between host and device memory requested for @cmd_queue on
+ * @copy_queue, so that they can overlap with kernels enqueued on @cmd_queue
+ * later on. Each transfer waits for all commands issued on @cmd_queue before
+ * it and for the event set with ufo_buffer_set_event(), and still blocks the
+ * caller. Passing %NULL for @copy_queue restores transfers on @cmd_queue.
+ */
+void
+ufo_buffer_set_copy_queue (gpointer cmd_queue,
+                           gpointer copy_queue)
+{
+    g_return_if_fail (cmd_queue != NULL);
+
+    g_static_mutex_lock (&copy_queues_mutex);
+
+    if (copy_queues == NULL)
+        copy_queues = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    if (copy_queue != NULL)
+        g_hash_table_insert (copy_queues, cmd_queue, copy_queue);
+    else
+        g_hash_table_remove (copy_queues, cmd_queue);
+
+    g_static_mutex_unlock (&copy_queues_mutex);
+}
+
 static void
 transfer_host_to_host (UfoBufferPrivate *src_priv,
                        UfoBufferPrivate *dst_priv,
@@ -335,16 +503,24 @@ transfer_host_to_device (UfoBufferPrivate *src_priv,
                          UfoBufferPrivate *dst_priv,
                          cl_command_queue queue)
 {
+    cl_event wait_list[3];
+    cl_event marker;
+    guint n_events;
     cl_int errcode;
 
+    n_events = get_wait_list (src_priv, dst_priv, wait_list);
+    queue = get_transfer_queue (queue, wait_list, &n_events, &marker);
+
     errcode = clEnqueueWriteBuffer (queue,
                                     dst_priv->device_array,
                                     CL_TRUE,
                                     0, src_priv->size,
                                     src_priv->host_array,
-                                    0, NULL, NULL);
+                                    n_events, n_events > 0 ? wait_list : NULL, NULL);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
+    release_marker (marker);
+    replace_event (dst_priv, NULL);
 }
 
 static void
@@ -353,11 +529,15 @@ transfer_host_to_image (UfoBufferPrivate *src_priv,
                         cl_command_queue queue)
 {
     cl_int errcode;
-    cl_event event;
+    cl_event wait_list[3];
+    cl_event marker;
+    guint n_events;
     size_t region[3];
     size_t origin[] = { 0, 0, 0 };
 
     set_region_from_requisition (region, &src_priv->requisition);
+    n_events = get_wait_list (src_priv, dst_priv, wait_list);
+    queue = get_transfer_queue (queue, wait_list, &n_events, &marker);
 
     errcode = clEnqueueWriteImage (queue,
                                    dst_priv->device_image,
@@ -365,11 +545,11 @@ transfer_host_to_image (UfoBufferPrivate *src_priv,
                                    origin, region,
                                    0, 0,
                                    src_priv->host_array,
-                                   0, NULL, &event);
+                                   n_events, n_events > 0 ? wait_list : NULL, NULL);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    release_marker (marker);
+    replace_event (dst_priv, NULL);
 }
 
 static void
@@ -378,18 +558,20 @@ transfer_device_to_device (UfoBufferPrivate *src_priv,
                            cl_command_queue queue)
 {
     cl_event event;
+    cl_event wait_list[2];
+    guint n_events;
     cl_int errcode;
 
+    n_events = get_wait_list (src_priv, dst_priv, wait_list);
     errcode = clEnqueueCopyBuffer (queue,
                                    src_priv->device_array,
                                    dst_priv->device_array,
                                    0, 0,
                                    src_priv->size,
-                                   0, NULL, &event);
+                                   n_events, n_events > 0 ? wait_list : NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    replace_event (dst_priv, event);
 }
 
 static void
@@ -397,14 +579,20 @@ transfer_device_to_host (UfoBufferPrivate *src_priv,
                          UfoBufferPrivate *dst_priv,
                          cl_command_queue queue)
 {
+    cl_event wait_list[3];
+    cl_event marker;
+    guint n_events;
     cl_int errcode;
 
+    n_events = get_wait_list (src_priv, dst_priv, wait_list);
+    queue = get_transfer_queue (queue, wait_list, &n_events, &marker);
+
     errcode = clEnqueueReadBuffer (queue,
                                    src_priv->device_array,
                                    CL_TRUE,
                                    0, src_priv->size,
                                    dst_priv->host_array,
-                                   0, NULL, NULL);
+                                   n_events, n_events > 0 ? wait_list : NULL, NULL);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
 }
@@ -415,21 +603,23 @@ transfer_device_to_image (UfoBufferPrivate *src_priv,
                           cl_command_queue queue)
 {
     cl_event event;
+    cl_event wait_list[2];
+    guint n_events;
     cl_int errcode;
     size_t region[3];
     size_t origin[] = { 0, 0, 0 };
 
     set_region_from_requisition (region, &src_priv->requisition);
 
+    n_events = get_wait_list (src_priv, dst_priv, wait_list);
     errcode = clEnqueueCopyBufferToImage (queue,
                                           src_priv->device_array,
                                           dst_priv->device_image,
                                           0, origin, region,
-                                          0, NULL, &event);
+                                          n_events, n_events > 0 ? wait_list : NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    replace_event (dst_priv, event);
 }
 
 static void
@@ -438,21 +628,23 @@ transfer_image_to_image (UfoBufferPrivate *src_priv,
                          cl_command_queue queue)
 {
     cl_event event;
+    cl_event wait_list[2];
+    guint n_events;
     cl_int errcode;
     size_t region[3];
     size_t origin[] = { 0, 0, 0 };
 
     set_region_from_requisition (region, &src_priv->requisition);
 
+    n_events = get_wait_list (src_priv, dst_priv, wait_list);
     errcode = clEnqueueCopyImage (queue,
                                   src_priv->device_image,
                                   dst_priv->device_image,
                                   origin, origin, region,
-                                  0, NULL, &event);
+                                  n_events, n_events > 0 ? wait_list : NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    replace_event (dst_priv, event);
 }
 
 static void
@@ -461,10 +653,15 @@ transfer_image_to_host (UfoBufferPrivate *src_priv,
                         cl_command_queue queue)
 {
     cl_int errcode;
+    cl_event wait_list[3];
+    cl_event marker;
+    guint n_events;
     size_t region[3];
     size_t origin[] = { 0, 0, 0 };
 
     set_region_from_requisition (region, &src_priv->requisition);
+    n_events = get_wait_list (src_priv, dst_priv, wait_list);
+    queue = get_transfer_queue (queue, wait_list, &n_events, &marker);
 
     errcode = clEnqueueReadImage (queue,
                                   src_priv->device_image,
@@ -472,7 +669,7 @@ transfer_image_to_host (UfoBufferPrivate *src_priv,
                                   origin, region,
                                   0, 0,
                                   dst_priv->host_array,
-                                  0, NULL, NULL);
+                                  n_events, n_events > 0 ? wait_list : NULL, NULL);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
 }
@@ -483,21 +680,23 @@ transfer_image_to_device (UfoBufferPrivate *src_priv,
                           cl_command_queue queue)
 {
     cl_event event;
+    cl_event wait_list[2];
+    guint n_events;
     cl_int errcode;
     size_t region[3];
     size_t origin[] = { 0, 0, 0 };
 
     set_region_from_requisition (region, &src_priv->requisition);
 
+    n_events = get_wait_list (src_priv, dst_priv, wait_list);
     errcode = clEnqueueCopyImageToBuffer (queue,
                                           src_priv->device_image,
                                           dst_priv->device_array,
                                           origin, region, 0,
-                                          0, NULL, &event);
+                                          n_events, n_events > 0 ? wait_list : NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    replace_event (dst_priv, event);
 }
 
 
@@ -534,12 +733,12 @@ ufo_buffer_copy (UfoBuffer *src, UfoBuffer *dst)
     g_mutex_lock (dpriv->mutex);
     queue = spriv->last_queue != NULL ? spriv->last_queue : dpriv->last_queue;
 
-    if (spriv->location == UFO_LOCATION_INVALID) {
+    if (spriv->location == UFO_BUFFER_LOCATION_INVALID) {
         alloc_host_mem (spriv);
-        spriv->location = UFO_LOCATION_HOST;
+        spriv->location = UFO_BUFFER_LOCATION_HOST;
     }
 
-    if (dpriv->location == UFO_LOCATION_INVALID) {
+    if (dpriv->location == UFO_BUFFER_LOCATION_INVALID) {
         alloc[spriv->location](dpriv);
         dpriv->location = spriv->location;
     }
@@ -567,6 +766,7 @@ ufo_buffer_dup (UfoBuffer *buffer)
 
     ufo_buffer_get_requisition (buffer, &requisition);
     copy = ufo_buffer_new (&requisition, buffer->priv->origin, buffer->priv->context);
+    ufo_buffer_set_numa_node (copy, buffer->priv->numa_node);
     return copy;
 }
 
@@ -590,10 +790,7 @@ ufo_buffer_resize (UfoBuffer *buffer,
 
     priv = UFO_BUFFER_GET_PRIVATE (buffer);
 
-    if (priv->host_array != NULL) {
-        g_free (priv->host_array);
-        priv->host_array = NULL;
-    }
+    free_host_mem (priv);
 
     if (priv->device_array != NULL) {
         UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_array));
@@ -678,7 +875,7 @@ update_last_queue (UfoBufferPrivate *priv,
 
 static void
 update_location (UfoBufferPrivate *priv,
-                 UfoMemLocation new_location)
+                 UfoBufferLocation new_location)
 {
     priv->last_location = priv->location;
     priv->location = new_location;
@@ -688,11 +885,10 @@ void ufo_buffer_set_host_array (UfoBuffer *buffer, gpointer data)
 {
     UfoBufferPrivate *priv = UFO_BUFFER_GET_PRIVATE (buffer);
     g_mutex_lock (priv->mutex);
-    if (priv->host_array != NULL) {
-        g_free (priv->host_array);
-    }
+    free_host_mem (priv);
+    replace_event (priv, NULL);
     priv->host_array = (gfloat *) data;
-    update_location (priv, UFO_LOCATION_HOST);
+    update_location (priv, UFO_BUFFER_LOCATION_HOST);
     g_mutex_unlock (priv->mutex);
 }
 
@@ -720,13 +916,15 @@ ufo_buffer_get_host_array (UfoBuffer *buffer, gpointer cmd_queue)
     if (priv->host_array == NULL) {
         alloc_host_mem (priv);
     }
-    if (priv->location == UFO_LOCATION_DEVICE && priv->device_array)
+    if (priv->location == UFO_BUFFER_LOCATION_DEVICE && priv->device_array)
         transfer_device_to_host (priv, priv, priv->last_queue);
 
-    if (priv->location == UFO_LOCATION_DEVICE_IMAGE && priv->device_image)
+    if (priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE && priv->device_image)
         transfer_image_to_host (priv, priv, priv->last_queue);
 
-    update_location (priv, UFO_LOCATION_HOST);
+    /* The caller may write the host array, the next upload replaces device memory */
+    replace_event (priv, NULL);
+    update_location (priv, UFO_BUFFER_LOCATION_HOST);
     g_mutex_unlock (priv->mutex);
     return priv->host_array;
 }
@@ -755,13 +953,13 @@ ufo_buffer_get_device_array (UfoBuffer *buffer, gpointer cmd_queue)
     if (priv->device_array == NULL)
         alloc_device_array (priv);
 
-    if (priv->location == UFO_LOCATION_HOST && priv->host_array)
+    if (priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array)
         transfer_host_to_device (priv, priv, priv->last_queue);
 
-    if (priv->location == UFO_LOCATION_DEVICE_IMAGE && priv->device_array)
+    if (priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE && priv->device_array)
         transfer_image_to_device (priv, priv, priv->last_queue);
 
-    update_location (priv, UFO_LOCATION_DEVICE);
+    update_location (priv, UFO_BUFFER_LOCATION_DEVICE);
 
     return priv->device_array;
 }
@@ -791,17 +989,150 @@ ufo_buffer_get_device_image (UfoBuffer *buffer,
     if (priv->device_image == NULL)
         alloc_device_image (priv);
 
-    if (priv->location == UFO_LOCATION_HOST && priv->host_array)
+    if (priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array)
         transfer_host_to_image (priv, priv, priv->last_queue);
 
-    if (priv->location == UFO_LOCATION_DEVICE && priv->device_array)
+    if (priv->location == UFO_BUFFER_LOCATION_DEVICE && priv->device_array)
         transfer_device_to_image (priv, priv, priv->last_queue);
 
-    update_location (priv, UFO_LOCATION_DEVICE_IMAGE);
+    update_location (priv, UFO_BUFFER_LOCATION_DEVICE_IMAGE);
 
     return priv->device_image;
 }
 
+/**
+ * ufo_buffer_get_event:
+ * @buffer: A #UfoBuffer
+ *
+ * Get the event of the last asynchronous write to the device memory of
+ * @buffer. Commands reading @buffer on another queue or an out-of-order queue
+ * must wait on it.
+ *
+ * Returns: (transfer none): A cl_event or %NULL if no write is pending.
+ */
+gpointer
+ufo_buffer_get_event (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
+    return buffer->priv->event;
+}
+
+/**
+ * ufo_buffer_set_event:
+ * @buffer: A #UfoBuffer
+ * @event: (allow-none): A cl_event or %NULL
+ *
+ * Record @event as the last write to the device memory of @buffer. Transfers
+ * and ufo_op_* functions involving @buffer wait on it, so dependent commands
+ * can be enqueued back to back without synchronizing with the host. @event is
+ * retained by @buffer.
+ */
+void
+ufo_buffer_set_event (UfoBuffer *buffer,
+                      gpointer event)
+{
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+
+    if (event != NULL)
+        UFO_RESOURCES_CHECK_CLERR (clRetainEvent (event));
+
+    replace_event (buffer->priv, event);
+}
+
+/**
+ * ufo_buffer_get_location:
+ * @buffer: A #UfoBuffer
+ *
+ * Query where the current data of @buffer resides. This can be used to pick an
+ * operation that works on the current representation instead of forcing a
+ * transfer.
+ *
+ * Returns: The current #UfoBufferLocation of @buffer.
+ */
+UfoBufferLocation
+ufo_buffer_get_location (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), UFO_BUFFER_LOCATION_INVALID);
+    return buffer->priv->location;
+}
+
+/**
+ * ufo_buffer_preallocate:
+ * @buffer: A #UfoBuffer
+ * @location: Memory to allocate, either %UFO_BUFFER_LOCATION_HOST or
+ * %UFO_BUFFER_LOCATION_DEVICE
+ *
+ * Allocate the memory for @location now instead of on first access. Neither
+ * the data nor the current location of @buffer change.
+ */
+void
+ufo_buffer_preallocate (UfoBuffer *buffer,
+                        UfoBufferLocation location)
+{
+    UfoBufferPrivate *priv;
+
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    priv = buffer->priv;
+
+    switch (location) {
+        case UFO_BUFFER_LOCATION_HOST:
+            g_mutex_lock (priv->mutex);
+
+            if (priv->host_array == NULL)
+                alloc_host_mem (priv);
+
+            g_mutex_unlock (priv->mutex);
+            break;
+
+        case UFO_BUFFER_LOCATION_DEVICE:
+            if (priv->device_array == NULL && priv->context != NULL)
+                alloc_device_array (priv);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * ufo_buffer_set_numa_node:
+ * @buffer: A #UfoBuffer
+ * @node: NUMA node or -1 to use the default policy
+ *
+ * Prefer memory of NUMA node @node for the host array of @buffer. Buffers that
+ * are transferred to a device should be placed on the node that the device is
+ * attached to, see ufo_gpu_node_get_numa_node(). A host array allocated by
+ * @buffer itself is migrated, one passed with ufo_buffer_set_host_array() is
+ * left alone.
+ */
+void
+ufo_buffer_set_numa_node (UfoBuffer *buffer,
+                          gint node)
+{
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+
+    if (buffer->priv->numa_node == node)
+        return;
+
+    buffer->priv->numa_node = node;
+    bind_host_mem (buffer->priv);
+}
+
+/**
+ * ufo_buffer_get_numa_node:
+ * @buffer: A #UfoBuffer
+ *
+ * Get the preferred NUMA node of the host array of @buffer.
+ *
+ * Returns: NUMA node or -1 if the default policy is used.
+ */
+gint
+ufo_buffer_get_numa_node (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), -1);
+    return buffer->priv->numa_node;
+}
+
 /**
  * ufo_buffer_discard_location:
  * @buffer: A #UfoBuffer
@@ -814,6 +1145,9 @@ ufo_buffer_discard_location (UfoBuffer *buffer)
     g_return_if_fail (UFO_IS_BUFFER (buffer));
 
     buffer->priv->location = buffer->priv->last_location;
+
+    /* The recorded write produced the discarded contents */
+    replace_event (buffer->priv, NULL);
 }
 
 static void
@@ -938,9 +1272,9 @@ ufo_buffer_finalize (GObject *gobject)
     UfoBuffer *buffer = UFO_BUFFER (gobject);
     UfoBufferPrivate *priv = UFO_BUFFER_GET_PRIVATE (buffer);
 
-    g_free (priv->host_array);
-    priv->host_array = NULL;
+    free_host_mem (priv);
 
+    replace_event (priv, NULL);
     free_cl_mem (&priv->device_array);
     free_cl_mem (&priv->device_image);
 
@@ -965,9 +1299,12 @@ ufo_buffer_init (UfoBuffer *buffer)
     priv->device_array = NULL;
     priv->device_image = NULL;
     priv->host_array = NULL;
+    priv->host_aligned = FALSE;
+    priv->event = NULL;
+    priv->numa_node = -1;
 
-    priv->location = UFO_LOCATION_INVALID;
-    priv->last_location = UFO_LOCATION_INVALID;
+    priv->location = UFO_BUFFER_LOCATION_INVALID;
+    priv->last_location = UFO_BUFFER_LOCATION_INVALID;
     priv->requisition.n_dims = 0;
 }
 
@@ -113,6 +113,23 @@ typedef enum {
     UFO_BUFFER_DEPTH_16U
 } UfoBufferDepth;
 
+/**
+ * UfoBufferLocation:
+ * @UFO_BUFFER_LOCATION_HOST: Data is in host memory
+ * @UFO_BUFFER_LOCATION_DEVICE: Data is in a device array
+ * @UFO_BUFFER_LOCATION_DEVICE_IMAGE: Data is in a device image
+ * @UFO_BUFFER_LOCATION_INVALID: No data has been written yet
+ *
+ * Location of the most recent data of a #UfoBuffer as returned by
+ * ufo_buffer_get_location().
+ */
+typedef enum {
+    UFO_BUFFER_LOCATION_HOST = 0,
+    UFO_BUFFER_LOCATION_DEVICE,
+    UFO_BUFFER_LOCATION_DEVICE_IMAGE,
+    UFO_BUFFER_LOCATION_INVALID
+} UfoBufferLocation;
+
 UfoBuffer*  ufo_buffer_new                  (UfoRequisition *requisition,
                                             gpointer origin,
                                              gpointer        context);
@@ -138,7 +155,19 @@ gpointer    ufo_buffer_get_device_array     (UfoBuffer      *buffer,
                                              gpointer        cmd_queue);
 gpointer    ufo_buffer_get_device_image     (UfoBuffer      *buffer,
                                              gpointer        cmd_queue);
+gpointer    ufo_buffer_get_event            (UfoBuffer      *buffer);
+void        ufo_buffer_set_event            (UfoBuffer      *buffer,
+                                             gpointer        event);
+void        ufo_buffer_set_copy_queue       (gpointer        cmd_queue,
+                                             gpointer        copy_queue);
+UfoBufferLocation
+            ufo_buffer_get_location         (UfoBuffer      *buffer);
 void        ufo_buffer_discard_location     (UfoBuffer      *buffer);
+void        ufo_buffer_preallocate          (UfoBuffer      *buffer,
+                                             UfoBufferLocation location);
+void        ufo_buffer_set_numa_node        (UfoBuffer      *buffer,
+                                             gint            node);
+gint        ufo_buffer_get_numa_node        (UfoBuffer      *buffer);
 void        ufo_buffer_convert              (UfoBuffer      *buffer,
                                              UfoBufferDepth  depth);
 void        ufo_buffer_convert_from_data    (UfoBuffer      *buffer,
@@ -45,6 +45,9 @@ enum {
     PROP_DEVICE_TYPE,
     PROP_DISABLE_GPU,
     PROP_NETWORK_WRITER,
+    PROP_CPU_REPLICAS,
+    PROP_THREAD_PLACEMENT,
+    PROP_RESERVE_GENERATOR_CPUS,
     N_PROPERTIES
 };
 
@@ -53,6 +56,9 @@ struct _UfoConfigPrivate {
     UfoDeviceType    device_type;
     gboolean         disable_gpu;
     gboolean         network_writer;
+    guint            cpu_replicas;
+    UfoThreadPlacement thread_placement;
+    gboolean         reserve_generator_cpus;
 };
 
 static GParamSpec *properties[N_PROPERTIES] = { NULL, };
@@ -170,6 +176,18 @@ ufo_config_set_property (GObject      *object,
             priv->network_writer = g_value_get_boolean (value);
             break;
 
+        case PROP_CPU_REPLICAS:
+            priv->cpu_replicas = g_value_get_uint (value);
+            break;
+
+        case PROP_THREAD_PLACEMENT:
+            priv->thread_placement = g_value_get_enum (value);
+            break;
+
+        case PROP_RESERVE_GENERATOR_CPUS:
+            priv->reserve_generator_cpus = g_value_get_boolean (value);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
             break;
@@ -201,6 +219,18 @@ ufo_config_get_property (GObject      *object,
             g_value_set_boolean (value, priv->network_writer);
             break;
 
+        case PROP_CPU_REPLICAS:
+            g_value_set_uint (value, priv->cpu_replicas);
+            break;
+
+        case PROP_THREAD_PLACEMENT:
+            g_value_set_enum (value, priv->thread_placement);
+            break;
+
+        case PROP_RESERVE_GENERATOR_CPUS:
+            g_value_set_boolean (value, priv->reserve_generator_cpus);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
             break;
@@ -298,6 +328,46 @@ ufo_config_class_init (UfoConfigClass *klass)
                               FALSE,
                               G_PARAM_READWRITE);
 
+    /**
+     * UfoConfig:cpu-replicas
+     *
+     * Maximum number of copies of CPU-only sub-graphs made when expanding a
+     * task graph. The default of 1 keeps CPU tasks as they are.
+     */
+    properties[PROP_CPU_REPLICAS] =
+        g_param_spec_uint ("cpu-replicas",
+                           "Maximum number of copies of CPU-only sub-graphs",
+                           "Maximum number of copies of CPU-only sub-graphs",
+                           1, G_MAXUINT, 1,
+                           G_PARAM_READWRITE);
+
+    /**
+     * UfoConfig:thread-placement
+     *
+     * Policy to pin task threads to CPUs. See #UfoThreadPlacement.
+     */
+    properties[PROP_THREAD_PLACEMENT] =
+        g_param_spec_enum ("thread-placement",
+                           "Policy to pin task threads to CPUs",
+                           "Policy to pin task threads to CPUs",
+                           UFO_TYPE_THREAD_PLACEMENT,
+                           UFO_THREAD_PLACEMENT_NONE,
+                           G_PARAM_READWRITE);
+
+    /**
+     * UfoConfig:reserve-generator-cpus
+     *
+     * Give each generator a CPU of its own that no other task thread is pinned
+     * to. Only used if UfoConfig:thread-placement is not
+     * %UFO_THREAD_PLACEMENT_NONE.
+     */
+    properties[PROP_RESERVE_GENERATOR_CPUS] =
+        g_param_spec_boolean ("reserve-generator-cpus",
+                              "Pin generators to CPUs of their own",
+                              "Pin generators to CPUs of their own",
+                              FALSE,
+                              G_PARAM_READWRITE);
+
     g_object_class_install_property (oclass, PROP_PATHS,
                                      properties[PROP_PATHS]);
     g_object_class_install_property (oclass, PROP_DISABLE_GPU,
@@ -308,6 +378,12 @@ ufo_config_class_init (UfoConfigClass *klass)
                                      properties[PROP_DISABLE_GPU]);
     g_object_class_install_property (oclass, PROP_NETWORK_WRITER,
                                      properties[PROP_NETWORK_WRITER]);
+    g_object_class_install_property (oclass, PROP_CPU_REPLICAS,
+                                     properties[PROP_CPU_REPLICAS]);
+    g_object_class_install_property (oclass, PROP_THREAD_PLACEMENT,
+                                     properties[PROP_THREAD_PLACEMENT]);
+    g_object_class_install_property (oclass, PROP_RESERVE_GENERATOR_CPUS,
+                                     properties[PROP_RESERVE_GENERATOR_CPUS]);
 
     g_type_class_add_private(klass, sizeof (UfoConfigPrivate));
 }
@@ -320,6 +396,9 @@ ufo_config_init (UfoConfig *config)
     config->priv = priv = UFO_CONFIG_GET_PRIVATE (config);
     priv->path_array = g_value_array_new (0);
     priv->device_type = UFO_DEVICE_ALL;
+    priv->cpu_replicas = 1;
+    priv->thread_placement = UFO_THREAD_PLACEMENT_NONE;
+    priv->reserve_generator_cpus = FALSE;
 
     add_path ("/usr/local/lib64/ufo", priv);
     add_path ("/usr/local/lib/ufo", priv);
@@ -75,6 +75,24 @@ typedef enum {
     UFO_DEVICE_ALL = (1 << 1) | (1 << 0)
 } UfoDeviceType;
 
+/**
+ * UfoThreadPlacement:
+ * @UFO_THREAD_PLACEMENT_NONE: Let the operating system move task threads
+ * @UFO_THREAD_PLACEMENT_COMPACT: Pin task threads to neighbouring CPUs
+ * @UFO_THREAD_PLACEMENT_SCATTER: Pin task threads to CPUs spread across all
+ * sockets
+ * @UFO_THREAD_PLACEMENT_DEVICE: Pin GPU tasks and the tasks feeding them to
+ * CPUs close to their device, the others like @UFO_THREAD_PLACEMENT_COMPACT
+ *
+ * Policies to pin task threads to CPUs. See UfoConfig:"thread-placement".
+ */
+typedef enum {
+    UFO_THREAD_PLACEMENT_NONE,
+    UFO_THREAD_PLACEMENT_COMPACT,
+    UFO_THREAD_PLACEMENT_SCATTER,
+    UFO_THREAD_PLACEMENT_DEVICE
+} UfoThreadPlacement;
+
 
 UfoConfig   * ufo_config_new                (void);
 void          ufo_config_add_paths          (UfoConfig *config,
@@ -19,6 +19,7 @@
 
 #define _GNU_SOURCE
 #include <sched.h>
+#include <stdlib.h>
 #include <ufo/ufo-cpu-node.h>
 
 G_DEFINE_TYPE (UfoCpuNode, ufo_cpu_node, UFO_TYPE_NODE)
@@ -28,8 +29,21 @@ G_DEFINE_TYPE (UfoCpuNode, ufo_cpu_node, UFO_TYPE_NODE)
 
 struct _UfoCpuNodePrivate {
     cpu_set_t *mask;
+    gint       package;
+    gint       numa_node;
 };
 
+static guint
+get_first_cpu (cpu_set_t *mask)
+{
+    for (guint i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET (i, mask))
+            return i;
+    }
+
+    return 0;
+}
+
 UfoNode *
 ufo_cpu_node_new (gpointer mask)
 {
@@ -57,6 +71,124 @@ ufo_cpu_node_get_affinity (UfoCpuNode *node)
     return node->priv->mask;
 }
 
+/**
+ * ufo_cpu_node_get_id:
+ * @node: A #UfoCpuNode
+ *
+ * Get the number of the first CPU in the affinity mask of @node as used by the
+ * operating system.
+ *
+ * Returns: CPU number.
+ */
+guint
+ufo_cpu_node_get_id (UfoCpuNode *node)
+{
+    g_return_val_if_fail (UFO_IS_CPU_NODE (node), 0);
+    return get_first_cpu (node->priv->mask);
+}
+
+/**
+ * ufo_cpu_node_get_package:
+ * @node: A #UfoCpuNode
+ *
+ * Get the physical package, i.e. the socket, that @node belongs to. If the
+ * topology cannot be read from sysfs, all CPUs are considered to be part of
+ * package 0.
+ *
+ * Returns: Physical package id of @node.
+ */
+guint
+ufo_cpu_node_get_package (UfoCpuNode *node)
+{
+    UfoCpuNodePrivate *priv;
+
+    g_return_val_if_fail (UFO_IS_CPU_NODE (node), 0);
+    priv = node->priv;
+
+    if (priv->package < 0) {
+        gchar *filename;
+        gchar *contents;
+
+        filename = g_strdup_printf ("/sys/devices/system/cpu/cpu%u/topology/physical_package_id",
+                                    get_first_cpu (priv->mask));
+        priv->package = 0;
+
+        if (g_file_get_contents (filename, &contents, NULL, NULL)) {
+            priv->package = MAX (0, atoi (contents));
+            g_free (contents);
+        }
+
+        g_free (filename);
+    }
+
+    return (guint) priv->package;
+}
+
+/**
+ * ufo_cpu_node_get_numa_node:
+ * @node: A #UfoCpuNode
+ *
+ * Get the NUMA node that the memory controller closest to @node belongs to.
+ *
+ * Returns: NUMA node number or -1 if the system does not report one.
+ */
+gint
+ufo_cpu_node_get_numa_node (UfoCpuNode *node)
+{
+    UfoCpuNodePrivate *priv;
+
+    g_return_val_if_fail (UFO_IS_CPU_NODE (node), -1);
+    priv = node->priv;
+
+    if (priv->numa_node < -1) {
+        gchar *dirname;
+        GDir *dir;
+
+        /* sysfs links each CPU to its memory node with a "nodeX" entry */
+        dirname = g_strdup_printf ("/sys/devices/system/cpu/cpu%u", get_first_cpu (priv->mask));
+        dir = g_dir_open (dirname, 0, NULL);
+        priv->numa_node = -1;
+
+        if (dir != NULL) {
+            const gchar *name;
+
+            while ((name = g_dir_read_name (dir)) != NULL) {
+                if (g_str_has_prefix (name, "node") && g_ascii_isdigit (name[4])) {
+                    priv->numa_node = atoi (name + 4);
+                    break;
+                }
+            }
+
+            g_dir_close (dir);
+        }
+
+        g_free (dirname);
+    }
+
+    return priv->numa_node;
+}
+
+/**
+ * ufo_cpu_node_bind_current_thread:
+ * @node: A #UfoCpuNode
+ *
+ * Restrict the calling thread to the CPUs of @node.
+ *
+ * Returns: %TRUE if the affinity could be set, %FALSE otherwise.
+ */
+gboolean
+ufo_cpu_node_bind_current_thread (UfoCpuNode *node)
+{
+    g_return_val_if_fail (UFO_IS_CPU_NODE (node), FALSE);
+
+    if (sched_setaffinity (0, sizeof (cpu_set_t), node->priv->mask) != 0) {
+        g_warning ("Could not bind thread to CPU %u", get_first_cpu (node->priv->mask));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 static void
 ufo_cpu_node_finalize (GObject *object)
 {
@@ -118,4 +250,6 @@ ufo_cpu_node_init (UfoCpuNode *self)
     UfoCpuNodePrivate *priv;
     self->priv = priv = UFO_CPU_NODE_GET_PRIVATE (self);
     priv->mask = NULL;
+    priv->package = -1;
+    priv->numa_node = -2;
 }
@@ -64,6 +64,11 @@ struct _UfoCpuNodeClass {
 
 UfoNode     *ufo_cpu_node_new           (gpointer mask);
 gpointer     ufo_cpu_node_get_affinity  (UfoCpuNode *node);
+guint        ufo_cpu_node_get_id        (UfoCpuNode *node);
+guint        ufo_cpu_node_get_package   (UfoCpuNode *node);
+gint         ufo_cpu_node_get_numa_node (UfoCpuNode *node);
+gboolean     ufo_cpu_node_bind_current_thread
+                                        (UfoCpuNode *node);
 GType        ufo_cpu_node_get_type      (void);
 
 G_END_DECLS
@@ -41,6 +41,30 @@ ufo_cpu_task_generate (UfoCpuTask *task,
     return UFO_CPU_TASK_GET_IFACE (task)->generate (task, output, requisition);
 }
 
+/**
+ * ufo_cpu_task_process_batch:
+ * @task: A #UfoCpuTask
+ * @inputs: (array): @n_items sets of input buffers, stored item by item
+ * @outputs: (array length=n_items): Output buffers, one for each item
+ * @n_items: Number of items in this batch
+ * @requisition: Requisition of the first item, shared by all @outputs
+ *
+ * Process several items in one call. Implementing process_batch() is optional,
+ * the scheduler only uses it if ufo_task_get_batch_size() returns more than one.
+ * The last batch of a stream may contain fewer items.
+ *
+ * Returns: %TRUE if processing should continue, %FALSE otherwise.
+ */
+gboolean
+ufo_cpu_task_process_batch (UfoCpuTask *task,
+                            UfoBuffer **inputs,
+                            UfoBuffer **outputs,
+                            guint n_items,
+                            UfoRequisition *requisition)
+{
+    return UFO_CPU_TASK_GET_IFACE (task)->process_batch (task, inputs, outputs, n_items, requisition);
+}
+
 static gboolean
 ufo_cpu_task_process_real (UfoCpuTask *task,
                            UfoBuffer **inputs,
@@ -65,4 +89,5 @@ ufo_cpu_task_default_init (UfoCpuTaskInterface *iface)
 {
     iface->process = ufo_cpu_task_process_real;
     iface->generate = ufo_cpu_task_generate_real;
+    iface->process_batch = NULL;
 }
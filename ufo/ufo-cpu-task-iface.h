@@ -50,6 +50,12 @@ struct _UfoCpuTaskIface {
     gboolean (*generate) (UfoCpuTask *task,
                           UfoBuffer *output,
                           UfoRequisition *requisition);
+    gboolean (*process_batch)
+                         (UfoCpuTask *task,
+                          UfoBuffer **inputs,
+                          UfoBuffer **outputs,
+                          guint n_items,
+                          UfoRequisition *requisition);
 };
 
 gboolean    ufo_cpu_task_process    (UfoCpuTask     *task,
@@ -59,6 +65,12 @@ gboolean    ufo_cpu_task_process    (UfoCpuTask     *task,
 gboolean    ufo_cpu_task_generate   (UfoCpuTask     *task,
                                      UfoBuffer      *output,
                                      UfoRequisition *requisition);
+gboolean    ufo_cpu_task_process_batch
+                                    (UfoCpuTask     *task,
+                                     UfoBuffer     **inputs,
+                                     UfoBuffer     **outputs,
+                                     guint           n_items,
+                                     UfoRequisition *requisition);
 
 GType ufo_cpu_task_get_type (void);
 
@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <ufo/ufo-fused-task.h>
+#include <ufo/ufo-gpu-task-iface.h>
+#include <ufo/ufo-resources.h>
+
+/**
+ * SECTION:ufo-fused-task
+ * @Short_description: Run a chain of GPU tasks in one thread
+ * @Title: UfoFusedTask
+ *
+ * A #UfoFusedTask replaces a linear chain of single-input GPU processors that
+ * are mapped to the same device. It calls the process function of each task
+ * in turn and keeps the intermediate results in private buffers, so that they
+ * never leave the device and no group or thread switch sits between two
+ * tasks. Fused task graphs are created by ufo_task_graph_fuse().
+ */
+
+struct _UfoFusedTaskPrivate {
+    GList           *tasks;
+    guint            n_tasks;
+    guint            n_active;
+    UfoBuffer      **intermediates;
+    UfoRequisition  *requisitions;
+    gpointer         context;
+};
+
+static void ufo_task_interface_init (UfoTaskIface *iface);
+static void ufo_gpu_task_interface_init (UfoGpuTaskIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UfoFusedTask, ufo_fused_task, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK,
+                                                ufo_task_interface_init)
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_GPU_TASK,
+                                                ufo_gpu_task_interface_init))
+
+#define UFO_FUSED_TASK_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_FUSED_TASK, UfoFusedTaskPrivate))
+
+/**
+ * ufo_fused_task_new:
+ * @tasks: (element-type UfoTaskNode): Chain of GPU tasks in processing order
+ *
+ * Create a task that runs @tasks one after another. The tasks share the
+ * profiler of the new node, so their work shows up in its trace.
+ *
+ * Returns: (transfer full): A new #UfoFusedTask.
+ */
+UfoNode *
+ufo_fused_task_new (GList *tasks)
+{
+    UfoFusedTask *task;
+    UfoFusedTaskPrivate *priv;
+    UfoProfiler *profiler;
+    GString *name;
+
+    g_return_val_if_fail (tasks != NULL, NULL);
+
+    task = UFO_FUSED_TASK (g_object_new (UFO_TYPE_FUSED_TASK, NULL));
+    priv = task->priv;
+    priv->tasks = g_list_copy (tasks);
+    priv->n_tasks = g_list_length (tasks);
+    priv->n_active = priv->n_tasks;
+    priv->intermediates = g_new0 (UfoBuffer *, priv->n_tasks);
+    priv->requisitions = g_new0 (UfoRequisition, priv->n_tasks);
+
+    profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (task));
+    name = g_string_new (NULL);
+
+    for (GList *it = g_list_first (priv->tasks); it != NULL; it = g_list_next (it)) {
+        UfoTaskNode *node = UFO_TASK_NODE (it->data);
+        const gchar *plugin = ufo_task_node_get_plugin_name (node);
+
+        g_object_ref (node);
+        ufo_task_node_set_profiler (node, profiler);
+        g_string_append_printf (name, "%s%s", name->len > 0 ? "+" : "",
+                                plugin != NULL ? plugin : G_OBJECT_TYPE_NAME (node));
+    }
+
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (task), name->str);
+    g_string_free (name, TRUE);
+
+    return UFO_NODE (task);
+}
+
+/**
+ * ufo_fused_task_get_tasks:
+ * @task: A #UfoFusedTask
+ *
+ * Get the tasks that @task runs.
+ *
+ * Returns: (transfer none) (element-type UfoTaskNode): The fused tasks in
+ * processing order.
+ */
+GList *
+ufo_fused_task_get_tasks (UfoFusedTask *task)
+{
+    g_return_val_if_fail (UFO_IS_FUSED_TASK (task), NULL);
+    return task->priv->tasks;
+}
+
+static void
+ufo_fused_task_setup (UfoTask *task,
+                      UfoResources *resources,
+                      GError **error)
+{
+    UfoFusedTaskPrivate *priv;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (task);
+    priv->context = ufo_resources_get_context (resources);
+
+    for (GList *it = g_list_first (priv->tasks); it != NULL; it = g_list_next (it)) {
+        ufo_task_setup (UFO_TASK (it->data), resources, error);
+
+        if (error != NULL && *error != NULL)
+            return;
+    }
+}
+
+static void
+ufo_fused_task_get_structure (UfoTask *task,
+                              guint *n_inputs,
+                              UfoInputParam **in_params,
+                              UfoTaskMode *mode)
+{
+    UfoFusedTaskPrivate *priv;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (task);
+
+    /* Input comes from the head of the chain, the rest is fed internally */
+    ufo_task_get_structure (UFO_TASK (priv->tasks->data), n_inputs, in_params, mode);
+    *mode = UFO_TASK_MODE_PROCESSOR;
+}
+
+static void
+ufo_fused_task_get_requisition (UfoTask *task,
+                                UfoBuffer **inputs,
+                                UfoRequisition *requisition)
+{
+    UfoFusedTaskPrivate *priv;
+    UfoBuffer **current;
+    guint i = 0;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (task);
+    current = inputs;
+    requisition->n_dims = 0;
+
+    for (GList *it = g_list_first (priv->tasks); it != NULL; it = g_list_next (it), i++) {
+        UfoRequisition *req = &priv->requisitions[i];
+
+        ufo_task_get_requisition (UFO_TASK (it->data), current, req);
+        priv->n_active = i + 1;
+
+        /* A task without output ends the chain for this item */
+        if (req->n_dims == 0)
+            return;
+
+        if (i == priv->n_tasks - 1)
+            break;
+
+        if (priv->intermediates[i] == NULL)
+            priv->intermediates[i] = ufo_buffer_new (req, NULL, priv->context);
+        else if (ufo_buffer_cmp_dimensions (priv->intermediates[i], req))
+            ufo_buffer_resize (priv->intermediates[i], req);
+
+        current = &priv->intermediates[i];
+    }
+
+    memcpy (requisition, &priv->requisitions[priv->n_tasks - 1], sizeof (UfoRequisition));
+}
+
+static gboolean
+ufo_fused_task_get_static_requisition (UfoTask *task,
+                                       UfoRequisition *inputs,
+                                       UfoRequisition *requisition)
+{
+    UfoFusedTaskPrivate *priv;
+    UfoRequisition *current;
+    guint i = 0;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (task);
+    current = inputs;
+
+    /* The chain has a static shape only if every member has one */
+    for (GList *it = g_list_first (priv->tasks); it != NULL; it = g_list_next (it), i++) {
+        UfoRequisition *req = &priv->requisitions[i];
+
+        if (!ufo_task_get_static_requisition (UFO_TASK (it->data), current, req))
+            return FALSE;
+
+        if (i == priv->n_tasks - 1)
+            break;
+
+        if (req->n_dims == 0)
+            return FALSE;
+
+        current = req;
+    }
+
+    /* get_requisition() will not be called, so set up the intermediates now */
+    for (i = 0; i < priv->n_tasks - 1; i++) {
+        if (priv->intermediates[i] == NULL)
+            priv->intermediates[i] = ufo_buffer_new (&priv->requisitions[i], NULL, priv->context);
+        else if (ufo_buffer_cmp_dimensions (priv->intermediates[i], &priv->requisitions[i]))
+            ufo_buffer_resize (priv->intermediates[i], &priv->requisitions[i]);
+    }
+
+    priv->n_active = priv->n_tasks;
+    memcpy (requisition, &priv->requisitions[priv->n_tasks - 1], sizeof (UfoRequisition));
+    return TRUE;
+}
+
+static gboolean
+ufo_fused_task_process (UfoGpuTask *task,
+                        UfoBuffer **inputs,
+                        UfoBuffer *output,
+                        UfoRequisition *requisition)
+{
+    UfoFusedTaskPrivate *priv;
+    UfoProfiler *profiler;
+    UfoBuffer **current;
+    GList *it;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (task);
+    profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (task));
+    current = inputs;
+    it = g_list_first (priv->tasks);
+
+    for (guint i = 0; i < priv->n_active; i++, it = g_list_next (it)) {
+        UfoTaskNode *node = UFO_TASK_NODE (it->data);
+        UfoBuffer *out;
+        gboolean active;
+
+        if (i == priv->n_tasks - 1)
+            out = output;
+        else if (i == priv->n_active - 1)
+            out = NULL;
+        else
+            out = priv->intermediates[i];
+
+        if (out != NULL && out != output)
+            ufo_buffer_discard_location (out);
+
+        ufo_profiler_trace_event (profiler, ufo_task_node_get_unique_name (node), "B");
+        active = ufo_gpu_task_process (UFO_GPU_TASK (node), current, out, &priv->requisitions[i]);
+        ufo_profiler_trace_event (profiler, ufo_task_node_get_unique_name (node), "E");
+        ufo_task_node_increase_processed (node);
+
+        if (!active)
+            return FALSE;
+
+        current = &priv->intermediates[i];
+    }
+
+    return TRUE;
+}
+
+static void
+ufo_fused_task_dispose (GObject *object)
+{
+    UfoFusedTaskPrivate *priv;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (object);
+
+    for (guint i = 0; i < priv->n_tasks; i++) {
+        if (priv->intermediates[i] != NULL) {
+            g_object_unref (priv->intermediates[i]);
+            priv->intermediates[i] = NULL;
+        }
+    }
+
+    g_list_foreach (priv->tasks, (GFunc) g_object_unref, NULL);
+    g_list_free (priv->tasks);
+    priv->tasks = NULL;
+
+    G_OBJECT_CLASS (ufo_fused_task_parent_class)->dispose (object);
+}
+
+static void
+ufo_fused_task_finalize (GObject *object)
+{
+    UfoFusedTaskPrivate *priv;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (object);
+    g_free (priv->intermediates);
+    g_free (priv->requisitions);
+
+    G_OBJECT_CLASS (ufo_fused_task_parent_class)->finalize (object);
+}
+
+static void
+ufo_task_interface_init (UfoTaskIface *iface)
+{
+    iface->setup = ufo_fused_task_setup;
+    iface->get_structure = ufo_fused_task_get_structure;
+    iface->get_requisition = ufo_fused_task_get_requisition;
+    iface->get_static_requisition = ufo_fused_task_get_static_requisition;
+}
+
+static void
+ufo_gpu_task_interface_init (UfoGpuTaskIface *iface)
+{
+    iface->process = ufo_fused_task_process;
+}
+
+static void
+ufo_fused_task_class_init (UfoFusedTaskClass *klass)
+{
+    GObjectClass *oclass = G_OBJECT_CLASS (klass);
+
+    oclass->dispose = ufo_fused_task_dispose;
+    oclass->finalize = ufo_fused_task_finalize;
+
+    g_type_class_add_private (oclass, sizeof(UfoFusedTaskPrivate));
+}
+
+static void
+ufo_fused_task_init (UfoFusedTask *self)
+{
+    self->priv = UFO_FUSED_TASK_GET_PRIVATE (self);
+    self->priv->tasks = NULL;
+    self->priv->n_tasks = 0;
+    self->priv->n_active = 0;
+    self->priv->intermediates = NULL;
+    self->priv->requisitions = NULL;
+    self->priv->context = NULL;
+}
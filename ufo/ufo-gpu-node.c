@@ -18,8 +18,30 @@
  */
 
 #include <CL/cl.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ufo/ufo-gpu-node.h>
 
+/* Vendor queries for the PCI location, see cl_nv_device_attribute_query and
+ * cl_amd_device_attribute_query */
+#ifndef CL_DEVICE_PCI_BUS_ID_NV
+#define CL_DEVICE_PCI_BUS_ID_NV     0x4008
+#endif
+#ifndef CL_DEVICE_PCI_SLOT_ID_NV
+#define CL_DEVICE_PCI_SLOT_ID_NV    0x4009
+#endif
+#ifndef CL_DEVICE_PCI_DOMAIN_ID_NV
+#define CL_DEVICE_PCI_DOMAIN_ID_NV  0x400A
+#endif
+#ifndef CL_DEVICE_TOPOLOGY_AMD
+#define CL_DEVICE_TOPOLOGY_AMD      0x4037
+#endif
+
+typedef union {
+    struct { cl_uint type; cl_uint data[5]; } raw;
+    struct { cl_uint type; cl_char unused[17]; cl_char bus; cl_char device; cl_char function; } pcie;
+} AmdTopology;
+
 G_DEFINE_TYPE (UfoGpuNode, ufo_gpu_node, UFO_TYPE_NODE)
 
 #define UFO_GPU_NODE_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_GPU_NODE, UfoGpuNodePrivate))
@@ -27,18 +49,98 @@ G_DEFINE_TYPE (UfoGpuNode, ufo_gpu_node, UFO_TYPE_NODE)
 
 struct _UfoGpuNodePrivate {
     gpointer cmd_queue;
+    gchar   *pci_address;
+    gint     numa_node;
 };
 
+static gboolean
+has_extension (cl_device_id device,
+               const gchar *extension)
+{
+    gchar *extensions;
+    gsize size;
+    gboolean found = FALSE;
+
+    if (clGetDeviceInfo (device, CL_DEVICE_EXTENSIONS, 0, NULL, &size) != CL_SUCCESS)
+        return FALSE;
+
+    extensions = g_malloc0 (size + 1);
+
+    if (clGetDeviceInfo (device, CL_DEVICE_EXTENSIONS, size, extensions, NULL) == CL_SUCCESS)
+        found = strstr (extensions, extension) != NULL;
+
+    g_free (extensions);
+    return found;
+}
+
+static gchar *
+get_pci_address (cl_device_id device)
+{
+    if (has_extension (device, "cl_nv_device_attribute_query")) {
+        cl_uint domain;
+        cl_uint bus;
+        cl_uint slot;
+
+        /* Drivers that predate the domain query only know domain 0 */
+        if (clGetDeviceInfo (device, CL_DEVICE_PCI_DOMAIN_ID_NV, sizeof (cl_uint), &domain, NULL) != CL_SUCCESS)
+            domain = 0;
+
+        if (clGetDeviceInfo (device, CL_DEVICE_PCI_BUS_ID_NV, sizeof (cl_uint), &bus, NULL) == CL_SUCCESS &&
+            clGetDeviceInfo (device, CL_DEVICE_PCI_SLOT_ID_NV, sizeof (cl_uint), &slot, NULL) == CL_SUCCESS)
+            return g_strdup_printf ("%04x:%02x:%02x.%x", domain, bus & 0xff, slot >> 3, slot & 0x7);
+    }
+
+    if (has_extension (device, "cl_amd_device_attribute_query")) {
+        AmdTopology topology;
+
+        /* The AMD topology does not report a domain */
+        if (clGetDeviceInfo (device, CL_DEVICE_TOPOLOGY_AMD, sizeof (topology), &topology, NULL) == CL_SUCCESS)
+            return g_strdup_printf ("0000:%02x:%02x.%x",
+                                    (guint8) topology.pcie.bus,
+                                    (guint8) topology.pcie.device,
+                                    (guint8) topology.pcie.function);
+    }
+
+    return NULL;
+}
+
+static gint
+read_numa_node (const gchar *pci_address)
+{
+    gchar *filename;
+    gchar *contents;
+    gint node = -1;
+
+    if (pci_address == NULL)
+        return -1;
+
+    filename = g_strdup_printf ("/sys/bus/pci/devices/%s/numa_node", pci_address);
+
+    if (g_file_get_contents (filename, &contents, NULL, NULL)) {
+        node = atoi (contents);
+        g_free (contents);
+    }
+
+    g_free (filename);
+    return node;
+}
+
 UfoNode *
 ufo_gpu_node_new (gpointer cmd_queue)
 {
     UfoGpuNode *node;
+    cl_device_id device;
 
     g_return_val_if_fail (cmd_queue != NULL, NULL);
     node = UFO_GPU_NODE (g_object_new (UFO_TYPE_GPU_NODE, NULL));
     node->priv->cmd_queue = cmd_queue;
     clRetainCommandQueue (cmd_queue);
 
+    if (clGetCommandQueueInfo (cmd_queue, CL_QUEUE_DEVICE, sizeof (cl_device_id), &device, NULL) == CL_SUCCESS) {
+        node->priv->pci_address = get_pci_address (device);
+        node->priv->numa_node = read_numa_node (node->priv->pci_address);
+    }
+
     return UFO_NODE (node);
 }
 
@@ -57,6 +159,39 @@ ufo_gpu_node_get_cmd_queue (UfoGpuNode *node)
     return node->priv->cmd_queue;
 }
 
+/**
+ * ufo_gpu_node_get_pci_address:
+ * @node: A #UfoGpuNode
+ *
+ * Get the PCI address of the device of @node in the domain:bus:device.function
+ * notation used by sysfs. The address is only known for platforms that
+ * support the NVIDIA or AMD device attribute query extensions.
+ *
+ * Returns: (transfer none): PCI address or %NULL if it is unknown.
+ */
+const gchar *
+ufo_gpu_node_get_pci_address (UfoGpuNode *node)
+{
+    g_return_val_if_fail (UFO_IS_GPU_NODE (node), NULL);
+    return node->priv->pci_address;
+}
+
+/**
+ * ufo_gpu_node_get_numa_node:
+ * @node: A #UfoGpuNode
+ *
+ * Get the NUMA node that the PCI root complex of the device of @node is
+ * attached to.
+ *
+ * Returns: NUMA node number or -1 if it is unknown.
+ */
+gint
+ufo_gpu_node_get_numa_node (UfoGpuNode *node)
+{
+    g_return_val_if_fail (UFO_IS_GPU_NODE (node), -1);
+    return node->priv->numa_node;
+}
+
 static UfoNode *
 ufo_gpu_node_copy_real (UfoNode *node,
                         GError **error)
@@ -87,6 +222,17 @@ ufo_gpu_node_dispose (GObject *object)
     G_OBJECT_CLASS (ufo_gpu_node_parent_class)->dispose (object);
 }
 
+static void
+ufo_gpu_node_finalize (GObject *object)
+{
+    UfoGpuNodePrivate *priv;
+
+    priv = UFO_GPU_NODE_GET_PRIVATE (object);
+    g_free (priv->pci_address);
+
+    G_OBJECT_CLASS (ufo_gpu_node_parent_class)->finalize (object);
+}
+
 static void
 ufo_gpu_node_class_init (UfoGpuNodeClass *klass)
 {
@@ -94,6 +240,7 @@ ufo_gpu_node_class_init (UfoGpuNodeClass *klass)
     UfoNodeClass *node_class = UFO_NODE_CLASS (klass);
 
     oclass->dispose = ufo_gpu_node_dispose;
+    oclass->finalize = ufo_gpu_node_finalize;
     node_class->copy = ufo_gpu_node_copy_real;
     node_class->equal = ufo_gpu_node_equal_real;
 
@@ -106,4 +253,6 @@ ufo_gpu_node_init (UfoGpuNode *self)
     UfoGpuNodePrivate *priv;
     self->priv = priv = UFO_GPU_NODE_GET_PRIVATE (self);
     priv->cmd_queue = NULL;
+    priv->pci_address = NULL;
+    priv->numa_node = -1;
 }
@@ -64,6 +64,9 @@ struct _UfoGpuNodeClass {
 
 UfoNode  *ufo_gpu_node_new              (gpointer    cmd_queue);
 gpointer  ufo_gpu_node_get_cmd_queue    (UfoGpuNode *node);
+const gchar *
+          ufo_gpu_node_get_pci_address  (UfoGpuNode *node);
+gint      ufo_gpu_node_get_numa_node    (UfoGpuNode *node);
 GType     ufo_gpu_node_get_type         (void);
 
 G_END_DECLS
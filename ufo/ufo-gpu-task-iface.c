@@ -40,6 +40,103 @@ ufo_gpu_task_generate (UfoGpuTask *task,
     return UFO_GPU_TASK_GET_IFACE (task)->generate (task, output, requisition);
 }
 
+/**
+ * ufo_gpu_task_process_batch:
+ * @task: A #UfoGpuTask
+ * @inputs: (array): @n_items sets of input buffers, stored item by item
+ * @outputs: (array length=n_items): Output buffers, one for each item
+ * @n_items: Number of items in this batch
+ * @requisition: Requisition of the first item, shared by all @outputs
+ *
+ * Process several items in one call. Implementing process_batch() is optional,
+ * the scheduler only uses it if ufo_task_get_batch_size() returns more than one.
+ * The last batch of a stream may contain fewer items.
+ *
+ * Returns: %TRUE if processing should continue, %FALSE otherwise.
+ */
+gboolean
+ufo_gpu_task_process_batch (UfoGpuTask *task,
+                            UfoBuffer **inputs,
+                            UfoBuffer **outputs,
+                            guint n_items,
+                            UfoRequisition *requisition)
+{
+    return UFO_GPU_TASK_GET_IFACE (task)->process_batch (task, inputs, outputs, n_items, requisition);
+}
+
+/**
+ * ufo_gpu_task_process_async:
+ * @task: A #UfoGpuTask
+ * @inputs: (array): Input buffers
+ * @output: Output buffer
+ * @requisition: Size of @output
+ * @event: (out) (transfer full): Location for the cl_event of the last command
+ * writing @output or %NULL if everything has finished already
+ *
+ * Like ufo_gpu_task_process() but only enqueues the work without waiting for
+ * it. The scheduler attaches @event to @output and keeps @inputs alive until
+ * @event has completed, so several frames can be in flight at the same time.
+ * Implementing process_async() is optional.
+ *
+ * Returns: %TRUE if processing should continue, %FALSE otherwise.
+ */
+gboolean
+ufo_gpu_task_process_async (UfoGpuTask *task,
+                            UfoBuffer **inputs,
+                            UfoBuffer *output,
+                            UfoRequisition *requisition,
+                            gpointer *event)
+{
+    return UFO_GPU_TASK_GET_IFACE (task)->process_async (task, inputs, output, requisition, event);
+}
+
+/**
+ * ufo_gpu_task_generate_async:
+ * @task: A #UfoGpuTask
+ * @output: Output buffer
+ * @requisition: Size of @output
+ * @event: (out) (transfer full): Location for the cl_event of the last command
+ * writing @output or %NULL if everything has finished already
+ *
+ * Asynchronous variant of ufo_gpu_task_generate(), see
+ * ufo_gpu_task_process_async().
+ *
+ * Returns: %TRUE if more data will be generated, %FALSE otherwise.
+ */
+gboolean
+ufo_gpu_task_generate_async (UfoGpuTask *task,
+                             UfoBuffer *output,
+                             UfoRequisition *requisition,
+                             gpointer *event)
+{
+    return UFO_GPU_TASK_GET_IFACE (task)->generate_async (task, output, requisition, event);
+}
+
+/**
+ * ufo_gpu_task_has_async:
+ * @task: A #UfoGpuTask
+ * @mode: Mode in which @task is run
+ *
+ * Check if @task implements the asynchronous method needed for @mode.
+ *
+ * Returns: %TRUE if @task can be run asynchronously in @mode.
+ */
+gboolean
+ufo_gpu_task_has_async (UfoGpuTask *task,
+                        UfoTaskMode mode)
+{
+    UfoGpuTaskIface *iface = UFO_GPU_TASK_GET_IFACE (task);
+
+    switch (mode) {
+        case UFO_TASK_MODE_PROCESSOR:
+            return iface->process_async != NULL;
+        case UFO_TASK_MODE_GENERATOR:
+            return iface->generate_async != NULL;
+        default:
+            return FALSE;
+    }
+}
+
 static gboolean
 ufo_gpu_task_process_real (UfoGpuTask *task,
                            UfoBuffer **inputs,
@@ -64,4 +161,7 @@ ufo_gpu_task_default_init (UfoGpuTaskInterface *iface)
 {
     iface->process = ufo_gpu_task_process_real;
     iface->generate = ufo_gpu_task_generate_real;
+    iface->process_batch = NULL;
+    iface->process_async = NULL;
+    iface->generate_async = NULL;
 }
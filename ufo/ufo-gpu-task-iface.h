@@ -51,6 +51,23 @@ struct _UfoGpuTaskIface {
     gboolean (*generate) (UfoGpuTask     *task,
                           UfoBuffer      *output,
                           UfoRequisition *requisition);
+    gboolean (*process_batch)
+                         (UfoGpuTask     *task,
+                          UfoBuffer     **inputs,
+                          UfoBuffer     **outputs,
+                          guint           n_items,
+                          UfoRequisition *requisition);
+    gboolean (*process_async)
+                         (UfoGpuTask     *task,
+                          UfoBuffer     **inputs,
+                          UfoBuffer      *output,
+                          UfoRequisition *requisition,
+                          gpointer       *event);
+    gboolean (*generate_async)
+                         (UfoGpuTask     *task,
+                          UfoBuffer      *output,
+                          UfoRequisition *requisition,
+                          gpointer       *event);
 };
 
 gboolean ufo_gpu_task_process   (UfoGpuTask       *task,
@@ -60,6 +77,25 @@ gboolean ufo_gpu_task_process   (UfoGpuTask       *task,
 gboolean ufo_gpu_task_generate  (UfoGpuTask       *task,
                                  UfoBuffer        *output,
                                  UfoRequisition   *requisition);
+gboolean ufo_gpu_task_process_batch
+                                (UfoGpuTask       *task,
+                                 UfoBuffer       **inputs,
+                                 UfoBuffer       **outputs,
+                                 guint             n_items,
+                                 UfoRequisition   *requisition);
+gboolean ufo_gpu_task_process_async
+                                (UfoGpuTask       *task,
+                                 UfoBuffer       **inputs,
+                                 UfoBuffer        *output,
+                                 UfoRequisition   *requisition,
+                                 gpointer         *event);
+gboolean ufo_gpu_task_generate_async
+                                (UfoGpuTask       *task,
+                                 UfoBuffer        *output,
+                                 UfoRequisition   *requisition,
+                                 gpointer         *event);
+gboolean ufo_gpu_task_has_async (UfoGpuTask       *task,
+                                 UfoTaskMode       mode);
 
 GType ufo_gpu_task_get_type (void);
 
@@ -20,6 +20,7 @@
 #include <CL/cl.h>
 #include <ufo/ufo-group.h>
 #include <ufo/ufo-task-node.h>
+#include <ufo/ufo-gpu-task-iface.h>
 
 G_DEFINE_TYPE (UfoGroup, ufo_group, G_TYPE_OBJECT)
 
@@ -28,6 +29,7 @@ G_DEFINE_TYPE (UfoGroup, ufo_group, G_TYPE_OBJECT)
 typedef struct {
     GAsyncQueue *queues[2];
     guint        capacity;
+    guint        max_capacity;
 } UfoQueue;
 
 struct _UfoGroupPrivate {
@@ -39,6 +41,11 @@ struct _UfoGroupPrivate {
     gboolean        *ready;
     UfoSendPattern   pattern;
     guint            current;
+    gint            *active;
+    GQueue          *pending;
+    GAsyncQueue    **routes;
+    guint           *route_index;
+    gint            *numa_nodes;
     cl_context       context;
     GList           *buffers;
 };
@@ -88,9 +95,18 @@ ufo_group_new (GList *targets,
     priv->current = 0;
     priv->context = context;
     priv->n_received = 0;
+    priv->active = g_new0 (gint, priv->n_targets);
+    priv->pending = g_queue_new ();
+    priv->routes = g_new0 (GAsyncQueue *, priv->n_targets);
+    priv->route_index = g_new0 (guint, priv->n_targets);
+    priv->numa_nodes = g_new0 (gint, priv->n_targets);
 
-    for (guint i = 0; i < priv->n_targets; i++)
+    for (guint i = 0; i < priv->n_targets; i++) {
         priv->queues[i] = ufo_queue_new ();
+        priv->queues[i]->max_capacity = priv->n_targets + 1;
+        priv->active[i] = TRUE;
+        priv->numa_nodes[i] = -1;
+    }
 
     return group;
 }
@@ -102,6 +118,55 @@ ufo_group_get_num_targets (UfoGroup *group)
     return group->priv->n_targets;
 }
 
+static gint
+get_target_pos (UfoGroupPrivate *priv,
+                UfoTask *target)
+{
+    gint pos;
+
+    pos = g_list_index (priv->targets, target);
+
+    if (pos < 0)
+        g_warning ("%s is not a target of this group", G_OBJECT_TYPE_NAME (target));
+
+    return pos;
+}
+
+static guint
+next_scatter_target (UfoGroupPrivate *priv)
+{
+    guint pos = priv->current;
+
+    /* Skip parked targets, if all of them are parked use the current one */
+    for (guint i = 0; i < priv->n_targets; i++) {
+        guint candidate = (priv->current + i) % priv->n_targets;
+
+        if (g_atomic_int_get (&priv->active[candidate])) {
+            pos = candidate;
+            break;
+        }
+    }
+
+    priv->current = (pos + 1) % priv->n_targets;
+    return pos;
+}
+
+static UfoBuffer *
+alloc_buffer (UfoGroupPrivate *priv,
+              guint pos,
+              UfoRequisition *requisition)
+{
+    UfoBuffer *buffer;
+
+    buffer = ufo_buffer_new (requisition, NULL, priv->context);
+    if (buffer == NULL)
+        G_BREAKPOINT();
+    ufo_buffer_set_numa_node (buffer, priv->numa_nodes[pos]);
+    priv->buffers = g_list_append (priv->buffers, buffer);
+    ufo_queue_insert (priv->queues[pos], UFO_QUEUE_PRODUCER, buffer);
+    return buffer;
+}
+
 static UfoBuffer *
 pop_or_alloc_buffer (UfoGroupPrivate *priv,
                      guint pos,
@@ -109,13 +174,8 @@ pop_or_alloc_buffer (UfoGroupPrivate *priv,
 {
     UfoBuffer *buffer;
 
-    if (ufo_queue_get_capacity (priv->queues[pos]) < (priv->n_targets + 1)) {
-        buffer = ufo_buffer_new (requisition, NULL, priv->context);
-        if (buffer == NULL)
-            G_BREAKPOINT();
-        priv->buffers = g_list_append (priv->buffers, buffer);
-        ufo_queue_insert (priv->queues[pos], UFO_QUEUE_PRODUCER, buffer);
-    }
+    if (ufo_queue_get_capacity (priv->queues[pos]) < priv->queues[pos]->max_capacity)
+        alloc_buffer (priv, pos, requisition);
 
     buffer = ufo_queue_pop (priv->queues[pos], UFO_QUEUE_PRODUCER);
 
@@ -142,12 +202,48 @@ ufo_group_pop_output_buffer (UfoGroup *group,
 
     priv = group->priv;
 
-    if ((priv->pattern == UFO_SEND_SCATTER) || (priv->pattern == UFO_SEND_SEQUENTIAL))
+    /*
+     * A producer may pop several buffers before pushing them, take each one
+     * from the queue it is going to be pushed to and remember the order.
+     */
+    if (priv->pattern == UFO_SEND_SCATTER) {
+        pos = next_scatter_target (priv);
+        g_queue_push_tail (priv->pending, GUINT_TO_POINTER (pos));
+    }
+    else if (priv->pattern == UFO_SEND_SEQUENTIAL)
         pos = priv->current;
 
     return pop_or_alloc_buffer (priv, pos, requisition);
 }
 
+/**
+ * ufo_group_return_output_buffer:
+ * @group: A #UfoGroup
+ * @buffer: A buffer obtained with ufo_group_pop_output_buffer()
+ *
+ * Give back a buffer that was popped but will not be pushed, e.g. because
+ * the producer failed, so that it can be popped again. Buffers that were
+ * popped together must be returned in the order they were popped.
+ */
+void
+ufo_group_return_output_buffer (UfoGroup *group,
+                                UfoBuffer *buffer)
+{
+    UfoGroupPrivate *priv;
+    guint pos = 0;
+
+    g_return_if_fail (UFO_IS_GROUP (group) && buffer != NULL);
+    priv = group->priv;
+
+    /* Undo the bookkeeping of ufo_group_pop_output_buffer() */
+    if (priv->pattern == UFO_SEND_SCATTER)
+        pos = GPOINTER_TO_UINT (g_queue_pop_head (priv->pending));
+    else if (priv->pattern == UFO_SEND_SEQUENTIAL)
+        pos = priv->current;
+
+    ufo_queue_push (priv->queues[pos], UFO_QUEUE_CONSUMER, buffer);
+}
+
 void
 ufo_group_push_output_buffer (UfoGroup *group,
                               UfoBuffer *buffer)
@@ -162,11 +258,21 @@ ufo_group_push_output_buffer (UfoGroup *group,
     }
     /* Copy or not depending on the send pattern */
     if (priv->pattern == UFO_SEND_SCATTER) {
-        ufo_queue_push (priv->queues[priv->current],
+        guint pos;
+
+        /* In-place producers push buffers they have not popped from us */
+        if (g_queue_is_empty (priv->pending))
+            pos = next_scatter_target (priv);
+        else
+            pos = GPOINTER_TO_UINT (g_queue_pop_head (priv->pending));
+
+        /* Tell the consumer behind the targets where to look next */
+        if (priv->routes[pos] != NULL)
+            g_async_queue_push (priv->routes[pos], GUINT_TO_POINTER (priv->route_index[pos] + 2));
+
+        ufo_queue_push (priv->queues[pos],
                         UFO_QUEUE_PRODUCER,
                         buffer);
-
-        priv->current = (priv->current + 1) % priv->n_targets;
     }
     else if (priv->pattern == UFO_SEND_BROADCAST) {
         UfoRequisition requisition;
@@ -213,6 +319,272 @@ ufo_group_set_num_expected (UfoGroup *group,
     priv->n_expected[pos] = n_expected;
 }
 
+/**
+ * ufo_group_set_min_capacity:
+ * @group: A #UfoGroup
+ * @target: (allow-none): The #UfoTask that is a target in @group or %NULL for
+ * all targets
+ * @capacity: Minimum number of buffers
+ *
+ * Allow at least @capacity buffers to circulate between the producer of @group
+ * and @target. This is necessary for tasks that hold more than one buffer at a
+ * time, e.g. when processing in batches.
+ */
+void
+ufo_group_set_min_capacity (UfoGroup *group,
+                            UfoTask *target,
+                            guint capacity)
+{
+    UfoGroupPrivate *priv;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    priv = group->priv;
+
+    for (guint i = 0; i < priv->n_targets; i++) {
+        UfoQueue *queue = priv->queues[i];
+
+        if (target == NULL || g_list_nth_data (priv->targets, i) == target)
+            queue->max_capacity = MAX (queue->max_capacity, capacity);
+    }
+}
+
+/**
+ * ufo_group_preallocate:
+ * @group: A #UfoGroup
+ * @requisition: Shape of every buffer sent through @group
+ * @location: Memory the producer writes its results to
+ *
+ * Allocate all buffers that can circulate between the producer and the targets
+ * of @group before the stream starts, so that the first items do not pay for
+ * the allocation. Besides @location, device memory is allocated for GPU
+ * targets. Call this after the capacities and NUMA nodes have been set.
+ */
+void
+ufo_group_preallocate (UfoGroup *group,
+                       UfoRequisition *requisition,
+                       UfoBufferLocation location)
+{
+    UfoGroupPrivate *priv;
+    GList *it;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    priv = group->priv;
+    it = g_list_first (priv->targets);
+
+    for (guint i = 0; i < priv->n_targets; i++, it = g_list_next (it)) {
+        UfoQueue *queue = priv->queues[i];
+
+        while (ufo_queue_get_capacity (queue) < queue->max_capacity) {
+            UfoBuffer *buffer = alloc_buffer (priv, i, requisition);
+
+            ufo_buffer_preallocate (buffer, location);
+
+            if (UFO_IS_GPU_TASK (it->data))
+                ufo_buffer_preallocate (buffer, UFO_BUFFER_LOCATION_DEVICE);
+        }
+    }
+}
+
+/**
+ * ufo_group_set_numa_node:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ * @node: NUMA node or -1 for the default policy
+ *
+ * Allocate the host memory of buffers sent to @target on NUMA node @node. This
+ * must be called before the first buffer is popped.
+ */
+void
+ufo_group_set_numa_node (UfoGroup *group,
+                         UfoTask *target,
+                         gint node)
+{
+    UfoGroupPrivate *priv;
+    gint pos;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    priv = group->priv;
+    pos = g_list_index (priv->targets, target);
+
+    if (pos >= 0)
+        priv->numa_nodes[pos] = node;
+}
+
+/**
+ * ufo_group_set_target_active:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ * @active: %FALSE to park @target
+ *
+ * Park or resume @target of a scattering @group. A parked target does not
+ * receive new buffers but still processes everything that has already been
+ * sent to it and receives the end of stream. If all targets are parked, data is
+ * scattered as if none were. This function may be called from any thread while
+ * the producer is running.
+ */
+void
+ufo_group_set_target_active (UfoGroup *group,
+                             UfoTask *target,
+                             gboolean active)
+{
+    gint pos;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    pos = get_target_pos (group->priv, target);
+
+    if (pos >= 0)
+        g_atomic_int_set (&group->priv->active[pos], active);
+}
+
+/**
+ * ufo_group_get_target_active:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ *
+ * Returns: %TRUE if @target receives new buffers, %FALSE if it is parked.
+ */
+gboolean
+ufo_group_get_target_active (UfoGroup *group,
+                             UfoTask *target)
+{
+    gint pos;
+
+    g_return_val_if_fail (UFO_IS_GROUP (group), FALSE);
+    pos = get_target_pos (group->priv, target);
+    return pos >= 0 && g_atomic_int_get (&group->priv->active[pos]);
+}
+
+/**
+ * ufo_group_get_num_queued:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ *
+ * Get the number of buffers that have been sent to @target but were not yet
+ * taken by it. Together with ufo_group_get_capacity() this tells how busy
+ * @target is compared to its producer.
+ *
+ * Returns: Number of waiting buffers.
+ */
+guint
+ufo_group_get_num_queued (UfoGroup *group,
+                          UfoTask *target)
+{
+    gint pos;
+    gint length;
+
+    g_return_val_if_fail (UFO_IS_GROUP (group), 0);
+    pos = get_target_pos (group->priv, target);
+
+    if (pos < 0)
+        return 0;
+
+    length = g_async_queue_length (group->priv->queues[pos]->queues[UFO_QUEUE_CONSUMER]);
+    return (guint) MAX (length, 0);
+}
+
+/**
+ * ufo_group_get_capacity:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ *
+ * Returns: Maximum number of buffers circulating between the producer and
+ * @target.
+ */
+guint
+ufo_group_get_capacity (UfoGroup *group,
+                        UfoTask *target)
+{
+    gint pos;
+
+    g_return_val_if_fail (UFO_IS_GROUP (group), 0);
+    pos = get_target_pos (group->priv, target);
+    return pos >= 0 ? group->priv->queues[pos]->max_capacity : 0;
+}
+
+/**
+ * ufo_group_get_num_buffers:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ *
+ * Returns: Number of buffers allocated so far for @target, at most
+ * ufo_group_get_capacity().
+ */
+guint
+ufo_group_get_num_buffers (UfoGroup *group,
+                           UfoTask *target)
+{
+    gint pos;
+
+    g_return_val_if_fail (UFO_IS_GROUP (group), 0);
+    pos = get_target_pos (group->priv, target);
+    return pos >= 0 ? ufo_queue_get_capacity (group->priv->queues[pos]) : 0;
+}
+
+/**
+ * ufo_group_set_route:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ * @route: A #GAsyncQueue shared by all targets that feed the same consumer
+ * @index: Index of @target's branch as known to that consumer
+ *
+ * Record the order in which a scattering @group hands out buffers. Each time a
+ * buffer is sent to @target, @index + 2 is pushed to @route and
+ * ufo_group_finish() pushes %UFO_END_OF_STREAM once. A consumer that
+ * merges the branches behind the targets reads @route to know from which branch
+ * the next item comes, which keeps the stream in order even if targets are
+ * parked with ufo_group_set_target_active(). See
+ * ufo_task_node_set_in_group_route().
+ */
+void
+ufo_group_set_route (UfoGroup *group,
+                     UfoTask *target,
+                     GAsyncQueue *route,
+                     guint index)
+{
+    UfoGroupPrivate *priv;
+    gint pos;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    priv = group->priv;
+    pos = get_target_pos (priv, target);
+
+    if (pos < 0)
+        return;
+
+    if (priv->routes[pos] != NULL)
+        g_async_queue_unref (priv->routes[pos]);
+
+    priv->routes[pos] = route != NULL ? g_async_queue_ref (route) : NULL;
+    priv->route_index[pos] = index;
+}
+
+/**
+ * ufo_group_reclaim_buffer:
+ * @group: A #UfoGroup
+ * @wait: %TRUE if the call should block until a buffer is available
+ *
+ * Take a buffer that has been released by a target out of circulation. This is
+ * used by producers that push buffers they did not get from @group, e.g. when
+ * processing in-place, to hand them back to where they came from.
+ *
+ * Return value: (transfer full): A released buffer or %NULL if @wait is %FALSE
+ * and no buffer was available.
+ */
+UfoBuffer *
+ufo_group_reclaim_buffer (UfoGroup *group,
+                          gboolean wait)
+{
+    UfoQueue *queue;
+
+    g_return_val_if_fail (UFO_IS_GROUP (group), NULL);
+    queue = group->priv->queues[0];
+
+    if (wait)
+        return ufo_queue_pop (queue, UFO_QUEUE_PRODUCER);
+
+    return g_async_queue_try_pop (queue->queues[UFO_QUEUE_PRODUCER]);
+}
+
 /**
  * ufo_group_pop_input_buffer:
  * @group: A #UfoGroup
@@ -266,6 +638,19 @@ ufo_group_finish (UfoGroup *group)
                         UFO_QUEUE_PRODUCER,
                         UFO_END_OF_STREAM);
     }
+
+    for (guint i = 0; i < priv->n_targets; i++) {
+        gboolean seen = FALSE;
+
+        if (priv->routes[i] == NULL)
+            continue;
+
+        for (guint j = 0; j < i; j++)
+            seen = seen || priv->routes[j] == priv->routes[i];
+
+        if (!seen)
+            g_async_queue_push (priv->routes[i], UFO_END_OF_STREAM);
+    }
 }
 
 static UfoQueue *
@@ -340,6 +725,17 @@ ufo_group_finalize (GObject *object)
     g_free (priv->queues);
     priv->queues = NULL;
 
+    for (guint i = 0; i < priv->n_targets; i++) {
+        if (priv->routes[i] != NULL)
+            g_async_queue_unref (priv->routes[i]);
+    }
+
+    g_free (priv->routes);
+    g_free (priv->route_index);
+    g_free (priv->numa_nodes);
+    g_free (priv->active);
+    g_queue_free (priv->pending);
+
     G_OBJECT_CLASS (ufo_group_parent_class)->finalize (object);
 }
 
@@ -88,10 +88,38 @@ GList      *ufo_group_get_targets           (UfoGroup       *group);
 void        ufo_group_set_num_expected      (UfoGroup       *group,
                                              UfoTask        *target,
                                              gint            n_expected);
+void        ufo_group_set_min_capacity      (UfoGroup       *group,
+                                             UfoTask        *target,
+                                             guint           capacity);
+void        ufo_group_preallocate           (UfoGroup       *group,
+                                             UfoRequisition *requisition,
+                                             UfoBufferLocation location);
+void        ufo_group_set_numa_node         (UfoGroup       *group,
+                                             UfoTask        *target,
+                                             gint            node);
 UfoBuffer * ufo_group_pop_output_buffer     (UfoGroup       *group,
                                              UfoRequisition *requisition);
 void        ufo_group_push_output_buffer    (UfoGroup       *group,
                                              UfoBuffer      *buffer);
+void        ufo_group_return_output_buffer  (UfoGroup       *group,
+                                             UfoBuffer      *buffer);
+void        ufo_group_set_target_active     (UfoGroup       *group,
+                                             UfoTask        *target,
+                                             gboolean        active);
+gboolean    ufo_group_get_target_active     (UfoGroup       *group,
+                                             UfoTask        *target);
+guint       ufo_group_get_num_queued        (UfoGroup       *group,
+                                             UfoTask        *target);
+guint       ufo_group_get_capacity          (UfoGroup       *group,
+                                             UfoTask        *target);
+guint       ufo_group_get_num_buffers       (UfoGroup       *group,
+                                             UfoTask        *target);
+void        ufo_group_set_route             (UfoGroup       *group,
+                                             UfoTask        *target,
+                                             GAsyncQueue    *route,
+                                             guint           index);
+UfoBuffer * ufo_group_reclaim_buffer        (UfoGroup       *group,
+                                             gboolean        wait);
 UfoBuffer * ufo_group_pop_input_buffer      (UfoGroup       *group,
                                              UfoTask        *target);
 void        ufo_group_push_input_buffer     (UfoGroup       *group,
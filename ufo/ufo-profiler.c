@@ -79,6 +79,8 @@ static GTimer *global_clock = NULL;
  *  time to fetch data from the queues.
  * @UFO_PROFILER_TIMER_RELEASE: Select timer that measures the synchronization
  *  time to push data to the queues.
+ * @UFO_PROFILER_TIMER_SETUP: Select timer that measures the time spent in
+ *  ufo_task_setup(), including building OpenCL programs.
  * @UFO_PROFILER_TIMER_LAST: Auxiliary value, do not use.
  *
  * Use these values to select a specific timer when calling
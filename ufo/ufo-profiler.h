@@ -100,6 +100,7 @@ typedef enum {
     UFO_PROFILER_TIMER_GPU,
     UFO_PROFILER_TIMER_FETCH,
     UFO_PROFILER_TIMER_RELEASE,
+    UFO_PROFILER_TIMER_SETUP,
     UFO_PROFILER_TIMER_LAST,
 } UfoProfilerTimer;
 
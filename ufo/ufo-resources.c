@@ -22,6 +22,8 @@
 #include <glib.h>
 #include <gio/gio.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #ifdef __APPLE__
 #include <OpenCL/cl.h>
 #else
@@ -76,15 +78,67 @@ struct _UfoResourcesPrivate {
     cl_uint          n_devices;         /**< Number of OpenCL devices per platform id */
     cl_device_id     *devices;          /**< Array of OpenCL devices per platform id */
     cl_command_queue *command_queues;   /**< Array of command queues per device */
+    cl_command_queue *copy_queues;      /**< Array of host transfer queues per device */
 
     GList       *include_paths;         /**< List of include paths for kernel includes >*/
     GList       *kernel_paths;          /**< Colon-separated string with paths to kernel files */
-    GHashTable  *kernel_cache;
+    GHashTable  *kernel_cache;          /**< Maps thread:program:kernel to cl_kernel */
+    GHashTable  *program_cache;         /**< Maps file name or source to cl_program */
     GList       *programs;
     GList       *kernels;
     GString     *build_opts;
+    GMutex      *lock;                  /**< Protects programs, kernels, the caches and constants */
+
+    GHashTable  *constants;             /**< Maps ConstantKey to read-only cl_mem */
+    gsize        constants_size;
+    GHashTable  *scratch_buffers;       /**< Maps thread:queue to ScratchBuffer */
+    guint        n_constant_hits;
+    guint        n_constant_misses;
+
+    GMutex      *tuning_lock;
+    GHashTable  *local_sizes;           /**< Maps program:kernel:device:size class to LocalSizeTuning */
+    GHashTable  *launches;              /**< Maps LaunchKey to LocalSizeTuning in local_sizes */
+    GKeyFile    *tuning_file;           /**< Persistent local work sizes, loaded on first use */
+    gboolean     tuning_changed;        /**< tuning_file must be written at teardown */
 };
 
+#define N_MAX_CANDIDATES 9
+
+/* Timed launches per candidate, each candidate is warmed up once before */
+#define N_TUNING_SAMPLES 5
+
+/*
+ * Tuning state of a single (program, kernel, device, global size class)
+ * combination. A local size of all zeros stands for the driver's choice, i.e.
+ * passing NULL.
+ */
+typedef struct {
+    gsize       candidates[N_MAX_CANDIDATES][3];
+    cl_ulong    samples[N_MAX_CANDIDATES][N_TUNING_SAMPLES];
+    guint       n_candidates;
+    guint       n_launched;
+    guint       n_measured;
+    gsize       best[3];
+    gboolean    tuned;
+    gchar      *device_name;
+    gchar      *file_key;
+} LocalSizeTuning;
+
+/*
+ * Identifies a launch without querying OpenCL, so that launches of an already
+ * tuned kernel only cost a hash lookup.
+ */
+typedef struct {
+    gpointer    kernel;
+    gpointer    queue;
+    guint       work_dim;
+    gsize       size_class[3];
+} LaunchKey;
+
+static const gsize candidates_1d[][1] = {{32}, {64}, {128}, {256}, {512}};
+static const gsize candidates_2d[][2] = {{8, 8}, {16, 8}, {16, 16}, {32, 4}, {32, 8}, {32, 16}, {64, 4}};
+static const gsize candidates_3d[][3] = {{4, 4, 4}, {8, 4, 4}, {8, 8, 4}, {16, 8, 2}, {8, 8, 8}};
+
 enum {
     PROP_0,
     PROP_CONFIG,
@@ -437,6 +491,7 @@ initialize_opencl (UfoResourcesPrivate *priv,
         return FALSE;
 
     priv->command_queues = g_malloc0 (priv->n_devices * sizeof (cl_command_queue));
+    priv->copy_queues = g_malloc0 (priv->n_devices * sizeof (cl_command_queue));
 
     for (guint i = 0; i < priv->n_devices; i++) {
         priv->command_queues[i] = clCreateCommandQueue (priv->context,
@@ -446,6 +501,20 @@ initialize_opencl (UfoResourcesPrivate *priv,
 
         if (errcode != CL_SUCCESS)
             return FALSE;
+
+        /*
+         * Host transfers go through a second queue so that they overlap with
+         * kernels of other tasks on the same device.
+         */
+        priv->copy_queues[i] = clCreateCommandQueue (priv->context,
+                                                     priv->devices[i],
+                                                     queue_properties, &errcode);
+        UFO_RESOURCES_CHECK_AND_SET (errcode, error);
+
+        if (errcode != CL_SUCCESS)
+            return FALSE;
+
+        ufo_buffer_set_copy_queue (priv->command_queues[i], priv->copy_queues[i]);
     }
 
     print_used_device_overview (priv);
@@ -497,13 +566,24 @@ append_include_path (const gchar *path,
     g_string_append_printf (str, " -I%s", path);
 }
 
+static gchar *
+get_device_name (cl_device_id device)
+{
+    gsize size;
+    gchar *name;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (device, CL_DEVICE_NAME, 0, NULL, &size));
+    name = g_malloc0 (size);
+    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (device, CL_DEVICE_NAME, size, name, NULL));
+    return name;
+}
+
 static gchar *
 get_device_build_options (UfoResourcesPrivate *priv,
                           guint device_index,
                           const gchar *additional)
 {
     GString *opts;
-    gsize size;
     gchar *name;
 
     g_assert (device_index < priv->n_devices);
@@ -513,13 +593,7 @@ get_device_build_options (UfoResourcesPrivate *priv,
     if (additional != NULL)
         g_string_append (opts, additional);
 
-    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (priv->devices[device_index],
-                                                CL_DEVICE_NAME, 0, NULL, &size));
-    name = g_malloc0 (size);
-
-    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (priv->devices[device_index],
-                                                CL_DEVICE_NAME, size, name, NULL));
-
+    name = get_device_name (priv->devices[device_index]);
     g_string_append_printf (opts, " -DDEVICE=%s", escape_device_name (name));
     g_free (name);
 
@@ -550,6 +624,105 @@ handle_build_error (cl_program program,
     g_free (log);
 }
 
+typedef struct {
+    GMutex     *mutex;
+    GCond      *cond;
+    gboolean    finished;
+    gint        ref_count;
+} BuildStatus;
+
+static void
+unref_build_status (BuildStatus *status)
+{
+    gboolean last;
+
+    g_mutex_lock (status->mutex);
+    last = --status->ref_count == 0;
+    g_mutex_unlock (status->mutex);
+
+    if (last) {
+        g_cond_free (status->cond);
+        g_mutex_free (status->mutex);
+        g_free (status);
+    }
+}
+
+static void CL_CALLBACK
+build_finished (cl_program program,
+                gpointer user_data)
+{
+    BuildStatus *status = (BuildStatus *) user_data;
+
+    g_mutex_lock (status->mutex);
+    status->finished = TRUE;
+    g_cond_signal (status->cond);
+    g_mutex_unlock (status->mutex);
+
+    unref_build_status (status);
+}
+
+static cl_int
+build_program (UfoResourcesPrivate *priv,
+               cl_program program,
+               const gchar *build_options,
+               cl_device_id *failed_device)
+{
+    BuildStatus *status;
+    cl_int errcode;
+
+    /*
+     * The callback holds its own reference because it may still run after a
+     * failed clBuildProgram call or not at all.
+     */
+    status = g_new0 (BuildStatus, 1);
+    status->mutex = g_mutex_new ();
+    status->cond = g_cond_new ();
+    status->finished = FALSE;
+    status->ref_count = 2;
+
+    /*
+     * With a callback, clBuildProgram may return before the build is done
+     * which lets the driver compile programs of different threads
+     * concurrently instead of serializing them.
+     */
+    errcode = clBuildProgram (program,
+                              priv->n_devices, priv->devices,
+                              build_options,
+                              build_finished, status);
+
+    /* Only a successful call guarantees that the callback is invoked */
+    if (errcode == CL_SUCCESS) {
+        g_mutex_lock (status->mutex);
+
+        while (!status->finished)
+            g_cond_wait (status->cond, status->mutex);
+
+        g_mutex_unlock (status->mutex);
+    }
+
+    unref_build_status (status);
+
+    *failed_device = priv->devices[0];
+
+    if (errcode == CL_SUCCESS || errcode == CL_BUILD_PROGRAM_FAILURE) {
+        for (guint i = 0; i < priv->n_devices; i++) {
+            cl_build_status build_status;
+
+            UFO_RESOURCES_CHECK_CLERR (clGetProgramBuildInfo (program, priv->devices[i],
+                                                              CL_PROGRAM_BUILD_STATUS,
+                                                              sizeof (cl_build_status), &build_status, NULL));
+
+            if (build_status != CL_BUILD_SUCCESS) {
+                *failed_device = priv->devices[i];
+                errcode = CL_BUILD_PROGRAM_FAILURE;
+                break;
+            }
+        }
+    }
+
+    return errcode;
+}
+
 static cl_program
 add_program_from_source (UfoResourcesPrivate *priv,
                          const gchar *source,
@@ -557,6 +730,7 @@ add_program_from_source (UfoResourcesPrivate *priv,
                          GError **error)
 {
     cl_program program;
+    cl_device_id failed_device;
     cl_int errcode = CL_SUCCESS;
     gchar *build_options;
 
@@ -573,19 +747,19 @@ add_program_from_source (UfoResourcesPrivate *priv,
 
     build_options = get_device_build_options (priv, 0, options);
 
-    errcode = clBuildProgram (program,
-                              priv->n_devices, priv->devices,
-                              build_options,
-                              NULL, NULL);
+    errcode = build_program (priv, program, build_options, &failed_device);
+    g_free (build_options);
 
     if (errcode != CL_SUCCESS) {
-        handle_build_error (program, priv->devices[0], errcode, error);
+        handle_build_error (program, failed_device, errcode, error);
+        UFO_RESOURCES_CHECK_CLERR (clReleaseProgram (program));
         return NULL;
     }
 
+    g_mutex_lock (priv->lock);
     priv->programs = g_list_append (priv->programs, program);
+    g_mutex_unlock (priv->lock);
 
-    g_free (build_options);
     return program;
 }
 
@@ -649,15 +823,137 @@ create_kernel (UfoResourcesPrivate *priv,
         return NULL;
     }
 
+    g_mutex_lock (priv->lock);
     priv->kernels = g_list_append (priv->kernels, kernel);
+    g_mutex_unlock (priv->lock);
+
     return kernel;
 }
 
+static cl_program
+load_program (UfoResourcesPrivate *priv,
+              const gchar *filename,
+              GError **error)
+{
+    cl_program program;
+    gchar *path;
+    gchar *buffer;
+
+    path = lookup_kernel_path (priv, filename);
+
+    if (path == NULL) {
+        g_set_error (error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_LOAD_PROGRAM,
+                     "Could not find `%s'. Maybe you forgot to pass a configuration?", filename);
+        return NULL;
+    }
+
+    buffer = read_file (path);
+    g_free (path);
+
+    if (buffer == NULL) {
+        g_set_error (error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_LOAD_PROGRAM,
+                     "Could not open `%s'", filename);
+        return NULL;
+    }
+
+    program = add_program_from_source (priv, buffer, "", error);
+    g_free (buffer);
+
+    if (program != NULL)
+        g_debug ("Added program %p from `%s`", (gpointer) program, filename);
+
+    return program;
+}
+
+static GStaticPrivate thread_serial_key = G_STATIC_PRIVATE_INIT;
+static GStaticMutex thread_serial_lock = G_STATIC_MUTEX_INIT;
+static guint thread_serial_counter = 0;
+
+/*
+ * Return a number that identifies the calling thread. Unlike the GThread
+ * address it is never reused for another thread.
+ */
+static guint
+get_thread_serial (void)
+{
+    guint serial;
+
+    serial = GPOINTER_TO_UINT (g_static_private_get (&thread_serial_key));
+
+    if (serial == 0) {
+        g_static_mutex_lock (&thread_serial_lock);
+        serial = ++thread_serial_counter;
+        g_static_mutex_unlock (&thread_serial_lock);
+        g_static_private_set (&thread_serial_key, GUINT_TO_POINTER (serial), NULL);
+    }
+
+    return serial;
+}
+
+/*
+ * Cached kernels are private to the calling thread, because setting kernel
+ * arguments on a kernel object shared by several threads is not thread-safe.
+ * Tasks are set up in their own threads and thus never share a kernel. The
+ * programs are cached per file or source and shared by all threads.
+ */
 static gchar *
 create_cache_key (const gchar *filename,
                   const gchar *kernelname)
 {
-    return g_strdup_printf ("%s:%s", filename, kernelname);
+    return g_strdup_printf ("%u:%s:%s", get_thread_serial (), filename, kernelname);
+}
+
+static cl_kernel
+get_cached_kernel_from_program (UfoResourcesPrivate *priv,
+                                const gchar *program_key,
+                                const gchar *kernelname,
+                                gboolean from_source,
+                                GError **error)
+{
+    cl_program program;
+    cl_kernel kernel;
+    gchar *cache_key;
+
+    cache_key = create_cache_key (program_key, kernelname);
+
+    g_mutex_lock (priv->lock);
+    kernel = g_hash_table_lookup (priv->kernel_cache, cache_key);
+    program = g_hash_table_lookup (priv->program_cache, program_key);
+    g_mutex_unlock (priv->lock);
+
+    if (kernel != NULL) {
+        g_free (cache_key);
+        return kernel;
+    }
+
+    if (program == NULL) {
+        if (from_source)
+            program = add_program_from_source (priv, program_key, NULL, error);
+        else
+            program = load_program (priv, program_key, error);
+
+        if (program == NULL) {
+            g_free (cache_key);
+            return NULL;
+        }
+
+        /* Another thread may have built the same program in the meantime */
+        g_mutex_lock (priv->lock);
+        g_hash_table_insert (priv->program_cache, g_strdup (program_key), program);
+        g_mutex_unlock (priv->lock);
+    }
+
+    kernel = create_kernel (priv, program, kernelname, error);
+
+    if (kernel != NULL) {
+        g_mutex_lock (priv->lock);
+        g_hash_table_insert (priv->kernel_cache, cache_key, kernel);
+        g_mutex_unlock (priv->lock);
+    }
+    else
+        g_free (cache_key);
+
+    return kernel;
 }
 
 /**
@@ -680,34 +976,16 @@ ufo_resources_get_kernel (UfoResources *resources,
                           GError **error)
 {
     UfoResourcesPrivate *priv;
-    gchar *path;
-    gchar *buffer;
     cl_program program;
 
     g_return_val_if_fail (UFO_IS_RESOURCES (resources) &&
                           (filename != NULL), NULL);
 
     priv = resources->priv;
-    path = lookup_kernel_path (priv, filename);
-
-    if (path == NULL) {
-        g_set_error (error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_LOAD_PROGRAM,
-                     "Could not find `%s'. Maybe you forgot to pass a configuration?", filename);
-        return NULL;
-    }
-
-    buffer = read_file (path);
-    g_free (path);
+    program = load_program (priv, filename, error);
 
-    if (buffer == NULL) {
-        g_set_error (error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_LOAD_PROGRAM,
-                     "Could not open `%s'", filename);
+    if (program == NULL)
         return NULL;
-    }
-
-    program = add_program_from_source (priv, buffer, "", error);
-    g_debug ("Added program %p from `%s`", (gpointer) program, filename);
-    g_free (buffer);
 
     return create_kernel (priv, program, kernelname, error);
 }
@@ -721,8 +999,10 @@ ufo_resources_get_kernel (UfoResources *resources,
  *
  * Loads a and builds a kernel from a file. The file is searched in the current
  * working directory and all paths added through ufo_resources_add_paths (). If
- * @kernel is %NULL, the first encountered kernel is returned. The kernel object
- * is cached and should not be used by two threads concurrently.
+ * @kernel is %NULL, the first encountered kernel is returned. The program is
+ * built only once, but every thread gets its own kernel object, so that a
+ * task may set kernel arguments without locking. A kernel returned during
+ * setup must therefore not be shared with other tasks.
  *
  * Returns: (transfer none): a cl_kernel object that is load from @filename or %NULL on error
  */
@@ -732,36 +1012,13 @@ ufo_resources_get_cached_kernel (UfoResources *resources,
                                  const gchar *kernelname,
                                  GError **error)
 {
-    UfoResourcesPrivate *priv;
-    cl_kernel kernel;
-
     g_return_val_if_fail (UFO_IS_RESOURCES (resources) &&
                           (filename != NULL), NULL);
 
-    priv = resources->priv;
-
-    if (kernelname != NULL) {
-        gchar *cache_key;
-
-        cache_key = create_cache_key (filename, kernelname);
-        kernel = g_hash_table_lookup (priv->kernel_cache, cache_key);
-
-        if (kernel != NULL) {
-            g_free (cache_key);
-            return kernel;
-        }
-    }
-
-    kernel = ufo_resources_get_kernel (resources, filename, kernelname, error);
-
-    if (kernel != NULL && kernelname != NULL) {
-        gchar *cache_key;
-
-        cache_key = create_cache_key (filename, kernelname);
-        g_hash_table_insert (priv->kernel_cache, cache_key, kernel);
-    }
+    if (kernelname == NULL)
+        return ufo_resources_get_kernel (resources, filename, NULL, error);
 
-    return kernel;
+    return get_cached_kernel_from_program (resources->priv, filename, kernelname, FALSE, error);
 }
 
 /**
@@ -790,10 +1047,319 @@ ufo_resources_get_kernel_from_source (UfoResources *resources,
 
     priv = UFO_RESOURCES_GET_PRIVATE (resources);
     program = add_program_from_source (priv, source, NULL, error);
+
+    if (program == NULL)
+        return NULL;
+
     g_debug ("Added program %p from source", (gpointer) program);
     return create_kernel (priv, program, kernel, error);
 }
 
+/**
+ * ufo_resources_get_cached_kernel_from_source:
+ * @resources: A #UfoResources
+ * @source: OpenCL source string
+ * @kernel: Name of a kernel
+ * @error: Return location for a GError from #UfoResourcesError, or NULL
+ *
+ * Loads and builds a kernel from a string like
+ * ufo_resources_get_kernel_from_source() but builds @source only once. Later
+ * calls with the same @source and @kernel from the same thread return the
+ * cached kernel object. Other threads get their own kernel object of the same
+ * program.
+ *
+ * Returns: (transfer none): a cl_kernel object built from @source or %NULL on
+ * error
+ */
+gpointer
+ufo_resources_get_cached_kernel_from_source (UfoResources *resources,
+                                             const gchar *source,
+                                             const gchar *kernel,
+                                             GError **error)
+{
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources) &&
+                          (source != NULL) && (kernel != NULL), NULL);
+
+    return get_cached_kernel_from_program (resources->priv, source, kernel, TRUE, error);
+}
+
+/*
+ * Constant buffers are identified by their device, size and a SHA-256 digest
+ * of the contents instead of the contents themselves, so that large tables
+ * such as flat fields are not kept twice in host memory. A weak hash would let
+ * a collision hand out another task's data.
+ */
+#define CONSTANT_DIGEST_SIZE 32
+
+typedef struct {
+    cl_device_id    device;
+    gsize           size;
+    guint8          digest[CONSTANT_DIGEST_SIZE];
+} ConstantKey;
+
+static void
+digest_data (gconstpointer data, gsize size, guint8 *digest)
+{
+    GChecksum *checksum;
+    gsize digest_size = CONSTANT_DIGEST_SIZE;
+
+    checksum = g_checksum_new (G_CHECKSUM_SHA256);
+    g_checksum_update (checksum, data, (gssize) size);
+    g_checksum_get_digest (checksum, digest, &digest_size);
+    g_checksum_free (checksum);
+}
+
+static guint
+constant_key_hash (gconstpointer key)
+{
+    const ConstantKey *k = key;
+    guint hash;
+
+    memcpy (&hash, k->digest, sizeof (guint));
+    return hash ^ g_direct_hash (k->device);
+}
+
+static gboolean
+constant_key_equal (gconstpointer a, gconstpointer b)
+{
+    const ConstantKey *ka = a;
+    const ConstantKey *kb = b;
+
+    return ka->device == kb->device && ka->size == kb->size &&
+           memcmp (ka->digest, kb->digest, CONSTANT_DIGEST_SIZE) == 0;
+}
+
+static void
+release_mem_object (cl_mem mem)
+{
+    UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (mem));
+}
+
+static cl_command_queue
+get_device_queue (UfoResourcesPrivate *priv,
+                  cl_device_id device)
+{
+    for (guint i = 0; i < priv->n_devices; i++) {
+        if (priv->devices[i] == device)
+            return priv->command_queues[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * ufo_resources_get_constant_buffer: (skip)
+ * @resources: A #UfoResources
+ * @device: The cl_device_id that will read the buffer
+ * @data: Host data to upload
+ * @size: Size of @data in bytes
+ * @error: Return location for a GError or %NULL
+ *
+ * Get a read-only device buffer with the contents of @data, e.g. filter
+ * coefficients, flat fields or angle tables. Buffers are looked up by a
+ * SHA-256 digest of @data and @device, so identical constants are uploaded
+ * only once per device and shared by all tasks, including expanded copies of
+ * the same task. The buffer must not be written to.
+ *
+ * Returns: (transfer none): a cl_mem object owned by @resources or %NULL on
+ * error
+ */
+gpointer
+ufo_resources_get_constant_buffer (UfoResources *resources,
+                                   gpointer device,
+                                   gconstpointer data,
+                                   gsize size,
+                                   GError **error)
+{
+    UfoResourcesPrivate *priv;
+    ConstantKey key;
+    ConstantKey *new_key;
+    cl_command_queue queue;
+    cl_mem mem;
+    cl_mem existing;
+    cl_int errcode;
+
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources) && data != NULL && size > 0, NULL);
+
+    priv = resources->priv;
+    key.device = device;
+    key.size = size;
+    digest_data (data, size, key.digest);
+
+    g_mutex_lock (priv->lock);
+    mem = g_hash_table_lookup (priv->constants, &key);
+
+    if (mem != NULL) {
+        priv->n_constant_hits++;
+        g_mutex_unlock (priv->lock);
+        return mem;
+    }
+
+    queue = get_device_queue (priv, device);
+    g_mutex_unlock (priv->lock);
+
+    if (queue == NULL) {
+        g_set_error (error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_GENERAL,
+                     "Device %p is not managed by these resources", device);
+        return NULL;
+    }
+
+    /* Upload without holding the lock, which would block all other lookups */
+    mem = clCreateBuffer (priv->context, CL_MEM_READ_ONLY, size, NULL, &errcode);
+    UFO_RESOURCES_CHECK_AND_SET (errcode, error);
+
+    if (errcode != CL_SUCCESS)
+        return NULL;
+
+    /* Writing through the device's queue places the data on that device */
+    errcode = clEnqueueWriteBuffer (queue, mem, CL_TRUE, 0, size, data, 0, NULL, NULL);
+    UFO_RESOURCES_CHECK_AND_SET (errcode, error);
+
+    if (errcode != CL_SUCCESS) {
+        release_mem_object (mem);
+        return NULL;
+    }
+
+    g_mutex_lock (priv->lock);
+    existing = g_hash_table_lookup (priv->constants, &key);
+
+    if (existing == NULL) {
+        new_key = g_new (ConstantKey, 1);
+        *new_key = key;
+        g_hash_table_insert (priv->constants, new_key, mem);
+        priv->constants_size += size;
+        priv->n_constant_misses++;
+    }
+    else
+        priv->n_constant_hits++;
+
+    g_mutex_unlock (priv->lock);
+
+    /* Another thread uploaded the same data in the meantime */
+    if (existing != NULL) {
+        release_mem_object (mem);
+        return existing;
+    }
+
+    return mem;
+}
+
+typedef struct {
+    cl_mem  mem;
+    gsize   size;
+} ScratchBuffer;
+
+static void
+free_scratch_buffer (ScratchBuffer *scratch)
+{
+    release_mem_object (scratch->mem);
+    g_free (scratch);
+}
+
+/**
+ * ufo_resources_get_scratch_buffer: (skip)
+ * @resources: A #UfoResources
+ * @cmd_queue: The cl_command_queue that will use the buffer
+ * @size: Minimum size in bytes
+ * @error: Return location for a GError or %NULL
+ *
+ * Get a device buffer for intermediate results, e.g. the partial results of
+ * a reduction. The buffer is private to the calling thread and @cmd_queue and
+ * is reused by subsequent calls, so its contents are undefined and must not
+ * be expected to survive the next call. It grows if @size exceeds its current
+ * size.
+ *
+ * Returns: (transfer none): a cl_mem object owned by @resources or %NULL on
+ * error
+ */
+gpointer
+ufo_resources_get_scratch_buffer (UfoResources *resources,
+                                  gpointer cmd_queue,
+                                  gsize size,
+                                  GError **error)
+{
+    UfoResourcesPrivate *priv;
+    ScratchBuffer *scratch;
+    gchar *key;
+    cl_mem mem;
+    cl_int errcode;
+
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources) && cmd_queue != NULL && size > 0, NULL);
+
+    priv = resources->priv;
+    key = g_strdup_printf ("%u:%p", get_thread_serial (), cmd_queue);
+
+    g_mutex_lock (priv->lock);
+    scratch = g_hash_table_lookup (priv->scratch_buffers, key);
+
+    if (scratch != NULL && scratch->size >= size) {
+        g_mutex_unlock (priv->lock);
+        g_free (key);
+        return scratch->mem;
+    }
+
+    g_mutex_unlock (priv->lock);
+
+    mem = clCreateBuffer (priv->context, CL_MEM_READ_WRITE, size, NULL, &errcode);
+    UFO_RESOURCES_CHECK_AND_SET (errcode, error);
+
+    if (errcode != CL_SUCCESS) {
+        g_free (key);
+        return NULL;
+    }
+
+    scratch = g_new0 (ScratchBuffer, 1);
+    scratch->mem = mem;
+    scratch->size = size;
+
+    /* Only the calling thread uses this key, replacing releases the old one */
+    g_mutex_lock (priv->lock);
+    g_hash_table_insert (priv->scratch_buffers, key, scratch);
+    g_mutex_unlock (priv->lock);
+
+    return mem;
+}
+
+/**
+ * ufo_resources_get_constant_cache_stats:
+ * @resources: A #UfoResources
+ * @n_buffers: (out) (allow-none): Location for the number of cached buffers
+ * @size: (out) (allow-none): Location for the total size in bytes
+ * @n_hits: (out) (allow-none): Location for the number of cache hits
+ * @n_misses: (out) (allow-none): Location for the number of uploads
+ *
+ * Report the state of the constant buffer cache, see
+ * ufo_resources_get_constant_buffer().
+ */
+void
+ufo_resources_get_constant_cache_stats (UfoResources *resources,
+                                        guint *n_buffers,
+                                        gsize *size,
+                                        guint *n_hits,
+                                        guint *n_misses)
+{
+    UfoResourcesPrivate *priv;
+
+    g_return_if_fail (UFO_IS_RESOURCES (resources));
+    priv = resources->priv;
+
+    g_mutex_lock (priv->lock);
+
+    if (n_buffers != NULL)
+        *n_buffers = g_hash_table_size (priv->constants);
+
+    if (size != NULL)
+        *size = priv->constants_size;
+
+    if (n_hits != NULL)
+        *n_hits = priv->n_constant_hits;
+
+    if (n_misses != NULL)
+        *n_misses = priv->n_constant_misses;
+
+    g_mutex_unlock (priv->lock);
+}
+
 /**
  * ufo_resources_get_context: (skip)
  * @resources: A #UfoResources
@@ -834,6 +1400,35 @@ ufo_resources_get_cmd_queues (UfoResources *resources)
     return result;
 }
 
+/**
+ * ufo_resources_get_copy_queue: (skip)
+ * @resources: A #UfoResources
+ * @cmd_queue: A cl_command_queue managed by @resources
+ *
+ * Get the queue used for transfers between host and the device of @cmd_queue.
+ * Commands enqueued on it do not wait for commands on @cmd_queue, use events
+ * to synchronize them.
+ *
+ * Returns: (transfer none): A cl_command_queue or %NULL if @cmd_queue is not
+ * managed by @resources.
+ */
+gpointer
+ufo_resources_get_copy_queue (UfoResources *resources,
+                              gpointer cmd_queue)
+{
+    UfoResourcesPrivate *priv;
+
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources), NULL);
+    priv = resources->priv;
+
+    for (guint i = 0; i < priv->n_devices; i++) {
+        if (priv->command_queues[i] == cmd_queue)
+            return priv->copy_queues[i];
+    }
+
+    return NULL;
+}
+
 /**
  * ufo_resources_get_devices: (skip)
  * @resources: A #UfoResources
@@ -885,6 +1480,534 @@ ufo_resources_get_mapped_cmd_queues (UfoResources *resources)
     return result;
 }
 
+static gchar *
+get_tuning_filename (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "ufo", "local-work-sizes.conf", NULL);
+}
+
+static GKeyFile *
+get_tuning_file (UfoResourcesPrivate *priv)
+{
+    if (priv->tuning_file == NULL) {
+        gchar *filename;
+
+        filename = get_tuning_filename ();
+        priv->tuning_file = g_key_file_new ();
+
+        /* A missing file simply means that nothing has been tuned yet */
+        g_key_file_load_from_file (priv->tuning_file, filename, G_KEY_FILE_NONE, NULL);
+        g_free (filename);
+    }
+
+    return priv->tuning_file;
+}
+
+static void
+save_tuning_file (UfoResourcesPrivate *priv)
+{
+    gchar *filename;
+    gchar *dirname;
+    gchar *data;
+    gsize length;
+    GError *error = NULL;
+
+    filename = get_tuning_filename ();
+    dirname = g_path_get_dirname (filename);
+    data = g_key_file_to_data (priv->tuning_file, &length, NULL);
+
+    if (g_mkdir_with_parents (dirname, 0755) != 0 ||
+        !g_file_set_contents (filename, data, (gssize) length, &error)) {
+        g_warning ("Could not store local work sizes in `%s': %s", filename,
+                   error != NULL ? error->message : "cannot create directory");
+        g_clear_error (&error);
+    }
+
+    g_free (data);
+    g_free (dirname);
+    g_free (filename);
+}
+
+static void
+get_size_class (guint work_dim,
+                const gsize *global_work_size,
+                gsize *size_class)
+{
+    /* Group global sizes by the next power of two to keep the table small */
+    for (guint i = 0; i < 3; i++) {
+        gsize size = 1;
+
+        while (i < work_dim && size < global_work_size[i])
+            size <<= 1;
+
+        size_class[i] = i < work_dim ? size : 0;
+    }
+}
+
+static gchar *
+format_size_class (guint work_dim,
+                   const gsize *size_class)
+{
+    GString *str;
+
+    str = g_string_new (NULL);
+
+    for (guint i = 0; i < work_dim; i++) {
+        if (i > 0)
+            g_string_append_c (str, 'x');
+
+        g_string_append_printf (str, "%" G_GSIZE_FORMAT, size_class[i]);
+    }
+
+    return g_string_free (str, FALSE);
+}
+
+/*
+ * Kernels with the same name in different programs must not share their
+ * tuning. A program is identified by a digest of its source, which also
+ * invalidates stored results when the source changes.
+ */
+static gchar *
+get_program_digest (cl_kernel kernel)
+{
+    cl_program program;
+    gchar *source;
+    gchar *digest;
+    gsize size = 0;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelInfo (kernel, CL_KERNEL_PROGRAM,
+                                                sizeof (cl_program), &program, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetProgramInfo (program, CL_PROGRAM_SOURCE, 0, NULL, &size));
+    source = g_malloc0 (size + 1);
+
+    if (size > 0)
+        UFO_RESOURCES_CHECK_CLERR (clGetProgramInfo (program, CL_PROGRAM_SOURCE, size, source, NULL));
+
+    digest = g_compute_checksum_for_string (G_CHECKSUM_MD5, source, -1);
+    digest[12] = '\0';
+    g_free (source);
+    return digest;
+}
+
+static guint
+launch_key_hash (gconstpointer data)
+{
+    const LaunchKey *key = data;
+    guint hash;
+
+    hash = g_direct_hash (key->kernel) ^ (g_direct_hash (key->queue) << 1) ^ key->work_dim;
+
+    for (guint i = 0; i < 3; i++)
+        hash = hash * 31 + (guint) key->size_class[i];
+
+    return hash;
+}
+
+static gboolean
+launch_key_equal (gconstpointer a,
+                  gconstpointer b)
+{
+    return memcmp (a, b, sizeof (LaunchKey)) == 0;
+}
+
+static void
+free_local_size_tuning (LocalSizeTuning *tuning)
+{
+    g_free (tuning->device_name);
+    g_free (tuning->file_key);
+    g_free (tuning);
+}
+
+static gboolean
+local_size_fits (const gsize *local_work_size,
+                 guint work_dim,
+                 const gsize *global_work_size)
+{
+    if (local_work_size[0] == 0)
+        return TRUE;
+
+    for (guint i = 0; i < work_dim; i++) {
+        if (global_work_size[i] % local_work_size[i] != 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+add_candidates (LocalSizeTuning *tuning,
+                cl_kernel kernel,
+                cl_device_id device,
+                guint work_dim,
+                const gsize *global_work_size)
+{
+    const gsize *candidates;
+    guint n_candidates;
+    gsize max_group_size;
+    gsize max_item_sizes[3] = {1, 1, 1};
+    cl_uint max_dims;
+
+    switch (work_dim) {
+        case 1:
+            candidates = &candidates_1d[0][0];
+            n_candidates = G_N_ELEMENTS (candidates_1d);
+            break;
+        case 2:
+            candidates = &candidates_2d[0][0];
+            n_candidates = G_N_ELEMENTS (candidates_2d);
+            break;
+        case 3:
+            candidates = &candidates_3d[0][0];
+            n_candidates = G_N_ELEMENTS (candidates_3d);
+            break;
+        default:
+            return;
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelWorkGroupInfo (kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                                         sizeof (gsize), &max_group_size, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (device, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS,
+                                                sizeof (cl_uint), &max_dims, NULL));
+
+    if (max_dims >= 3) {
+        gsize *sizes = g_malloc0 (max_dims * sizeof (gsize));
+
+        UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (device, CL_DEVICE_MAX_WORK_ITEM_SIZES,
+                                                    max_dims * sizeof (gsize), sizes, NULL));
+
+        for (guint i = 0; i < 3; i++)
+            max_item_sizes[i] = sizes[i];
+
+        g_free (sizes);
+    }
+
+    for (guint i = 0; i < n_candidates && tuning->n_candidates < N_MAX_CANDIDATES; i++) {
+        const gsize *candidate = &candidates[i * work_dim];
+        gsize group_size = 1;
+        gboolean valid = TRUE;
+
+        for (guint j = 0; j < work_dim; j++) {
+            group_size *= candidate[j];
+            valid = valid && candidate[j] <= max_item_sizes[j];
+        }
+
+        if (!valid || group_size > max_group_size ||
+            !local_size_fits (candidate, work_dim, global_work_size))
+            continue;
+
+        for (guint j = 0; j < work_dim; j++)
+            tuning->candidates[tuning->n_candidates][j] = candidate[j];
+
+        tuning->n_candidates++;
+    }
+}
+
+/*
+ * Look up the tuning state of a launch. Only the first launch of a kernel on a
+ * queue with a new size class has to query OpenCL, all further launches are
+ * served from priv->launches. Must be called with priv->tuning_lock held.
+ */
+static LocalSizeTuning *
+get_local_size_tuning (UfoResourcesPrivate *priv,
+                       cl_command_queue queue,
+                       cl_kernel kernel,
+                       guint work_dim,
+                       const gsize *global_work_size)
+{
+    LocalSizeTuning *tuning;
+    LaunchKey launch;
+    cl_device_id device;
+    gchar kernel_name[256] = {0};
+    gchar *program;
+    gchar *size_class;
+    gchar *key;
+    gint *stored;
+    gsize n_stored;
+
+    memset (&launch, 0, sizeof (LaunchKey));
+    launch.kernel = kernel;
+    launch.queue = queue;
+    launch.work_dim = work_dim;
+    get_size_class (work_dim, global_work_size, launch.size_class);
+
+    tuning = g_hash_table_lookup (priv->launches, &launch);
+
+    if (tuning != NULL)
+        return tuning;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (queue, CL_QUEUE_DEVICE,
+                                                      sizeof (cl_device_id), &device, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelInfo (kernel, CL_KERNEL_FUNCTION_NAME,
+                                                sizeof (kernel_name) - 1, kernel_name, NULL));
+
+    program = get_program_digest (kernel);
+    size_class = format_size_class (work_dim, launch.size_class);
+    tuning = g_new0 (LocalSizeTuning, 1);
+    tuning->device_name = get_device_name (device);
+    tuning->file_key = g_strdup_printf ("%s@%s:%s", kernel_name, program, size_class);
+    key = g_strdup_printf ("%s:%s", tuning->device_name, tuning->file_key);
+
+    /* Other kernel objects of the same program may have been tuned already */
+    if (g_hash_table_lookup (priv->local_sizes, key) != NULL) {
+        free_local_size_tuning (tuning);
+        tuning = g_hash_table_lookup (priv->local_sizes, key);
+        g_free (key);
+    }
+    else {
+        stored = g_key_file_get_integer_list (get_tuning_file (priv), tuning->device_name,
+                                              tuning->file_key, &n_stored, NULL);
+
+        if (stored != NULL && (n_stored == work_dim || (n_stored == 1 && stored[0] == 0))) {
+            for (guint i = 0; i < n_stored; i++)
+                tuning->best[i] = (gsize) stored[i];
+
+            tuning->tuned = TRUE;
+        }
+        else {
+            /* The first candidate is the driver's choice so that tuning never ends up worse */
+            tuning->n_candidates = 1;
+            add_candidates (tuning, kernel, device, work_dim, global_work_size);
+            tuning->tuned = tuning->n_candidates == 1;
+        }
+
+        g_hash_table_insert (priv->local_sizes, key, tuning);
+        g_free (stored);
+    }
+
+    g_hash_table_insert (priv->launches, g_memdup (&launch, sizeof (LaunchKey)), tuning);
+
+    g_free (size_class);
+    g_free (program);
+    return tuning;
+}
+
+static gint
+compare_samples (gconstpointer a,
+                 gconstpointer b)
+{
+    const cl_ulong x = *((const cl_ulong *) a);
+    const cl_ulong y = *((const cl_ulong *) b);
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*
+ * Pick the candidate with the lowest median time. The tuning file is only
+ * updated in memory and written once when the resources are destroyed.
+ */
+static void
+finish_local_size_tuning (UfoResourcesPrivate *priv,
+                          LocalSizeTuning *tuning,
+                          guint work_dim)
+{
+    cl_ulong best_time = G_MAXUINT64;
+    gint values[3] = {0, 0, 0};
+
+    for (guint i = 0; i < tuning->n_candidates; i++) {
+        cl_ulong median;
+
+        qsort (tuning->samples[i], N_TUNING_SAMPLES, sizeof (cl_ulong), compare_samples);
+        median = tuning->samples[i][N_TUNING_SAMPLES / 2];
+
+        if (median < best_time) {
+            best_time = median;
+            memcpy (tuning->best, tuning->candidates[i], sizeof (tuning->best));
+        }
+    }
+
+    /* No candidate could run with its own size, leave it to the driver */
+    if (best_time == G_MAXUINT64)
+        memset (tuning->best, 0, sizeof (tuning->best));
+
+    tuning->tuned = TRUE;
+
+    for (guint i = 0; i < work_dim; i++)
+        values[i] = (gint) tuning->best[i];
+
+    g_debug ("Tuned local work size of `%s' on %s: [%i %i %i]",
+             tuning->file_key, tuning->device_name, values[0], values[1], values[2]);
+
+    g_key_file_set_integer_list (get_tuning_file (priv), tuning->device_name, tuning->file_key,
+                                 values, values[0] == 0 ? 1 : work_dim);
+    priv->tuning_changed = TRUE;
+}
+
+/**
+ * ufo_resources_launch_kernel: (skip)
+ * @resources: A #UfoResources
+ * @cmd_queue: A cl_command_queue created with profiling enabled
+ * @kernel: A cl_kernel with all arguments set
+ * @work_dim: Number of work dimensions
+ * @global_work_size: Global work sizes, must have at least @work_dim entries
+ * @n_wait_events: Number of events in @wait_list
+ * @wait_list: (allow-none): Array of cl_event that must complete before
+ * @kernel is started or %NULL
+ * @event: Location of a cl_event or %NULL
+ *
+ * Enqueue @kernel with a local work size that is tuned for the program and
+ * name of the kernel, the device of @cmd_queue and the size class of
+ * @global_work_size. On the first launches of a new combination, a small set
+ * of candidate local sizes is tried. Each candidate is launched once to warm
+ * up and then timed over several launches, the one with the lowest median
+ * wins. The results are stored in the user's cache directory when @resources
+ * is destroyed. Launches that are timed block until the kernel has finished.
+ * If @event is not %NULL, the event associated with the kernel is stored in it
+ * and must be released by the caller.
+ */
+void
+ufo_resources_launch_kernel (UfoResources *resources,
+                             gpointer cmd_queue,
+                             gpointer kernel,
+                             guint work_dim,
+                             const gsize *global_work_size,
+                             guint n_wait_events,
+                             gconstpointer wait_list,
+                             gpointer event)
+{
+    UfoResourcesPrivate *priv;
+    LocalSizeTuning *tuning;
+    gsize local_work_size[3] = {0, 0, 0};
+    gboolean measure = FALSE;
+    gboolean failed = FALSE;
+    guint candidate = 0;
+    guint sample = 0;
+    cl_event kernel_event;
+    cl_int errcode;
+
+    g_return_if_fail (UFO_IS_RESOURCES (resources));
+    g_return_if_fail (work_dim > 0 && work_dim <= 3);
+
+    priv = resources->priv;
+
+    g_mutex_lock (priv->tuning_lock);
+    tuning = get_local_size_tuning (priv, cmd_queue, kernel, work_dim, global_work_size);
+
+    if (!tuning->tuned && tuning->n_launched < tuning->n_candidates * (N_TUNING_SAMPLES + 1)) {
+        candidate = tuning->n_launched / (N_TUNING_SAMPLES + 1);
+        sample = tuning->n_launched % (N_TUNING_SAMPLES + 1);
+
+        /* The first launch of each candidate is a warm-up and not timed */
+        measure = sample > 0;
+
+        for (guint i = 0; i < work_dim; i++)
+            local_work_size[i] = tuning->candidates[candidate][i];
+
+        tuning->n_launched++;
+    }
+    else {
+        for (guint i = 0; i < work_dim; i++)
+            local_work_size[i] = tuning->best[i];
+    }
+
+    g_mutex_unlock (priv->tuning_lock);
+
+    /* Sizes in the same class are not necessarily divisible by the winner */
+    if (!local_size_fits (local_work_size, work_dim, global_work_size)) {
+        local_work_size[0] = 0;
+        failed = TRUE;
+    }
+
+    errcode = clEnqueueNDRangeKernel (cmd_queue, kernel,
+                                      work_dim, NULL, global_work_size,
+                                      local_work_size[0] == 0 ? NULL : local_work_size,
+                                      n_wait_events,
+                                      n_wait_events > 0 ? wait_list : NULL,
+                                      &kernel_event);
+
+    /* A stale entry of a released kernel must not break the launch */
+    if (errcode == CL_INVALID_WORK_GROUP_SIZE && local_work_size[0] != 0) {
+        failed = TRUE;
+        errcode = clEnqueueNDRangeKernel (cmd_queue, kernel,
+                                          work_dim, NULL, global_work_size, NULL,
+                                          n_wait_events,
+                                          n_wait_events > 0 ? wait_list : NULL,
+                                          &kernel_event);
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+
+    if (measure) {
+        cl_ulong start = 0;
+        cl_ulong end = 0;
+
+        /* A candidate that did not run with its own size is not timed */
+        if (!failed) {
+            UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &kernel_event));
+            errcode = clGetEventProfilingInfo (kernel_event, CL_PROFILING_COMMAND_START,
+                                               sizeof (cl_ulong), &start, NULL);
+
+            if (errcode == CL_SUCCESS)
+                errcode = clGetEventProfilingInfo (kernel_event, CL_PROFILING_COMMAND_END,
+                                                   sizeof (cl_ulong), &end, NULL);
+        }
+
+        g_mutex_lock (priv->tuning_lock);
+
+        if (errcode != CL_SUCCESS) {
+            /* Queue without profiling, stay with the driver's choice */
+            memset (tuning->best, 0, sizeof (tuning->best));
+            tuning->tuned = TRUE;
+        }
+        else if (!tuning->tuned) {
+            /* ... but still counts, so that tuning finishes without it winning */
+            tuning->samples[candidate][sample - 1] = failed ? G_MAXUINT64 : end - start;
+            tuning->n_measured++;
+
+            if (tuning->n_measured == tuning->n_candidates * N_TUNING_SAMPLES)
+                finish_local_size_tuning (priv, tuning, work_dim);
+        }
+
+        g_mutex_unlock (priv->tuning_lock);
+    }
+
+    if (event != NULL)
+        *((cl_event *) event) = kernel_event;
+    else
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (kernel_event));
+}
+
+/**
+ * ufo_resources_get_local_work_size: (skip)
+ * @resources: A #UfoResources
+ * @cmd_queue: A cl_command_queue
+ * @kernel: A cl_kernel
+ * @work_dim: Number of work dimensions
+ * @global_work_size: Global work sizes, must have at least @work_dim entries
+ * @local_work_size: Location for @work_dim local work sizes, all zero for the
+ * driver's choice
+ *
+ * Query the local work size that ufo_resources_launch_kernel() uses for
+ * @kernel once tuning has finished.
+ *
+ * Returns: %TRUE if tuning has finished and @local_work_size is valid.
+ */
+gboolean
+ufo_resources_get_local_work_size (UfoResources *resources,
+                                   gpointer cmd_queue,
+                                   gpointer kernel,
+                                   guint work_dim,
+                                   const gsize *global_work_size,
+                                   gsize *local_work_size)
+{
+    UfoResourcesPrivate *priv;
+    LocalSizeTuning *tuning;
+    gboolean tuned;
+
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources), FALSE);
+    g_return_val_if_fail (work_dim > 0 && work_dim <= 3, FALSE);
+
+    priv = resources->priv;
+    g_mutex_lock (priv->tuning_lock);
+    tuning = get_local_size_tuning (priv, cmd_queue, kernel, work_dim, global_work_size);
+    tuned = tuning->tuned;
+
+    for (guint i = 0; i < work_dim; i++)
+        local_work_size[i] = tuned ? tuning->best[i] : 0;
+
+    g_mutex_unlock (priv->tuning_lock);
+    return tuned;
+}
+
 static GList *
 append_config_paths (GList *list, UfoConfig *config)
 {
@@ -980,14 +2103,37 @@ ufo_resources_finalize (GObject *object)
 
     g_clear_error (&priv->construct_error);
     g_hash_table_destroy (priv->kernel_cache);
+    g_hash_table_destroy (priv->program_cache);
+
+    g_debug ("UfoResources: %u constant buffers with %" G_GSIZE_FORMAT " bytes, %u hits",
+             g_hash_table_size (priv->constants), priv->constants_size, priv->n_constant_hits);
+    g_hash_table_destroy (priv->constants);
+    g_hash_table_destroy (priv->scratch_buffers);
+
+    if (priv->tuning_changed)
+        save_tuning_file (priv);
+
+    g_hash_table_destroy (priv->launches);
+    g_hash_table_destroy (priv->local_sizes);
+    g_mutex_free (priv->tuning_lock);
+    g_mutex_free (priv->lock);
+
+    if (priv->tuning_file != NULL)
+        g_key_file_free (priv->tuning_file);
 
     list_free_full (&priv->kernel_paths, (GFunc) g_free);
     list_free_full (&priv->include_paths, (GFunc) g_free);
     list_free_full (&priv->kernels, (GFunc) release_kernel);
     list_free_full (&priv->programs, (GFunc) release_program);
 
-    for (guint i = 0; i < priv->n_devices; i++)
+    for (guint i = 0; i < priv->n_devices; i++) {
+        if (priv->copy_queues != NULL && priv->copy_queues[i] != NULL) {
+            ufo_buffer_set_copy_queue (priv->command_queues[i], NULL);
+            UFO_RESOURCES_CHECK_CLERR (clReleaseCommandQueue (priv->copy_queues[i]));
+        }
+
         UFO_RESOURCES_CHECK_CLERR (clReleaseCommandQueue (priv->command_queues[i]));
+    }
 
     if (priv->context)
         UFO_RESOURCES_CHECK_CLERR (clReleaseContext (priv->context));
@@ -996,6 +2142,7 @@ ufo_resources_finalize (GObject *object)
 
     g_free (priv->devices);
     g_free (priv->command_queues);
+    g_free (priv->copy_queues);
 
     priv->kernels = NULL;
     priv->devices = NULL;
@@ -1061,6 +2208,21 @@ ufo_resources_init (UfoResources *self)
     priv->programs = NULL;
     priv->kernels = NULL;
     priv->kernel_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->program_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->local_sizes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                               (GDestroyNotify) free_local_size_tuning);
+    priv->launches = g_hash_table_new_full (launch_key_hash, launch_key_equal, g_free, NULL);
+    priv->tuning_changed = FALSE;
+    priv->constants = g_hash_table_new_full (constant_key_hash, constant_key_equal,
+                                             g_free, (GDestroyNotify) release_mem_object);
+    priv->constants_size = 0;
+    priv->scratch_buffers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                   (GDestroyNotify) free_scratch_buffer);
+    priv->n_constant_hits = 0;
+    priv->n_constant_misses = 0;
+    priv->lock = g_mutex_new ();
+    priv->tuning_lock = g_mutex_new ();
+    priv->tuning_file = NULL;
     priv->build_opts = g_string_new ("-cl-mad-enable ");
     priv->include_paths = g_list_append (NULL, g_strdup ("."));
 
@@ -112,10 +112,45 @@ gpointer         ufo_resources_get_kernel_from_source   (UfoResources   *resourc
                                                          const gchar    *source,
                                                          const gchar    *kernel,
                                                          GError        **error);
+gpointer         ufo_resources_get_cached_kernel_from_source
+                                                        (UfoResources   *resources,
+                                                         const gchar    *source,
+                                                         const gchar    *kernel,
+                                                         GError        **error);
+gpointer         ufo_resources_get_constant_buffer      (UfoResources   *resources,
+                                                         gpointer        device,
+                                                         gconstpointer   data,
+                                                         gsize           size,
+                                                         GError        **error);
+gpointer         ufo_resources_get_scratch_buffer       (UfoResources   *resources,
+                                                         gpointer        cmd_queue,
+                                                         gsize           size,
+                                                         GError        **error);
+void             ufo_resources_get_constant_cache_stats (UfoResources   *resources,
+                                                         guint          *n_buffers,
+                                                         gsize          *size,
+                                                         guint          *n_hits,
+                                                         guint          *n_misses);
 gpointer         ufo_resources_get_context              (UfoResources   *resources);
 GList          * ufo_resources_get_cmd_queues           (UfoResources   *resources);
+gpointer         ufo_resources_get_copy_queue           (UfoResources   *resources,
+                                                         gpointer        cmd_queue);
 GList          * ufo_resources_get_devices              (UfoResources   *resources);
 GHashTable     * ufo_resources_get_mapped_cmd_queues    (UfoResources   *resources);
+void             ufo_resources_launch_kernel            (UfoResources   *resources,
+                                                         gpointer        cmd_queue,
+                                                         gpointer        kernel,
+                                                         guint           work_dim,
+                                                         const gsize    *global_work_size,
+                                                         guint           n_wait_events,
+                                                         gconstpointer   wait_list,
+                                                         gpointer        event);
+gboolean         ufo_resources_get_local_work_size      (UfoResources   *resources,
+                                                         gpointer        cmd_queue,
+                                                         gpointer        kernel,
+                                                         guint           work_dim,
+                                                         const gsize    *global_work_size,
+                                                         gsize          *local_work_size);
 const gchar    * ufo_resources_clerr                    (int             error);
 GType            ufo_resources_get_type                 (void);
 GQuark           ufo_resources_error_quark              (void);
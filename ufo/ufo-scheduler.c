@@ -26,6 +26,7 @@
 #include <gio/gio.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/prctl.h>
 
 #ifdef HAVE_PYTHON
 #include <Python.h>
@@ -34,7 +35,9 @@
 #include <ufo/ufo-buffer.h>
 #include <ufo/ufo-config.h>
 #include <ufo/ufo-configurable.h>
+#include <ufo/ufo-cpu-node.h>
 #include <ufo/ufo-cpu-task-iface.h>
+#include <ufo/ufo-gpu-node.h>
 #include <ufo/ufo-gpu-task-iface.h>
 #include <ufo/ufo-remote-node.h>
 #include <ufo/ufo-remote-task.h>
@@ -74,6 +77,22 @@ G_DEFINE_TYPE_WITH_CODE (UfoScheduler, ufo_scheduler, G_TYPE_OBJECT,
 
 static GTimer *global_clock;
 
+/* Buffers an in-place task may pass on before returning one upstream */
+#define MAX_IN_PLACE_IN_FLIGHT  2
+
+/* Frames an asynchronous GPU task may have enqueued but not finished */
+#define MAX_ASYNC_IN_FLIGHT     3
+
+/* Microseconds between two looks at the queues of replicated sub-graphs */
+#define ADAPTIVE_INTERVAL       20000
+
+/* Fill level of the input queues at which replicas count as overloaded */
+#define ADAPTIVE_HIGH           0.5
+
+/* Consecutive samples needed before a replica is resumed or parked */
+#define ADAPTIVE_BUSY_SAMPLES   3
+#define ADAPTIVE_IDLE_SAMPLES   10
+
 typedef struct {
     gpointer         context;
     UfoTask          *task;
@@ -87,8 +106,33 @@ typedef struct {
     volatile gint   *in_flight;
     gint             max_in_flight;
     GList           *successor_queues;
+    guint            n_items;           /* items passed to process or generate */
+    gsize            output_size;       /* bytes of the last output */
+    gdouble          cpu_start;         /* profiler timers before this run */
+    gdouble          gpu_start;
+    UfoCpuNode      *cpu;               /* CPU the thread is pinned to */
+    gboolean         static_shape;      /* output shape known before the stream */
+    UfoRequisition   static_requisition;
 } TaskLocalData;
 
+typedef struct {
+    UfoGroup        *group;             /* scattering group of the head */
+    GList           *entries;           /* first task of each replica */
+    GList           *exit_groups;       /* groups between replicas and tail */
+    UfoTask         *tail;
+    const gchar     *name;
+    guint            n_replicas;
+    guint            n_active;
+    guint            n_max_active;
+    guint            n_busy;
+    guint            n_idle;
+} AdaptiveSet;
+
+typedef struct {
+    GList           *sets;
+    volatile gint    running;
+} AdaptiveMonitor;
+
 static inline void trace (gchar *msg, TaskLocalData *tld)
 {
 #ifndef DEBUG
@@ -113,12 +157,18 @@ struct _UfoSchedulerPrivate {
     GList           *remotes;
     UfoRemoteMode    mode;
     gboolean         expand;
+    gboolean         adaptive;
+    gboolean         fuse;
     gboolean         trace;
+    guint            max_active_replicas;
 };
 
 enum {
     PROP_0,
     PROP_EXPAND,
+    PROP_ADAPTIVE,
+    PROP_MAX_ACTIVE_REPLICAS,
+    PROP_FUSE,
     PROP_REMOTES,
     PROP_ENABLE_TRACING,
     N_PROPERTIES,
@@ -229,6 +279,82 @@ ufo_scheduler_set_remote_mode (UfoScheduler *scheduler,
     scheduler->priv->mode = mode;
 }
 
+static inline void
+begin_work (UfoProfiler *profiler,
+            const gchar *name)
+{
+    ufo_profiler_trace_event (profiler, name, "B");
+    ufo_profiler_start (profiler, UFO_PROFILER_TIMER_CPU);
+}
+
+/* Account time spent in process() and generate() for the cost model */
+static inline void
+end_work (TaskLocalData *tld,
+          UfoProfiler *profiler,
+          const gchar *name,
+          guint n_items)
+{
+    ufo_profiler_stop (profiler, UFO_PROFILER_TIMER_CPU);
+    ufo_profiler_trace_event (profiler, name, "E");
+    tld->n_items += n_items;
+}
+
+static void
+record_output_size (TaskLocalData *tld,
+                    UfoRequisition *requisition)
+{
+    gsize size = 0;
+
+    if (requisition->n_dims > 0) {
+        size = sizeof (gfloat);
+
+        for (guint i = 0; i < requisition->n_dims; i++)
+            size *= requisition->dims[i];
+    }
+
+    tld->output_size = size;
+}
+
+static void
+get_requisition (TaskLocalData *tld,
+                 UfoBuffer **inputs,
+                 UfoRequisition *requisition)
+{
+    if (tld->static_shape)
+        *requisition = tld->static_requisition;
+    else
+        ufo_task_get_requisition (tld->task, inputs, requisition);
+}
+
+static const gchar *
+get_task_name (UfoTaskNode *node)
+{
+    const gchar *name = ufo_task_node_get_plugin_name (node);
+    return name != NULL ? name : G_OBJECT_TYPE_NAME (node);
+}
+
+/*
+ * Name the calling thread after its task, so that it can be told apart in top
+ * and perf, and pin it if a placement was chosen.
+ */
+static void
+setup_thread (TaskLocalData *tld)
+{
+    UfoTaskNode *node = UFO_TASK_NODE (tld->task);
+    guint index = ufo_node_get_index (UFO_NODE (node));
+    gchar name[16];
+
+    if (index > 0)
+        g_snprintf (name, sizeof (name), "%.10s:%u", get_task_name (node), index);
+    else
+        g_snprintf (name, sizeof (name), "%s", get_task_name (node));
+
+    prctl (PR_SET_NAME, name, 0, 0, 0);
+
+    if (tld->cpu != NULL)
+        ufo_cpu_node_bind_current_thread (tld->cpu);
+}
+
 static gboolean
 get_inputs (TaskLocalData *tld,
             UfoBuffer **inputs)
@@ -269,7 +395,10 @@ release_inputs (TaskLocalData *tld,
         UfoGroup *group;
 
         group = ufo_task_node_get_current_in_group (node, i);
-        ufo_group_push_input_buffer (group, tld->task, inputs[i]);
+
+        if (inputs[i] != NULL)
+            ufo_group_push_input_buffer (group, tld->task, inputs[i]);
+
         ufo_task_node_switch_in_group (node, i);
     }
 }
@@ -484,6 +613,8 @@ run_task_without_grouping (TaskLocalData *tld)
     UfoBufferPool *obp = ufo_buffer_pool_new (MAX_POOL_LEN, static_context);
     UfoTaskNode *self = UFO_TASK_NODE (tld->task);
 
+    setup_thread (tld);
+
     if (UFO_IS_REMOTE_TASK (tld->task)) {
         run_remote_task (tld);
         return NULL;
@@ -567,6 +698,365 @@ run_task_without_grouping (TaskLocalData *tld)
 }
 
 
+/*
+ * Like get_inputs() but remembers the group each buffer came from and switches
+ * to the next input group right away, so that several items can be held at the
+ * same time. Inputs that have already finished are left untouched and get a
+ * NULL group.
+ */
+static gboolean
+get_batch_inputs (TaskLocalData *tld,
+                  UfoBuffer **inputs,
+                  UfoGroup **groups)
+{
+    UfoTaskNode *node = UFO_TASK_NODE (tld->task);
+    guint n_finished = 0;
+
+    for (guint i = 0; i < tld->n_inputs; i++) {
+        groups[i] = NULL;
+
+        if (!tld->finished[i]) {
+            UfoGroup *group;
+            UfoBuffer *input;
+
+            group = ufo_task_node_get_current_in_group (node, i);
+            input = ufo_group_pop_input_buffer (group, tld->task);
+
+            if (input == UFO_END_OF_STREAM) {
+                tld->finished[i] = TRUE;
+                n_finished++;
+            }
+            else {
+                inputs[i] = input;
+                groups[i] = group;
+                ufo_task_node_switch_in_group (node, i);
+            }
+        }
+        else
+            n_finished++;
+    }
+
+    return (tld->n_inputs == 0) || (n_finished < tld->n_inputs);
+}
+
+static void
+release_batch_inputs (TaskLocalData *tld,
+                      UfoBuffer **inputs,
+                      UfoGroup **groups,
+                      guint n_items)
+{
+    for (guint i = 0; i < n_items * tld->n_inputs; i++) {
+        if (groups[i] != NULL)
+            ufo_group_push_input_buffer (groups[i], tld->task, inputs[i]);
+    }
+}
+
+static UfoTaskProcessBatchFunc
+get_process_batch_func (UfoTask *task)
+{
+    if (UFO_IS_GPU_TASK (task)) {
+        if (UFO_GPU_TASK_GET_IFACE (task)->process_batch != NULL)
+            return (UfoTaskProcessBatchFunc) ufo_gpu_task_process_batch;
+    }
+    else if (UFO_IS_CPU_TASK (task)) {
+        if (UFO_CPU_TASK_GET_IFACE (task)->process_batch != NULL)
+            return (UfoTaskProcessBatchFunc) ufo_cpu_task_process_batch;
+    }
+
+    return NULL;
+}
+
+static gboolean
+same_requisition (UfoRequisition *a,
+                  UfoRequisition *b)
+{
+    if (a->n_dims != b->n_dims)
+        return FALSE;
+
+    for (guint i = 0; i < a->n_dims; i++) {
+        if (a->dims[i] != b->dims[i])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Processor loop for tasks that consume several items per call. Input and
+ * output buffers are assembled into batches of up to @batch_size items that
+ * share the same requisition. An item with a different requisition ends the
+ * batch and starts the next one, and a partial batch is flushed when the
+ * input stream ends.
+ */
+static void
+run_task_batched (TaskLocalData *tld,
+                  UfoProfiler *profiler,
+                  UfoTaskProcessBatchFunc process_batch,
+                  guint batch_size)
+{
+    UfoTaskNode *node;
+    UfoGroup *group;
+    UfoBuffer **inputs;
+    UfoBuffer **outputs;
+    UfoGroup **in_groups;
+    UfoRequisition requisition;
+    UfoRequisition held_requisition;
+    gboolean active;
+    gboolean held;
+    guint n_inputs;
+
+    node = UFO_TASK_NODE (tld->task);
+    group = ufo_task_node_get_out_group (node);
+    n_inputs = tld->n_inputs;
+
+    /* One extra slot holds an item that did not fit into the last batch */
+    inputs = g_new0 (UfoBuffer *, (batch_size + 1) * n_inputs + 1);
+    in_groups = g_new0 (UfoGroup *, (batch_size + 1) * n_inputs + 1);
+    outputs = g_new0 (UfoBuffer *, batch_size);
+    active = TRUE;
+    held = FALSE;
+
+    while (active || held) {
+        gboolean produces;
+        gboolean success;
+        guint n_items = 0;
+
+        if (held) {
+            memmove (inputs, &inputs[batch_size * n_inputs], n_inputs * sizeof (UfoBuffer *));
+            memmove (in_groups, &in_groups[batch_size * n_inputs], n_inputs * sizeof (UfoGroup *));
+            requisition = held_requisition;
+            held = FALSE;
+            n_items = 1;
+        }
+
+        /* Assemble a batch, stop early at the end of the stream */
+        while (active && n_items < batch_size) {
+            UfoBuffer **item = &inputs[n_items * n_inputs];
+            UfoRequisition item_requisition;
+
+            /* Finished inputs keep their last buffer like in run_task() */
+            if (n_items > 0)
+                memcpy (item, item - n_inputs, n_inputs * sizeof (UfoBuffer *));
+
+            if (!get_batch_inputs (tld, item, &in_groups[n_items * n_inputs])) {
+                active = FALSE;
+                break;
+            }
+
+            get_requisition (tld, item, &item_requisition);
+
+            if (n_items > 0 && !same_requisition (&item_requisition, &requisition)) {
+                /* Keep the item for the next batch in the extra slot */
+                memcpy (&inputs[batch_size * n_inputs], item, n_inputs * sizeof (UfoBuffer *));
+                memcpy (&in_groups[batch_size * n_inputs], &in_groups[n_items * n_inputs],
+                        n_inputs * sizeof (UfoGroup *));
+                held_requisition = item_requisition;
+                held = TRUE;
+                break;
+            }
+
+            requisition = item_requisition;
+            n_items++;
+        }
+
+        if (n_items == 0)
+            break;
+
+        produces = requisition.n_dims > 0;
+        record_output_size (tld, &requisition);
+
+        for (guint i = 0; i < n_items; i++) {
+            outputs[i] = NULL;
+
+            if (produces) {
+                outputs[i] = ufo_group_pop_output_buffer (group, &requisition);
+                g_assert (outputs[i] != NULL);
+                ufo_buffer_discard_location (outputs[i]);
+            }
+        }
+
+        begin_work (profiler, "process");
+        success = process_batch (tld->task, inputs, outputs, n_items, &requisition);
+        end_work (tld, profiler, "process", n_items);
+
+        for (guint i = 0; i < n_items; i++)
+            ufo_task_node_increase_processed (node);
+
+        if (produces) {
+            for (guint i = 0; i < n_items; i++) {
+                if (success)
+                    ufo_group_push_output_buffer (group, outputs[i]);
+                else
+                    ufo_group_return_output_buffer (group, outputs[i]);
+            }
+        }
+
+        /* Upstream must get its buffers back in any case */
+        release_batch_inputs (tld, inputs, in_groups, n_items);
+
+        if (!success) {
+            if (held)
+                release_batch_inputs (tld, &inputs[batch_size * n_inputs],
+                                      &in_groups[batch_size * n_inputs], 1);
+
+            break;
+        }
+    }
+
+    ufo_group_finish (group);
+
+    g_free (outputs);
+    g_free (in_groups);
+    g_free (inputs);
+}
+
+/*
+ * Wait until the frame in @slot has finished on the device and hand its inputs
+ * back to the upstream groups.
+ */
+static void
+retire_async_slot (TaskLocalData *tld,
+                   cl_event *events,
+                   UfoBuffer **inputs,
+                   UfoGroup **groups,
+                   guint slot)
+{
+    guint n_inputs = tld->n_inputs;
+
+    if (events[slot] != NULL) {
+        UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &events[slot]));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (events[slot]));
+        events[slot] = NULL;
+    }
+
+    release_batch_inputs (tld, &inputs[slot * n_inputs], &groups[slot * n_inputs], 1);
+
+    for (guint i = 0; i < n_inputs; i++)
+        groups[slot * n_inputs + i] = NULL;
+}
+
+/*
+ * Processor and generator loop for GPU tasks implementing the asynchronous
+ * interface. Outputs are pushed as soon as their commands are enqueued with the
+ * event attached, inputs are only released once the frame's event completed.
+ * Up to MAX_ASYNC_IN_FLIGHT frames are kept in flight.
+ */
+static void
+run_task_async (TaskLocalData *tld,
+                UfoProfiler *profiler)
+{
+    UfoTaskNode *node;
+    UfoGroup *group;
+    UfoGpuTask *task;
+    cl_command_queue cmd_queue;
+    UfoBuffer **inputs;
+    UfoGroup **in_groups;
+    cl_event *events;
+    UfoRequisition requisition;
+    gboolean active;
+    guint n_inputs;
+    guint current;
+
+    node = UFO_TASK_NODE (tld->task);
+    task = UFO_GPU_TASK (tld->task);
+    group = ufo_task_node_get_out_group (node);
+    cmd_queue = ufo_gpu_node_get_cmd_queue (UFO_GPU_NODE (ufo_task_node_get_proc_node (node)));
+    n_inputs = tld->n_inputs;
+    inputs = g_new0 (UfoBuffer *, MAX_ASYNC_IN_FLIGHT * n_inputs + 1);
+    in_groups = g_new0 (UfoGroup *, MAX_ASYNC_IN_FLIGHT * n_inputs + 1);
+    events = g_new0 (cl_event, MAX_ASYNC_IN_FLIGHT);
+    active = TRUE;
+    current = 0;
+
+    while (active) {
+        UfoBuffer **item = &inputs[current * n_inputs];
+        UfoBuffer *output = NULL;
+        cl_event event = NULL;
+        gboolean produces;
+
+        /* Re-use the oldest slot */
+        retire_async_slot (tld, events, inputs, in_groups, current);
+
+        if (tld->mode == UFO_TASK_MODE_PROCESSOR) {
+            guint previous = (current + MAX_ASYNC_IN_FLIGHT - 1) % MAX_ASYNC_IN_FLIGHT;
+
+            /* Finished inputs keep their last buffer like in run_task() */
+            memcpy (item, &inputs[previous * n_inputs], n_inputs * sizeof (UfoBuffer *));
+
+            if (!get_batch_inputs (tld, item, &in_groups[current * n_inputs]))
+                break;
+        }
+
+        get_requisition (tld, item, &requisition);
+        produces = requisition.n_dims > 0;
+        record_output_size (tld, &requisition);
+
+        if (produces) {
+            output = ufo_group_pop_output_buffer (group, &requisition);
+            g_assert (output != NULL);
+            ufo_buffer_discard_location (output);
+        }
+
+        if (tld->mode == UFO_TASK_MODE_PROCESSOR) {
+            begin_work (profiler, "process");
+            active = ufo_gpu_task_process_async (task, item, output, &requisition, (gpointer *) &event);
+            end_work (tld, profiler, "process", 1);
+            ufo_task_node_increase_processed (node);
+        }
+        else {
+            begin_work (profiler, "generate");
+            active = ufo_gpu_task_generate_async (task, output, &requisition, (gpointer *) &event);
+            end_work (tld, profiler, "generate", 1);
+        }
+
+        if (event != NULL) {
+            if (output != NULL)
+                ufo_buffer_set_event (output, event);
+
+            events[current] = event;
+            UFO_RESOURCES_CHECK_CLERR (clFlush (cmd_queue));
+        }
+
+        if (active && produces)
+            ufo_group_push_output_buffer (group, output);
+
+        current = (current + 1) % MAX_ASYNC_IN_FLIGHT;
+    }
+
+    /* Drain remaining frames in submission order */
+    for (guint i = 0; i < MAX_ASYNC_IN_FLIGHT; i++)
+        retire_async_slot (tld, events, inputs, in_groups, (current + i) % MAX_ASYNC_IN_FLIGHT);
+
+    ufo_group_finish (group);
+
+    g_free (events);
+    g_free (in_groups);
+    g_free (inputs);
+}
+
+/*
+ * Return the input that can be passed on as the output buffer or -1 if there is
+ * none. The buffer must have exactly one consumer, otherwise its release could
+ * not be traced back to our input. Only single-input tasks qualify: a finished
+ * input keeps its last buffer for the remaining inputs, which is impossible
+ * once that buffer has been passed on.
+ */
+static gint
+get_in_place_input (TaskLocalData *tld)
+{
+    UfoGroup *group;
+
+    if (tld->mode != UFO_TASK_MODE_PROCESSOR || tld->n_inputs != 1)
+        return -1;
+
+    group = ufo_task_node_get_out_group (UFO_TASK_NODE (tld->task));
+
+    if (ufo_group_get_num_targets (group) != 1)
+        return -1;
+
+    return ufo_task_can_process_in_place (tld->task, 0) ? 0 : -1;
+}
+
 static gpointer
 run_task (TaskLocalData *tld)
 {
@@ -578,12 +1068,17 @@ run_task (TaskLocalData *tld)
     UfoTaskGenerateFunc generate;
     UfoRequisition requisition;
     gboolean active;
+    gint in_place;
+    guint n_in_flight;
 
     node = UFO_TASK_NODE (tld->task);
     active = TRUE;
     output = NULL;
+    n_in_flight = 0;
     profiler = g_object_ref (ufo_task_node_get_profiler (node));
 
+    setup_thread (tld);
+
     if (UFO_IS_REMOTE_TASK (tld->task)) {
         run_remote_task (tld);
         return NULL;
@@ -601,9 +1096,33 @@ run_task (TaskLocalData *tld)
     if (!is_correctly_implemented (node, tld->mode, process, generate))
         return NULL;
 
+    if (tld->mode == UFO_TASK_MODE_PROCESSOR) {
+        UfoTaskProcessBatchFunc process_batch;
+        guint batch_size;
+
+        batch_size = ufo_task_get_batch_size (tld->task);
+        process_batch = get_process_batch_func (tld->task);
+
+        if (batch_size > 1 && process_batch != NULL) {
+            run_task_batched (tld, profiler, process_batch, batch_size);
+            g_object_unref (profiler);
+            return NULL;
+        }
+    }
+
+    if (UFO_IS_GPU_TASK (tld->task) &&
+        ufo_gpu_task_has_async (UFO_GPU_TASK (tld->task), tld->mode)) {
+        run_task_async (tld, profiler);
+        g_object_unref (profiler);
+        return NULL;
+    }
+
+    in_place = get_in_place_input (tld);
+
     while (active) {
         UfoGroup *group;
         gboolean produces;
+        gboolean use_in_place;
 
         group = ufo_task_node_get_out_group (node);
 
@@ -616,30 +1135,38 @@ run_task (TaskLocalData *tld)
         }
 
         /* Get output buffers */
-        ufo_task_get_requisition (tld->task, inputs, &requisition);
+        get_requisition (tld, inputs, &requisition);
         produces = requisition.n_dims > 0;
+        record_output_size (tld, &requisition);
+        use_in_place = produces && in_place >= 0 && !tld->finished[in_place] &&
+                       !ufo_buffer_cmp_dimensions (inputs[in_place], &requisition);
 
-        if (produces) {
-            output = ufo_group_pop_output_buffer (group, &requisition);
-            g_assert (output != NULL);
+        if (use_in_place) {
+            output = inputs[in_place];
         }
+        else {
+            if (produces) {
+                output = ufo_group_pop_output_buffer (group, &requisition);
+                g_assert (output != NULL);
+            }
 
-        if (output != NULL)
-            ufo_buffer_discard_location (output);
+            if (output != NULL)
+                ufo_buffer_discard_location (output);
+        }
 
         switch (tld->mode) {
             case UFO_TASK_MODE_PROCESSOR:
-                ufo_profiler_trace_event (profiler, "process", "B");
+                begin_work (profiler, "process");
                 active = process (tld->task, inputs, output, &requisition);
-                ufo_profiler_trace_event (profiler, "process", "E");
+                end_work (tld, profiler, "process", 1);
                 ufo_task_node_increase_processed (UFO_TASK_NODE (tld->task));
                 break;
 
             case UFO_TASK_MODE_REDUCTOR:
                 do {
-                    ufo_profiler_trace_event (profiler, "process", "B");
+                    begin_work (profiler, "process");
                     process (tld->task, inputs, output, &requisition);
-                    ufo_profiler_trace_event (profiler, "process", "E");
+                    end_work (tld, profiler, "process", 1);
                     ufo_task_node_increase_processed (UFO_TASK_NODE (tld->task));
 
                     release_inputs (tld, inputs);
@@ -648,15 +1175,29 @@ run_task (TaskLocalData *tld)
                 break;
 
             case UFO_TASK_MODE_GENERATOR:
-                ufo_profiler_trace_event (profiler, "generate", "B");
+                begin_work (profiler, "generate");
                 active = generate (tld->task, output, &requisition);
-                ufo_profiler_trace_event (profiler, "generate", "E");
+                end_work (tld, profiler, "generate", 1);
                 break;
         }
 
         if (active && produces && (tld->mode != UFO_TASK_MODE_REDUCTOR)) {
             ufo_group_push_output_buffer (group, output);
         }
+
+        /*
+         * An in-place input went downstream, give a buffer released by our
+         * consumer back to the upstream group instead. Only wait for one when
+         * too many are in flight, the upstream group can allocate meanwhile.
+         */
+        if (active && use_in_place) {
+            n_in_flight++;
+            inputs[in_place] = ufo_group_reclaim_buffer (group, n_in_flight > MAX_IN_PLACE_IN_FLIGHT);
+
+            if (inputs[in_place] != NULL)
+                n_in_flight--;
+        }
+
         /* Release buffers for further consumption */
         if (active)
             release_inputs (tld, inputs);
@@ -665,9 +1206,9 @@ run_task (TaskLocalData *tld)
             active = TRUE;
 
             do {
-                ufo_profiler_trace_event (profiler, "generate", "B");
+                begin_work (profiler, "generate");
                 active = generate (tld->task, output, &requisition);
-                ufo_profiler_trace_event (profiler, "generate", "E");
+                end_work (tld, profiler, "generate", 1);
 
                 if (active) {
                     ufo_group_push_output_buffer (group, output);
@@ -691,6 +1232,7 @@ cleanup_task_local_data (TaskLocalData **tlds,
     for (guint i = 0; i < n; i++) {
         TaskLocalData *tld = tlds[i];
 
+        g_list_free (tld->successors);
         g_free (tld->in_params);
         g_free (tld->finished);
         g_free (tld);
@@ -699,20 +1241,110 @@ cleanup_task_local_data (TaskLocalData **tlds,
     g_free (tlds);
 }
 
+/*
+ * Feed the timings of this run into the cost model of the task graph and
+ * compare the achieved throughput with the one predicted by the last mapping.
+ */
+static void
+record_costs (UfoTaskGraph *task_graph,
+              TaskLocalData **tlds,
+              guint n,
+              gdouble elapsed)
+{
+    gdouble predicted;
+    guint n_output = 0;
+
+    predicted = ufo_task_graph_get_predicted_throughput (task_graph);
+
+    for (guint i = 0; i < n; i++) {
+        TaskLocalData *tld = tlds[i];
+        UfoProfiler *profiler;
+        gdouble seconds;
+
+        if (tld->n_items == 0)
+            continue;
+
+        profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (tld->task));
+        seconds = MAX (ufo_profiler_elapsed (profiler, UFO_PROFILER_TIMER_CPU) - tld->cpu_start,
+                       ufo_profiler_elapsed (profiler, UFO_PROFILER_TIMER_GPU) - tld->gpu_start);
+
+        ufo_task_graph_add_cost_sample (task_graph, UFO_TASK_NODE (tld->task),
+                                        seconds, tld->n_items, tld->output_size);
+
+        if (ufo_graph_get_num_successors (UFO_GRAPH (task_graph), UFO_NODE (tld->task)) == 0)
+            n_output += tld->n_items;
+    }
+
+    if (predicted > 0.0 && elapsed > 0.0)
+        g_message ("Predicted throughput %.2f items/s, achieved %.2f items/s",
+                   predicted, n_output / elapsed);
+}
+
+static void
+join_threads (GThread **threads, guint n_threads)
+{
+    for (guint i = 0; i < n_threads; i++)
+        g_thread_join (threads[i]);
+}
+
+typedef struct {
+    TaskLocalData   *tld;
+    UfoResources    *resources;
+    gboolean         trace;
+    GError          *error;
+} SetupData;
+
+static gpointer
+setup_task (SetupData *data)
+{
+    TaskLocalData *tld;
+    UfoProfiler *profiler;
+
+    tld = data->tld;
+    profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (tld->task));
+    ufo_profiler_enable_tracing (profiler, data->trace);
+
+    ufo_profiler_trace_event (profiler, "setup", "B");
+    ufo_profiler_start (profiler, UFO_PROFILER_TIMER_SETUP);
+
+    ufo_task_setup (tld->task, data->resources, &data->error);
+
+    ufo_profiler_stop (profiler, UFO_PROFILER_TIMER_SETUP);
+    ufo_profiler_trace_event (profiler, "setup", "E");
+
+    if (data->error == NULL) {
+        ufo_task_get_structure (tld->task, &tld->n_inputs, &tld->in_params, &tld->mode);
+        tld->finished = g_new0 (gboolean, tld->n_inputs);
+    }
+
+    return NULL;
+}
+
 static TaskLocalData **
 setup_tasks (UfoSchedulerPrivate *priv,
              UfoTaskGraph *task_graph,
              GError **error)
 {
     TaskLocalData **tlds;
+    SetupData *setup_data;
+    GThread **threads;
     GList *nodes;
     guint n_nodes;
+    guint n_allocated;
+    gboolean success = TRUE;
 
     nodes = ufo_graph_get_nodes (UFO_GRAPH (task_graph));
     n_nodes = g_list_length (nodes);
 
     tlds = g_new0 (TaskLocalData *, n_nodes);
+    setup_data = g_new0 (SetupData, n_nodes);
+    threads = g_new0 (GThread *, n_nodes);
+    n_allocated = n_nodes;
 
+    /*
+     * Set up all tasks concurrently, most of the time is spent building
+     * OpenCL programs which do not depend on each other.
+     */
     for (guint i = 0; i < n_nodes; i++) {
         UfoNode *node;
         UfoProfiler *profiler;
@@ -722,26 +1354,70 @@ setup_tasks (UfoSchedulerPrivate *priv,
         tld = g_new0 (TaskLocalData, 1);
         tld->task_graph = task_graph;
         tld->context = ufo_resources_get_context (priv->resources);
-        tld->successors = NULL;
+        tld->successors = ufo_graph_get_successors (UFO_GRAPH (task_graph), node);
         tld->last_trace = 0.0;
         tld->task = UFO_TASK (node);
         tlds[i] = tld;
 
-        tld->successors = ufo_graph_get_successors (UFO_GRAPH (task_graph), node);
+        /* Profilers live as long as the nodes, count only this run */
+        profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (node));
+        tld->cpu_start = ufo_profiler_elapsed (profiler, UFO_PROFILER_TIMER_CPU);
+        tld->gpu_start = ufo_profiler_elapsed (profiler, UFO_PROFILER_TIMER_GPU);
+
+        setup_data[i].tld = tld;
+        setup_data[i].resources = priv->resources;
+        setup_data[i].trace = priv->trace;
+        threads[i] = g_thread_create ((GThreadFunc) setup_task, &setup_data[i], TRUE, error);
+
+        if (threads[i] == NULL) {
+            /* Only join the threads that were started but free all tlds */
+            n_allocated = i + 1;
+            n_nodes = i;
+            success = FALSE;
+            break;
+        }
+    }
 
-        ufo_task_setup (UFO_TASK (node), priv->resources, error);
-        ufo_task_get_structure (UFO_TASK (node), &tld->n_inputs, &tld->in_params, &tld->mode);
+#ifdef HAVE_PYTHON
+    if (Py_IsInitialized ()) {
+        Py_BEGIN_ALLOW_THREADS
 
-        profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (node));
-        ufo_profiler_enable_tracing (profiler, priv->trace);
+        join_threads (threads, n_nodes);
 
-        tld->finished = g_new0 (gboolean, tld->n_inputs);
+        Py_END_ALLOW_THREADS
+    }
+    else {
+        join_threads (threads, n_nodes);
+    }
+#else
+    join_threads (threads, n_nodes);
+#endif
 
-        if (error && *error != NULL)
-            return NULL;
+    for (guint i = 0; i < n_nodes; i++) {
+        UfoTaskNode *node = UFO_TASK_NODE (tlds[i]->task);
+
+        g_debug ("Setup of %s took %3.5fs", ufo_task_node_get_unique_name (node),
+                 ufo_profiler_elapsed (ufo_task_node_get_profiler (node), UFO_PROFILER_TIMER_SETUP));
+
+        if (setup_data[i].error != NULL) {
+            if (success)
+                g_propagate_error (error, setup_data[i].error);
+            else
+                g_error_free (setup_data[i].error);
+
+            success = FALSE;
+        }
     }
 
+    g_free (threads);
+    g_free (setup_data);
     g_list_free (nodes);
+
+    if (!success) {
+        cleanup_task_local_data (tlds, n_allocated);
+        return NULL;
+    }
+
     return tlds;
 }
 
@@ -827,6 +1503,101 @@ static void print_group_summary (GList *groups)
 //     return groups;
 // }
 
+static gint
+find_task (TaskLocalData **tlds,
+           guint n_nodes,
+           UfoNode *node)
+{
+    for (guint i = 0; i < n_nodes; i++) {
+        if (UFO_NODE (tlds[i]->task) == node)
+            return (gint) i;
+    }
+
+    return -1;
+}
+
+/*
+ * Propagate constant output shapes from the generators downstream and
+ * preallocate the output buffers of all tasks with a known shape. A task is
+ * only asked once the shapes of all its inputs are known.
+ */
+static void
+setup_static_shapes (UfoTaskGraph *task_graph,
+                     TaskLocalData **tlds)
+{
+    guint n_nodes;
+    gboolean *visited;
+    gboolean progress = TRUE;
+
+    n_nodes = ufo_graph_get_num_nodes (UFO_GRAPH (task_graph));
+    visited = g_new0 (gboolean, n_nodes);
+
+    while (progress) {
+        progress = FALSE;
+
+        for (guint i = 0; i < n_nodes; i++) {
+            TaskLocalData *tld = tlds[i];
+            UfoRequisition *inputs;
+            GList *predecessors;
+            gboolean ready = TRUE;
+            gboolean known = !UFO_IS_REMOTE_TASK (tld->task);
+
+            if (visited[i])
+                continue;
+
+            predecessors = ufo_graph_get_predecessors (UFO_GRAPH (task_graph), UFO_NODE (tld->task));
+            inputs = g_new0 (UfoRequisition, tld->n_inputs + 1);
+
+            for (GList *it = g_list_first (predecessors); it != NULL; it = g_list_next (it)) {
+                gint j = find_task (tlds, n_nodes, UFO_NODE (it->data));
+                guint pos = (guint) GPOINTER_TO_INT (ufo_graph_get_edge_label (UFO_GRAPH (task_graph),
+                                                                               UFO_NODE (it->data),
+                                                                               UFO_NODE (tld->task)));
+
+                if (j < 0 || !visited[j])
+                    ready = FALSE;
+                else if (!tlds[j]->static_shape || pos >= tld->n_inputs)
+                    known = FALSE;
+                else
+                    inputs[pos] = tlds[j]->static_requisition;
+            }
+
+            if (ready) {
+                visited[i] = TRUE;
+                progress = TRUE;
+
+                if (known)
+                    tld->static_shape = ufo_task_get_static_requisition (tld->task,
+                                                                         tld->n_inputs > 0 ? inputs : NULL,
+                                                                         &tld->static_requisition);
+            }
+
+            g_free (inputs);
+            g_list_free (predecessors);
+        }
+    }
+
+    for (guint i = 0; i < n_nodes; i++) {
+        TaskLocalData *tld = tlds[i];
+        UfoGroup *group;
+
+        if (!tld->static_shape || tld->static_requisition.n_dims == 0)
+            continue;
+
+        /* In-place tasks pass their inputs on and need few buffers of their own */
+        if (get_in_place_input (tld) >= 0)
+            continue;
+
+        group = ufo_task_node_get_out_group (UFO_TASK_NODE (tld->task));
+        ufo_group_preallocate (group, &tld->static_requisition,
+                               UFO_IS_GPU_TASK (tld->task) ? UFO_BUFFER_LOCATION_DEVICE : UFO_BUFFER_LOCATION_HOST);
+        g_debug ("Preallocated output buffers of %s",
+                 ufo_task_node_get_unique_name (UFO_TASK_NODE (tld->task)));
+    }
+
+    g_free (visited);
+}
+
 static GList *
 setup_groups (UfoSchedulerPrivate *priv,
               UfoTaskGraph *task_graph)
@@ -846,6 +1617,7 @@ setup_groups (UfoSchedulerPrivate *priv,
         UfoNode *node;
         UfoGroup *group;
         UfoSendPattern pattern;
+        guint batch_size;
 
         node = UFO_NODE (it->data);
         successors = ufo_graph_get_successors (UFO_GRAPH (task_graph), node);
@@ -854,11 +1626,13 @@ setup_groups (UfoSchedulerPrivate *priv,
         group = ufo_group_new (successors, context, pattern);
         groups = g_list_append (groups, group);
         ufo_task_node_set_out_group (UFO_TASK_NODE (node), group);
+        batch_size = ufo_task_get_batch_size (UFO_TASK (node));
 
         for (GList *jt = g_list_first (successors); jt != NULL; jt = g_list_next (jt)) {
             UfoNode *target;
             gpointer label;
             guint input_pos;
+            guint target_batch_size;
 
             target = UFO_NODE (jt->data);
             label = ufo_graph_get_edge_label (UFO_GRAPH (task_graph), node, target);
@@ -869,6 +1643,36 @@ setup_groups (UfoSchedulerPrivate *priv,
             gint num_expected = ufo_task_node_get_num_expected (UFO_TASK_NODE (target), input_pos);
             trace (g_strdup_printf("num_expected: %d", num_expected), NULL);
             ufo_group_set_num_expected (group, UFO_TASK (target), num_expected);
+
+            /*
+             * Batching producers and consumers hold several buffers at once,
+             * make sure enough of them circulate to avoid a deadlock.
+             */
+            target_batch_size = ufo_task_get_batch_size (UFO_TASK (target));
+
+            if (batch_size > 1 || target_batch_size > 1)
+                ufo_group_set_min_capacity (group, UFO_TASK (target),
+                                            batch_size + target_batch_size + 1);
+
+            /* Asynchronous targets keep inputs until their frames finished */
+            if (UFO_IS_GPU_TASK (target) &&
+                ufo_gpu_task_has_async (UFO_GPU_TASK (target), UFO_TASK_MODE_PROCESSOR))
+                ufo_group_set_min_capacity (group, UFO_TASK (target),
+                                            ufo_group_get_num_targets (group) + 1 + MAX_ASYNC_IN_FLIGHT);
+
+            /* In-place targets keep input buffers for a while */
+            if (ufo_task_can_process_in_place (UFO_TASK (target), input_pos))
+                ufo_group_set_min_capacity (group, UFO_TASK (target),
+                                            ufo_group_get_num_targets (group) + 1 + MAX_IN_PLACE_IN_FLIGHT);
+
+            /* Stage host data for a GPU on the memory node it is attached to */
+            if (UFO_IS_GPU_TASK (target)) {
+                UfoNode *proc_node = ufo_task_node_get_proc_node (UFO_TASK_NODE (target));
+
+                if (proc_node != NULL && UFO_IS_GPU_NODE (proc_node))
+                    ufo_group_set_numa_node (group, UFO_TASK (target),
+                                             ufo_gpu_node_get_numa_node (UFO_GPU_NODE (proc_node)));
+            }
         }
 
         g_list_free (successors);
@@ -885,6 +1689,338 @@ setup_groups (UfoSchedulerPrivate *priv,
     return groups;
 }
 
+static guint
+count_inputs_at (UfoGraph *graph,
+                 UfoNode *node,
+                 gpointer label)
+{
+    GList *predecessors;
+    guint n = 0;
+
+    predecessors = ufo_graph_get_predecessors (graph, node);
+
+    for (GList *it = g_list_first (predecessors); it != NULL; it = g_list_next (it)) {
+        if (ufo_graph_get_edge_label (graph, UFO_NODE (it->data), node) == label)
+            n++;
+    }
+
+    g_list_free (predecessors);
+    return n;
+}
+
+/*
+ * Route the items of each replicated sub-graph so that its tail reads them in
+ * the order the head scattered them, and start with a single active replica.
+ */
+static GList *
+setup_adaptive_sets (UfoTaskGraph *task_graph)
+{
+    UfoGraph *graph = UFO_GRAPH (task_graph);
+    GList *sets = NULL;
+    guint n_sets;
+
+    n_sets = ufo_task_graph_get_num_replica_sets (task_graph);
+
+    for (guint i = 0; i < n_sets; i++) {
+        UfoTaskNode *head;
+        UfoTaskNode *tail;
+        GList *entries;
+        GList *exits;
+        UfoGroup *group;
+        GAsyncQueue *route;
+        AdaptiveSet *set;
+        gpointer label;
+        guint n_replicas;
+
+        ufo_task_graph_get_replica_set (task_graph, i, &head, &tail, &entries, &exits);
+        group = ufo_task_node_get_out_group (head);
+        n_replicas = g_list_length (entries);
+        label = ufo_graph_get_edge_label (graph, UFO_NODE (exits->data), UFO_NODE (tail));
+
+        /* Only route streams that are scattered among the replicas alone */
+        if (group == NULL ||
+            ufo_task_node_get_send_pattern (head) != UFO_SEND_SCATTER ||
+            ufo_group_get_num_targets (group) != n_replicas ||
+            count_inputs_at (graph, UFO_NODE (tail), label) != n_replicas) {
+            g_debug ("Cannot adapt replicas fed by %s", ufo_task_node_get_unique_name (head));
+            continue;
+        }
+
+        set = g_new0 (AdaptiveSet, 1);
+        set->group = group;
+        set->entries = g_list_copy (entries);
+        set->tail = UFO_TASK (tail);
+        set->name = ufo_task_node_get_unique_name (UFO_TASK_NODE (entries->data));
+
+        if (set->name == NULL)
+            set->name = G_OBJECT_TYPE_NAME (entries->data);
+        set->n_replicas = n_replicas;
+        set->n_active = 1;
+        set->n_max_active = 1;
+
+        for (GList *it = g_list_first (exits); it != NULL; it = g_list_next (it))
+            set->exit_groups = g_list_append (set->exit_groups, ufo_task_node_get_out_group (UFO_TASK_NODE (it->data)));
+
+        route = g_async_queue_new ();
+
+        for (guint j = 0; j < n_replicas; j++) {
+            UfoTask *entry = UFO_TASK (g_list_nth_data (entries, j));
+
+            ufo_group_set_route (group, entry, route, j);
+            ufo_group_set_target_active (group, entry, j == 0);
+        }
+
+        ufo_task_node_set_in_group_route (tail, (guint) GPOINTER_TO_INT (label), route, set->exit_groups);
+        g_async_queue_unref (route);
+
+        g_debug ("Adapting %u replicas of %s", n_replicas, set->name);
+        sets = g_list_append (sets, set);
+    }
+
+    return sets;
+}
+
+static gdouble
+get_fill_level (UfoGroup *group,
+                UfoTask *target)
+{
+    guint capacity = ufo_group_get_capacity (group, target);
+    return capacity > 0 ? ((gdouble) ufo_group_get_num_queued (group, target)) / capacity : 0.0;
+}
+
+static void
+adapt_replicas (AdaptiveSet *set)
+{
+    gdouble input = 0.0;
+    gdouble output = 0.0;
+
+    for (guint i = 0; i < set->n_active; i++) {
+        input += get_fill_level (set->group, UFO_TASK (g_list_nth_data (set->entries, i)));
+        output += get_fill_level (UFO_GROUP (g_list_nth_data (set->exit_groups, i)), set->tail);
+    }
+
+    input /= set->n_active;
+    output /= set->n_active;
+
+    /*
+     * Full inputs mean the replicas cannot keep up. If their outputs fill up
+     * as well, the tail is the bottleneck and more replicas would not help.
+     */
+    set->n_busy = input >= ADAPTIVE_HIGH && output < ADAPTIVE_HIGH ? set->n_busy + 1 : 0;
+    set->n_idle = input == 0.0 ? set->n_idle + 1 : 0;
+
+    if (set->n_busy >= ADAPTIVE_BUSY_SAMPLES && set->n_active < set->n_replicas) {
+        ufo_group_set_target_active (set->group, UFO_TASK (g_list_nth_data (set->entries, set->n_active)), TRUE);
+        set->n_active++;
+        set->n_max_active = MAX (set->n_max_active, set->n_active);
+        set->n_busy = 0;
+        g_debug ("Resumed replica of %s, %u of %u active", set->name, set->n_active, set->n_replicas);
+    }
+    else if (set->n_idle >= ADAPTIVE_IDLE_SAMPLES && set->n_active > 1) {
+        set->n_active--;
+        ufo_group_set_target_active (set->group, UFO_TASK (g_list_nth_data (set->entries, set->n_active)), FALSE);
+        set->n_idle = 0;
+        g_debug ("Parked replica of %s, %u of %u active", set->name, set->n_active, set->n_replicas);
+    }
+}
+
+static gpointer
+monitor_replicas (AdaptiveMonitor *monitor)
+{
+    while (g_atomic_int_get (&monitor->running)) {
+        g_usleep (ADAPTIVE_INTERVAL);
+        g_list_foreach (monitor->sets, (GFunc) adapt_replicas, NULL);
+    }
+
+    return NULL;
+}
+
+static void
+free_adaptive_set (AdaptiveSet *set)
+{
+    g_message ("Finished with %u of %u replicas of %s active, at most %u",
+               set->n_active, set->n_replicas, set->name, set->n_max_active);
+
+    g_list_free (set->entries);
+    g_list_free (set->exit_groups);
+    g_free (set);
+}
+
+/*
+ * Order in which CPUs are handed out: neighbouring CPUs for compact placement,
+ * alternating between sockets for scattered placement.
+ */
+static GList *
+get_cpu_order (UfoArchGraph *arch_graph,
+               UfoThreadPlacement placement)
+{
+    GList *cpus;
+    GPtrArray *packages;
+    GList *order = NULL;
+    guint n_cpus;
+
+    cpus = ufo_arch_graph_get_cpu_nodes (arch_graph);
+
+    if (placement != UFO_THREAD_PLACEMENT_SCATTER)
+        return cpus;
+
+    n_cpus = g_list_length (cpus);
+    packages = g_ptr_array_new ();
+
+    for (GList *it = g_list_first (cpus); it != NULL; it = g_list_next (it)) {
+        guint package = ufo_cpu_node_get_package (UFO_CPU_NODE (it->data));
+
+        while (packages->len <= package)
+            g_ptr_array_add (packages, NULL);
+
+        g_ptr_array_index (packages, package) = g_list_append (g_ptr_array_index (packages, package), it->data);
+    }
+
+    while (g_list_length (order) < n_cpus) {
+        for (guint i = 0; i < packages->len; i++) {
+            GList *package = g_ptr_array_index (packages, i);
+
+            if (package != NULL) {
+                order = g_list_append (order, package->data);
+                g_ptr_array_index (packages, i) = g_list_delete_link (package, package);
+            }
+        }
+    }
+
+    g_ptr_array_free (packages, TRUE);
+    g_list_free (cpus);
+    return order;
+}
+
+/* Get the GPU that @tld runs on or directly feeds, if any */
+static UfoGpuNode *
+get_fed_gpu_node (TaskLocalData *tld)
+{
+    GList *candidates = g_list_prepend (g_list_copy (tld->successors), tld->task);
+    UfoGpuNode *gpu_node = NULL;
+
+    for (GList *it = g_list_first (candidates); it != NULL && gpu_node == NULL; it = g_list_next (it)) {
+        UfoNode *proc_node;
+
+        if (!UFO_IS_GPU_TASK (it->data))
+            continue;
+
+        proc_node = ufo_task_node_get_proc_node (UFO_TASK_NODE (it->data));
+
+        if (UFO_IS_GPU_NODE (proc_node))
+            gpu_node = UFO_GPU_NODE (proc_node);
+    }
+
+    g_list_free (candidates);
+    return gpu_node;
+}
+
+static UfoCpuNode *
+get_next_local_cpu (UfoArchGraph *arch_graph,
+                    UfoGpuNode *gpu_node,
+                    GList *pool,
+                    GHashTable *n_placed)
+{
+    GList *local;
+    GList *available = NULL;
+    guint n;
+    UfoCpuNode *cpu = NULL;
+
+    local = ufo_arch_graph_get_local_cpu_nodes (arch_graph, gpu_node);
+
+    for (GList *it = g_list_first (local); it != NULL; it = g_list_next (it)) {
+        if (g_list_find (pool, it->data) != NULL)
+            available = g_list_append (available, it->data);
+    }
+
+    if (available != NULL) {
+        n = GPOINTER_TO_UINT (g_hash_table_lookup (n_placed, gpu_node));
+        cpu = UFO_CPU_NODE (g_list_nth_data (available, n % g_list_length (available)));
+        g_hash_table_insert (n_placed, gpu_node, GUINT_TO_POINTER (n + 1));
+    }
+
+    g_list_free (available);
+    g_list_free (local);
+    return cpu;
+}
+
+/*
+ * Choose a CPU for each task thread according to the configured placement.
+ * Generators may get a CPU of their own, the remaining threads are handed the
+ * CPUs in turn and share them if there are more threads than CPUs.
+ */
+static void
+place_threads (UfoSchedulerPrivate *priv,
+               UfoArchGraph *arch_graph,
+               TaskLocalData **tlds,
+               guint n_nodes)
+{
+    UfoThreadPlacement placement;
+    gboolean reserve;
+    GList *pool;
+    GList *next;
+    GHashTable *n_placed;
+    GString *report;
+
+    g_object_get (G_OBJECT (priv->config),
+                  "thread-placement", &placement,
+                  "reserve-generator-cpus", &reserve,
+                  NULL);
+
+    if (placement == UFO_THREAD_PLACEMENT_NONE)
+        return;
+
+    pool = get_cpu_order (arch_graph, placement);
+
+    if (pool == NULL)
+        return;
+
+    if (reserve) {
+        for (guint i = 0; i < n_nodes; i++) {
+            if (tlds[i]->mode == UFO_TASK_MODE_GENERATOR && g_list_next (pool) != NULL) {
+                tlds[i]->cpu = UFO_CPU_NODE (pool->data);
+                pool = g_list_delete_link (pool, pool);
+            }
+        }
+    }
+
+    next = pool;
+    n_placed = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    for (guint i = 0; i < n_nodes; i++) {
+        UfoGpuNode *gpu_node = NULL;
+
+        if (tlds[i]->cpu != NULL)
+            continue;
+
+        if (placement == UFO_THREAD_PLACEMENT_DEVICE)
+            gpu_node = get_fed_gpu_node (tlds[i]);
+
+        if (gpu_node != NULL)
+            tlds[i]->cpu = get_next_local_cpu (arch_graph, gpu_node, pool, n_placed);
+
+        if (tlds[i]->cpu == NULL) {
+            tlds[i]->cpu = UFO_CPU_NODE (next->data);
+            next = g_list_next (next) != NULL ? g_list_next (next) : pool;
+        }
+    }
+
+    report = g_string_new ("Thread placement:");
+
+    for (guint i = 0; i < n_nodes; i++) {
+        g_string_append_printf (report, "\n  %s: CPU %u (socket %u)",
+                                get_task_name (UFO_TASK_NODE (tlds[i]->task)),
+                                ufo_cpu_node_get_id (tlds[i]->cpu),
+                                ufo_cpu_node_get_package (tlds[i]->cpu));
+    }
+
+    g_message ("%s", report->str);
+
+    g_string_free (report, TRUE);
+    g_hash_table_destroy (n_placed);
+    g_list_free (pool);
+}
+
 static gboolean
 correct_connections (UfoTaskGraph *graph,
                      GError **error)
@@ -1050,13 +2186,6 @@ write_traces (TaskLocalData **tlds,
     g_list_free (sorted);
 }
 
-static void
-join_threads (GThread **threads, guint n_threads)
-{
-    for (guint i = 0; i < n_threads; i++)
-        g_thread_join (threads[i]);
-}
-
 static gboolean
 is_gpu_node (UfoNode *node, gpointer user_data)
 {
@@ -1073,6 +2202,8 @@ ufo_scheduler_run (UfoScheduler *scheduler,
     GList *groups;
     guint n_nodes;
     GThread **threads;
+    GThread *monitor_thread;
+    AdaptiveMonitor monitor;
     TaskLocalData **tlds;
     GTimer *timer;
 
@@ -1099,6 +2230,10 @@ ufo_scheduler_run (UfoScheduler *scheduler,
 
     if (priv->expand) {
         gboolean expand_remote = priv->mode == UFO_REMOTE_MODE_STREAM;
+        guint cpu_replicas;
+
+        g_object_get (G_OBJECT (priv->config), "cpu-replicas", &cpu_replicas, NULL);
+        ufo_task_graph_set_cpu_replicas (task_graph, cpu_replicas);
         ufo_task_graph_expand (task_graph, arch_graph,
                                expand_remote, !disable_gpu, use_network_writer);
     }
@@ -1117,6 +2252,9 @@ ufo_scheduler_run (UfoScheduler *scheduler,
     propagate_partition (task_graph);
     ufo_task_graph_map (task_graph, arch_graph);
 
+    if (priv->fuse)
+        ufo_task_graph_fuse (task_graph);
+
     /* Prepare task structures */
     tlds = setup_tasks (priv, task_graph, error);
 
@@ -1129,18 +2267,29 @@ ufo_scheduler_run (UfoScheduler *scheduler,
     gboolean has_remote_nodes = n_remotes > 0;
 
     // group system is only used when operating locally
-    if (!has_remote_nodes)
+    if (!has_remote_nodes) {
         groups = setup_groups (priv, task_graph);
+        setup_static_shapes (task_graph, tlds);
+    }
 
     if (!correct_connections (task_graph, error))
         return;
 
     n_nodes = ufo_graph_get_num_nodes (UFO_GRAPH (task_graph));
     threads = g_new0 (GThread *, n_nodes);
+    place_threads (priv, arch_graph, tlds, n_nodes);
     timer = g_timer_new ();
 
     static_context = ufo_resources_get_context (priv->resources);
 
+    monitor.sets = NULL;
+    monitor.running = TRUE;
+    monitor_thread = NULL;
+    priv->max_active_replicas = 0;
+
+    if (priv->adaptive && !has_remote_nodes)
+        monitor.sets = setup_adaptive_sets (task_graph);
+
     /* Spawn threads */
     for (guint i = 0; i < n_nodes; i++) {
         if (has_remote_nodes)
@@ -1152,6 +2301,9 @@ ufo_scheduler_run (UfoScheduler *scheduler,
             return;
     }
 
+    if (monitor.sets != NULL)
+        monitor_thread = g_thread_create ((GThreadFunc) monitor_replicas, &monitor, TRUE, NULL);
+
 #ifdef HAVE_PYTHON
     if (Py_IsInitialized ()) {
         Py_BEGIN_ALLOW_THREADS
@@ -1167,6 +2319,19 @@ ufo_scheduler_run (UfoScheduler *scheduler,
     join_threads (threads, n_nodes);
 #endif
 
+    if (monitor_thread != NULL) {
+        g_atomic_int_set (&monitor.running, FALSE);
+        g_thread_join (monitor_thread);
+    }
+
+    for (GList *it = g_list_first (monitor.sets); it != NULL; it = g_list_next (it)) {
+        AdaptiveSet *set = (AdaptiveSet *) it->data;
+        priv->max_active_replicas = MAX (priv->max_active_replicas, set->n_max_active);
+    }
+
+    g_list_foreach (monitor.sets, (GFunc) free_adaptive_set, NULL);
+    g_list_free (monitor.sets);
+
 #ifdef HAVE_PYTHON
     if (Py_IsInitialized ())
 #endif
@@ -1174,6 +2339,7 @@ ufo_scheduler_run (UfoScheduler *scheduler,
     g_message ("Processing finished after %3.5fs", g_timer_elapsed (timer, NULL));
     g_message ("Processing finished after %3.5fs", g_timer_elapsed (timer, NULL));
 
+    record_costs (task_graph, tlds, n_nodes, g_timer_elapsed (timer, NULL));
     g_timer_destroy (timer);
 
     /* Cleanup */
@@ -1235,6 +2401,14 @@ ufo_scheduler_set_property (GObject      *object,
             priv->expand = g_value_get_boolean (value);
             break;
 
+        case PROP_ADAPTIVE:
+            priv->adaptive = g_value_get_boolean (value);
+            break;
+
+        case PROP_FUSE:
+            priv->fuse = g_value_get_boolean (value);
+            break;
+
         case PROP_ENABLE_TRACING:
             priv->trace = g_value_get_boolean (value);
             break;
@@ -1258,6 +2432,18 @@ ufo_scheduler_get_property (GObject      *object,
             g_value_set_boolean (value, priv->expand);
             break;
 
+        case PROP_ADAPTIVE:
+            g_value_set_boolean (value, priv->adaptive);
+            break;
+
+        case PROP_MAX_ACTIVE_REPLICAS:
+            g_value_set_uint (value, priv->max_active_replicas);
+            break;
+
+        case PROP_FUSE:
+            g_value_set_boolean (value, priv->fuse);
+            break;
+
         case PROP_ENABLE_TRACING:
             g_value_set_boolean (value, priv->trace);
             break;
@@ -1365,6 +2551,27 @@ ufo_scheduler_class_init (UfoSchedulerClass *klass)
                               TRUE,
                               G_PARAM_READWRITE);
 
+    properties[PROP_ADAPTIVE] =
+        g_param_spec_boolean ("adaptive",
+                              "Resume and park replicated tasks at run-time",
+                              "Resume and park replicated tasks depending on how full their queues are",
+                              FALSE,
+                              G_PARAM_READWRITE);
+
+    properties[PROP_MAX_ACTIVE_REPLICAS] =
+        g_param_spec_uint ("max-active-replicas",
+                           "Largest number of replicas active at once",
+                           "Largest number of replicas of a task that were active at once during the last adaptive run",
+                           0, G_MAXUINT, 0,
+                           G_PARAM_READABLE);
+
+    properties[PROP_FUSE] =
+        g_param_spec_boolean ("fuse",
+                              "Fuse chains of GPU tasks",
+                              "Run chains of GPU tasks on the same device in a single thread",
+                              FALSE,
+                              G_PARAM_READWRITE);
+
     properties[PROP_ENABLE_TRACING] =
         g_param_spec_boolean ("enable-tracing",
                               "Enable and write profile traces",
@@ -1398,7 +2605,10 @@ ufo_scheduler_init (UfoScheduler *scheduler)
 
     scheduler->priv = priv = UFO_SCHEDULER_GET_PRIVATE (scheduler);
     priv->expand = TRUE;
+    priv->adaptive = FALSE;
+    priv->fuse = FALSE;
     priv->trace = FALSE;
+    priv->max_active_replicas = 0;
     priv->config = NULL;
     priv->resources = NULL;
     priv->remotes = NULL;
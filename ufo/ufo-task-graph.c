@@ -18,6 +18,12 @@
  */
 
 #include <string.h>
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
 #include <json-glib/json-glib.h>
 #include <ufo/ufo-task-graph.h>
 #include <ufo/ufo-task-node.h>
@@ -25,8 +31,11 @@
 #include <ufo/ufo-cpu-task-iface.h>
 #include <ufo/ufo-gpu-task-iface.h>
 #include <ufo/ufo-input-task.h>
+#include <ufo/ufo-output-task.h>
 #include <ufo/ufo-dummy-task.h>
 #include <ufo/ufo-remote-task.h>
+#include <ufo/ufo-gpu-node.h>
+#include <ufo/ufo-fused-task.h>
 
 /**
  * SECTION:ufo-task-graph
@@ -45,8 +54,37 @@ struct _UfoTaskGraphPrivate {
     GList *remote_tasks;
     guint index;
     guint total;
+    GHashTable *costs;      /* maps cost key of a node to TaskCost */
+    guint cpu_replicas;
+    gdouble bandwidth;      /* host-device bytes/s, measured if 0 */
+    gchar *expansion;       /* report of the last expansion */
+    GList *replica_sets;    /* list of ReplicaSet */
+    gdouble predicted;
+    gchar *plan;
 };
 
+typedef struct {
+    gdouble time;           /* accumulated seconds */
+    gdouble n_items;
+    gsize   bytes;          /* output size per item */
+} TaskCost;
+
+typedef struct {
+    UfoNode *head;
+    UfoNode *tail;
+    GList   *entries;       /* first node of each copy, original first */
+    GList   *exits;         /* node of each copy that feeds the tail */
+} ReplicaSet;
+
+/* Transfer bandwidth in bytes/s if it cannot be measured */
+#define DEFAULT_TRANSFER_BANDWIDTH  6.0e9
+
+/* Size of the upload timed to measure the transfer bandwidth */
+#define BANDWIDTH_PROBE_SIZE        (16 * 1024 * 1024)
+
+/* Replicate a path only as long as it gains more than this fraction */
+#define REPLICATION_TOLERANCE 0.05
+
 typedef enum {
     JSON_FILE,
     JSON_DATA
@@ -471,296 +509,1683 @@ ufo_task_graph_get_writer_node (UfoTaskGraph *task_graph)
     return (UfoNode *) g_list_nth_data (allnodes, 0);
 }
 
-/**
- * ufo_task_graph_expand:
- * @task_graph: A #UfoTaskGraph
- * @arch_graph: A #UfoArchGraph
- * @expand_remote: %TRUE if remote nodes should be inserted
- * @expand_gpu: %FALSE if the master node should not use gpus for computing
- * @use_network_writer: %TRUE if the last remote node should be used for dedicated
- *                      writing (no computation)
- *
- * Expands @task_graph in a way that most of the resources in @arch_graph can be
- * occupied. In the simple pipeline case, the longest possible GPU paths are
- * duplicated as much as there are GPUs in @arch_graph.
+static const gchar *
+get_node_name (UfoNode *node)
+{
+    const gchar *name = ufo_task_node_get_unique_name (UFO_TASK_NODE (node));
+    return name != NULL ? name : G_OBJECT_TYPE_NAME (node);
+}
+
+static const gchar *
+get_plugin_name (UfoNode *node)
+{
+    const gchar *name = ufo_task_node_get_plugin_name (UFO_TASK_NODE (node));
+    return name != NULL ? name : G_OBJECT_TYPE_NAME (node);
+}
+
+/*
+ * Costs are kept per node of the original graph, so that two instances of a
+ * plugin get their own estimate while copies made by the expansion share the
+ * one of their original. The key numbers the original nodes of a plugin in
+ * graph order and thus stays valid when the same graph is built again.
  */
-void
-ufo_task_graph_expand (UfoTaskGraph *task_graph,
-                       UfoArchGraph *arch_graph,
-                       gboolean expand_remote,
-                       gboolean expand_gpu,
-                       gboolean network_writer)
+static gchar *
+get_cost_key (UfoTaskGraph *task_graph,
+              UfoNode *node)
 {
-    UfoTaskGraphPrivate *priv = UFO_TASK_GRAPH_GET_PRIVATE (task_graph);
-    GList *paths;
-    GList *path;
+    const gchar *name = get_plugin_name (node);
+    GList *nodes;
+    guint number = 0;
 
-    g_return_if_fail (UFO_IS_TASK_GRAPH (task_graph));
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (task_graph));
 
-    paths = ufo_graph_get_paths (UFO_GRAPH (task_graph), is_gpu_task);
-    g_debug ("Number of identified paths: %i", g_list_length (paths));
-    paths = remove_common_ancestry_paths (paths);
-    g_debug ("Number of cleaned paths: %i", g_list_length (paths));
-    path = find_longest_path (paths);
+    for (GList *it = g_list_first (nodes); it != NULL; it = g_list_next (it)) {
+        UfoNode *other = UFO_NODE (it->data);
 
-    GList *remotes = ufo_arch_graph_get_remote_nodes (arch_graph);
+        if (ufo_node_get_index (other) != 0 || g_strcmp0 (get_plugin_name (other), name))
+            continue;
 
-    UfoRemoteNode *writer_remote = NULL;
-    if (network_writer) {
-        // last remote reserved for writer
-        GList *last_remote = g_list_last (remotes);
-        if (last_remote != NULL) {
-            writer_remote = UFO_REMOTE_NODE (last_remote->data);
-            remotes = g_list_remove (remotes, writer_remote);
-        }
+        if (ufo_node_equal (other, node))
+            break;
+
+        number++;
     }
 
-    if (path != NULL) {
-        guint n_gpus;
+    g_list_free (nodes);
+    return g_strdup_printf ("%s-%u", name, number);
+}
 
-        guint n_remotes = g_list_length (remotes);
-        if (expand_remote && n_remotes > 0) {
-            g_debug ("Expand for %i remote nodes", n_remotes);
-            expand_remotes (task_graph, remotes, path);
+static gboolean
+lookup_cost (UfoTaskGraph *task_graph,
+             UfoNode *node,
+             gdouble *time,
+             gsize *bytes)
+{
+    TaskCost *cost;
+    gchar *key;
 
-            g_list_free (remotes);
-        }
+    key = get_cost_key (task_graph, node);
+    cost = g_hash_table_lookup (task_graph->priv->costs, key);
+    g_free (key);
 
-        if (expand_gpu) {
-            n_gpus = ufo_arch_graph_get_num_gpus (arch_graph);
-            g_debug ("Expand for %i GPU nodes", n_gpus);
+    if (cost == NULL || cost->n_items <= 0.0)
+        return FALSE;
 
-            for (guint i = 1; i < n_gpus; i++)
-                ufo_graph_expand (UFO_GRAPH (task_graph), path);
-        }
+    *time = cost->time / cost->n_items;
+    *bytes = cost->bytes;
+    return TRUE;
+}
 
-        // only execute on main runner, not on ufod
-        if (network_writer && expand_remote && g_list_length (remotes) > 0) {
-            // find the writer task
-            UfoNode *writer_node = ufo_task_graph_get_writer_node (task_graph);
-            g_assert (writer_node != NULL);
-            // create a remote node for it
-            UfoTaskGraph *remote_graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
-            UfoTaskNode *writer_task = UFO_TASK_NODE (writer_node);
+/**
+ * ufo_task_graph_add_cost_sample:
+ * @task_graph: A #UfoTaskGraph
+ * @node: A #UfoTaskNode
+ * @seconds: Time @node spent processing @n_items
+ * @n_items: Number of processed items
+ * @bytes: Size of one output item in bytes
+ *
+ * Record a timing of @node for the cost model used by ufo_task_graph_expand()
+ * and ufo_task_graph_map(). Samples are accumulated per node, copies made by
+ * ufo_task_graph_expand() contribute to the estimate of their original. The
+ * scheduler adds samples after each run.
+ */
+void
+ufo_task_graph_add_cost_sample (UfoTaskGraph *task_graph,
+                                UfoTaskNode *node,
+                                gdouble seconds,
+                                guint n_items,
+                                gsize bytes)
+{
+    UfoTaskGraphPrivate *priv;
+    gchar *key;
+    TaskCost *cost;
 
-            // construct a remote graph that we send to the rmeote (only thewriter node)
-            UfoTaskNode *dummy = UFO_TASK_NODE (ufo_dummy_task_new ());
-            ufo_task_graph_connect_nodes (remote_graph, dummy, writer_task);
-            gchar *json;
-            json = ufo_task_graph_get_json_data (remote_graph, NULL);
-            ufo_remote_node_send_json (writer_remote, UFO_REMOTE_MODE_STREAM, json);
+    g_return_if_fail (UFO_IS_TASK_GRAPH (task_graph) && UFO_IS_TASK_NODE (node));
 
-            // create the mapping RemoteTask<->RemoteNode
-            UfoTaskNode *remote_task = UFO_TASK_NODE (ufo_remote_task_new ());
-            priv->remote_tasks = g_list_append (priv->remote_tasks, remote_task);
-            ufo_task_node_set_proc_node (remote_task, UFO_NODE (writer_remote));
+    if (n_items == 0)
+        return;
 
-            // remove all edges to the local writer task node
-            // re-connect all edges  to the remote task
-            ufo_graph_replace_node (UFO_GRAPH (task_graph), UFO_NODE (writer_task), UFO_NODE (remote_task));
-        }
+    priv = task_graph->priv;
+    key = get_cost_key (task_graph, UFO_NODE (node));
+    cost = g_hash_table_lookup (priv->costs, key);
+
+    if (cost == NULL) {
+        cost = g_new0 (TaskCost, 1);
+        g_hash_table_insert (priv->costs, key, cost);
     }
+    else
+        g_free (key);
 
-    g_list_foreach (paths, (GFunc) g_list_free, NULL);
-    g_list_free (paths);
+    cost->time += seconds;
+    cost->n_items += n_items;
+    cost->bytes = bytes;
 }
 
 /**
- * ufo_task_graph_fuse:
+ * ufo_task_graph_save_costs:
  * @task_graph: A #UfoTaskGraph
+ * @filename: Path of the file to write
+ * @error: Location for a #GError or %NULL
  *
- * Fuses task nodes to increase data locality.
+ * Store the recorded per-item timings and output sizes, so that a later run can
+ * be planned with ufo_task_graph_load_costs().
  *
- * Note: This is not implemented and a no-op right now.
+ * Returns: %TRUE on success.
  */
-void
-ufo_task_graph_fuse (UfoTaskGraph *task_graph)
+gboolean
+ufo_task_graph_save_costs (UfoTaskGraph *task_graph,
+                           const gchar *filename,
+                           GError **error)
 {
-}
+    GKeyFile *key_file;
+    GHashTableIter iter;
+    gpointer key;
+    gpointer value;
+    gchar *data;
+    gsize length;
+    gboolean success;
 
-static void
-map_proc_node (UfoGraph *graph,
-               UfoNode *node,
-               guint proc_index,
-               GList *gpu_nodes)
-{
-    UfoNode *proc_node;
-    GList *successors;
-    guint n_gpus;
+    g_return_val_if_fail (UFO_IS_TASK_GRAPH (task_graph), FALSE);
 
-    proc_node = UFO_NODE (g_list_nth_data (gpu_nodes, proc_index));
+    key_file = g_key_file_new ();
+    g_hash_table_iter_init (&iter, task_graph->priv->costs);
 
-    if ((UFO_IS_GPU_TASK (node) || UFO_IS_INPUT_TASK (node)) &&
-        (!ufo_task_node_get_proc_node (UFO_TASK_NODE (node)))) {
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        TaskCost *cost = (TaskCost *) value;
 
-        g_debug ("Mapping GPU %i to %s-%p",
-                 proc_index, G_OBJECT_TYPE_NAME (node),
-                 (gpointer) node);
+        if (cost->n_items <= 0.0)
+            continue;
 
-        ufo_task_node_set_proc_node (UFO_TASK_NODE (node), proc_node);
+        g_key_file_set_double (key_file, key, "time", cost->time / cost->n_items);
+        g_key_file_set_uint64 (key_file, key, "bytes", cost->bytes);
     }
 
-    n_gpus = g_list_length (gpu_nodes);
-    successors = ufo_graph_get_successors (graph, node);
-
-    for (GList *it = g_list_first (successors); it != NULL; it = g_list_next (it)) {
-        map_proc_node (graph, UFO_NODE (it->data), proc_index, gpu_nodes);
-
-        if (!UFO_IS_REMOTE_TASK (UFO_NODE (it->data)))
-            proc_index = (proc_index + 1) % n_gpus;
-    }
+    data = g_key_file_to_data (key_file, &length, NULL);
+    success = g_file_set_contents (filename, data, (gssize) length, error);
 
-    g_list_free (successors);
+    g_free (data);
+    g_key_file_free (key_file);
+    return success;
 }
 
-
 /**
- * ufo_task_graph_map:
+ * ufo_task_graph_load_costs:
  * @task_graph: A #UfoTaskGraph
- * @arch_graph: A #UfoArchGraph to which @task_graph's nodes are mapped onto
+ * @filename: Path of a file written by ufo_task_graph_save_costs()
+ * @error: Location for a #GError or %NULL
  *
- * Map task nodes of @task_graph to the processing nodes of @arch_graph. Not
- * doing this could break execution of @task_graph.
+ * Load per-item timings of a previous or calibration run. Loaded timings
+ * count as a single sample each.
+ *
+ * Returns: %TRUE on success.
  */
-void
-ufo_task_graph_map (UfoTaskGraph *task_graph,
-                    UfoArchGraph *arch_graph)
+gboolean
+ufo_task_graph_load_costs (UfoTaskGraph *task_graph,
+                           const gchar *filename,
+                           GError **error)
 {
-    GList *gpu_nodes;
-    GList *roots;
+    GKeyFile *key_file;
+    gchar **groups;
 
-    gpu_nodes = ufo_arch_graph_get_gpu_nodes (arch_graph);
-    roots = ufo_graph_get_roots (UFO_GRAPH (task_graph));
+    g_return_val_if_fail (UFO_IS_TASK_GRAPH (task_graph), FALSE);
 
-    for (GList *it = g_list_first (roots); it != NULL; it = g_list_next (it))
-        map_proc_node (UFO_GRAPH (task_graph), UFO_NODE (it->data), 0, gpu_nodes);
+    key_file = g_key_file_new ();
 
-    g_list_free (roots);
-    g_list_free (gpu_nodes);
-}
+    if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, error)) {
+        g_key_file_free (key_file);
+        return FALSE;
+    }
 
-/**
- * ufo_task_graph_connect_nodes:
- * @graph: A #UfoTaskGraph
- * @n1: A source node
- * @n2: A destination node
- *
- * Connect @n1 with @n2 using @n2's default input port. To specify any other
- * port, use ufo_task_graph_connect_nodes_full().
- */
-void
-ufo_task_graph_connect_nodes (UfoTaskGraph *graph,
-                              UfoTaskNode *n1,
-                              UfoTaskNode *n2)
-{
-    ufo_task_graph_connect_nodes_full (graph, n1, n2, 0);
+    groups = g_key_file_get_groups (key_file, NULL);
+
+    for (guint i = 0; groups[i] != NULL; i++) {
+        TaskCost *cost = g_new0 (TaskCost, 1);
+
+        cost->time = g_key_file_get_double (key_file, groups[i], "time", NULL);
+        cost->bytes = (gsize) g_key_file_get_uint64 (key_file, groups[i], "bytes", NULL);
+        cost->n_items = 1.0;
+        g_hash_table_insert (task_graph->priv->costs, g_strdup (groups[i]), cost);
+    }
+
+    g_strfreev (groups);
+    g_key_file_free (key_file);
+    return TRUE;
 }
 
-/**
- * ufo_task_graph_connect_nodes_full:
- * @graph: A #UfoTaskGraph
- * @n1: A source node
- * @n2: A destination node
- * @input: Input port of @n2
- *
- * Connect @n1 with @n2 using @n2's @input port.
+/*
+ * Predicted items per second if @path is replicated @n_replicas times. Each
+ * replica of a GPU path runs on its own GPU, its tasks share that device and
+ * the data entering and leaving the path is transferred to it. The inner
+ * nodes of @path are ordered such that the one feeding the tail comes last.
  */
-void
-ufo_task_graph_connect_nodes_full (UfoTaskGraph *graph,
-                                   UfoTaskNode *n1,
-                                   UfoTaskNode *n2,
-                                   guint input)
+static gdouble
+predict_replicated_path (UfoTaskGraph *task_graph,
+                         GList *nodes,
+                         GList *path,
+                         guint n_replicas)
 {
-    ufo_graph_connect_nodes (UFO_GRAPH (graph), UFO_NODE (n1), UFO_NODE (n2), GINT_TO_POINTER (input));
-}
+    GList *head = g_list_first (path);
+    GList *tail = g_list_last (path);
+    gboolean gpu = UFO_IS_GPU_TASK (g_list_next (head)->data);
+    gdouble bandwidth = task_graph->priv->bandwidth;
+    gdouble other_bound = G_MAXDOUBLE;
+    gdouble max_thread = 0.0;
+    gdouble device = 0.0;
+    gdouble time;
+    gsize bytes;
+
+    for (GList *it = g_list_first (nodes); it != NULL; it = g_list_next (it)) {
+        if (g_list_find (path, it->data) != NULL && it->data != head->data && it->data != tail->data)
+            continue;
+
+        if (lookup_cost (task_graph, UFO_NODE (it->data), &time, &bytes) && time > 0.0)
+            other_bound = MIN (other_bound, 1.0 / time);
+    }
 
-void
-ufo_task_graph_set_partition (UfoTaskGraph *graph,
-                              guint index,
-                              guint total)
-{
-    g_return_if_fail (UFO_IS_TASK_GRAPH (graph));
-    g_assert (index < total);
-    graph->priv->index = index;
-    graph->priv->total = total;
-}
+    if (gpu && !UFO_IS_GPU_TASK (head->data) && lookup_cost (task_graph, UFO_NODE (head->data), &time, &bytes))
+        device += bytes / bandwidth;
 
-void
-ufo_task_graph_get_partition (UfoTaskGraph *graph,
-                              guint *index,
-                              guint *total)
-{
-    g_return_if_fail (UFO_IS_TASK_GRAPH (graph));
-    *index = graph->priv->index;
-    *total = graph->priv->total;
-}
+    for (GList *it = g_list_next (head); it != tail; it = g_list_next (it)) {
+        if (!lookup_cost (task_graph, UFO_NODE (it->data), &time, &bytes))
+            continue;
 
-static void
-add_nodes_from_json (UfoTaskGraph *graph,
-                     JsonNode *root,
-                     GError **error)
-{
-    JsonObject *root_object = json_node_get_object (root);
+        max_thread = MAX (max_thread, time);
 
-    if (json_object_has_member (root_object, "prop-sets")) {
-        JsonObject *sets = json_object_get_object_member (root_object, "prop-sets");
-        json_object_foreach_member (sets, handle_json_prop_set, graph->priv);
+        if (gpu)
+            device += time;
+
+        if (gpu && g_list_next (it) == tail && !UFO_IS_GPU_TASK (tail->data))
+            device += bytes / bandwidth;
     }
 
-    if (json_object_has_member (root_object, "nodes")) {
-        JsonArray *nodes = json_object_get_array_member (root_object, "nodes");
-        GList *elements = json_array_get_elements (nodes);
+    if (MAX (max_thread, device) <= 0.0)
+        return other_bound;
 
-        for (GList *it = g_list_first (elements); it != NULL; it = g_list_next (it)) {
-            if (!handle_json_task_node (it->data, graph->priv, error)) {
-                g_list_free (elements);
-                return;
-            }
-        }
+    return MIN (other_bound, n_replicas / MAX (max_thread, device));
+}
 
-        g_list_free (elements);
+/*
+ * Choose the smallest replication factor up to @max_replicas for @path that
+ * comes close to the best predicted throughput. Without timings for all tasks
+ * of the path, use @max_replicas.
+ */
+static guint
+choose_replication (UfoTaskGraph *task_graph,
+                    GList *path,
+                    guint max_replicas)
+{
+    GList *nodes;
+    gdouble best;
+    guint n_replicas = max_replicas;
+    gdouble time;
+    gsize bytes;
 
-        /*
-         * We only check edges if we have nodes, anything else doesn't make much
-         * sense.
-         */
-        if (json_object_has_member (root_object, "edges")) {
-            JsonArray *edges = json_object_get_array_member (root_object, "edges");
-            json_array_foreach_element (edges, handle_json_task_edge, graph);
+    if (max_replicas <= 1)
+        return max_replicas;
+
+    for (GList *it = g_list_next (g_list_first (path)); it != g_list_last (path); it = g_list_next (it)) {
+        if (!lookup_cost (task_graph, UFO_NODE (it->data), &time, &bytes))
+            return max_replicas;
+    }
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (task_graph));
+    best = predict_replicated_path (task_graph, nodes, path, max_replicas);
+
+    for (guint i = 1; i < max_replicas; i++) {
+        if (predict_replicated_path (task_graph, nodes, path, i) >= (1.0 - REPLICATION_TOLERANCE) * best) {
+            n_replicas = i;
+            break;
         }
     }
+
+    g_list_free (nodes);
+    return n_replicas;
 }
 
+/*
+ * Check if @node implements generate(), i.e. is a generator or a reductor.
+ * Expansion and fusion run before the tasks are set up, when plugins need not
+ * answer ufo_task_get_structure() yet, so the interface is inspected instead.
+ */
 static gboolean
-handle_json_task_node (JsonNode *element,
-                       UfoTaskGraphPrivate *priv,
-                       GError **error)
+implements_generate (UfoNode *node)
 {
-    UfoTaskNode *plugin;
-    JsonObject *object;
-    GError *tmp_error = NULL;
-    const gchar *name;
-    const gchar *plugin_name;
+    if (UFO_IS_GPU_TASK (node)) {
+        UfoGpuTaskIface *defaults = g_type_default_interface_peek (UFO_TYPE_GPU_TASK);
 
-    object = json_node_get_object (element);
-
-    if (!json_object_has_member (object, "plugin") ||
-        !json_object_has_member (object, "name")) {
-        g_set_error (error, UFO_TASK_GRAPH_ERROR, UFO_TASK_GRAPH_ERROR_JSON_KEY,
-                     "Node does not have `plugin' or `name' key");
-        return FALSE;
+        return defaults == NULL || UFO_GPU_TASK_GET_IFACE (node)->generate != defaults->generate;
     }
 
-    plugin_name = json_object_get_string_member (object, "plugin");
-    plugin = ufo_plugin_manager_get_task (priv->manager, plugin_name, &tmp_error);
-    ufo_task_node_set_plugin_name (plugin, plugin_name);
+    if (UFO_IS_CPU_TASK (node)) {
+        UfoCpuTaskIface *defaults = g_type_default_interface_peek (UFO_TYPE_CPU_TASK);
 
-    if (tmp_error != NULL) {
-        g_propagate_error (error, tmp_error);
-        return FALSE;
+        return defaults == NULL || UFO_CPU_TASK_GET_IFACE (node)->generate != defaults->generate;
     }
 
-    name = json_object_get_string_member (object, "name");
+    return TRUE;
+}
+
+static gboolean
+is_replicable (UfoNode *node,
+               gboolean gpu)
+{
+    if (UFO_IS_REMOTE_TASK (node) || UFO_IS_INPUT_TASK (node) || UFO_IS_OUTPUT_TASK (node))
+        return FALSE;
+
+    if (gpu ? !UFO_IS_GPU_TASK (node) : (UFO_IS_GPU_TASK (node) || !UFO_IS_CPU_TASK (node)))
+        return FALSE;
+
+    /* Copies of reductors and generators would each see only part of the data */
+    return !implements_generate (node);
+}
+
+static gboolean
+all_in_list (GList *nodes,
+             GList *list)
+{
+    for (GList *it = g_list_first (nodes); it != NULL; it = g_list_next (it)) {
+        if (g_list_find (list, it->data) == NULL)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Grow the largest sub-graph starting at @entry that only receives data from
+ * @head and only sends data to a single node. Because each copy then gets
+ * whole items from @head, nodes with several inputs can be replicated as long
+ * as all of their inputs lie within the sub-graph. Returns a path of @head,
+ * the nodes of the sub-graph with the one feeding the tail last, and the tail,
+ * or %NULL if there is more than one way out.
+ */
+static GList *
+grow_expandable_path (UfoGraph *graph,
+                      UfoNode *head,
+                      UfoNode *entry)
+{
+    gboolean gpu = UFO_IS_GPU_TASK (entry);
+    GList *inner = g_list_append (NULL, entry);
+    UfoNode *exit = NULL;
+    UfoNode *tail = NULL;
+    GList *path;
+
+    for (GList *it = inner; it != NULL; it = g_list_next (it)) {
+        GList *successors = ufo_graph_get_successors (graph, UFO_NODE (it->data));
+
+        for (GList *jt = g_list_first (successors); jt != NULL; jt = g_list_next (jt)) {
+            UfoNode *successor = UFO_NODE (jt->data);
+            GList *predecessors;
+
+            if (g_list_find (inner, successor) != NULL ||
+                ufo_graph_get_num_successors (graph, successor) == 0 ||
+                !is_replicable (successor, gpu))
+                continue;
+
+            predecessors = ufo_graph_get_predecessors (graph, successor);
+
+            if (all_in_list (predecessors, inner))
+                inner = g_list_append (inner, successor);
+
+            g_list_free (predecessors);
+        }
+
+        g_list_free (successors);
+    }
+
+    for (GList *it = g_list_first (inner); it != NULL; it = g_list_next (it)) {
+        GList *successors = ufo_graph_get_successors (graph, UFO_NODE (it->data));
+
+        for (GList *jt = g_list_first (successors); jt != NULL; jt = g_list_next (jt)) {
+            if (g_list_find (inner, jt->data) != NULL)
+                continue;
+
+            if (tail != NULL) {
+                g_list_free (successors);
+                g_list_free (inner);
+                return NULL;
+            }
+
+            exit = UFO_NODE (it->data);
+            tail = UFO_NODE (jt->data);
+        }
+
+        g_list_free (successors);
+    }
+
+    if (tail == NULL) {
+        g_list_free (inner);
+        return NULL;
+    }
+
+    inner = g_list_remove (inner, exit);
+    path = g_list_prepend (inner, head);
+    path = g_list_append (path, exit);
+    return g_list_append (path, tail);
+}
+
+static gboolean
+path_overlaps (GList *path,
+               GHashTable *taken)
+{
+    for (GList *it = g_list_first (path); it != NULL; it = g_list_next (it)) {
+        if (g_hash_table_lookup (taken, it->data) != NULL)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static gint
+compare_path_length (gconstpointer a,
+                     gconstpointer b)
+{
+    return (gint) g_list_length ((GList *) b) - (gint) g_list_length ((GList *) a);
+}
+
+/*
+ * Find all sub-graphs that can be replicated independently of each other. They
+ * must be fed by a scattering node, otherwise each copy would receive the same
+ * data.
+ */
+static GList *
+find_expandable_paths (UfoGraph *graph)
+{
+    GList *nodes;
+    GList *candidates = NULL;
+    GList *result = NULL;
+    GHashTable *inner;
+    GHashTable *ends;
+
+    nodes = ufo_graph_get_nodes (graph);
+
+    for (GList *it = g_list_first (nodes); it != NULL; it = g_list_next (it)) {
+        UfoNode *head = UFO_NODE (it->data);
+        GList *successors;
+
+        if (ufo_task_node_get_send_pattern (UFO_TASK_NODE (head)) != UFO_SEND_SCATTER)
+            continue;
+
+        successors = ufo_graph_get_successors (graph, head);
+
+        for (GList *jt = g_list_first (successors); jt != NULL; jt = g_list_next (jt)) {
+            UfoNode *entry = UFO_NODE (jt->data);
+            GList *path;
+
+            if (ufo_graph_get_num_predecessors (graph, entry) != 1 ||
+                ufo_graph_get_num_successors (graph, entry) == 0 ||
+                !is_replicable (entry, UFO_IS_GPU_TASK (entry)))
+                continue;
+
+            path = grow_expandable_path (graph, head, entry);
+
+            if (path != NULL)
+                candidates = g_list_append (candidates, path);
+        }
+
+        g_list_free (successors);
+    }
+
+    /* Prefer large sub-graphs and skip those that overlap with them */
+    candidates = g_list_sort (candidates, compare_path_length);
+    inner = g_hash_table_new (g_direct_hash, g_direct_equal);
+    ends = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    for (GList *it = g_list_first (candidates); it != NULL; it = g_list_next (it)) {
+        GList *path = (GList *) it->data;
+        GList *head = g_list_first (path);
+        GList *tail = g_list_last (path);
+        gboolean overlaps = path_overlaps (path, inner);
+
+        for (GList *jt = g_list_next (head); jt != tail && !overlaps; jt = g_list_next (jt))
+            overlaps = g_hash_table_lookup (ends, jt->data) != NULL;
+
+        if (overlaps) {
+            g_list_free (path);
+            continue;
+        }
+
+        for (GList *jt = g_list_next (head); jt != tail; jt = g_list_next (jt))
+            g_hash_table_insert (inner, jt->data, jt->data);
+
+        g_hash_table_insert (ends, head->data, head->data);
+        g_hash_table_insert (ends, tail->data, tail->data);
+        result = g_list_append (result, path);
+    }
+
+    g_hash_table_destroy (inner);
+    g_hash_table_destroy (ends);
+    g_list_free (candidates);
+    g_list_free (nodes);
+    return result;
+}
+
+/*
+ * Add a copy of the inner nodes of @path including all edges among them, fed
+ * by the head and feeding the tail of @path.
+ */
+static void
+replicate_path (UfoGraph *graph,
+                GList *path,
+                ReplicaSet *set)
+{
+    GList *head = g_list_first (path);
+    GList *tail = g_list_last (path);
+    GHashTable *copies;
+    GError *error = NULL;
+
+    copies = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_object_unref);
+
+    for (GList *it = g_list_next (head); it != tail; it = g_list_next (it)) {
+        UfoNode *copy = ufo_node_copy (UFO_NODE (it->data), &error);
+
+        if (error != NULL) {
+            g_warning ("Could not copy %s: %s", get_node_name (it->data), error->message);
+            g_error_free (error);
+            g_hash_table_destroy (copies);
+            return;
+        }
+
+        g_hash_table_insert (copies, it->data, copy);
+    }
+
+    ufo_graph_connect_nodes (graph, head->data,
+                             g_hash_table_lookup (copies, g_list_next (head)->data),
+                             ufo_graph_get_edge_label (graph, head->data, g_list_next (head)->data));
+
+    for (GList *it = g_list_next (head); it != tail; it = g_list_next (it)) {
+        UfoNode *source = g_hash_table_lookup (copies, it->data);
+        GList *successors = ufo_graph_get_successors (graph, UFO_NODE (it->data));
+
+        for (GList *jt = g_list_first (successors); jt != NULL; jt = g_list_next (jt)) {
+            UfoNode *target = g_hash_table_lookup (copies, jt->data);
+            gpointer label = ufo_graph_get_edge_label (graph, it->data, jt->data);
+
+            ufo_graph_connect_nodes (graph, source, target != NULL ? target : jt->data, label);
+        }
+
+        g_list_free (successors);
+    }
+
+    set->entries = g_list_append (set->entries, g_hash_table_lookup (copies, g_list_next (head)->data));
+    set->exits = g_list_append (set->exits, g_hash_table_lookup (copies, g_list_previous (tail)->data));
+
+    /* The graph holds references to the connected copies */
+    g_hash_table_destroy (copies);
+}
+
+static void
+free_replica_set (ReplicaSet *set)
+{
+    g_list_free (set->entries);
+    g_list_free (set->exits);
+    g_free (set);
+}
+
+static void
+clear_replica_sets (UfoTaskGraphPrivate *priv)
+{
+    g_list_foreach (priv->replica_sets, (GFunc) free_replica_set, NULL);
+    g_list_free (priv->replica_sets);
+    priv->replica_sets = NULL;
+}
+
+static gpointer
+substitute_node (gpointer node,
+                 GList *chain,
+                 gpointer fused)
+{
+    return g_list_find (chain, node) != NULL ? fused : node;
+}
+
+/* Let replica sets refer to @fused instead of the nodes in @chain */
+static void
+substitute_replica_nodes (UfoTaskGraphPrivate *priv,
+                          GList *chain,
+                          UfoNode *fused)
+{
+    for (GList *it = g_list_first (priv->replica_sets); it != NULL; it = g_list_next (it)) {
+        ReplicaSet *set = (ReplicaSet *) it->data;
+
+        set->head = substitute_node (set->head, chain, fused);
+        set->tail = substitute_node (set->tail, chain, fused);
+
+        for (GList *jt = g_list_first (set->entries); jt != NULL; jt = g_list_next (jt))
+            jt->data = substitute_node (jt->data, chain, fused);
+
+        for (GList *jt = g_list_first (set->exits); jt != NULL; jt = g_list_next (jt))
+            jt->data = substitute_node (jt->data, chain, fused);
+    }
+}
+
+/**
+ * ufo_task_graph_get_num_replica_sets:
+ * @task_graph: A #UfoTaskGraph
+ *
+ * Get the number of sub-graphs that ufo_task_graph_expand() replicated.
+ *
+ * Returns: Number of replicated sub-graphs.
+ */
+guint
+ufo_task_graph_get_num_replica_sets (UfoTaskGraph *task_graph)
+{
+    g_return_val_if_fail (UFO_IS_TASK_GRAPH (task_graph), 0);
+    return g_list_length (task_graph->priv->replica_sets);
+}
+
+/**
+ * ufo_task_graph_get_replica_set:
+ * @task_graph: A #UfoTaskGraph
+ * @index: Index of the replicated sub-graph
+ * @head: (out) (transfer none): Location for the node feeding all copies
+ * @tail: (out) (transfer none): Location for the node fed by all copies
+ * @entries: (out) (transfer none) (element-type UfoTaskNode): Location for the
+ * first node of each copy
+ * @exits: (out) (transfer none) (element-type UfoTaskNode): Location for the
+ * node of each copy that feeds @tail
+ *
+ * Get the copies of a sub-graph that was replicated by ufo_task_graph_expand().
+ * The original comes first in @entries and @exits. Fused tasks replace their
+ * members after ufo_task_graph_fuse().
+ */
+void
+ufo_task_graph_get_replica_set (UfoTaskGraph *task_graph,
+                                guint index,
+                                UfoTaskNode **head,
+                                UfoTaskNode **tail,
+                                GList **entries,
+                                GList **exits)
+{
+    ReplicaSet *set;
+
+    g_return_if_fail (UFO_IS_TASK_GRAPH (task_graph));
+    set = g_list_nth_data (task_graph->priv->replica_sets, index);
+    g_return_if_fail (set != NULL);
+
+    *head = UFO_TASK_NODE (set->head);
+    *tail = UFO_TASK_NODE (set->tail);
+    *entries = set->entries;
+    *exits = set->exits;
+}
+
+static void
+describe_expansion (GString *report,
+                    GList *path,
+                    guint n_replicas)
+{
+    GList *head = g_list_first (path);
+    GList *tail = g_list_last (path);
+
+    g_string_append_printf (report, "  %s:", UFO_IS_GPU_TASK (g_list_next (head)->data) ? "GPU" : "CPU");
+
+    for (GList *it = g_list_next (head); it != tail; it = g_list_next (it))
+        g_string_append_printf (report, " %s", get_node_name (it->data));
+
+    g_string_append_printf (report, " (fed by %s, feeding %s): %u replicas\n",
+                            get_node_name (head->data), get_node_name (tail->data), n_replicas);
+}
+
+/**
+ * ufo_task_graph_set_cpu_replicas:
+ * @task_graph: A #UfoTaskGraph
+ * @n_replicas: Maximum number of copies of CPU-only sub-graphs
+ *
+ * Let ufo_task_graph_expand() run CPU-only sub-graphs in up to @n_replicas
+ * copies. With timings available, fewer copies are made if they do not pay
+ * off. The default of 1 does not replicate CPU tasks.
+ */
+void
+ufo_task_graph_set_cpu_replicas (UfoTaskGraph *task_graph,
+                                 guint n_replicas)
+{
+    g_return_if_fail (UFO_IS_TASK_GRAPH (task_graph));
+    task_graph->priv->cpu_replicas = MAX (1, n_replicas);
+}
+
+/**
+ * ufo_task_graph_set_transfer_bandwidth:
+ * @task_graph: A #UfoTaskGraph
+ * @bandwidth: Bytes per second or 0
+ *
+ * Set the bandwidth of host-device and device-device transfers that
+ * ufo_task_graph_expand() and ufo_task_graph_map() assume when predicting the
+ * throughput. With the default of 0, the bandwidth of an upload to the first
+ * GPU is measured once timings are available.
+ */
+void
+ufo_task_graph_set_transfer_bandwidth (UfoTaskGraph *task_graph,
+                                       gdouble bandwidth)
+{
+    g_return_if_fail (UFO_IS_TASK_GRAPH (task_graph));
+    task_graph->priv->bandwidth = MAX (0.0, bandwidth);
+}
+
+/* Time a few blocking uploads to the first GPU and return the best bandwidth */
+static gdouble
+measure_transfer_bandwidth (GList *gpu_nodes)
+{
+    cl_command_queue queue;
+    cl_context context;
+    cl_mem mem;
+    cl_int errcode;
+    gpointer data;
+    GTimer *timer;
+    gdouble best = G_MAXDOUBLE;
+
+    if (gpu_nodes == NULL)
+        return DEFAULT_TRANSFER_BANDWIDTH;
+
+    queue = ufo_gpu_node_get_cmd_queue (UFO_GPU_NODE (gpu_nodes->data));
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (queue, CL_QUEUE_CONTEXT, sizeof (cl_context), &context, NULL));
+    mem = clCreateBuffer (context, CL_MEM_READ_WRITE, BANDWIDTH_PROBE_SIZE, NULL, &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+
+    if (errcode != CL_SUCCESS)
+        return DEFAULT_TRANSFER_BANDWIDTH;
+
+    data = g_malloc0 (BANDWIDTH_PROBE_SIZE);
+    timer = g_timer_new ();
+
+    for (guint i = 0; i < 3; i++) {
+        g_timer_start (timer);
+        errcode = clEnqueueWriteBuffer (queue, mem, CL_TRUE, 0, BANDWIDTH_PROBE_SIZE, data, 0, NULL, NULL);
+        UFO_RESOURCES_CHECK_CLERR (errcode);
+        best = MIN (best, g_timer_elapsed (timer, NULL));
+    }
+
+    g_timer_destroy (timer);
+    g_free (data);
+    UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (mem));
+
+    if (errcode != CL_SUCCESS || best <= 0.0)
+        return DEFAULT_TRANSFER_BANDWIDTH;
+
+    return BANDWIDTH_PROBE_SIZE / best;
+}
+
+/* Make sure a bandwidth is known before predictions use the timings */
+static void
+update_transfer_bandwidth (UfoTaskGraph *task_graph,
+                           GList *gpu_nodes)
+{
+    UfoTaskGraphPrivate *priv = task_graph->priv;
+
+    if (priv->bandwidth > 0.0 || g_hash_table_size (priv->costs) == 0)
+        return;
+
+    priv->bandwidth = measure_transfer_bandwidth (gpu_nodes);
+    g_debug ("Measured transfer bandwidth: %.2f GB/s", priv->bandwidth * 1e-9);
+}
+
+/**
+ * ufo_task_graph_expand:
+ * @task_graph: A #UfoTaskGraph
+ * @arch_graph: A #UfoArchGraph
+ * @expand_remote: %TRUE if remote nodes should be inserted
+ * @expand_gpu: %FALSE if the master node should not use gpus for computing
+ * @use_network_writer: %TRUE if the last remote node should be used for dedicated
+ *                      writing (no computation)
+ *
+ * Expands @task_graph in a way that most of the resources in @arch_graph can be
+ * occupied. Every sub-graph of GPU tasks that is fed by a scattering node and
+ * feeds a single node is duplicated as much as there are GPUs in @arch_graph.
+ * Sub-graphs of CPU tasks are duplicated according to
+ * ufo_task_graph_set_cpu_replicas(). Nodes with several inputs are copied
+ * together with all their producers. The chosen expansion is part of
+ * ufo_task_graph_get_plan().
+ */
+void
+ufo_task_graph_expand (UfoTaskGraph *task_graph,
+                       UfoArchGraph *arch_graph,
+                       gboolean expand_remote,
+                       gboolean expand_gpu,
+                       gboolean network_writer)
+{
+    UfoTaskGraphPrivate *priv = UFO_TASK_GRAPH_GET_PRIVATE (task_graph);
+    GString *expansion;
+    GList *gpu_nodes;
+    GList *paths;
+    GList *path;
+    guint n_gpus;
+
+    g_return_if_fail (UFO_IS_TASK_GRAPH (task_graph));
+
+    paths = ufo_graph_get_paths (UFO_GRAPH (task_graph), is_gpu_task);
+    g_debug ("Number of identified paths: %i", g_list_length (paths));
+    paths = remove_common_ancestry_paths (paths);
+    g_debug ("Number of cleaned paths: %i", g_list_length (paths));
+    path = find_longest_path (paths);
+
+    GList *remotes = ufo_arch_graph_get_remote_nodes (arch_graph);
+
+    UfoRemoteNode *writer_remote = NULL;
+    if (network_writer) {
+        // last remote reserved for writer
+        GList *last_remote = g_list_last (remotes);
+        if (last_remote != NULL) {
+            writer_remote = UFO_REMOTE_NODE (last_remote->data);
+            remotes = g_list_remove (remotes, writer_remote);
+        }
+    }
+
+    if (path != NULL) {
+        guint n_remotes = g_list_length (remotes);
+        if (expand_remote && n_remotes > 0) {
+            g_debug ("Expand for %i remote nodes", n_remotes);
+            expand_remotes (task_graph, remotes, path);
+
+            g_list_free (remotes);
+        }
+
+        // only execute on main runner, not on ufod
+        if (network_writer && expand_remote && g_list_length (remotes) > 0) {
+            // find the writer task
+            UfoNode *writer_node = ufo_task_graph_get_writer_node (task_graph);
+            g_assert (writer_node != NULL);
+            // create a remote node for it
+            UfoTaskGraph *remote_graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+            UfoTaskNode *writer_task = UFO_TASK_NODE (writer_node);
+
+            // construct a remote graph that we send to the rmeote (only thewriter node)
+            UfoTaskNode *dummy = UFO_TASK_NODE (ufo_dummy_task_new ());
+            ufo_task_graph_connect_nodes (remote_graph, dummy, writer_task);
+            gchar *json;
+            json = ufo_task_graph_get_json_data (remote_graph, NULL);
+            ufo_remote_node_send_json (writer_remote, UFO_REMOTE_MODE_STREAM, json);
+
+            // create the mapping RemoteTask<->RemoteNode
+            UfoTaskNode *remote_task = UFO_TASK_NODE (ufo_remote_task_new ());
+            priv->remote_tasks = g_list_append (priv->remote_tasks, remote_task);
+            ufo_task_node_set_proc_node (remote_task, UFO_NODE (writer_remote));
+
+            // remove all edges to the local writer task node
+            // re-connect all edges  to the remote task
+            ufo_graph_replace_node (UFO_GRAPH (task_graph), UFO_NODE (writer_task), UFO_NODE (remote_task));
+        }
+    }
+
+    g_list_foreach (paths, (GFunc) g_list_free, NULL);
+    g_list_free (paths);
+
+    n_gpus = expand_gpu ? ufo_arch_graph_get_num_gpus (arch_graph) : 1;
+    gpu_nodes = ufo_arch_graph_get_gpu_nodes (arch_graph);
+    update_transfer_bandwidth (task_graph, gpu_nodes);
+    g_list_free (gpu_nodes);
+
+    paths = find_expandable_paths (UFO_GRAPH (task_graph));
+    expansion = g_string_new (NULL);
+    clear_replica_sets (priv);
+
+    for (GList *it = g_list_first (paths); it != NULL; it = g_list_next (it)) {
+        GList *expandable = (GList *) it->data;
+        gboolean gpu = UFO_IS_GPU_TASK (g_list_next (expandable)->data);
+        guint n_replicas;
+
+        n_replicas = choose_replication (task_graph, expandable, gpu ? n_gpus : priv->cpu_replicas);
+        describe_expansion (expansion, expandable, n_replicas);
+
+        if (n_replicas > 1) {
+            ReplicaSet *set = g_new0 (ReplicaSet, 1);
+
+            set->head = g_list_first (expandable)->data;
+            set->tail = g_list_last (expandable)->data;
+            set->entries = g_list_append (NULL, g_list_next (expandable)->data);
+            set->exits = g_list_append (NULL, g_list_previous (g_list_last (expandable))->data);
+
+            for (guint i = 1; i < n_replicas; i++)
+                replicate_path (UFO_GRAPH (task_graph), expandable, set);
+
+            priv->replica_sets = g_list_append (priv->replica_sets, set);
+        }
+    }
+
+    /* Replace the report of an earlier expansion */
+    g_free (priv->expansion);
+    priv->expansion = g_string_free (expansion, FALSE);
+    g_debug ("Expansion:\n%s", priv->expansion);
+
+    g_free (priv->plan);
+    priv->plan = g_strdup (priv->expansion);
+
+    g_list_foreach (paths, (GFunc) g_list_free, NULL);
+    g_list_free (paths);
+}
+
+/*
+ * A fused task only calls process(), so members must not depend on the batched,
+ * asynchronous or in-place paths of the scheduler. Members must be processors
+ * with a single input, which is seen from their single predecessor.
+ */
+static gboolean
+is_fusable (UfoGraph *graph,
+            UfoNode *node)
+{
+    UfoGpuTaskIface *iface;
+
+    if (!UFO_IS_GPU_TASK (node) || UFO_IS_FUSED_TASK (node) ||
+        !ufo_task_node_get_fusable (UFO_TASK_NODE (node)) ||
+        ufo_task_node_get_proc_node (UFO_TASK_NODE (node)) == NULL)
+        return FALSE;
+
+    iface = UFO_GPU_TASK_GET_IFACE (node);
+
+    if (implements_generate (node) ||
+        iface->process_batch != NULL || iface->process_async != NULL ||
+        ufo_task_can_process_in_place (UFO_TASK (node), 0))
+        return FALSE;
+
+    return ufo_graph_get_num_predecessors (graph, node) == 1;
+}
+
+/*
+ * Two fusable nodes can be merged if the edge between them is the only way
+ * in and out and both run on the same device.
+ */
+static gboolean
+can_fuse_edge (UfoGraph *graph,
+               GHashTable *fusable,
+               UfoNode *source,
+               UfoNode *target)
+{
+    return g_hash_table_lookup (fusable, source) != NULL &&
+           g_hash_table_lookup (fusable, target) != NULL &&
+           ufo_graph_get_num_successors (graph, source) == 1 &&
+           ufo_graph_get_num_predecessors (graph, target) == 1 &&
+           ufo_task_node_get_proc_node (UFO_TASK_NODE (source)) ==
+           ufo_task_node_get_proc_node (UFO_TASK_NODE (target));
+}
+
+static GList *
+get_fusable_chain (UfoGraph *graph,
+                   GHashTable *fusable,
+                   UfoNode *head)
+{
+    GList *chain = g_list_append (NULL, head);
+    UfoNode *current = head;
+
+    while (TRUE) {
+        GList *successors;
+        UfoNode *next = NULL;
+
+        successors = ufo_graph_get_successors (graph, current);
+
+        if (successors != NULL && can_fuse_edge (graph, fusable, current, successors->data))
+            next = UFO_NODE (successors->data);
+
+        g_list_free (successors);
+
+        if (next == NULL)
+            break;
+
+        chain = g_list_append (chain, next);
+        current = next;
+    }
+
+    return chain;
+}
+
+static void
+replace_chain (UfoTaskGraph *task_graph,
+               GList *chain)
+{
+    UfoGraph *graph = UFO_GRAPH (task_graph);
+    UfoTaskNode *head = UFO_TASK_NODE (g_list_first (chain)->data);
+    UfoTaskNode *tail = UFO_TASK_NODE (g_list_last (chain)->data);
+    UfoTaskNode *fused;
+    GList *predecessors;
+    GList *successors;
+    guint index;
+    guint total;
+
+    fused = UFO_TASK_NODE (ufo_fused_task_new (chain));
+    ufo_task_node_set_proc_node (fused, ufo_task_node_get_proc_node (head));
+    ufo_task_node_get_partition (head, &index, &total);
+    ufo_task_node_set_partition (fused, index, total);
+    ufo_task_node_set_num_expected (fused, 0, ufo_task_node_get_num_expected (head, 0));
+    ufo_task_node_set_send_pattern (fused, ufo_task_node_get_send_pattern (tail));
+
+    predecessors = ufo_graph_get_predecessors (graph, UFO_NODE (head));
+    successors = ufo_graph_get_successors (graph, UFO_NODE (tail));
+
+    for (GList *it = g_list_first (predecessors); it != NULL; it = g_list_next (it))
+        ufo_graph_connect_nodes (graph, UFO_NODE (it->data), UFO_NODE (fused),
+                                 ufo_graph_get_edge_label (graph, UFO_NODE (it->data), UFO_NODE (head)));
+
+    for (GList *it = g_list_first (successors); it != NULL; it = g_list_next (it))
+        ufo_graph_connect_nodes (graph, UFO_NODE (fused), UFO_NODE (it->data),
+                                 ufo_graph_get_edge_label (graph, UFO_NODE (tail), UFO_NODE (it->data)));
+
+    substitute_replica_nodes (task_graph->priv, chain, UFO_NODE (fused));
+
+    /* The fused task holds its own references, drop the ones of the graph */
+    for (GList *it = g_list_first (chain); it != NULL; it = g_list_next (it)) {
+        ufo_graph_remove_node (graph, UFO_NODE (it->data));
+        g_object_unref (it->data);
+    }
+
+    /* Connecting took a reference, we don't need ours anymore */
+    g_object_unref (fused);
+
+    g_debug ("Fused %u tasks into %s", g_list_length (chain),
+             ufo_task_node_get_unique_name (fused));
+
+    g_list_free (predecessors);
+    g_list_free (successors);
+}
+
+/**
+ * ufo_task_graph_fuse:
+ * @task_graph: A #UfoTaskGraph
+ *
+ * Fuses task nodes to increase data locality. Linear chains of single-input GPU
+ * processors that are mapped to the same device are replaced by a
+ * #UfoFusedTask, which runs all of them in one thread and keeps intermediate
+ * results on the device. Tasks implementing batched, asynchronous or in-place
+ * processing are left alone, other nodes can opt out with
+ * ufo_task_node_set_fusable().
+ *
+ * Call this after ufo_task_graph_map(), because only tasks that run on the same
+ * device are fused.
+ */
+void
+ufo_task_graph_fuse (UfoTaskGraph *task_graph)
+{
+    UfoGraph *graph;
+    GHashTable *fusable;
+    GList *nodes;
+    GList *chains = NULL;
+
+    g_return_if_fail (UFO_IS_TASK_GRAPH (task_graph));
+
+    graph = UFO_GRAPH (task_graph);
+    fusable = g_hash_table_new (g_direct_hash, g_direct_equal);
+    nodes = ufo_graph_get_nodes (graph);
+
+    for (GList *it = g_list_first (nodes); it != NULL; it = g_list_next (it)) {
+        if (is_fusable (graph, UFO_NODE (it->data)))
+            g_hash_table_insert (fusable, it->data, it->data);
+    }
+
+    /*
+     * Start a chain at each fusable node that cannot be fused with its input.
+     * Nodes without any input are not connected yet and left alone.
+     */
+    for (GList *it = g_list_first (nodes); it != NULL; it = g_list_next (it)) {
+        UfoNode *node = UFO_NODE (it->data);
+        GList *predecessors;
+        GList *chain;
+        gboolean is_head;
+
+        if (g_hash_table_lookup (fusable, node) == NULL)
+            continue;
+
+        predecessors = ufo_graph_get_predecessors (graph, node);
+        is_head = predecessors != NULL && !can_fuse_edge (graph, fusable, predecessors->data, node);
+        g_list_free (predecessors);
+
+        if (!is_head)
+            continue;
+
+        chain = get_fusable_chain (graph, fusable, node);
+
+        if (g_list_length (chain) > 1)
+            chains = g_list_append (chains, chain);
+        else
+            g_list_free (chain);
+    }
+
+    for (GList *it = g_list_first (chains); it != NULL; it = g_list_next (it))
+        replace_chain (task_graph, (GList *) it->data);
+
+    g_list_foreach (chains, (GFunc) g_list_free, NULL);
+    g_list_free (chains);
+    g_list_free (nodes);
+    g_hash_table_destroy (fusable);
+}
+
+static gboolean
+is_mappable (UfoNode *node)
+{
+    return (UFO_IS_GPU_TASK (node) || UFO_IS_INPUT_TASK (node)) &&
+           (ufo_task_node_get_proc_node (UFO_TASK_NODE (node)) == NULL);
+}
+
+/*
+ * Original round-robin mapping, that advances the GPU index for every
+ * successor. Only used to report how many cross-device edges it would cause.
+ */
+static void
+map_round_robin (UfoGraph *graph,
+                 UfoNode *node,
+                 guint proc_index,
+                 GList *gpu_nodes,
+                 GHashTable *mapping)
+{
+    GList *successors;
+    guint n_gpus;
+
+    if (is_mappable (node) && !g_hash_table_lookup (mapping, node))
+        g_hash_table_insert (mapping, node, g_list_nth_data (gpu_nodes, proc_index));
+
+    n_gpus = g_list_length (gpu_nodes);
+    successors = ufo_graph_get_successors (graph, node);
+
+    for (GList *it = g_list_first (successors); it != NULL; it = g_list_next (it)) {
+        map_round_robin (graph, UFO_NODE (it->data), proc_index, gpu_nodes, mapping);
+
+        if (!UFO_IS_REMOTE_TASK (UFO_NODE (it->data)))
+            proc_index = (proc_index + 1) % n_gpus;
+    }
+
+    g_list_free (successors);
+}
+
+static guint
+get_least_loaded (guint *n_branches,
+                  guint n_gpus,
+                  guint preferred)
+{
+    guint best = preferred;
+
+    for (guint i = 0; i < n_gpus; i++) {
+        if (n_branches[i] < n_branches[best])
+            best = i;
+    }
+
+    return best;
+}
+
+/*
+ * Successors inherit the GPU of their predecessor, so that linear chains never
+ * cross devices. Only where the graph splits into several GPU branches, each
+ * branch is placed on the GPU that carries the fewest branches so far.
+ */
+static void
+map_locality (UfoGraph *graph,
+              UfoNode *node,
+              guint proc_index,
+              GList *gpu_nodes,
+              guint *n_branches,
+              GHashTable *mapping)
+{
+    GList *successors;
+    gboolean first_branch = TRUE;
+    guint n_gpus;
+
+    if (g_hash_table_lookup_extended (mapping, node, NULL, NULL))
+        return;
+
+    g_hash_table_insert (mapping, node,
+                         is_mappable (node) ? g_list_nth_data (gpu_nodes, proc_index) : NULL);
+
+    n_gpus = g_list_length (gpu_nodes);
+    successors = ufo_graph_get_successors (graph, node);
+
+    for (GList *it = g_list_first (successors); it != NULL; it = g_list_next (it)) {
+        UfoNode *successor = UFO_NODE (it->data);
+        guint index = proc_index;
+
+        /* The first branch continues on our GPU, the others are new branches */
+        if (is_mappable (successor)) {
+            if (!first_branch) {
+                index = get_least_loaded (n_branches, n_gpus, proc_index);
+                n_branches[index]++;
+            }
+
+            first_branch = FALSE;
+        }
+
+        map_locality (graph, successor, index, gpu_nodes, n_branches, mapping);
+    }
+
+    g_list_free (successors);
+}
+
+static guint
+count_cross_device_edges (UfoGraph *graph,
+                          GHashTable *mapping)
+{
+    GList *edges;
+    guint n_edges = 0;
+
+    edges = ufo_graph_get_edges (graph);
+
+    for (GList *it = g_list_first (edges); it != NULL; it = g_list_next (it)) {
+        UfoEdge *edge = (UfoEdge *) it->data;
+        gpointer source = g_hash_table_lookup (mapping, edge->source);
+        gpointer target = g_hash_table_lookup (mapping, edge->target);
+
+        if (source != NULL && target != NULL && source != target)
+            n_edges++;
+    }
+
+    g_list_free (edges);
+    return n_edges;
+}
+
+static GHashTable *
+get_current_mapping (UfoGraph *graph)
+{
+    GHashTable *mapping;
+    GList *nodes;
+
+    mapping = g_hash_table_new (g_direct_hash, g_direct_equal);
+    nodes = ufo_graph_get_nodes (graph);
+
+    for (GList *it = g_list_first (nodes); it != NULL; it = g_list_next (it)) {
+        UfoNode *proc_node = ufo_task_node_get_proc_node (UFO_TASK_NODE (it->data));
+
+        if (proc_node != NULL && UFO_IS_GPU_NODE (proc_node))
+            g_hash_table_insert (mapping, it->data, proc_node);
+    }
+
+    g_list_free (nodes);
+    return mapping;
+}
+
+/**
+ * ufo_task_graph_get_num_cross_device_edges:
+ * @task_graph: A #UfoTaskGraph
+ *
+ * Count the edges of @task_graph whose both ends are mapped to different GPUs,
+ * i.e. which require a transfer between two devices.
+ *
+ * Returns: Number of edges between tasks on different GPUs.
+ */
+guint
+ufo_task_graph_get_num_cross_device_edges (UfoTaskGraph *task_graph)
+{
+    GHashTable *mapping;
+    guint n_edges;
+
+    g_return_val_if_fail (UFO_IS_TASK_GRAPH (task_graph), 0);
+
+    mapping = get_current_mapping (UFO_GRAPH (task_graph));
+    n_edges = count_cross_device_edges (UFO_GRAPH (task_graph), mapping);
+    g_hash_table_destroy (mapping);
+    return n_edges;
+}
+
+/*
+ * Fraction of the stream that passes @node. Scattering nodes split their
+ * output among successors, broadcasting nodes send everything to each.
+ */
+static gdouble
+get_stream_share (UfoGraph *graph,
+                  UfoNode *node,
+                  GHashTable *shares)
+{
+    gpointer value;
+    GList *predecessors;
+    gdouble sums[16] = { 0.0 };
+    gdouble share = 0.0;
+
+    if (g_hash_table_lookup_extended (shares, node, NULL, &value))
+        return *((gdouble *) value);
+
+    /* Mark as visited to cut cycles */
+    value = g_new0 (gdouble, 1);
+    g_hash_table_insert (shares, node, value);
+
+    predecessors = ufo_graph_get_predecessors (graph, node);
+
+    if (predecessors == NULL)
+        share = 1.0;
+
+    for (GList *it = g_list_first (predecessors); it != NULL; it = g_list_next (it)) {
+        UfoNode *predecessor = UFO_NODE (it->data);
+        guint pos = (guint) GPOINTER_TO_INT (ufo_graph_get_edge_label (graph, predecessor, node));
+        gdouble contribution = get_stream_share (graph, predecessor, shares);
+
+        if (ufo_task_node_get_send_pattern (UFO_TASK_NODE (predecessor)) != UFO_SEND_BROADCAST)
+            contribution /= MAX (1, ufo_graph_get_num_successors (graph, predecessor));
+
+        sums[MIN (pos, 15)] += contribution;
+    }
+
+    for (guint i = 0; i < 16; i++)
+        share = MAX (share, sums[i]);
+
+    g_list_free (predecessors);
+    *((gdouble *) value) = share;
+    return share;
+}
+
+static gpointer
+get_location (UfoNode *node)
+{
+    if (!UFO_IS_GPU_TASK (node))
+        return NULL;
+
+    return ufo_task_node_get_proc_node (UFO_TASK_NODE (node));
+}
+
+static void
+add_load (GHashTable *loads,
+          gpointer device,
+          gdouble load)
+{
+    gdouble *value = g_hash_table_lookup (loads, device);
+
+    if (value == NULL) {
+        value = g_new0 (gdouble, 1);
+        g_hash_table_insert (loads, device, value);
+    }
+
+    *value += load;
+}
+
+/*
+ * Predict the steady-state throughput of the mapped graph in items per second
+ * of its input stream and describe the plan. Every task runs in its own thread
+ * and is limited by its per-item time, GPU tasks mapped to the same device
+ * additionally share that device with the transfers from and to it.
+ */
+static gdouble
+predict_throughput (UfoTaskGraph *task_graph,
+                    GList *gpu_nodes,
+                    GString *plan)
+{
+    UfoTaskGraphPrivate *priv = task_graph->priv;
+    UfoGraph *graph = UFO_GRAPH (task_graph);
+    GHashTable *shares;
+    GHashTable *loads;
+    GHashTableIter iter;
+    gpointer device;
+    gpointer value;
+    GList *nodes;
+    GList *edges;
+    gdouble predicted = G_MAXDOUBLE;
+    const gchar *bottleneck = NULL;
+
+    shares = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    loads = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    nodes = ufo_graph_get_nodes (graph);
+    edges = ufo_graph_get_edges (graph);
+
+    if (priv->expansion != NULL)
+        g_string_append_printf (plan, "Expansion:\n%s", priv->expansion);
+
+    for (GList *it = g_list_first (nodes); it != NULL; it = g_list_next (it)) {
+        UfoNode *node = UFO_NODE (it->data);
+        gpointer location = get_location (node);
+        gdouble share = get_stream_share (graph, node, shares);
+        gdouble time;
+        gsize bytes;
+
+        if (!lookup_cost (task_graph, node, &time, &bytes)) {
+            g_string_append_printf (plan, "  %-32s %-6s no timing\n",
+                                    get_node_name (node),
+                                    location != NULL ? "gpu" : "host");
+            continue;
+        }
+
+        if (location != NULL) {
+            add_load (loads, location, time * share);
+            g_string_append_printf (plan, "  %-32s gpu %-2i %8.3f ms/item, %.2f of stream\n",
+                                    get_node_name (node),
+                                    g_list_index (gpu_nodes, location), time * 1000.0, share);
+        }
+        else {
+            g_string_append_printf (plan, "  %-32s host   %8.3f ms/item, %.2f of stream\n",
+                                    get_node_name (node),
+                                    time * 1000.0, share);
+        }
+
+        if (time * share > 0.0 && 1.0 / (time * share) < predicted) {
+            predicted = 1.0 / (time * share);
+            bottleneck = get_node_name (node);
+        }
+    }
+
+    /* Transfers between host and devices or between two devices */
+    for (GList *it = g_list_first (edges); it != NULL; it = g_list_next (it)) {
+        UfoEdge *edge = (UfoEdge *) it->data;
+        gpointer source = get_location (edge->source);
+        gpointer target = get_location (edge->target);
+        gdouble share;
+        gdouble time;
+        gsize bytes;
+
+        if (source == target || !lookup_cost (task_graph, edge->source, &time, &bytes))
+            continue;
+
+        share = get_stream_share (graph, edge->source, shares);
+
+        if (ufo_task_node_get_send_pattern (UFO_TASK_NODE (edge->source)) != UFO_SEND_BROADCAST)
+            share /= MAX (1, ufo_graph_get_num_successors (graph, edge->source));
+
+        if (source != NULL)
+            add_load (loads, source, share * bytes / priv->bandwidth);
+
+        if (target != NULL)
+            add_load (loads, target, share * bytes / priv->bandwidth);
+    }
+
+    g_hash_table_iter_init (&iter, loads);
+
+    while (g_hash_table_iter_next (&iter, &device, &value)) {
+        gdouble load = *((gdouble *) value);
+
+        g_string_append_printf (plan, "  gpu %-2i busy %8.3f ms/item\n",
+                                g_list_index (gpu_nodes, device), load * 1000.0);
+
+        if (load > 0.0 && 1.0 / load < predicted) {
+            predicted = 1.0 / load;
+            bottleneck = "GPU";
+        }
+    }
+
+    if (bottleneck == NULL)
+        predicted = 0.0;
+    else
+        g_string_append_printf (plan, "Predicted throughput: %.2f items/s (limited by %s)\n",
+                                predicted, bottleneck);
+
+    g_list_free (edges);
+    g_list_free (nodes);
+    g_hash_table_destroy (loads);
+    g_hash_table_destroy (shares);
+    return predicted;
+}
+
+/**
+ * ufo_task_graph_get_plan:
+ * @task_graph: A #UfoTaskGraph
+ *
+ * Describe how @task_graph was expanded and mapped. The expansion of each
+ * replicated sub-graph is listed after ufo_task_graph_expand(). Timings and
+ * the predicted throughput follow if they were recorded with
+ * ufo_task_graph_add_cost_sample() or loaded with ufo_task_graph_load_costs()
+ * before calling ufo_task_graph_map().
+ *
+ * Returns: (transfer full): A description of the plan or %NULL.
+ */
+gchar *
+ufo_task_graph_get_plan (UfoTaskGraph *task_graph)
+{
+    g_return_val_if_fail (UFO_IS_TASK_GRAPH (task_graph), NULL);
+    return g_strdup (task_graph->priv->plan);
+}
+
+/**
+ * ufo_task_graph_get_predicted_throughput:
+ * @task_graph: A #UfoTaskGraph
+ *
+ * Get the steady-state throughput predicted for the current plan.
+ *
+ * Returns: Items per second of the input stream or 0.0 if unknown.
+ */
+gdouble
+ufo_task_graph_get_predicted_throughput (UfoTaskGraph *task_graph)
+{
+    g_return_val_if_fail (UFO_IS_TASK_GRAPH (task_graph), 0.0);
+    return task_graph->priv->predicted;
+}
+
+/**
+ * ufo_task_graph_map:
+ * @task_graph: A #UfoTaskGraph
+ * @arch_graph: A #UfoArchGraph to which @task_graph's nodes are mapped onto
+ *
+ * Map task nodes of @task_graph to the processing nodes of @arch_graph. Not
+ * doing this could break execution of @task_graph.
+ *
+ * Connected GPU tasks are kept on the same GPU, branches of the graph are
+ * distributed by the number of branches already placed on each GPU.
+ */
+void
+ufo_task_graph_map (UfoTaskGraph *task_graph,
+                    UfoArchGraph *arch_graph)
+{
+    UfoGraph *graph;
+    GHashTable *round_robin;
+    GHashTable *mapping;
+    GHashTableIter iter;
+    gpointer node;
+    gpointer proc_node;
+    GList *gpu_nodes;
+    GList *roots;
+    guint *n_branches;
+    guint n_gpus;
+
+    graph = UFO_GRAPH (task_graph);
+    gpu_nodes = ufo_arch_graph_get_gpu_nodes (arch_graph);
+    roots = ufo_graph_get_roots (graph);
+    n_gpus = g_list_length (gpu_nodes);
+    n_branches = g_new0 (guint, MAX (n_gpus, 1));
+    round_robin = g_hash_table_new (g_direct_hash, g_direct_equal);
+    mapping = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    for (GList *it = g_list_first (roots); it != NULL; it = g_list_next (it)) {
+        UfoNode *root = UFO_NODE (it->data);
+        guint index = 0;
+
+        /* Independent pipelines are branches, too */
+        if (n_gpus > 0) {
+            index = get_least_loaded (n_branches, n_gpus, 0);
+            n_branches[index]++;
+        }
+
+        map_round_robin (graph, root, 0, gpu_nodes, round_robin);
+        map_locality (graph, root, index, gpu_nodes, n_branches, mapping);
+    }
+
+    g_hash_table_iter_init (&iter, mapping);
+
+    while (g_hash_table_iter_next (&iter, &node, &proc_node)) {
+        if (proc_node == NULL)
+            continue;
+
+        g_debug ("Mapping GPU %i to %s-%p",
+                 g_list_index (gpu_nodes, proc_node), G_OBJECT_TYPE_NAME (node), node);
+
+        ufo_task_node_set_proc_node (UFO_TASK_NODE (node), UFO_NODE (proc_node));
+    }
+
+    g_debug ("Cross-device edges: %u (round-robin mapping: %u)",
+             count_cross_device_edges (graph, mapping),
+             count_cross_device_edges (graph, round_robin));
+
+    if (g_hash_table_size (task_graph->priv->costs) > 0) {
+        GString *plan = g_string_new (NULL);
+
+        update_transfer_bandwidth (task_graph, gpu_nodes);
+        task_graph->priv->predicted = predict_throughput (task_graph, gpu_nodes, plan);
+        g_free (task_graph->priv->plan);
+        task_graph->priv->plan = g_string_free (plan, FALSE);
+        g_debug ("Plan:\n%s", task_graph->priv->plan);
+    }
+
+    g_hash_table_destroy (mapping);
+    g_hash_table_destroy (round_robin);
+    g_free (n_branches);
+    g_list_free (roots);
+    g_list_free (gpu_nodes);
+}
+
+/**
+ * ufo_task_graph_connect_nodes:
+ * @graph: A #UfoTaskGraph
+ * @n1: A source node
+ * @n2: A destination node
+ *
+ * Connect @n1 with @n2 using @n2's default input port. To specify any other
+ * port, use ufo_task_graph_connect_nodes_full().
+ */
+void
+ufo_task_graph_connect_nodes (UfoTaskGraph *graph,
+                              UfoTaskNode *n1,
+                              UfoTaskNode *n2)
+{
+    ufo_task_graph_connect_nodes_full (graph, n1, n2, 0);
+}
+
+/**
+ * ufo_task_graph_connect_nodes_full:
+ * @graph: A #UfoTaskGraph
+ * @n1: A source node
+ * @n2: A destination node
+ * @input: Input port of @n2
+ *
+ * Connect @n1 with @n2 using @n2's @input port.
+ */
+void
+ufo_task_graph_connect_nodes_full (UfoTaskGraph *graph,
+                                   UfoTaskNode *n1,
+                                   UfoTaskNode *n2,
+                                   guint input)
+{
+    ufo_graph_connect_nodes (UFO_GRAPH (graph), UFO_NODE (n1), UFO_NODE (n2), GINT_TO_POINTER (input));
+}
+
+void
+ufo_task_graph_set_partition (UfoTaskGraph *graph,
+                              guint index,
+                              guint total)
+{
+    g_return_if_fail (UFO_IS_TASK_GRAPH (graph));
+    g_assert (index < total);
+    graph->priv->index = index;
+    graph->priv->total = total;
+}
+
+void
+ufo_task_graph_get_partition (UfoTaskGraph *graph,
+                              guint *index,
+                              guint *total)
+{
+    g_return_if_fail (UFO_IS_TASK_GRAPH (graph));
+    *index = graph->priv->index;
+    *total = graph->priv->total;
+}
+
+static void
+add_nodes_from_json (UfoTaskGraph *graph,
+                     JsonNode *root,
+                     GError **error)
+{
+    JsonObject *root_object = json_node_get_object (root);
+
+    if (json_object_has_member (root_object, "prop-sets")) {
+        JsonObject *sets = json_object_get_object_member (root_object, "prop-sets");
+        json_object_foreach_member (sets, handle_json_prop_set, graph->priv);
+    }
+
+    if (json_object_has_member (root_object, "nodes")) {
+        JsonArray *nodes = json_object_get_array_member (root_object, "nodes");
+        GList *elements = json_array_get_elements (nodes);
+
+        for (GList *it = g_list_first (elements); it != NULL; it = g_list_next (it)) {
+            if (!handle_json_task_node (it->data, graph->priv, error)) {
+                g_list_free (elements);
+                return;
+            }
+        }
+
+        g_list_free (elements);
+
+        /*
+         * We only check edges if we have nodes, anything else doesn't make much
+         * sense.
+         */
+        if (json_object_has_member (root_object, "edges")) {
+            JsonArray *edges = json_object_get_array_member (root_object, "edges");
+            json_array_foreach_element (edges, handle_json_task_edge, graph);
+        }
+    }
+}
+
+static gboolean
+handle_json_task_node (JsonNode *element,
+                       UfoTaskGraphPrivate *priv,
+                       GError **error)
+{
+    UfoTaskNode *plugin;
+    JsonObject *object;
+    GError *tmp_error = NULL;
+    const gchar *name;
+    const gchar *plugin_name;
+
+    object = json_node_get_object (element);
+
+    if (!json_object_has_member (object, "plugin") ||
+        !json_object_has_member (object, "name")) {
+        g_set_error (error, UFO_TASK_GRAPH_ERROR, UFO_TASK_GRAPH_ERROR_JSON_KEY,
+                     "Node does not have `plugin' or `name' key");
+        return FALSE;
+    }
+
+    plugin_name = json_object_get_string_member (object, "plugin");
+    plugin = ufo_plugin_manager_get_task (priv->manager, plugin_name, &tmp_error);
+    ufo_task_node_set_plugin_name (plugin, plugin_name);
+
+    if (tmp_error != NULL) {
+        g_propagate_error (error, tmp_error);
+        return FALSE;
+    }
+
+    name = json_object_get_string_member (object, "name");
 
     if (g_hash_table_lookup (priv->json_nodes, name) != NULL)
         g_error ("Duplicate name `%s' found", name);
@@ -951,6 +2376,10 @@ ufo_task_graph_finalize (GObject *object)
 
     g_hash_table_destroy (priv->json_nodes);
     g_hash_table_destroy (priv->prop_sets);
+    g_hash_table_destroy (priv->costs);
+    g_free (priv->expansion);
+    clear_replica_sets (priv);
+    g_free (priv->plan);
 
     G_OBJECT_CLASS (ufo_task_graph_parent_class)->finalize (object);
 }
@@ -982,4 +2411,12 @@ ufo_task_graph_init (UfoTaskGraph *self)
                                              g_free, (GDestroyNotify) json_object_unref);
     priv->index = 0;
     priv->total = 1;
+
+    priv->costs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    priv->cpu_replicas = 1;
+    priv->bandwidth = 0.0;
+    priv->expansion = NULL;
+    priv->replica_sets = NULL;
+    priv->predicted = 0.0;
+    priv->plan = NULL;
 }
@@ -88,11 +88,40 @@ gchar       *ufo_task_graph_get_json_data       (UfoTaskGraph       *graph,
                                                  GError            **error);
 void         ufo_task_graph_map                 (UfoTaskGraph       *task_graph,
                                                  UfoArchGraph       *arch_graph);
+guint        ufo_task_graph_get_num_cross_device_edges
+                                                (UfoTaskGraph       *task_graph);
+void         ufo_task_graph_set_cpu_replicas    (UfoTaskGraph       *task_graph,
+                                                 guint               n_replicas);
+void         ufo_task_graph_set_transfer_bandwidth
+                                                (UfoTaskGraph       *task_graph,
+                                                 gdouble             bandwidth);
+void         ufo_task_graph_add_cost_sample     (UfoTaskGraph       *task_graph,
+                                                 UfoTaskNode        *node,
+                                                 gdouble             seconds,
+                                                 guint               n_items,
+                                                 gsize               bytes);
+gboolean     ufo_task_graph_save_costs          (UfoTaskGraph       *task_graph,
+                                                 const gchar        *filename,
+                                                 GError            **error);
+gboolean     ufo_task_graph_load_costs          (UfoTaskGraph       *task_graph,
+                                                 const gchar        *filename,
+                                                 GError            **error);
+gchar       *ufo_task_graph_get_plan            (UfoTaskGraph       *task_graph);
+gdouble      ufo_task_graph_get_predicted_throughput
+                                                (UfoTaskGraph       *task_graph);
 void         ufo_task_graph_expand              (UfoTaskGraph       *task_graph,
                                                  UfoArchGraph       *arch_graph,
                                                  gboolean            expand_remote,
                                                  gboolean            expand_gpu,
                                                  gboolean            network_writer);
+guint        ufo_task_graph_get_num_replica_sets
+                                                (UfoTaskGraph       *task_graph);
+void         ufo_task_graph_get_replica_set     (UfoTaskGraph       *task_graph,
+                                                 guint               index,
+                                                 UfoTaskNode       **head,
+                                                 UfoTaskNode       **tail,
+                                                 GList             **entries,
+                                                 GList             **exits);
 void         ufo_task_graph_connect_nodes       (UfoTaskGraph       *graph,
                                                  UfoTaskNode        *n1,
                                                  UfoTaskNode        *n2);
@@ -58,6 +58,64 @@ ufo_task_get_structure (UfoTask *task,
     UFO_TASK_GET_IFACE (task)->get_structure (task, n_inputs, in_params, mode);
 }
 
+/**
+ * ufo_task_get_batch_size:
+ * @task: A #UfoTask
+ *
+ * Get the number of items @task wants to receive per call of its
+ * process_batch() method. Tasks that do not implement batching process one item
+ * at a time.
+ *
+ * Returns: Preferred batch size, at least 1.
+ */
+guint
+ufo_task_get_batch_size (UfoTask *task)
+{
+    return MAX (1, UFO_TASK_GET_IFACE (task)->get_batch_size (task));
+}
+
+/**
+ * ufo_task_can_process_in_place:
+ * @task: A #UfoTask
+ * @input: Input position
+ *
+ * Check if @task can write its result directly into the buffer it receives at
+ * @input. In that case the scheduler may pass the input buffer as the output
+ * buffer to process() as long as the requisition matches its size. This is
+ * only done for tasks with a single input.
+ *
+ * Returns: %TRUE if @input may be overwritten.
+ */
+gboolean
+ufo_task_can_process_in_place (UfoTask *task,
+                               guint input)
+{
+    return UFO_TASK_GET_IFACE (task)->can_process_in_place (task, input);
+}
+
+/**
+ * ufo_task_get_static_requisition:
+ * @task: A #UfoTask
+ * @inputs: Constant shapes of the inputs in input order, %NULL for generators
+ * @requisition: Location for the output shape
+ *
+ * Ask @task if its output shape is the same for every item, given that each of
+ * its inputs always has the shape in @inputs. If it is, the scheduler computes
+ * it once before the stream starts, preallocates the output buffers and does
+ * not call get_requisition() for each item anymore. Tasks whose
+ * get_requisition() has side effects must not report a static shape.
+ *
+ * Returns: %TRUE if @requisition holds the constant output shape, %FALSE if
+ * the shape has to be determined for each item.
+ */
+gboolean
+ufo_task_get_static_requisition (UfoTask *task,
+                                 UfoRequisition *inputs,
+                                 UfoRequisition *requisition)
+{
+    return UFO_TASK_GET_IFACE (task)->get_static_requisition (task, inputs, requisition);
+}
+
 static void
 ufo_task_setup_real (UfoTask *task,
                      UfoResources *resources,
@@ -83,10 +141,34 @@ ufo_task_get_structure_real (UfoTask *task,
     g_warning ("`get_structure' not implemented");
 }
 
+static guint
+ufo_task_get_batch_size_real (UfoTask *task)
+{
+    return 1;
+}
+
+static gboolean
+ufo_task_can_process_in_place_real (UfoTask *task,
+                                    guint input)
+{
+    return FALSE;
+}
+
+static gboolean
+ufo_task_get_static_requisition_real (UfoTask *task,
+                                      UfoRequisition *inputs,
+                                      UfoRequisition *requisition)
+{
+    return FALSE;
+}
+
 static void
 ufo_task_default_init (UfoTaskInterface *iface)
 {
     iface->setup = ufo_task_setup_real;
     iface->get_requisition = ufo_task_get_requisition_real;
     iface->get_structure = ufo_task_get_structure_real;
+    iface->get_batch_size = ufo_task_get_batch_size_real;
+    iface->can_process_in_place = ufo_task_can_process_in_place_real;
+    iface->get_static_requisition = ufo_task_get_static_requisition_real;
 }
@@ -69,6 +69,12 @@ typedef gboolean (*UfoTaskGenerateFunc) (UfoTask *task,
                                          UfoBuffer *output,
                                          UfoRequisition *requisition);
 
+typedef gboolean (*UfoTaskProcessBatchFunc) (UfoTask *task,
+                                             UfoBuffer **inputs,
+                                             UfoBuffer **outputs,
+                                             guint n_items,
+                                             UfoRequisition *requisition);
+
 /**
  * UfoInputParam:
  * @n_dims: Number of dimensions
@@ -91,6 +97,14 @@ struct _UfoTaskIface {
     void (*get_requisition) (UfoTask        *task,
                              UfoBuffer     **inputs,
                              UfoRequisition *requisition);
+    guint (*get_batch_size) (UfoTask        *task);
+    gboolean (*can_process_in_place)
+                            (UfoTask        *task,
+                             guint           input);
+    gboolean (*get_static_requisition)
+                            (UfoTask        *task,
+                             UfoRequisition *inputs,
+                             UfoRequisition *requisition);
 };
 
 void   ufo_task_setup           (UfoTask          *task,
@@ -103,6 +117,16 @@ void   ufo_task_get_structure   (UfoTask          *task,
                                  guint            *n_inputs,
                                  UfoInputParam  **in_params,
                                  UfoTaskMode      *mode);
+guint  ufo_task_get_batch_size  (UfoTask          *task);
+gboolean
+       ufo_task_can_process_in_place
+                                (UfoTask          *task,
+                                 guint             input);
+gboolean
+       ufo_task_get_static_requisition
+                                (UfoTask          *task,
+                                 UfoRequisition   *inputs,
+                                 UfoRequisition   *requisition);
 
 GQuark ufo_task_error_quark     (void);
 GType  ufo_task_get_type        (void);
@@ -28,6 +28,7 @@ G_DEFINE_TYPE (UfoTaskNode, ufo_task_node, UFO_TYPE_NODE)
 enum {
     PROP_0,
     PROP_NUM_PROCESSED,
+    PROP_FUSABLE,
     N_PROPERTIES
 };
 
@@ -41,10 +42,14 @@ struct _UfoTaskNodePrivate {
     UfoProfiler     *profiler;
     GList           *in_groups[16];
     GList           *current[16];
+    GAsyncQueue     *routes[16];
+    GList           *routed[16];
+    gboolean         need_route[16];
     gint             n_expected[16];
     guint            index;
     guint            total;
     guint            num_processed;
+    gboolean         fusable;
 
     GAsyncQueue     *input_queue;
     GAsyncQueue     *output_queue;
@@ -190,6 +195,61 @@ ufo_task_node_get_in_groups (UfoTaskNode *node)
     return in_groups;
 }
 
+/**
+ * ufo_task_node_set_in_group_route:
+ * @node: A #UfoTaskNode
+ * @pos: Input position of @node
+ * @route: A #GAsyncQueue filled by ufo_group_set_route()
+ * @groups: (element-type UfoGroup): In groups at @pos, ordered by the index
+ * they were given in ufo_group_set_route()
+ *
+ * Instead of cycling through the in groups at @pos, take the next group from
+ * @route. This keeps the order of a stream that was scattered over branches
+ * that do not receive the same share of it.
+ */
+void
+ufo_task_node_set_in_group_route (UfoTaskNode *node,
+                                  guint pos,
+                                  GAsyncQueue *route,
+                                  GList *groups)
+{
+    UfoTaskNodePrivate *priv;
+
+    g_return_if_fail (UFO_IS_TASK_NODE (node));
+    g_return_if_fail (route != NULL && groups != NULL);
+    priv = node->priv;
+
+    if (priv->routes[pos] != NULL)
+        g_async_queue_unref (priv->routes[pos]);
+
+    g_list_free (priv->routed[pos]);
+
+    priv->routes[pos] = g_async_queue_ref (route);
+    priv->routed[pos] = g_list_copy (groups);
+    priv->current[pos] = priv->routed[pos];
+    priv->need_route[pos] = TRUE;
+}
+
+static void
+select_routed_group (UfoTaskNodePrivate *priv,
+                     guint pos)
+{
+    gpointer next;
+
+    next = g_async_queue_pop (priv->routes[pos]);
+
+    /* After the end, keep reading from a branch that delivers it */
+    if (next == UFO_END_OF_STREAM) {
+        g_async_queue_unref (priv->routes[pos]);
+        priv->routes[pos] = NULL;
+        priv->current[pos] = priv->routed[pos];
+        return;
+    }
+
+    priv->current[pos] = g_list_nth (priv->routed[pos], GPOINTER_TO_UINT (next) - 2);
+    priv->need_route[pos] = FALSE;
+}
+
 /**
  * ufo_task_node_get_current_in_group:
  * @node: A #UfoTaskNode
@@ -206,6 +266,10 @@ ufo_task_node_get_current_in_group (UfoTaskNode *node,
                                     guint pos)
 {
     g_return_val_if_fail (UFO_IS_TASK_NODE (node), NULL);
+
+    if (node->priv->routes[pos] != NULL && node->priv->need_route[pos])
+        select_routed_group (node->priv, pos);
+
     // UfoGroup *group = UFO_GROUP (node->priv->current[pos]->data);
     UfoGroup *group;
     gpointer p = node->priv->current[pos]->data;
@@ -227,6 +291,12 @@ ufo_task_node_switch_in_group (UfoTaskNode *node,
 
     g_return_if_fail (UFO_IS_TASK_NODE (node));
     priv = node->priv;
+
+    if (priv->routed[pos] != NULL) {
+        priv->need_route[pos] = TRUE;
+        return;
+    }
+
     priv->current[pos] = g_list_next (priv->current[pos]);
 
     if (priv->current[pos] == NULL)
@@ -305,6 +375,29 @@ ufo_task_node_get_partition (UfoTaskNode *node,
     *total = node->priv->total;
 }
 
+/**
+ * ufo_task_node_set_fusable:
+ * @node: A #UfoTaskNode
+ * @fusable: %FALSE to keep @node in its own thread
+ *
+ * Allow or forbid ufo_task_graph_fuse() to merge @node with its neighbours.
+ * This is the same as setting the #UfoTaskNode:fusable property.
+ */
+void
+ufo_task_node_set_fusable (UfoTaskNode *node,
+                           gboolean fusable)
+{
+    g_return_if_fail (UFO_IS_TASK_NODE (node));
+    node->priv->fusable = fusable;
+}
+
+gboolean
+ufo_task_node_get_fusable (UfoTaskNode *node)
+{
+    g_return_val_if_fail (UFO_IS_TASK_NODE (node), FALSE);
+    return node->priv->fusable;
+}
+
 void
 ufo_task_node_increase_processed (UfoTaskNode *node)
 {
@@ -323,6 +416,7 @@ ufo_task_node_copy (UfoNode *node,
     orig = UFO_TASK_NODE (node);
 
     copy->priv->pattern = orig->priv->pattern;
+    copy->priv->fusable = orig->priv->fusable;
 
     for (guint i = 0; i < 16; i++)
         copy->priv->n_expected[i] = orig->priv->n_expected[i];
@@ -332,6 +426,25 @@ ufo_task_node_copy (UfoNode *node,
     return UFO_NODE (copy);
 }
 
+static void
+ufo_task_node_set_property (GObject *object,
+                            guint property_id,
+                            const GValue *value,
+                            GParamSpec *pspec)
+{
+    UfoTaskNodePrivate *priv = UFO_TASK_NODE_GET_PRIVATE (object);
+
+    switch (property_id) {
+        case PROP_FUSABLE:
+            priv->fusable = g_value_get_boolean (value);
+            break;
+
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+            break;
+    }
+}
+
 static void
 ufo_task_node_get_property (GObject *object,
                             guint property_id,
@@ -345,6 +458,10 @@ ufo_task_node_get_property (GObject *object,
             g_value_set_uint (value, priv->num_processed);
             break;
 
+        case PROP_FUSABLE:
+            g_value_set_boolean (value, priv->fusable);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
             break;
@@ -375,6 +492,13 @@ ufo_task_node_finalize (GObject *object)
     g_free (priv->plugin);
     g_free (priv->unique);
 
+    for (guint i = 0; i < 16; i++) {
+        if (priv->routes[i] != NULL)
+            g_async_queue_unref (priv->routes[i]);
+
+        g_list_free (priv->routed[i]);
+    }
+
     G_OBJECT_CLASS (ufo_task_node_parent_class)->finalize (object);
 }
 
@@ -385,6 +509,7 @@ ufo_task_node_class_init (UfoTaskNodeClass *klass)
     UfoNodeClass *nclass;
 
     oclass = G_OBJECT_CLASS (klass);
+    oclass->set_property = ufo_task_node_set_property;
     oclass->get_property = ufo_task_node_get_property;
     oclass->dispose = ufo_task_node_dispose;
     oclass->finalize = ufo_task_node_finalize;
@@ -399,7 +524,15 @@ ufo_task_node_class_init (UfoTaskNodeClass *klass)
                            0, G_MAXUINT, 0,
                            G_PARAM_READABLE);
 
+    properties[PROP_FUSABLE] =
+        g_param_spec_boolean ("fusable",
+                              "Allow fusing with neighbouring tasks",
+                              "Allow fusing with neighbouring tasks",
+                              TRUE,
+                              G_PARAM_READWRITE);
+
     g_object_class_install_property (oclass, PROP_NUM_PROCESSED, properties[PROP_NUM_PROCESSED]);
+    g_object_class_install_property (oclass, PROP_FUSABLE, properties[PROP_FUSABLE]);
 
     g_type_class_add_private (klass, sizeof(UfoTaskNodePrivate));
 }
@@ -417,6 +550,7 @@ ufo_task_node_init (UfoTaskNode *self)
     self->priv->total = 1;
     self->priv->own_group = NULL;
     self->priv->num_processed = 0;
+    self->priv->fusable = TRUE;
     self->priv->profiler = ufo_profiler_new ();
 
     self->priv->input_queue = g_async_queue_new ();
@@ -425,6 +559,9 @@ ufo_task_node_init (UfoTaskNode *self)
     for (guint i = 0; i < 16; i++) {
         self->priv->in_groups[i] = NULL;
         self->priv->current[i] = NULL;
+        self->priv->routes[i] = NULL;
+        self->priv->routed[i] = NULL;
+        self->priv->need_route[i] = FALSE;
         self->priv->n_expected[i] = -1;
     }
 }
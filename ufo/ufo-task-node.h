@@ -88,6 +88,10 @@ UfoGroup       *ufo_task_node_get_current_in_group  (UfoTaskNode    *node,
                                                      guint           pos);
 void            ufo_task_node_switch_in_group       (UfoTaskNode    *node,
                                                      guint           pos);
+void            ufo_task_node_set_in_group_route    (UfoTaskNode    *node,
+                                                     guint           pos,
+                                                     GAsyncQueue    *route,
+                                                     GList          *groups);
 void            ufo_task_node_set_own_group         (UfoTaskNode *node,
                                                      UfoGroup *group);
 UfoGroup       *ufo_task_node_get_own_group         (UfoTaskNode *node);
@@ -105,6 +109,9 @@ void            ufo_task_node_get_partition         (UfoTaskNode    *node,
 void            ufo_task_node_set_profiler          (UfoTaskNode    *node,
                                                      UfoProfiler    *profiler);
 UfoProfiler    *ufo_task_node_get_profiler          (UfoTaskNode    *node);
+void            ufo_task_node_set_fusable           (UfoTaskNode    *node,
+                                                     gboolean        fusable);
+gboolean        ufo_task_node_get_fusable           (UfoTaskNode    *node);
 void            ufo_task_node_increase_processed    (UfoTaskNode    *node);
 GType           ufo_task_node_get_type              (void);
 
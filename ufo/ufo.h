@@ -32,6 +32,7 @@
 #include <ufo/ufo-dummy-task.h>
 #include <ufo/ufo-daemon.h>
 #include <ufo/ufo-enums.h>
+#include <ufo/ufo-fused-task.h>
 #include <ufo/ufo-gpu-node.h>
 #include <ufo/ufo-gpu-task-iface.h>
 #include <ufo/ufo-graph.h>